@@ -0,0 +1,77 @@
+#include "alloc_stats.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<uint64_t> request_count{0};
+static std::atomic<uint64_t> allocation_count{0};
+static std::atomic<uint64_t> allocated_bytes{0};
+
+#ifdef ASIO_ALLOC_STATS
+
+void *operator new(std::size_t size)
+{
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept
+{
+    std::free(p);
+}
+
+bool AllocStats::enabled()
+{
+    return true;
+}
+
+#else
+
+bool AllocStats::enabled()
+{
+    return false;
+}
+
+#endif
+
+void AllocStats::on_request()
+{
+#ifdef ASIO_ALLOC_STATS
+    request_count.fetch_add(1, std::memory_order_relaxed);
+#endif
+}
+
+uint64_t AllocStats::requests()
+{
+    return request_count.load(std::memory_order_relaxed);
+}
+
+uint64_t AllocStats::allocations()
+{
+    return allocation_count.load(std::memory_order_relaxed);
+}
+
+uint64_t AllocStats::bytes()
+{
+    return allocated_bytes.load(std::memory_order_relaxed);
+}
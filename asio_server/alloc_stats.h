@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+
+// Process-wide heap counters for comparing memory behaviour between changes. They only
+// count when asio-core is built with ASIO_ALLOC_STATS, which replaces the global operator
+// new/delete; otherwise enabled() is false and every counter stays zero.
+class AllocStats
+{
+public:
+    static bool enabled();
+
+    // Called once per request by Session.
+    static void on_request();
+
+    static uint64_t requests();
+    static uint64_t allocations();
+    static uint64_t bytes();
+};
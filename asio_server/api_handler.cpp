@@ -1,21 +1,21 @@
 #include "api_handler.h"
+#include "metrics.h"
 #include "middleware.h"
-#include <regex>
+#include "trace.h"
+#include "worker_pool.h"
+#include <boost/asio/post.hpp>
 
 class functional_middleware : public Middleware
 {
-    std::function<void(const ReqContext &ctxt, http::response<http::string_body> &res, std::function<void()> next)>
-            func_;
+    std::function<void(const ReqContext &ctxt, Response &res, std::function<void()> next)> func_;
 
 public:
-    functional_middleware(std::function<void(const ReqContext &ctxt, http::response<http::string_body> &res,
-                                             std::function<void()> next)>
-                                  func)
+    functional_middleware(std::function<void(const ReqContext &ctxt, Response &res, std::function<void()> next)> func)
         : func_(func)
     {
     }
 
-    void operator()(const ReqContext &ctxt, http::response<http::string_body> &res, std::function<void()> next) override
+    void operator()(const ReqContext &ctxt, Response &res, std::function<void()> next) override
     {
         func_(ctxt, res, next);
     }
@@ -26,26 +26,224 @@ void ApiHandler::use(std::shared_ptr<Middleware> middleware)
     middlewares_.push_back(middleware);
 }
 void ApiHandler::use(
-        std::function<void(const ReqContext &ctxt, http::response<http::string_body> &res, std::function<void()> next)>
-                middleware_func)
+        std::function<void(const ReqContext &ctxt, Response &res, std::function<void()> next)> middleware_func)
 {
     middlewares_.push_back(std::make_shared<functional_middleware>(middleware_func));
 }
 
-void ApiHandler::execute(const ReqContext &ctxt, http::response<http::string_body> &res)
+// Shared by every copy of the `next` handed to one middleware. If the last copy goes away
+// without having been called, that middleware answered the request itself.
+struct ApiHandler::ChainStep
 {
-    size_t index = 0;
-    std::function<void()> next = [&, this]() {
-        if (index < middlewares_.size())
+    ApiHandler *handler;
+    const ReqContext &ctxt;
+    Response &res;
+    std::shared_ptr<Completion> on_complete;
+    size_t index;
+    bool continued = false;
+
+    ChainStep(ApiHandler *handler, const ReqContext &ctxt, Response &res, std::shared_ptr<Completion> on_complete,
+              size_t index)
+        : handler(handler), ctxt(ctxt), res(res), on_complete(std::move(on_complete)), index(index)
+    {
+    }
+    ChainStep(const ChainStep &) = delete;
+    ChainStep &operator=(const ChainStep &) = delete;
+
+    ~ChainStep()
+    {
+        if (!continued)
         {
-            auto &&middleware = middlewares_[index++];
-            (*middleware)(ctxt, res, next);
+            (*on_complete)(nullptr);
         }
-        else
+    }
+};
+
+void ApiHandler::run_chain(const ReqContext &ctxt, Response &res, std::shared_ptr<Completion> on_complete,
+                           size_t index)
+{
+    if (index == middlewares_.size())
+    {
+        if (run_on_worker_)
         {
-            handle_request(ctxt, res);
+            auto queued = std::chrono::steady_clock::now();
+            WorkerPool::post([this, &ctxt, &res, on_complete = std::move(on_complete), queued]() {
+                auto dequeued = std::chrono::steady_clock::now();
+                Metrics::worker_queued(dequeued - queued);
+                Trace::record(ctxt.trace_id(), "worker_queue", queued, dequeued);
+                {
+                    TraceSpan span(ctxt.trace_id(), "handle_request");
+                    handle_request(ctxt, res);
+                }
+                for (auto it = middlewares_.rbegin(); it != middlewares_.rend(); ++it)
+                {
+                    if ((*it)->response_on_worker())
+                    {
+                        CachedResponsePtr none;
+                        (*it)->on_response(ctxt, res, none);
+                    }
+                }
+                // Back to the connection's io thread, so that on_response and the Session see
+                // the response where they would for any other handler.
+                boost::asio::post(ctxt.executor(), [on_complete]() { (*on_complete)(nullptr); });
+            });
+            return;
         }
+
+        respond(ctxt, res, *on_complete);
+        return;
+    }
+
+    auto step = std::make_shared<ChainStep>(this, ctxt, res, std::move(on_complete), index);
+    std::function<void()> next = [step]() {
+        if (step->continued)
+            return;
+        step->continued = true;
+        step->handler->run_chain(step->ctxt, step->res, step->on_complete, step->index + 1);
     };
 
-    next();// start the middleware chain
+    TraceSpan span(ctxt.trace_id(), middlewares_[index]->span_name());
+    (*middlewares_[index])(ctxt, res, std::move(next));
+}
+
+void ApiHandler::respond(const ReqContext &ctxt, Response &res, const Completion &on_complete)
+{
+    if (cache_id_ && ctxt.method() == http::verb::get)
+    {
+        respond_cached(ctxt, res, on_complete);
+        return;
+    }
+
+    {
+        TraceSpan span(ctxt.trace_id(), "handle_request");
+        handle_request(ctxt, res);
+    }
+    on_complete(nullptr);
+}
+
+void ApiHandler::respond_cached(const ReqContext &ctxt, Response &res, const Completion &on_complete)
+{
+    CachedResponsePtr cached = ResponseCache::find(cache_id_, ctxt.target());
+    if (!cached)
+    {
+        {
+            TraceSpan span(ctxt.trace_id(), "handle_request");
+            handle_request(ctxt, res);
+        }
+        if (res.result() == http::status::ok && !res.streams_body())
+        {
+            auto expires = cache_ttl_ == kCacheForever ? std::chrono::steady_clock::time_point::max()
+                                                       : std::chrono::steady_clock::now() + cache_ttl_;
+            ResponseCache::store(cache_id_, ctxt.target(), res, expires);
+        }
+        on_complete(nullptr);
+        return;
+    }
+
+    if (ResponseCache::etag_matches(ctxt.header(http::field::if_none_match), cached->etag))
+    {
+        res.result(http::status::not_modified);
+        res.set(http::field::etag, cached->etag);
+        on_complete(nullptr);
+        return;
+    }
+
+    // The pre-serialized bytes can only be sent if no middleware has touched the response
+    // and the connection is HTTP/1.1 keep-alive, which is what they were built for.
+    const auto &req = ctxt.raw_req();
+    if (req.version() == 11 && req.keep_alive() && res.begin() == res.end() && res.body().empty())
+    {
+        on_complete(std::move(cached));
+        return;
+    }
+
+    ResponseCache::copy_to(*cached, res);
+    on_complete(nullptr);
+}
+
+void ApiHandler::cache_responses(std::chrono::seconds ttl)
+{
+    if (!cache_id_)
+    {
+        cache_id_ = ResponseCache::new_owner_id();
+    }
+    cache_ttl_ = ttl;
+}
+
+void ApiHandler::stream_request_body(std::uint64_t limit)
+{
+    stream_request_body_ = true;
+    request_body_limit_ = limit;
+}
+
+bool ApiHandler::streams_request_body() const
+{
+    return stream_request_body_;
+}
+
+std::uint64_t ApiHandler::request_body_limit() const
+{
+    return request_body_limit_;
+}
+
+std::unique_ptr<BodySink> ApiHandler::open_body_sink(const ReqContext &)
+{
+    return nullptr;
+}
+
+void ApiHandler::accept_websocket(std::shared_ptr<WebSocketHandler> handler)
+{
+    websocket_handler_ = std::move(handler);
+}
+
+const std::shared_ptr<WebSocketHandler> &ApiHandler::websocket_handler() const
+{
+    return websocket_handler_;
+}
+
+void ApiHandler::set_run_on_worker(bool on_worker)
+{
+    run_on_worker_ = on_worker;
+}
+
+bool ApiHandler::runs_on_worker() const
+{
+    return run_on_worker_;
+}
+
+void ApiHandler::set_metrics_route(std::size_t route)
+{
+    metrics_route_ = route;
+}
+
+std::size_t ApiHandler::metrics_route() const
+{
+    return metrics_route_;
+}
+
+void ApiHandler::execute(const ReqContext &ctxt, Response &res, Completion on_complete)
+{
+    if (!middlewares_.empty())
+    {
+        Completion finish = [this, &ctxt, &res, on_complete = std::move(on_complete)](CachedResponsePtr cached) {
+            for (auto it = middlewares_.rbegin(); it != middlewares_.rend(); ++it)
+            {
+                if (!run_on_worker_ || !(*it)->response_on_worker())
+                {
+                    (*it)->on_response(ctxt, res, cached);
+                }
+            }
+            on_complete(std::move(cached));
+        };
+        run_chain(ctxt, res, std::make_shared<Completion>(std::move(finish)), 0);
+        return;
+    }
+    // Without middleware, only a handler on the WorkerPool outlives this call; otherwise
+    // the completion stays where it is rather than going to the heap on every request.
+    if (run_on_worker_)
+    {
+        run_chain(ctxt, res, std::make_shared<Completion>(std::move(on_complete)), 0);
+        return;
+    }
+    respond(ctxt, res, on_complete);
 }
@@ -1,31 +1,89 @@
 #pragma once
 
 #include "req_context.h"
+#include "response.h"
+#include "response_cache.h"
 #include <boost/beast/http.hpp>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
 
 namespace http = boost::beast::http;
 
 class Middleware;
+class WebSocketHandler;
 class ApiHandler
 {
 public:
+    // Receives the cached response when one can be sent as-is; otherwise `res` is complete.
+    using Completion = std::function<void(CachedResponsePtr cached)>;
+    static constexpr std::chrono::seconds kCacheForever = std::chrono::seconds::max();
+
     virtual ~ApiHandler() = default;
     void use(std::shared_ptr<Middleware> middleware);
-    void
-    use(std::function<void(const ReqContext &ctxt, http::response<http::string_body> &res, std::function<void()> next)>
-                middleware_func);
+    void use(std::function<void(const ReqContext &ctxt, Response &res, std::function<void()> next)> middleware_func);
     template<typename T, typename... Args>
     void use(Args &&...args)
     {
         middlewares_.push_back(std::make_shared<T>(std::forward<Args>(args)...));
     }
 
-    void execute(const ReqContext &ctxt, http::response<http::string_body> &res);
+    // Runs the middleware chain and the handler. `on_complete` is called exactly once when the
+    // response is ready, possibly after execute() has returned if a middleware is asynchronous.
+    void execute(const ReqContext &ctxt, Response &res, Completion on_complete);
+
+    // When set, handle_request runs on the WorkerPool instead of the connection's io thread.
+    // Middleware, including on_response unless Middleware::response_on_worker(), and
+    // `on_complete` still run on the io thread, so the ReqContext must carry the
+    // connection's executor.
+    void set_run_on_worker(bool on_worker);
+    bool runs_on_worker() const;
+
+    // Request bodies are normally buffered whole, up to Session's body limit, and read with
+    // ReqContext::body(). A handler that calls stream_request_body() gets them written to the
+    // sink from open_body_sink() as they arrive instead, up to `limit` bytes.
+    bool streams_request_body() const;
+    std::uint64_t request_body_limit() const;
+    // Called once the request header is in; returning null discards the body.
+    virtual std::unique_ptr<BodySink> open_body_sink(const ReqContext &ctxt);
+
+    // Set by handlers that call accept_websocket(). A WebSocket upgrade on their route then
+    // becomes a WebSocketSession served by it; other requests still reach handle_request().
+    const std::shared_ptr<WebSocketHandler> &websocket_handler() const;
+
+    // Id under which Metrics records this handler's latency; assigned by Router.
+    void set_metrics_route(std::size_t route);
+    std::size_t metrics_route() const;
 
 protected:
-    virtual void handle_request(const ReqContext &ctxt, http::response<http::string_body> &res) = 0;
+    virtual void handle_request(const ReqContext &ctxt, Response &res) = 0;
+
+    // Declares that a GET response depends only on the request target. Successful responses
+    // are then kept pre-serialized with an ETag and reused for `ttl`; a matching
+    // If-None-Match is answered with 304 without calling handle_request. Middleware still
+    // runs on every request. Not applied to handlers that run on the WorkerPool.
+    void cache_responses(std::chrono::seconds ttl = kCacheForever);
+
+    void stream_request_body(std::uint64_t limit);
+
+    void accept_websocket(std::shared_ptr<WebSocketHandler> handler);
 
 private:
+    struct ChainStep;
+    void run_chain(const ReqContext &ctxt, Response &res, std::shared_ptr<Completion> on_complete, size_t index);
+    // The end of the chain when the handler runs on this thread.
+    void respond(const ReqContext &ctxt, Response &res, const Completion &on_complete);
+    void respond_cached(const ReqContext &ctxt, Response &res, const Completion &on_complete);
+
     std::vector<std::shared_ptr<Middleware>> middlewares_;
+    bool run_on_worker_ = false;
+    std::size_t metrics_route_ = 0;
+    uint64_t cache_id_ = 0;
+    std::chrono::seconds cache_ttl_{0};
+    bool stream_request_body_ = false;
+    std::uint64_t request_body_limit_ = 0;
+    std::shared_ptr<WebSocketHandler> websocket_handler_;
 };
 using ApiHandlerPtr = std::shared_ptr<ApiHandler>;
\ No newline at end of file
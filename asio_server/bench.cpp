@@ -0,0 +1,650 @@
+#include <atomic>
+#include <boost/asio.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/beast/websocket.hpp>
+#include <boost/json.hpp>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <fstream>
+#include <gflags/gflags.h>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <metrics.h>
+#include <random>
+#include <sstream>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+namespace websocket = beast::websocket;
+namespace net = boost::asio;
+using tcp = boost::asio::ip::tcp;
+using Clock = std::chrono::steady_clock;
+
+DEFINE_string(host, "127.0.0.1", "Server address");
+DEFINE_int32(port, 8080, "Server port number");
+DEFINE_int32(connections, 64, "Number of keep-alive connections, each with one request in flight");
+DEFINE_int32(threads, 0, "Number of client io threads (0 = hardware concurrency, capped at --connections)");
+DEFINE_int32(duration, 10, "Seconds to measure");
+DEFINE_int32(warmup, 2, "Seconds to run before measuring");
+DEFINE_double(rate, 0, "Total requests per second in open-loop mode (0 = closed loop, send as soon as a response arrives)");
+DEFINE_string(mix, "version:1", "Weighted request mix, e.g. version:8,taskDetail:1,taskDetailList:1");
+DEFINE_int32(list_ids, 100, "Number of ids in each /taskDetailList query (at most the number of task ids)");
+DEFINE_string(task_ids, "", "Comma-separated ids of existing tasks for taskDetail and taskDetailList to query");
+DEFINE_string(seed_task, "", "Task name to submit --seed_count times through /taskSocket before the run; the created tasks are queried");
+DEFINE_int32(seed_count, 1000, "Number of tasks --seed_task creates");
+DEFINE_double(max_non_2xx, 0.5, "Fail the run when more than this fraction of measured responses are not 2xx");
+DEFINE_string(accept_encoding, "", "Accept-Encoding header sent with every request (empty = none)");
+DEFINE_string(server, "", "Path to an asio-demo binary to start on --port for the run (empty = use a running server)");
+DEFINE_string(server_args, "", "Extra space-separated flags for --server, e.g. --compression_level=0");
+DEFINE_string(output, "", "Write the JSON report to this file instead of stdout");
+DEFINE_int32(timeout_ms, 5000, "Per-request deadline; a connect or request that misses it fails the run");
+
+// The requests a connection picks from, with cumulative weights for weighted selection.
+// taskDetail and taskDetailList query the tasks given to set_task_ids(), so they measure
+// found tasks rather than the not-found path.
+class Workload
+{
+public:
+    static Workload parse(const std::string &mix)
+    {
+        Workload workload;
+        std::istringstream entries(mix);
+        std::string entry;
+        while (std::getline(entries, entry, ','))
+        {
+            auto pos = entry.find(':');
+            std::string name = entry.substr(0, pos);
+            unsigned weight = pos == std::string::npos ? 1 : std::stoul(entry.substr(pos + 1));
+            if (weight == 0)
+                continue;
+
+            if (name == "version")
+            {
+                workload.add("/version", Kind::fixed, weight);
+            }
+            else if (name == "taskDetail")
+            {
+                workload.add("/taskDetail/", Kind::task, weight);
+            }
+            else if (name == "taskDetailList")
+            {
+                workload.add("/taskDetailList?ids=", Kind::task_list, weight);
+            }
+            else
+            {
+                throw std::invalid_argument("unknown request kind in --mix: " + name);
+            }
+        }
+        if (workload.entries_.empty())
+            throw std::invalid_argument("--mix selects no requests");
+        return workload;
+    }
+
+    bool needs_task_ids() const
+    {
+        for (const auto &e: entries_)
+        {
+            if (e.kind != Kind::fixed)
+                return true;
+        }
+        return false;
+    }
+
+    // Every /taskDetailList query asks for the first `list_ids` of `ids`.
+    void set_task_ids(std::vector<std::string> ids, int list_ids)
+    {
+        task_ids_ = std::move(ids);
+        for (auto &e: entries_)
+        {
+            if (e.kind != Kind::task_list)
+                continue;
+            std::size_t count = std::min<std::size_t>(list_ids, task_ids_.size());
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                e.target += (i ? "," : "") + task_ids_[i];
+            }
+            e.kind = Kind::fixed;
+        }
+    }
+
+    // Writes the next target into `target`, appending a random task id where the route takes one.
+    void next(std::mt19937 &rng, std::string &target) const
+    {
+        unsigned pick = std::uniform_int_distribution<unsigned>(0, total_ - 1)(rng);
+        const Entry *entry = &entries_.front();
+        for (const auto &e: entries_)
+        {
+            entry = &e;
+            if (pick < e.cumulative)
+                break;
+        }
+
+        target = entry->target;
+        if (entry->kind == Kind::task)
+        {
+            target += task_ids_[std::uniform_int_distribution<std::size_t>(0, task_ids_.size() - 1)(rng)];
+        }
+    }
+
+private:
+    enum class Kind
+    {
+        fixed,
+        task,
+        task_list
+    };
+
+    struct Entry
+    {
+        std::string target;
+        Kind kind;
+        unsigned cumulative;
+    };
+
+    void add(std::string target, Kind kind, unsigned weight)
+    {
+        total_ += weight;
+        entries_.push_back({std::move(target), kind, total_});
+    }
+
+    std::vector<Entry> entries_;
+    std::vector<std::string> task_ids_;
+    unsigned total_ = 0;
+};
+
+static std::vector<std::string> split_ids(const std::string &list)
+{
+    std::vector<std::string> ids;
+    std::istringstream entries(list);
+    for (std::string id; std::getline(entries, id, ',');)
+    {
+        if (!id.empty())
+            ids.push_back(id);
+    }
+    return ids;
+}
+
+// Creates `count` tasks named `name` with the /taskSocket submit op, in batches, and
+// returns their ids. Runs before the warmup, so it is not measured.
+static std::vector<std::string> seed_tasks(const tcp::endpoint &endpoint, const std::string &name, int count)
+{
+    constexpr int kBatch = 100;
+    net::io_context ctx;
+    websocket::stream<beast::tcp_stream> ws(ctx);
+    ws.next_layer().expires_after(std::chrono::milliseconds(FLAGS_timeout_ms));
+    ws.next_layer().connect(endpoint);
+    ws.next_layer().expires_never();
+    auto timeout = std::chrono::milliseconds(FLAGS_timeout_ms);
+    ws.set_option(websocket::stream_base::timeout{timeout, timeout, false});
+    ws.handshake(FLAGS_host, "/taskSocket");
+
+    std::vector<std::string> ids;
+    for (int submitted = 0; submitted < count; submitted += kBatch)
+    {
+        boost::json::array tasks;
+        for (int i = submitted; i < std::min(count, submitted + kBatch); ++i)
+        {
+            tasks.push_back(boost::json::object{{"name", name}});
+        }
+        ws.write(net::buffer(boost::json::serialize(boost::json::object{{"op", "submit"}, {"tasks", std::move(tasks)}})));
+
+        beast::flat_buffer buffer;
+        ws.read(buffer);
+        boost::json::value reply = boost::json::parse(beast::buffers_to_string(buffer.data()));
+        const boost::json::value *created = reply.is_object() ? reply.as_object().if_contains("taskIds") : nullptr;
+        if (!created || !created->is_array())
+            throw std::runtime_error("unexpected /taskSocket reply: " + boost::json::serialize(reply));
+        for (const auto &id: created->as_array())
+        {
+            if (!id.is_string())
+                throw std::runtime_error("the server could not create a \"" + name + "\" task");
+            ids.emplace_back(id.as_string());
+        }
+    }
+
+    beast::error_code ec;
+    ws.close(websocket::close_code::normal, ec);
+    return ids;
+}
+
+// Results of one client thread; only that thread writes them.
+struct ThreadStats
+{
+    LatencyHistogram latency_ns;
+    uint64_t requests = 0;
+    uint64_t non_2xx = 0;
+    uint64_t errors = 0;
+    // Counted whenever they happen, warmup included: any timeout fails the run.
+    uint64_t timeouts = 0;
+    uint64_t bytes_in = 0;
+};
+
+struct RunWindow
+{
+    Clock::time_point measure_from;
+    Clock::time_point stop_at;
+};
+
+// One keep-alive connection with a single request in flight. In open-loop mode requests are
+// due at fixed intervals and latency is measured from the due time, so a stalled server is
+// charged for every request it delayed instead of silently lowering the offered load. The
+// connect, and each request's write and read together, must finish within --timeout_ms.
+class Connection : public std::enable_shared_from_this<Connection>
+{
+public:
+    Connection(net::io_context &ctx, const tcp::endpoint &endpoint, const Workload &workload, const RunWindow &window,
+               ThreadStats &stats, Clock::duration interval, Clock::time_point first_due, unsigned seed)
+        : stream_(ctx), timer_(ctx), endpoint_(endpoint), workload_(workload), window_(window), stats_(stats),
+          interval_(interval), due_(first_due), rng_(seed)
+    {
+        req_.version(11);
+        req_.method(http::verb::get);
+        req_.set(http::field::host, FLAGS_host);
+        req_.set(http::field::user_agent, "asio-bench");
+        if (!FLAGS_accept_encoding.empty())
+        {
+            req_.set(http::field::accept_encoding, FLAGS_accept_encoding);
+        }
+    }
+
+    void start()
+    {
+        stream_.expires_after(std::chrono::milliseconds(FLAGS_timeout_ms));
+        stream_.async_connect(endpoint_, [self = shared_from_this()](beast::error_code ec) {
+            if (ec)
+                return self->fail(ec);
+            self->stream_.socket().set_option(tcp::no_delay(true));
+            self->schedule();
+        });
+    }
+
+private:
+    bool open_loop() const
+    {
+        return interval_ != Clock::duration::zero();
+    }
+
+    void schedule()
+    {
+        if (!open_loop())
+            return send(Clock::now());
+        if (due_ >= window_.stop_at)
+            return close();
+
+        if (due_ <= Clock::now())
+            return send(due_);
+
+        timer_.expires_at(due_);
+        timer_.async_wait([self = shared_from_this()](beast::error_code ec) {
+            if (!ec)
+                self->send(self->due_);
+        });
+    }
+
+    void send(Clock::time_point intended)
+    {
+        if (Clock::now() >= window_.stop_at)
+            return close();
+
+        intended_ = intended;
+        due_ += interval_;
+        workload_.next(rng_, target_);
+        req_.target(target_);
+
+        stream_.expires_after(std::chrono::milliseconds(FLAGS_timeout_ms));
+        http::async_write(stream_, req_, [self = shared_from_this()](beast::error_code ec, std::size_t) {
+            if (ec)
+                return self->fail(ec);
+            self->read();
+        });
+    }
+
+    void read()
+    {
+        res_ = {};
+        http::async_read(stream_, buffer_, res_, [self = shared_from_this()](beast::error_code ec, std::size_t bytes) {
+            if (ec)
+                return self->fail(ec);
+            self->on_response(bytes);
+        });
+    }
+
+    void on_response(std::size_t bytes)
+    {
+        auto now = Clock::now();
+        if (intended_ >= window_.measure_from && now < window_.stop_at)
+        {
+            stats_.latency_ns.record(std::chrono::duration_cast<std::chrono::nanoseconds>(now - intended_).count());
+            ++stats_.requests;
+            stats_.bytes_in += bytes;
+            if (res_.result_int() / 100 != 2)
+                ++stats_.non_2xx;
+        }
+
+        if (!res_.keep_alive())
+            return reconnect();
+        schedule();
+    }
+
+    void fail(beast::error_code ec)
+    {
+        if (ec == beast::error::timeout)
+            ++stats_.timeouts;
+        if (Clock::now() >= window_.measure_from && Clock::now() < window_.stop_at)
+            ++stats_.errors;
+        reconnect();
+    }
+
+    // Opens a fresh connection after a short pause, so a refused connect does not spin.
+    void reconnect()
+    {
+        close();
+        if (Clock::now() >= window_.stop_at)
+            return;
+
+        buffer_.consume(buffer_.size());
+        timer_.expires_after(std::chrono::milliseconds(10));
+        timer_.async_wait([self = shared_from_this()](beast::error_code ec) {
+            if (!ec)
+                self->start();
+        });
+    }
+
+    void close()
+    {
+        beast::error_code ec;
+        stream_.socket().shutdown(tcp::socket::shutdown_both, ec);
+        stream_.socket().close(ec);
+    }
+
+    beast::tcp_stream stream_;
+    net::steady_timer timer_;
+    tcp::endpoint endpoint_;
+    const Workload &workload_;
+    const RunWindow &window_;
+    ThreadStats &stats_;
+    Clock::duration interval_;
+    Clock::time_point due_;
+    Clock::time_point intended_;
+    std::mt19937 rng_;
+    std::string target_;
+    beast::flat_buffer buffer_;
+    http::request<http::empty_body> req_;
+    http::response<http::string_body> res_;
+};
+
+// Starts --server on --port and waits until it accepts connections.
+static pid_t start_server(const tcp::endpoint &endpoint)
+{
+    std::vector<std::string> args = {FLAGS_server, "--port=" + std::to_string(FLAGS_port), "--report_interval=0"};
+    std::istringstream extra(FLAGS_server_args);
+    for (std::string arg; extra >> arg;)
+    {
+        args.push_back(arg);
+    }
+    std::vector<char *> argv;
+    for (auto &arg: args)
+    {
+        argv.push_back(arg.data());
+    }
+    argv.push_back(nullptr);
+
+    pid_t pid = fork();
+    if (pid < 0)
+        throw std::runtime_error("fork failed");
+    if (pid == 0)
+    {
+        execv(FLAGS_server.c_str(), argv.data());
+        _exit(127);
+    }
+
+    net::io_context ctx;
+    for (int attempt = 0; attempt < 500; ++attempt)
+    {
+        tcp::socket probe(ctx);
+        beast::error_code ec;
+        probe.connect(endpoint, ec);
+        if (!ec)
+            return pid;
+        if (waitpid(pid, nullptr, WNOHANG) == pid)
+            throw std::runtime_error("server exited during startup: " + FLAGS_server);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+    throw std::runtime_error("server did not start listening: " + FLAGS_server);
+}
+
+// User plus system CPU time the process has used so far, from /proc/<pid>/stat.
+static double cpu_seconds(pid_t pid)
+{
+    std::ifstream in("/proc/" + std::to_string(pid) + "/stat");
+    std::string stat((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    std::size_t paren = stat.rfind(')');
+    if (paren == std::string::npos)
+        return 0;
+
+    // Fields after the command name start at state (3); utime and stime are fields 14 and 15.
+    std::istringstream fields(stat.substr(paren + 1));
+    std::string field;
+    for (int i = 3; i < 14 && fields >> field; ++i)
+    {
+    }
+    unsigned long long utime = 0, stime = 0;
+    fields >> utime >> stime;
+    return static_cast<double>(utime + stime) / sysconf(_SC_CLK_TCK);
+}
+
+static void stop_server(pid_t pid)
+{
+    kill(pid, SIGTERM);
+    for (int attempt = 0; attempt < 200; ++attempt)
+    {
+        if (waitpid(pid, nullptr, WNOHANG) == pid)
+            return;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+}
+
+// `server_cpu` is the started server's CPU seconds during the measured window, or negative.
+static std::string report(const std::vector<std::unique_ptr<ThreadStats>> &stats, double seconds, double server_cpu)
+{
+    LatencyHistogram latency;
+    uint64_t requests = 0, non_2xx = 0, errors = 0, timeouts = 0, bytes_in = 0;
+    for (const auto &s: stats)
+    {
+        latency.merge(s->latency_ns);
+        requests += s->requests;
+        non_2xx += s->non_2xx;
+        errors += s->errors;
+        timeouts += s->timeouts;
+        bytes_in += s->bytes_in;
+    }
+
+    auto us = [&](double quantile) { return latency.value_at_quantile(quantile) / 1000.0; };
+    char buffer[1024];
+    snprintf(buffer, sizeof(buffer),
+             "{\"mode\":\"%s\",\"mix\":\"%s\",\"connections\":%d,\"target_rate\":%.1f,\"duration_s\":%.3f,"
+             "\"requests\":%llu,\"requests_per_sec\":%.1f,\"non_2xx\":%llu,\"errors\":%llu,\"timeouts\":%llu,"
+             "\"bytes_in\":%llu,"
+             "\"latency_us\":{\"mean\":%.1f,\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,\"p999\":%.1f,\"max\":%.1f}",
+             FLAGS_rate > 0 ? "open" : "closed", FLAGS_mix.c_str(), FLAGS_connections, FLAGS_rate, seconds,
+             static_cast<unsigned long long>(requests), requests / seconds, static_cast<unsigned long long>(non_2xx),
+             static_cast<unsigned long long>(errors), static_cast<unsigned long long>(timeouts),
+             static_cast<unsigned long long>(bytes_in),
+             requests ? latency.sum() / 1000.0 / requests : 0.0, us(0.5), us(0.9), us(0.99), us(0.999), us(1.0));
+    std::string json = buffer;
+    if (server_cpu >= 0)
+    {
+        snprintf(buffer, sizeof(buffer), ",\"server_cpu_us_per_req\":%.2f",
+                 requests ? server_cpu * 1e6 / requests : 0.0);
+        json += buffer;
+    }
+    return json + "}\n";
+}
+
+int main(int argc, char *argv[])
+{
+    gflags::SetUsageMessage("Usage: " + std::string(argv[0]) +
+                            " --port=<port> --connections=<n> --duration=<s> [--rate=<req/s>] [--mix=<mix>]\n"
+                            "Example:\n"
+                            "  " +
+                            std::string(argv[0]) +
+                            " --server=./asio-demo --connections=64 --rate=50000 --mix=version:8,taskDetail:1,taskDetailList:1"
+                            " --seed_task=<registered task name>");
+
+    try
+    {
+        gflags::ParseCommandLineFlags(&argc, &argv, true);
+        if (FLAGS_port <= 0 || FLAGS_connections <= 0 || FLAGS_duration <= 0 || FLAGS_warmup < 0 || FLAGS_rate < 0 ||
+            FLAGS_threads < 0 || FLAGS_list_ids < 0 || FLAGS_timeout_ms <= 0 || FLAGS_seed_count <= 0 ||
+            FLAGS_max_non_2xx < 0 || FLAGS_max_non_2xx > 1)
+        {
+            std::cerr << gflags::ProgramUsage();
+            return 1;
+        }
+
+        Workload workload = Workload::parse(FLAGS_mix);
+        std::vector<std::string> task_ids = split_ids(FLAGS_task_ids);
+        if (workload.needs_task_ids() && task_ids.empty() && FLAGS_seed_task.empty())
+            throw std::invalid_argument("taskDetail and taskDetailList query existing tasks: pass --task_ids or --seed_task");
+
+        tcp::endpoint endpoint(net::ip::make_address(FLAGS_host), FLAGS_port);
+        pid_t server = FLAGS_server.empty() ? 0 : start_server(endpoint);
+        if (workload.needs_task_ids() && !FLAGS_seed_task.empty())
+        {
+            try
+            {
+                auto seeded = seed_tasks(endpoint, FLAGS_seed_task, FLAGS_seed_count);
+                task_ids.insert(task_ids.end(), seeded.begin(), seeded.end());
+            }
+            catch (...)
+            {
+                if (server)
+                {
+                    stop_server(server);
+                }
+                throw;
+            }
+        }
+        workload.set_task_ids(std::move(task_ids), FLAGS_list_ids);
+
+        std::size_t threads = FLAGS_threads > 0 ? FLAGS_threads : std::max(1u, std::thread::hardware_concurrency());
+        threads = std::min<std::size_t>(threads, FLAGS_connections);
+
+        RunWindow window;
+        auto start = Clock::now();
+        window.measure_from = start + std::chrono::seconds(FLAGS_warmup);
+        window.stop_at = window.measure_from + std::chrono::seconds(FLAGS_duration);
+
+        // Each connection gets an equal share of --rate, with start times staggered evenly
+        // across one interval so requests do not arrive in bursts.
+        Clock::duration interval = Clock::duration::zero();
+        if (FLAGS_rate > 0)
+        {
+            interval = std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(FLAGS_connections / FLAGS_rate));
+        }
+
+        std::vector<std::unique_ptr<net::io_context>> contexts;
+        std::vector<std::unique_ptr<ThreadStats>> stats;
+        for (std::size_t i = 0; i < threads; ++i)
+        {
+            contexts.push_back(std::make_unique<net::io_context>(1));
+            stats.push_back(std::make_unique<ThreadStats>());
+        }
+
+        for (int i = 0; i < FLAGS_connections; ++i)
+        {
+            std::size_t t = i % threads;
+            auto first_due = start + interval * i / FLAGS_connections;
+            std::make_shared<Connection>(*contexts[t], endpoint, workload, window, *stats[t], interval, first_due, i + 1)
+                ->start();
+        }
+
+        // Every request in flight at stop_at ends within one timeout; a client thread still
+        // busy after that is stuck, and the run fails rather than hangs.
+        auto deadline = window.stop_at + std::chrono::milliseconds(FLAGS_timeout_ms) + std::chrono::seconds(1);
+        std::atomic<bool> overran{false};
+        std::vector<std::thread> runners;
+        for (auto &ctx: contexts)
+        {
+            runners.emplace_back([&ctx, &overran, deadline] {
+                ctx->run_until(deadline);
+                if (!ctx->stopped())
+                {
+                    overran = true;
+                }
+            });
+        }
+
+        // Samples the started server's CPU time at the edges of the measured window.
+        double server_cpu = -1;
+        if (server)
+        {
+            runners.emplace_back([&] {
+                std::this_thread::sleep_until(window.measure_from);
+                double before = cpu_seconds(server);
+                std::this_thread::sleep_until(window.stop_at);
+                server_cpu = cpu_seconds(server) - before;
+            });
+        }
+        for (auto &runner: runners)
+        {
+            runner.join();
+        }
+
+        if (server)
+        {
+            stop_server(server);
+        }
+
+        std::string json = report(stats, FLAGS_duration, server_cpu);
+        if (FLAGS_output.empty())
+        {
+            std::cout << json;
+        }
+        else
+        {
+            std::ofstream(FLAGS_output) << json;
+        }
+
+        uint64_t timeouts = 0, requests = 0, non_2xx = 0;
+        for (const auto &s: stats)
+        {
+            timeouts += s->timeouts;
+            requests += s->requests;
+            non_2xx += s->non_2xx;
+        }
+        if (timeouts > 0 || overran)
+        {
+            std::cerr << "Error: " << timeouts << " requests exceeded --timeout_ms"
+                      << (overran ? ", and client threads were still busy at the run's deadline" : "") << std::endl;
+            return 1;
+        }
+        // The numbers would describe error responses rather than the requested mix.
+        if (non_2xx > FLAGS_max_non_2xx * requests)
+        {
+            std::cerr << "Error: " << non_2xx << " of " << requests << " responses were not 2xx (--max_non_2xx="
+                      << FLAGS_max_non_2xx << ")" << std::endl;
+            return 1;
+        }
+    }
+    catch (std::exception const &e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
\ No newline at end of file
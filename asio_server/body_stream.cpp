@@ -0,0 +1,74 @@
+#include "body_stream.h"
+
+EventStream::EventStream(boost::asio::any_io_executor executor) : executor_(std::move(executor)) {}
+
+EventStream::~EventStream()
+{
+    for (const auto &[topic, id]: topics_)
+    {
+        EventHub::unsubscribe(executor_, topic, id);
+    }
+}
+
+void EventStream::subscribe(const std::string &topic)
+{
+    topics_.emplace_back(topic, EventHub::subscribe(topic, shared_from_this()));
+}
+
+boost::asio::any_io_executor EventStream::executor() const
+{
+    return executor_;
+}
+
+void EventStream::deliver(const std::shared_ptr<const std::string> &event)
+{
+    if (ended_)
+        return;
+    if (queued_.size() == kMaxQueued)
+    {
+        queued_.pop_front();
+    }
+    queued_.push_back(event);
+    wake();
+}
+
+void EventStream::end()
+{
+    ended_ = true;
+    wake();
+}
+
+std::deque<std::shared_ptr<const std::string>> &EventStream::queued()
+{
+    return queued_;
+}
+
+bool EventStream::ended() const
+{
+    return ended_;
+}
+
+void EventStream::wait(std::function<void()> ready)
+{
+    ready_ = std::move(ready);
+}
+
+bool EventStream::waiting() const
+{
+    return static_cast<bool>(ready_);
+}
+
+void EventStream::cancel_wait()
+{
+    ready_ = nullptr;
+}
+
+void EventStream::wake()
+{
+    if (ready_)
+    {
+        auto ready = std::move(ready_);
+        ready_ = nullptr;
+        ready();
+    }
+}
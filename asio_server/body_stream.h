@@ -0,0 +1,64 @@
+#pragma once
+
+#include "event_hub.h"
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Receives a request body piece by piece as Session reads it; see
+// ApiHandler::stream_request_body().
+class BodySink
+{
+public:
+    virtual ~BodySink() = default;
+    // Returns false to reject the upload; Session then answers 413 and closes the connection.
+    virtual bool write(std::string_view chunk) = 0;
+};
+
+// Produces a response body piece by piece; see Response::stream_body(). Each call
+// appends the next piece to `chunk`, which arrives empty, and returns false once the body
+// is complete.
+using BodyProducer = std::function<bool(std::string &chunk)>;
+
+// The body of a server-sent events response; see Response::stream_events(). Events are
+// queued as they are delivered and Session writes each as one "data:" field, so an event
+// must not contain a line break. A client that falls kMaxQueued events behind loses the
+// oldest ones, which suits streams of state snapshots where only the latest matters.
+class EventStream : public EventSubscriber, public std::enable_shared_from_this<EventStream>
+{
+public:
+    static constexpr std::size_t kMaxQueued = 64;
+
+    explicit EventStream(boost::asio::any_io_executor executor);
+    // Leaves every topic it subscribed to.
+    ~EventStream() override;
+
+    // Subscribes to `topic` through the EventHub until the stream is destroyed.
+    void subscribe(const std::string &topic);
+
+    boost::asio::any_io_executor executor() const override;
+    void deliver(const std::shared_ptr<const std::string> &event) override;
+    void end() override;
+
+    // For Session, which writes the stream out.
+    std::deque<std::shared_ptr<const std::string>> &queued();
+    bool ended() const;
+    // Calls `ready` once, at the next deliver() or end().
+    void wait(std::function<void()> ready);
+    bool waiting() const;
+    void cancel_wait();
+
+private:
+    void wake();
+
+    boost::asio::any_io_executor executor_;
+    std::vector<std::pair<std::string, std::uint64_t>> topics_;
+    std::deque<std::shared_ptr<const std::string>> queued_;
+    std::function<void()> ready_;
+    bool ended_ = false;
+};
@@ -0,0 +1,423 @@
+#include "compression.h"
+#include "reloadable.h"
+#include <atomic>
+#include <boost/beast/core/string.hpp>
+#include <climits>
+#include <cstring>
+#include <unordered_map>
+#include <zlib.h>
+
+namespace {
+
+Reloadable<Compression::Options> &global_options()
+{
+    static Reloadable<Compression::Options> options;
+    return options;
+}
+
+std::string_view trim(std::string_view s)
+{
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+    return s;
+}
+
+bool iequals(std::string_view a, std::string_view b)
+{
+    return boost::beast::iequals({a.data(), a.size()}, {b.data(), b.size()});
+}
+
+// q-values have at most three decimals (RFC 9110, 12.4.2); anything unparsable counts as 0.
+double parse_qvalue(std::string_view s)
+{
+    if (s.empty() || (s[0] != '0' && s[0] != '1'))
+        return 0;
+    double q = s[0] - '0';
+    if (s.size() > 2 && s[1] == '.')
+    {
+        double scale = 0.1;
+        for (char c: s.substr(2, 3))
+        {
+            if (c < '0' || c > '9')
+                break;
+            q += (c - '0') * scale;
+            scale /= 10;
+        }
+    }
+    return q > 1 ? 1 : q;
+}
+
+// One deflate stream per thread, encoding and level, reset between bodies instead of
+// reallocating zlib's window and hash tables for every response.
+struct Deflater
+{
+    z_stream stream;
+    bool ready = false;
+
+    ~Deflater()
+    {
+        if (ready)
+            deflateEnd(&stream);
+    }
+};
+
+bool compressible_type(std::string_view type)
+{
+    type = trim(type.substr(0, type.find(';')));
+    if (type.size() >= 5 && iequals(type.substr(0, 5), "text/"))
+        return true;
+    for (std::string_view suffix: {"json", "javascript", "xml"})
+    {
+        if (type.size() >= suffix.size() && iequals(type.substr(type.size() - suffix.size()), suffix))
+            return true;
+    }
+    return false;
+}
+
+bool eligible(const http::response<http::string_body> &res, std::size_t min_size)
+{
+    auto status = res.result();
+    return res.body().size() >= min_size && res.body().size() > 0 && status != http::status::no_content &&
+           status != http::status::partial_content && status != http::status::not_modified &&
+           res[http::field::content_encoding].empty() &&
+           compressible_type(to_string_view(res[http::field::content_type])) &&
+           res[http::field::cache_control].find("no-transform") == boost::beast::string_view::npos;
+}
+
+void add_vary(http::response<http::string_body> &res)
+{
+    auto vary = res[http::field::vary];
+    if (vary.empty())
+    {
+        res.set(http::field::vary, "Accept-Encoding");
+    }
+    else if (vary.find("Accept-Encoding") == boost::beast::string_view::npos)
+    {
+        res.set(http::field::vary, std::string(vary) + ", Accept-Encoding");
+    }
+}
+
+// Vary is set for every eligible response, so caches keep identity and compressed copies apart.
+// A strong ETag becomes weak once the bytes change, the same way nginx does it; If-None-Match
+// ignores the W/ prefix, so revalidation still answers 304.
+void set_encoded(http::response<http::string_body> &res, Compression::Encoding encoding, std::string body)
+{
+    res.body() = std::move(body);
+    res.set(http::field::content_encoding, Compression::name(encoding));
+    auto etag = res[http::field::etag];
+    if (!etag.empty() && etag.substr(0, 2) != "W/")
+    {
+        res.set(http::field::etag, "W/" + std::string(etag));
+    }
+    res.prepare_payload();
+}
+
+void encode(http::response<http::string_body> &res, Compression::Encoding encoding, int level)
+{
+    add_vary(res);
+    std::string out;
+    if (encoding == Compression::Encoding::identity || !Compression::compress(res.body(), encoding, level, out))
+        return;
+    set_encoded(res, encoding, std::move(out));
+}
+
+struct VariantKey
+{
+    const CachedResponse *source;
+    Compression::Encoding encoding;
+    int level;
+
+    bool operator==(const VariantKey &other) const
+    {
+        return source == other.source && encoding == other.encoding && level == other.level;
+    }
+};
+
+struct VariantKeyHash
+{
+    std::size_t operator()(const VariantKey &key) const
+    {
+        return std::hash<const void *>{}(key.source) ^ (static_cast<std::size_t>(key.encoding) << 4) ^
+               static_cast<std::size_t>(key.level);
+    }
+};
+
+// `source` guards against a new entry allocated at the address of an expired one.
+struct Variant
+{
+    std::weak_ptr<const CachedResponse> source;
+    CachedResponsePtr response;
+};
+
+using VariantMap = std::unordered_map<VariantKey, Variant, VariantKeyHash>;
+
+VariantMap &thread_variants()
+{
+    thread_local VariantMap variants;
+    return variants;
+}
+
+CachedResponsePtr build_variant(const CachedResponse &source, Compression::Encoding encoding, int level)
+{
+    auto variant = std::make_shared<CachedResponse>();
+    variant->message = source.message;
+    encode(variant->message, encoding, level);
+    variant->etag = std::string(variant->message[http::field::etag]);
+    variant->wire = ResponseCache::serialize(variant->message);
+    variant->expires = source.expires;
+    return variant;
+}
+
+CachedResponsePtr find_variant(const CachedResponsePtr &source, Compression::Encoding encoding, int level)
+{
+    auto &variants = thread_variants();
+    VariantKey key{source.get(), encoding, level};
+    auto it = variants.find(key);
+    if (it != variants.end() && !it->second.source.expired())
+        return it->second.response;
+
+    CachedResponsePtr variant = build_variant(*source, encoding, level);
+    if (it != variants.end())
+    {
+        it->second = {source, variant};
+        return variant;
+    }
+
+    if (variants.size() >= Compression::kMaxCachedVariants)
+    {
+        for (auto stale = variants.begin(); stale != variants.end();)
+        {
+            stale = stale->second.source.expired() ? variants.erase(stale) : std::next(stale);
+        }
+    }
+    if (variants.size() < Compression::kMaxCachedVariants)
+    {
+        variants.emplace(key, Variant{source, variant});
+    }
+    return variant;
+}
+
+// Compressed bodies of uncached responses, keyed by the target, the response's strong ETag,
+// the encoding and the level. A strong ETag promises the same bytes, so the compressed body
+// made for one response serves every later one with that tag.
+struct EtagVariants
+{
+    // Null when compressing did not make the body smaller.
+    std::unordered_map<std::string, std::shared_ptr<const std::string>> bodies;
+    std::size_t bytes = 0;
+};
+
+EtagVariants &thread_etag_variants()
+{
+    thread_local EtagVariants variants;
+    return variants;
+}
+
+std::atomic<std::uint64_t> reused_variants{0};
+
+void encode_tagged(std::string_view target, std::string_view etag, http::response<http::string_body> &res,
+                   Compression::Encoding encoding, int level)
+{
+    add_vary(res);
+    if (encoding == Compression::Encoding::identity)
+        return;
+
+    std::string key;
+    key.reserve(target.size() + etag.size() + 3);
+    key.append(1, static_cast<char>('0' + static_cast<int>(encoding))).append(1, static_cast<char>('0' + level));
+    key.append(etag).append(1, ' ').append(target);
+
+    auto &variants = thread_etag_variants();
+    auto it = variants.bodies.find(key);
+    if (it != variants.bodies.end())
+    {
+        reused_variants.fetch_add(1, std::memory_order_relaxed);
+        if (it->second)
+        {
+            set_encoded(res, encoding, *it->second);
+        }
+        return;
+    }
+
+    std::shared_ptr<const std::string> body;
+    std::string out;
+    if (Compression::compress(res.body(), encoding, level, out))
+    {
+        body = std::make_shared<const std::string>(out);
+        set_encoded(res, encoding, std::move(out));
+    }
+
+    // Past either bound, arbitrary entries make room: the cache only saves CPU.
+    std::size_t size = body ? body->size() : 0;
+    if (size > Compression::kMaxCachedVariantBytes)
+        return;
+    while (!variants.bodies.empty() && (variants.bodies.size() >= Compression::kMaxCachedVariants ||
+                                        variants.bytes + size > Compression::kMaxCachedVariantBytes))
+    {
+        auto victim = variants.bodies.begin();
+        variants.bytes -= victim->second ? victim->second->size() : 0;
+        variants.bodies.erase(victim);
+    }
+    variants.bytes += size;
+    variants.bodies.emplace(std::move(key), std::move(body));
+}
+
+}// namespace
+
+Compression::Compression() : own_options_(false) {}
+
+Compression::Compression(const Options &options) : options_(options), own_options_(true) {}
+
+void Compression::configure(const Options &options)
+{
+    global_options().set(options);
+}
+
+const Compression::Options &Compression::defaults()
+{
+    return global_options().get();
+}
+
+const Compression::Options &Compression::options() const
+{
+    return own_options_ ? options_ : global_options().get();
+}
+
+Compression::Encoding Compression::negotiate(std::string_view accept_encoding)
+{
+    double gzip = -1, deflate = -1, any = -1;
+    while (!accept_encoding.empty())
+    {
+        std::size_t comma = accept_encoding.find(',');
+        std::string_view element = accept_encoding.substr(0, comma);
+        accept_encoding = comma == std::string_view::npos ? std::string_view() : accept_encoding.substr(comma + 1);
+
+        std::size_t semicolon = element.find(';');
+        std::string_view coding = trim(element.substr(0, semicolon));
+        double q = 1;
+        if (semicolon != std::string_view::npos)
+        {
+            std::string_view param = trim(element.substr(semicolon + 1));
+            if (param.size() >= 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=')
+            {
+                q = parse_qvalue(trim(param.substr(2)));
+            }
+        }
+
+        if (iequals(coding, "gzip") || iequals(coding, "x-gzip"))
+            gzip = q;
+        else if (iequals(coding, "deflate"))
+            deflate = q;
+        else if (coding == "*")
+            any = q;
+    }
+
+    if (gzip < 0)
+        gzip = any;
+    if (deflate < 0)
+        deflate = any;
+    if (gzip <= 0 && deflate <= 0)
+        return Encoding::identity;
+    return gzip >= deflate ? Encoding::gzip : Encoding::deflate;
+}
+
+const char *Compression::name(Encoding encoding)
+{
+    switch (encoding)
+    {
+    case Encoding::gzip:
+        return "gzip";
+    case Encoding::deflate:
+        return "deflate";
+    default:
+        return "identity";
+    }
+}
+
+bool Compression::compress(std::string_view in, Encoding encoding, int level, std::string &out)
+{
+    if (encoding == Encoding::identity || in.size() > UINT_MAX)
+        return false;
+    level = level < 1 ? 1 : level > 9 ? 9 : level;
+
+    thread_local Deflater deflaters[2][10];
+    Deflater &deflater = deflaters[encoding == Encoding::gzip ? 0 : 1][level];
+    z_stream &z = deflater.stream;
+    if (!deflater.ready)
+    {
+        std::memset(&z, 0, sizeof(z));
+        // windowBits 15 gives the zlib format that HTTP calls "deflate"; +16 adds the gzip wrapper.
+        int window_bits = encoding == Encoding::gzip ? 15 + 16 : 15;
+        if (deflateInit2(&z, level, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            return false;
+        deflater.ready = true;
+    }
+    else
+    {
+        deflateReset(&z);
+    }
+
+    out.resize(deflateBound(&z, static_cast<uLong>(in.size())));
+    z.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(in.data()));
+    z.avail_in = static_cast<uInt>(in.size());
+    z.next_out = reinterpret_cast<Bytef *>(out.data());
+    z.avail_out = static_cast<uInt>(out.size());
+    if (deflate(&z, Z_FINISH) != Z_STREAM_END)
+        return false;
+
+    out.resize(z.total_out);
+    return out.size() < in.size();
+}
+
+std::size_t Compression::cached_variants()
+{
+    return thread_variants().size() + thread_etag_variants().bodies.size();
+}
+
+std::uint64_t Compression::reused_tagged_variants()
+{
+    return reused_variants.load(std::memory_order_relaxed);
+}
+
+void Compression::operator()(const ReqContext &, Response &, std::function<void()> next)
+{
+    next();
+}
+
+void Compression::on_response(const ReqContext &ctxt, Response &res, CachedResponsePtr &cached)
+{
+    if (res.streams_body())
+        return;
+
+    const Options &opts = options();
+    if (opts.level <= 0)
+        return;
+    if (cached)
+    {
+        if (!eligible(cached->message, opts.min_size))
+            return;
+        Encoding encoding = negotiate(ctxt.header(http::field::accept_encoding));
+        if (opts.cache_variants)
+        {
+            cached = find_variant(cached, encoding, opts.level);
+            return;
+        }
+
+        // Send it like an uncached response, compressed for this request only.
+        ResponseCache::copy_to(*cached, res);
+        cached = nullptr;
+        encode(res, encoding, opts.level);
+        return;
+    }
+
+    if (!eligible(res, opts.min_size))
+        return;
+    Encoding encoding = negotiate(ctxt.header(http::field::accept_encoding));
+    auto etag = res[http::field::etag];
+    if (opts.cache_variants && !etag.empty() && etag.substr(0, 2) != "W/")
+    {
+        encode_tagged(ctxt.target(), to_string_view(etag), res, encoding, opts.level);
+        return;
+    }
+    encode(res, encoding, opts.level);
+}
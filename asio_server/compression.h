@@ -0,0 +1,79 @@
+#pragma once
+
+#include "middleware.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Compresses response bodies with gzip or deflate (zlib) when the request's Accept-Encoding
+// allows it. Bodies below Options::min_size, non-text content types, streamed and file
+// bodies, and responses that already carry a Content-Encoding are sent as they are.
+//
+// Responses served from a handler's response cache are compressed once per encoding and the
+// result is kept next to the cached entry, so repeated hits cost no compression CPU. An
+// uncached response that carries a strong ETag is compressed once per target, tag and
+// encoding on each thread in the same way. For handlers on the WorkerPool, bodies are
+// compressed there rather than on the io thread.
+class Compression : public Middleware
+{
+public:
+    enum class Encoding
+    {
+        identity,
+        gzip,
+        deflate,
+    };
+
+    struct Options
+    {
+        // zlib level, 1 (fastest) to 9 (smallest); 0 turns compression off.
+        int level = 6;
+        std::size_t min_size = 1024;
+        // Keep compressed variants of cached and ETagged responses; see class comment.
+        bool cache_variants = true;
+    };
+
+    // Compressed variants kept per thread; further variants are compressed on every hit.
+    static constexpr std::size_t kMaxCachedVariants = 1024;
+    // Compressed bytes kept per thread for ETagged responses.
+    static constexpr std::size_t kMaxCachedVariantBytes = 8 * 1024 * 1024;
+
+    // Uses the process-wide options from configure(), read on every request.
+    Compression();
+    explicit Compression(const Options &options);
+
+    // Sets the options of every Compression built without its own; safe while serving.
+    static void configure(const Options &options);
+    static const Options &defaults();
+
+    // The coding to use for an Accept-Encoding header value: the acceptable one with the
+    // highest q-value, gzip winning ties. identity if neither gzip nor deflate is acceptable.
+    static Encoding negotiate(std::string_view accept_encoding);
+    static const char *name(Encoding encoding);
+
+    // Compresses `in` into `out`. Returns false if zlib fails or the result is not smaller.
+    static bool compress(std::string_view in, Encoding encoding, int level, std::string &out);
+
+    // Compressed variants cached on the calling thread.
+    static std::size_t cached_variants();
+    // ETagged responses served from a cached variant, on any thread, since the process started.
+    static std::uint64_t reused_tagged_variants();
+
+    void operator()(const ReqContext &ctxt, Response &res, std::function<void()> next) override;
+    const char *span_name() const override
+    {
+        return "compression";
+    }
+    void on_response(const ReqContext &ctxt, Response &res, CachedResponsePtr &cached) override;
+    bool response_on_worker() const override
+    {
+        return true;
+    }
+
+private:
+    const Options &options() const;
+
+    Options options_;
+    bool own_options_;
+};
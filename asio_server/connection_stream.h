@@ -0,0 +1,118 @@
+#pragma once
+
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/beast.hpp>
+#include <boost/beast/ssl.hpp>
+#include <boost/beast/websocket.hpp>
+#include <memory>
+#include <utility>
+#include <variant>
+
+namespace beast = boost::beast;
+namespace net = boost::asio;
+using tcp = boost::asio::ip::tcp;
+
+// The stream of one accepted connection: a beast::tcp_stream, or TLS over one. Session and
+// WebSocketSession read and write through it without knowing which; the deadline calls
+// (expires_after, cancel) and socket() always reach the TCP layer, so timeouts work the
+// same either way.
+class ConnectionStream
+{
+public:
+    using executor_type = beast::tcp_stream::executor_type;
+    using TlsStream = beast::ssl_stream<beast::tcp_stream>;
+
+    explicit ConnectionStream(tcp::socket socket) : stream_(std::in_place_type<beast::tcp_stream>, std::move(socket)) {}
+
+    // The context is kept alive for as long as the connection.
+    ConnectionStream(tcp::socket socket, std::shared_ptr<net::ssl::context> tls)
+        : tls_context_(std::move(tls)), stream_(std::in_place_type<TlsStream>, std::move(socket), *tls_context_)
+    {
+    }
+
+    bool is_tls() const
+    {
+        return std::holds_alternative<TlsStream>(stream_);
+    }
+
+    // The TLS stream; only valid when is_tls().
+    TlsStream &tls()
+    {
+        return std::get<TlsStream>(stream_);
+    }
+
+    beast::tcp_stream &tcp_layer()
+    {
+        return std::visit([](auto &s) -> beast::tcp_stream & { return beast::get_lowest_layer(s); }, stream_);
+    }
+
+    tcp::socket &socket()
+    {
+        return tcp_layer().socket();
+    }
+
+    executor_type get_executor()
+    {
+        return tcp_layer().get_executor();
+    }
+
+    void expires_after(std::chrono::steady_clock::duration timeout)
+    {
+        tcp_layer().expires_after(timeout);
+    }
+
+    void expires_never()
+    {
+        tcp_layer().expires_never();
+    }
+
+    void cancel()
+    {
+        tcp_layer().cancel();
+    }
+
+    template<typename MutableBuffers, typename ReadHandler>
+    auto async_read_some(const MutableBuffers &buffers, ReadHandler &&handler)
+    {
+        return net::async_initiate<ReadHandler, void(beast::error_code, std::size_t)>(
+                [this](auto &&handler, const MutableBuffers &buffers) {
+                    std::visit([&](auto &s) { s.async_read_some(buffers, std::move(handler)); }, stream_);
+                },
+                handler, buffers);
+    }
+
+    template<typename ConstBuffers, typename WriteHandler>
+    auto async_write_some(const ConstBuffers &buffers, WriteHandler &&handler)
+    {
+        return net::async_initiate<WriteHandler, void(beast::error_code, std::size_t)>(
+                [this](auto &&handler, const ConstBuffers &buffers) {
+                    std::visit([&](auto &s) { s.async_write_some(buffers, std::move(handler)); }, stream_);
+                },
+                handler, buffers);
+    }
+
+    // For websocket::stream, which closes its next layer through these customization points.
+    friend void beast_close_socket(ConnectionStream &stream)
+    {
+        beast::close_socket(stream.tcp_layer());
+    }
+
+    friend void teardown(beast::role_type role, ConnectionStream &stream, beast::error_code &ec)
+    {
+        using beast::websocket::teardown;
+        std::visit([&](auto &s) { teardown(role, s, ec); }, stream.stream_);
+    }
+
+    template<typename TeardownHandler>
+    friend void async_teardown(beast::role_type role, ConnectionStream &stream, TeardownHandler &&handler)
+    {
+        using beast::websocket::async_teardown;
+        std::visit([&](auto &s) { async_teardown(role, s, std::move(handler)); }, stream.stream_);
+    }
+
+private:
+    // Declared first so the SSL stream is destroyed before the context it was made from.
+    std::shared_ptr<net::ssl::context> tls_context_;
+    std::variant<beast::tcp_stream, TlsStream> stream_;
+};
@@ -0,0 +1,188 @@
+#include "event_hub.h"
+#include <algorithm>
+#include <atomic>
+#include <boost/asio/dispatch.hpp>
+#include <boost/asio/execution/context.hpp>
+#include <boost/asio/query.hpp>
+#include <boost/asio/post.hpp>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+// The subscribers of one io thread. Only that thread touches `topics`; publishers read
+// `subscribers` to skip threads with nothing to deliver.
+struct ThreadHub
+{
+    struct Entry
+    {
+        std::uint64_t id;
+        std::weak_ptr<EventSubscriber> subscriber;
+    };
+
+    boost::asio::any_io_executor executor;
+    std::unordered_map<std::string, std::vector<Entry>> topics;
+    std::atomic<std::size_t> subscribers{0};
+};
+
+std::atomic<std::size_t> total_subscribers{0};
+std::atomic<std::uint64_t> next_id{1};
+
+std::mutex hubs_mutex;
+std::vector<ThreadHub *> hubs;
+
+void forget(ThreadHub &hub, std::size_t count)
+{
+    hub.subscribers.fetch_sub(count, std::memory_order_relaxed);
+    total_subscribers.fetch_sub(count, std::memory_order_relaxed);
+}
+
+// Created by the first subscription on an io thread and unregistered when the thread exits,
+// which is before its io_context can be destroyed, so publish() never posts to a dead one.
+struct ThreadHubSlot
+{
+    std::unique_ptr<ThreadHub> hub;
+
+    ~ThreadHubSlot()
+    {
+        if (!hub)
+            return;
+        std::lock_guard<std::mutex> lock(hubs_mutex);
+        hubs.erase(std::find(hubs.begin(), hubs.end(), hub.get()));
+        forget(*hub, hub->subscribers.load());
+    }
+};
+
+thread_local ThreadHubSlot this_thread_hub;
+
+ThreadHub &thread_hub(const boost::asio::any_io_executor &executor)
+{
+    if (!this_thread_hub.hub)
+    {
+        this_thread_hub.hub = std::make_unique<ThreadHub>();
+        this_thread_hub.hub->executor = executor;
+        std::lock_guard<std::mutex> lock(hubs_mutex);
+        hubs.push_back(this_thread_hub.hub.get());
+    }
+    return *this_thread_hub.hub;
+}
+
+void deliver(ThreadHub &hub, const std::string &topic, const std::shared_ptr<const std::string> &event, bool last)
+{
+    auto it = hub.topics.find(topic);
+    if (it == hub.topics.end())
+        return;
+
+    auto &subscribers = it->second;
+    std::size_t before = subscribers.size();
+    std::size_t alive = 0;
+    for (std::size_t i = 0; i < subscribers.size(); ++i)
+    {
+        auto subscriber = subscribers[i].subscriber.lock();
+        if (!subscriber)
+            continue;
+        subscriber->deliver(event);
+        if (last)
+        {
+            subscriber->end();
+        }
+        if (alive != i)
+        {
+            subscribers[alive] = std::move(subscribers[i]);
+        }
+        ++alive;
+    }
+    subscribers.resize(alive);
+
+    if (last)
+    {
+        forget(hub, before);
+        hub.topics.erase(it);
+    }
+    else
+    {
+        forget(hub, before - subscribers.size());
+        if (subscribers.empty())
+        {
+            hub.topics.erase(it);
+        }
+    }
+}
+
+void remove(ThreadHub &hub, const std::string &topic, std::uint64_t id)
+{
+    auto it = hub.topics.find(topic);
+    if (it == hub.topics.end())
+        return;
+
+    auto &subscribers = it->second;
+    auto entry = std::find_if(subscribers.begin(), subscribers.end(),
+                              [id](const ThreadHub::Entry &e) { return e.id == id; });
+    // Already pruned by deliver(), or the topic ended.
+    if (entry == subscribers.end())
+        return;
+    subscribers.erase(entry);
+    forget(hub, 1);
+    if (subscribers.empty())
+    {
+        hub.topics.erase(it);
+    }
+}
+
+boost::asio::execution_context *context_of(const boost::asio::any_io_executor &executor)
+{
+    return &boost::asio::query(executor, boost::asio::execution::context);
+}
+
+}// namespace
+
+std::uint64_t EventHub::subscribe(const std::string &topic, const std::shared_ptr<EventSubscriber> &subscriber)
+{
+    auto executor = subscriber->executor();
+    std::uint64_t id = next_id.fetch_add(1, std::memory_order_relaxed);
+    boost::asio::dispatch(executor, [topic, id, weak = std::weak_ptr<EventSubscriber>(subscriber), executor] {
+        // Gone before the subscription was made: its unsubscribe() found nothing to remove.
+        if (weak.expired())
+            return;
+        ThreadHub &hub = thread_hub(executor);
+        hub.topics[topic].push_back({id, weak});
+        hub.subscribers.fetch_add(1, std::memory_order_relaxed);
+        total_subscribers.fetch_add(1, std::memory_order_relaxed);
+    });
+    return id;
+}
+
+void EventHub::unsubscribe(const boost::asio::any_io_executor &executor, const std::string &topic, std::uint64_t id)
+{
+    // Always posted: a subscriber may be destroyed inside deliver(), which is walking the
+    // same list. A subscribe() posted from another thread runs first.
+    auto context = context_of(executor);
+    std::lock_guard<std::mutex> lock(hubs_mutex);
+    for (ThreadHub *hub: hubs)
+    {
+        if (context_of(hub->executor) != context)
+            continue;
+        boost::asio::post(hub->executor, [hub, topic, id] { remove(*hub, topic, id); });
+        return;
+    }
+}
+
+void EventHub::publish(const std::string &topic, std::shared_ptr<const std::string> event, bool last)
+{
+    if (total_subscribers.load(std::memory_order_relaxed) == 0)
+        return;
+
+    std::lock_guard<std::mutex> lock(hubs_mutex);
+    for (ThreadHub *hub: hubs)
+    {
+        if (hub->subscribers.load(std::memory_order_relaxed) == 0)
+            continue;
+        boost::asio::post(hub->executor, [hub, topic, event, last] { deliver(*hub, topic, event, last); });
+    }
+}
+
+std::size_t EventHub::subscriber_count()
+{
+    return total_subscribers.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <boost/asio/any_io_executor.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Receives the events published to a topic it is subscribed to, such as an SSE response
+// (EventStream). Every call is made on executor(), the io thread of its connection.
+class EventSubscriber
+{
+public:
+    virtual ~EventSubscriber() = default;
+    virtual boost::asio::any_io_executor executor() const = 0;
+    // One event. The string is shared with every other subscriber of the topic.
+    virtual void deliver(const std::shared_ptr<const std::string> &event) = 0;
+    // The topic is finished; nothing more is delivered.
+    virtual void end() = 0;
+};
+
+// Fans events out to any number of subscribers without a thread, lock or copy per
+// subscriber. Each io thread keeps its own subscribers by topic; publish() posts the event
+// once to every io thread that has subscribers, which delivers it to its own. The hub only
+// holds weak references; a subscriber unsubscribes when it is destroyed, and one that does
+// not is dropped at the next event.
+class EventHub
+{
+public:
+    // May be called from any thread; the subscription is made on the subscriber's executor.
+    // Returns the id that unsubscribe() takes.
+    static std::uint64_t subscribe(const std::string &topic, const std::shared_ptr<EventSubscriber> &subscriber);
+    // May be called from any thread, including from the subscriber's destructor. `executor`
+    // is the subscriber's; nothing happens once its io thread has exited.
+    static void unsubscribe(const boost::asio::any_io_executor &executor, const std::string &topic,
+                            std::uint64_t id);
+    // May be called from any thread. With `last`, subscribers get end() after the event and
+    // the topic is forgotten.
+    static void publish(const std::string &topic, std::shared_ptr<const std::string> event, bool last = false);
+    // Subscriptions across all threads, including ones not yet removed. Publishers check this
+    // before formatting an event nobody would receive.
+    static std::size_t subscriber_count();
+};
@@ -0,0 +1,198 @@
+#include "file_cache.h"
+#include <algorithm>
+#include <cstdio>
+#include <fcntl.h>
+#include <list>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace {
+
+struct Entry
+{
+    OpenFilePtr file;
+    std::chrono::steady_clock::time_point checked;
+    std::list<std::string>::iterator lru;
+};
+
+// Most recently used path at the front of `lru`.
+struct Store
+{
+    std::unordered_map<std::string, Entry> entries;
+    std::list<std::string> lru;
+};
+
+Store &thread_store()
+{
+    thread_local Store store;
+    return store;
+}
+
+bool same_file(const struct stat &st, const OpenFile &file)
+{
+    return S_ISREG(st.st_mode) && static_cast<std::uint64_t>(st.st_size) == file.size() &&
+           st.st_mtime == file.mtime() && st.st_ino == file.inode();
+}
+
+bool parse_number(std::string_view s, std::uint64_t &value)
+{
+    if (s.empty() || s.size() > 19)
+        return false;
+    value = 0;
+    for (char c: s)
+    {
+        if (c < '0' || c > '9')
+            return false;
+        value = value * 10 + (c - '0');
+    }
+    return true;
+}
+
+}// namespace
+
+OpenFile::OpenFile(int fd, std::uint64_t size, std::int64_t mtime, std::uint64_t inode)
+    : fd_(fd), size_(size), mtime_(mtime), inode_(inode)
+{
+    char etag[2 + 16 + 1 + 16 + 1];
+    std::snprintf(etag, sizeof(etag), "\"%llx-%llx\"", static_cast<unsigned long long>(size),
+                  static_cast<unsigned long long>(mtime));
+    etag_ = etag;
+}
+
+OpenFile::~OpenFile()
+{
+    ::close(fd_);
+}
+
+int OpenFile::fd() const
+{
+    return fd_;
+}
+
+std::uint64_t OpenFile::size() const
+{
+    return size_;
+}
+
+std::int64_t OpenFile::mtime() const
+{
+    return mtime_;
+}
+
+std::uint64_t OpenFile::inode() const
+{
+    return inode_;
+}
+
+const std::string &OpenFile::etag() const
+{
+    return etag_;
+}
+
+OpenFilePtr FileCache::open(const std::string &path)
+{
+    auto &store = thread_store();
+    auto now = std::chrono::steady_clock::now();
+
+    auto it = store.entries.find(path);
+    if (it != store.entries.end())
+    {
+        Entry &entry = it->second;
+        struct stat st;
+        if (now - entry.checked < kRevalidateAfter ||
+            (::stat(path.c_str(), &st) == 0 && same_file(st, *entry.file)))
+        {
+            if (now - entry.checked >= kRevalidateAfter)
+            {
+                entry.checked = now;
+            }
+            store.lru.splice(store.lru.begin(), store.lru, entry.lru);
+            return entry.file;
+        }
+        store.lru.erase(entry.lru);
+        store.entries.erase(it);
+    }
+
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return nullptr;
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        ::close(fd);
+        return nullptr;
+    }
+
+    auto file = std::make_shared<const OpenFile>(fd, st.st_size, st.st_mtime, st.st_ino);
+    store.lru.push_front(path);
+    store.entries.emplace(path, Entry{file, now, store.lru.begin()});
+    if (store.entries.size() > kMaxEntries)
+    {
+        store.entries.erase(store.lru.back());
+        store.lru.pop_back();
+    }
+    return file;
+}
+
+std::size_t FileCache::size()
+{
+    return thread_store().entries.size();
+}
+
+void FileCache::clear()
+{
+    auto &store = thread_store();
+    store.entries.clear();
+    store.lru.clear();
+}
+
+ByteRange parse_byte_range(std::string_view header, std::uint64_t size)
+{
+    ByteRange range;
+    constexpr std::string_view prefix = "bytes=";
+    if (header.substr(0, prefix.size()) != prefix)
+        return range;
+    header.remove_prefix(prefix.size());
+    if (header.find(',') != std::string_view::npos)
+        return range;
+
+    std::size_t dash = header.find('-');
+    if (dash == std::string_view::npos)
+        return range;
+    std::string_view first = header.substr(0, dash);
+    std::string_view last = header.substr(dash + 1);
+
+    std::uint64_t start = 0;
+    std::uint64_t end = 0;
+    if (first.empty())
+    {
+        // Suffix range: the final `last` bytes.
+        if (!parse_number(last, end))
+            return range;
+        if (end == 0 || size == 0)
+        {
+            range.kind = ByteRange::Kind::unsatisfiable;
+            return range;
+        }
+        range.kind = ByteRange::Kind::satisfiable;
+        range.length = std::min(end, size);
+        range.offset = size - range.length;
+        return range;
+    }
+
+    if (!parse_number(first, start) || (!last.empty() && (!parse_number(last, end) || end < start)))
+        return range;
+    if (start >= size)
+    {
+        range.kind = ByteRange::Kind::unsatisfiable;
+        return range;
+    }
+
+    end = last.empty() ? size - 1 : std::min(end, size - 1);
+    range.kind = ByteRange::Kind::satisfiable;
+    range.offset = start;
+    range.length = end - start + 1;
+    return range;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// A regular file opened read-only for serving. The descriptor is closed when the last
+// request using it is done, even if FileCache has dropped the entry by then.
+class OpenFile
+{
+public:
+    OpenFile(int fd, std::uint64_t size, std::int64_t mtime, std::uint64_t inode);
+    ~OpenFile();
+    OpenFile(const OpenFile &) = delete;
+    OpenFile &operator=(const OpenFile &) = delete;
+
+    int fd() const;
+    std::uint64_t size() const;
+    std::int64_t mtime() const;
+    std::uint64_t inode() const;
+    // Derived from size and modification time, quoted for use as an ETag.
+    const std::string &etag() const;
+
+private:
+    int fd_;
+    std::uint64_t size_;
+    std::int64_t mtime_;
+    std::uint64_t inode_;
+    std::string etag_;
+};
+using OpenFilePtr = std::shared_ptr<const OpenFile>;
+
+// Open file descriptors kept per thread, so a hot file is not opened and stat'ed on every
+// request. An entry is revalidated with stat(2) once it is kRevalidateAfter old, which
+// notices files replaced or rewritten on disk; beyond kMaxEntries the least recently used
+// file is closed.
+class FileCache
+{
+public:
+    static constexpr std::size_t kMaxEntries = 256;
+    static constexpr std::chrono::milliseconds kRevalidateAfter{1000};
+
+    // Returns null if `path` is not a readable regular file.
+    static OpenFilePtr open(const std::string &path);
+
+    // Entries cached on the calling thread.
+    static std::size_t size();
+    static void clear();
+};
+
+// A single byte range resolved against a file size.
+struct ByteRange
+{
+    enum class Kind
+    {
+        none,          // No usable Range header: send the whole file.
+        satisfiable,   // Send [offset, offset + length) as 206.
+        unsatisfiable, //  Answer 416.
+    };
+
+    Kind kind = Kind::none;
+    std::uint64_t offset = 0;
+    std::uint64_t length = 0;
+};
+
+// Parses a Range header value ("bytes=0-99", "bytes=100-", "bytes=-100"). Multiple ranges and
+// other units are treated as no range, which RFC 9110 allows.
+ByteRange parse_byte_range(std::string_view header, std::uint64_t size);
@@ -0,0 +1,89 @@
+#include "artifact_handler.h"
+#include <file_cache.h>
+#include <gflags/gflags.h>
+#include <response_cache.h>
+#include <string>
+
+DEFINE_string(artifact_dir, "./artifacts", "Directory that /artifact/{taskId} serves task result files from");
+
+// Task ids name files directly under --artifact_dir, so anything that could leave it is refused.
+static bool valid_task_id(std::string_view id)
+{
+    if (id.empty() || id.front() == '.')
+        return false;
+    for (char c: id)
+    {
+        bool allowed = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' ||
+                       c == '_' || c == '.';
+        if (!allowed)
+            return false;
+    }
+    return true;
+}
+
+static void plain_error(Response &res, http::status status, const char *message)
+{
+    res.result(status);
+    res.set(http::field::content_type, "text/plain");
+    res.body() = message;
+    res.prepare_payload();
+}
+
+void artifact_handler::handle_request(const ReqContext &ctx, Response &res)
+{
+    if (ctx.method() != http::verb::get && ctx.method() != http::verb::head)
+    {
+        res.set(http::field::allow, "GET, HEAD");
+        plain_error(res, http::status::method_not_allowed, "Method Not Allowed");
+        return;
+    }
+
+    std::string_view task_id = ctx.path_param("taskId");
+    if (!valid_task_id(task_id))
+    {
+        plain_error(res, http::status::bad_request, "Invalid task id");
+        return;
+    }
+
+    OpenFilePtr file = FileCache::open(FLAGS_artifact_dir + "/" + std::string(task_id));
+    if (!file)
+    {
+        plain_error(res, http::status::not_found, "Artifact not found");
+        return;
+    }
+
+    res.set(http::field::etag, file->etag());
+    res.set(http::field::accept_ranges, "bytes");
+    if (ResponseCache::etag_matches(ctx.header(http::field::if_none_match), file->etag()))
+    {
+        res.result(http::status::not_modified);
+        return;
+    }
+
+    res.set(http::field::content_type, "application/octet-stream");
+    std::string_view if_range = ctx.header(http::field::if_range);
+    ByteRange range;
+    if (if_range.empty() || if_range == file->etag())
+    {
+        range = parse_byte_range(ctx.header(http::field::range), file->size());
+    }
+
+    switch (range.kind)
+    {
+    case ByteRange::Kind::unsatisfiable:
+        res.set(http::field::content_range, "bytes */" + std::to_string(file->size()));
+        plain_error(res, http::status::range_not_satisfiable, "Range Not Satisfiable");
+        return;
+    case ByteRange::Kind::satisfiable:
+        res.result(http::status::partial_content);
+        res.set(http::field::content_range, "bytes " + std::to_string(range.offset) + "-" +
+                                                    std::to_string(range.offset + range.length - 1) + "/" +
+                                                    std::to_string(file->size()));
+        res.send_file(std::move(file), range.offset, range.length);
+        return;
+    case ByteRange::Kind::none:
+        res.result(http::status::ok);
+        res.send_file(file, 0, file->size());
+        return;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <router.h>
+#include <session.h>
+
+// Serves the result file of a task from --artifact_dir with sendfile(2), honouring single
+// byte ranges and If-None-Match. Open descriptors are kept in FileCache.
+class artifact_handler : public ApiHandler
+{
+public:
+    void handle_request(const ReqContext &ctx, Response &res) override;
+};
+REGISTER_DYNAMIC_HANDLER("/artifact/{taskId}", artifact_handler)
\ No newline at end of file
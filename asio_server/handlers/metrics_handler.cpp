@@ -0,0 +1,11 @@
+#include "metrics_handler.h"
+#include <metrics.h>
+
+void metrics_handler::handle_request(const ReqContext &, Response &res)
+{
+    res.result(http::status::ok);
+    res.set(http::field::content_type, "text/plain; version=0.0.4");
+
+    Metrics::render_prometheus(res.body());
+    res.prepare_payload();
+}
\ No newline at end of file
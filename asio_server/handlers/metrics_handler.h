@@ -0,0 +1,11 @@
+#pragma once
+
+#include <router.h>
+#include <session.h>
+
+class metrics_handler : public ApiHandler
+{
+public:
+    void handle_request(const ReqContext &ctx, Response &res) override;
+};
+REGISTER_STATIC_HANDLER("/metrics", metrics_handler)
\ No newline at end of file
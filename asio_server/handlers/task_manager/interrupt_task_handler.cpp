@@ -1,9 +1,20 @@
 #include "interrupt_task_handler.h"
+#include "task_rate_limiter.h"
 
 /* ------------------------- interrupt_task_handler ------------------------- */
 
-void interrupt_task_handler::handle_request(const ReqContext &ctx, http::response<http::string_body> &res) {}
+interrupt_task_handler::interrupt_task_handler()
+{
+    use(task_rate_limiter());
+}
+
+void interrupt_task_handler::handle_request(const ReqContext &ctx, Response &res) {}
 
 /* ----------------------- interrupt_task_list_handler ---------------------- */
 
-void interrupt_task_list_handler::handle_request(const ReqContext &ctx, http::response<http::string_body> &res) {}
+interrupt_task_list_handler::interrupt_task_list_handler()
+{
+    use(task_rate_limiter());
+}
+
+void interrupt_task_list_handler::handle_request(const ReqContext &ctx, Response &res) {}
@@ -6,13 +6,15 @@
 class interrupt_task_handler : public ApiHandler
 {
 public:
-    void handle_request(const ReqContext &ctx, http::response<http::string_body> &res) override;
+    interrupt_task_handler();
+    void handle_request(const ReqContext &ctx, Response &res) override;
 };
 REGISTER_DYNAMIC_HANDLER("/interruptTask/{taskId}", interrupt_task_handler)
 
 class interrupt_task_list_handler : public ApiHandler
 {
 public:
-    void handle_request(const ReqContext &ctx, http::response<http::string_body> &res) override;
+    interrupt_task_list_handler();
+    void handle_request(const ReqContext &ctx, Response &res) override;
 };
 REGISTER_STATIC_HANDLER("/interruptTaskList", interrupt_task_list_handler)
\ No newline at end of file
@@ -1,27 +1,216 @@
 #include "query_task_detail_handler.h"
+#include "task_events.h"
+#include "task_rate_limiter.h"
 #include <boost/json.hpp>
+#include <charconv>
+#include <compression.h>
+#include <json_writer.h>
+#include <response_cache.h>
+#include <vector>
 
-/* ------------------------ query_task_detail_handler ----------------------- */
+static void error_response(Response &res, http::status status, const char *error)
+{
+    res.result(status);
+    res.set(http::field::content_type, "application/json");
+    res.body().clear();
+    JsonWriter json(res.body());
+    json.begin_object();
+    json.member("error", error);
+    json.end_object();
+    res.prepare_payload();
+}
 
-void query_task_detail_handler::handle_request(const ReqContext &ctx, http::response<http::string_body> &res)
+static void bad_request(Response &res, const char *error)
 {
+    error_response(res, http::status::bad_request, error);
+}
+
+// Sends the JSON already in the body with a strong ETag of it, or 304 if the client has it.
+// The tag also lets Compression reuse the compressed body while the tasks are unchanged.
+static void send_json(const ReqContext &ctx, Response &res)
+{
+    std::string etag = ResponseCache::make_etag(res.body());
+    res.set(http::field::etag, etag);
+    if (ctx.method() == http::verb::get && ResponseCache::etag_matches(ctx.header(http::field::if_none_match), etag))
+    {
+        res.result(http::status::not_modified);
+        res.body().clear();
+        return;
+    }
     res.result(http::status::ok);
     res.set(http::field::content_type, "application/json");
+    res.prepare_payload();
+}
 
-    boost::json::object obj;
+// Ids from ?ids=a,b&ids=c, or from a POST body {"ids":["a","b"]}. False if the body is not
+// such an object.
+static bool requested_ids(const ReqContext &ctx, std::vector<std::string> &ids)
+{
+    if (ctx.method() == http::verb::post)
+    {
+        boost::json::error_code ec;
+        boost::json::value body = boost::json::parse(ctx.body(), ec);
+        const boost::json::object *obj = ec ? nullptr : body.if_object();
+        const boost::json::value *list = obj ? obj->if_contains("ids") : nullptr;
+        if (!list || !list->if_array())
+            return false;
+        for (const auto &id: *list->if_array())
+        {
+            if (id.is_string())
+            {
+                ids.emplace_back(id.as_string());
+            }
+        }
+        return true;
+    }
 
-    res.body() = boost::json::serialize(obj);
-    res.prepare_payload();
+    auto it = ctx.query_params().find("ids");
+    if (it == ctx.query_params().end())
+        return true;
+    for (std::string_view value: it->second)
+    {
+        while (!value.empty())
+        {
+            auto comma = value.find(',');
+            if (comma != 0)
+            {
+                ids.emplace_back(value.substr(0, comma));
+            }
+            value = comma == std::string_view::npos ? std::string_view() : value.substr(comma + 1);
+        }
+    }
+    return true;
+}
+
+static std::string_view query_value(const ReqContext &ctx, std::string_view key)
+{
+    auto it = ctx.query_params().find(key);
+    return it == ctx.query_params().end() || it->second.empty() ? std::string_view() : it->second.front();
+}
+
+/* ------------------------ query_task_detail_handler ----------------------- */
+
+query_task_detail_handler::query_task_detail_handler()
+{
+    use(task_rate_limiter());
+    use<Compression>();
+}
+
+void query_task_detail_handler::handle_request(const ReqContext &ctx, Response &res)
+{
+    auto info = TaskManager::instance()->getTaskInfo(std::string(ctx.path_param("taskId")));
+    if (!info)
+    {
+        error_response(res, http::status::not_found, "unknown task");
+        return;
+    }
+
+    res.body().clear();
+    JsonWriter(res.body()).value(*info);
+    send_json(ctx, res);
 }
 
 /* --------------------- query_task_detail_list_handler --------------------- */
 
-void query_task_detail_list_handler::handle_request(const ReqContext &ctx, http::response<http::string_body> &res)
+query_task_detail_list_handler::query_task_detail_list_handler()
 {
-    res.result(http::status::ok);
-    res.set(http::field::content_type, "application/json");
+    use(task_rate_limiter());
+    use<Compression>();
+}
 
-    boost::json::object obj;
-    res.body() = boost::json::serialize(obj);
-    res.prepare_payload();
+void query_task_detail_list_handler::handle_request(const ReqContext &ctx, Response &res)
+{
+    std::vector<std::string> ids;
+    if (!requested_ids(ctx, ids))
+    {
+        bad_request(res, "expected {\"ids\":[...]}");
+        return;
+    }
+    if (ids.size() > kMaxIds)
+    {
+        bad_request(res, "too many ids");
+        return;
+    }
+
+    // The tasks are written straight into the body; about 200 bytes each is reserved up front.
+    std::string &body = res.body();
+    body.clear();
+    JsonWriter json(body);
+
+    if (!ids.empty() || ctx.method() == http::verb::post)
+    {
+        // Found infos come back in the order asked for, so the ids missing from them are
+        // found in one pass.
+        auto infos = TaskManager::instance()->getTaskInfos(ids);
+        std::vector<std::string_view> unknown;
+        body.reserve(infos.size() * 200 + 64);
+        json.begin_object();
+        json.key("tasks");
+        json.begin_array();
+        std::size_t next = 0;
+        for (const auto &id: ids)
+        {
+            if (next < infos.size() && infos[next].id == id)
+            {
+                json.value(infos[next++]);
+            }
+            else
+            {
+                unknown.push_back(id);
+            }
+        }
+        json.end_array();
+        json.key("unknown");
+        json.begin_array();
+        for (std::string_view id: unknown)
+        {
+            json.value(id);
+        }
+        json.end_array();
+        json.end_object();
+    }
+    else
+    {
+        std::size_t limit = kDefaultLimit;
+        std::string_view limit_param = query_value(ctx, "limit");
+        if (!limit_param.empty())
+        {
+            auto [end, ec] = std::from_chars(limit_param.data(), limit_param.data() + limit_param.size(), limit);
+            if (ec != std::errc() || end != limit_param.data() + limit_param.size() || limit == 0 || limit > kMaxLimit)
+            {
+                bad_request(res, "limit must be between 1 and 1000");
+                return;
+            }
+        }
+
+        std::optional<Task::Status> status;
+        std::string_view status_param = query_value(ctx, "status");
+        if (!status_param.empty() && !(status = task_status(status_param)))
+        {
+            bad_request(res, "unknown status");
+            return;
+        }
+
+        auto page = TaskManager::instance()->listTasks(std::string(query_value(ctx, "cursor")), limit, status);
+        if (!page)
+        {
+            bad_request(res, "malformed cursor");
+            return;
+        }
+        body.reserve(page->infos.size() * 200 + 64);
+        json.begin_object();
+        json.member("tasks", page->infos);
+        json.key("nextCursor");
+        if (page->nextCursor.empty())
+        {
+            json.null();
+        }
+        else
+        {
+            json.value(page->nextCursor);
+        }
+        json.end_object();
+    }
+
+    send_json(ctx, res);
 }
\ No newline at end of file
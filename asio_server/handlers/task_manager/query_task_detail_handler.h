@@ -3,16 +3,33 @@
 #include <router.h>
 #include <session.h>
 
+// One task: GET /taskDetail/<id> -> the task's JSON, or 404 {"error":"unknown task"}.
+// Found tasks carry an ETag, and a GET with a matching If-None-Match gets 304.
 class query_task_detail_handler : public ApiHandler
 {
 public:
-    void handle_request(const ReqContext &ctx, http::response<http::string_body> &res) override;
+    query_task_detail_handler();
+    void handle_request(const ReqContext &ctx, Response &res) override;
 };
-REGISTER_DYNAMIC_HANDLER("/taskDetail/{taskId}", query_task_detail_handler)
+REGISTER_DYNAMIC_WORKER_HANDLER("/taskDetail/{taskId}", query_task_detail_handler)
 
+// Many tasks in one request, either by id or as pages of all tasks:
+//
+//     GET  /taskDetailList?ids=<id>,<id>...       (or POST {"ids":[...]} for long lists)
+//          -> {"tasks":[...],"unknown":[<ids not found>]}
+//     GET  /taskDetailList?limit=100&status=running&cursor=<nextCursor>
+//          -> {"tasks":[...],"nextCursor":<cursor of the next page, or null>}
+//
+// Pages follow creation order, so a task created while paging shows up on the last page.
+// Lists carry an ETag of their JSON, and a GET with a matching If-None-Match gets 304.
 class query_task_detail_list_handler : public ApiHandler
 {
 public:
-    void handle_request(const ReqContext &ctx, http::response<http::string_body> &res) override;
+    static constexpr std::size_t kMaxIds = 10000;
+    static constexpr std::size_t kDefaultLimit = 100;
+    static constexpr std::size_t kMaxLimit = 1000;
+
+    query_task_detail_list_handler();
+    void handle_request(const ReqContext &ctx, Response &res) override;
 };
-REGISTER_STATIC_HANDLER("/taskDetailList", query_task_detail_list_handler)
\ No newline at end of file
+REGISTER_STATIC_WORKER_HANDLER("/taskDetailList", query_task_detail_list_handler)
\ No newline at end of file
@@ -1,13 +1,56 @@
 #include "query_task_result_handler.h"
+#include "task_rate_limiter.h"
 #include <boost/json.hpp>
+#include <json_writer.h>
+#include <memory>
+#include <taskmanager.h>
 
-void query_task_result_handler::handle_request(const ReqContext &ctx, http::response<http::string_body> &res)
+static void error_response(Response &res, http::status status, const char *error)
 {
-    res.result(http::status::ok);
+    res.result(status);
     res.set(http::field::content_type, "application/json");
-    boost::json::object obj;
-    std::string taskId = ctx.path_param("taskId");
-
-    res.body() = boost::json::serialize(obj);
+    res.body().clear();
+    JsonWriter json(res.body());
+    json.begin_object();
+    json.member("error", error);
+    json.end_object();
     res.prepare_payload();
+}
+
+// Owns the result for as long as the producer serializes it, on the connection's io thread.
+struct ResultStream
+{
+    boost::json::object object;
+    boost::json::serializer serializer;
+};
+
+query_task_result_handler::query_task_result_handler()
+{
+    use(task_rate_limiter());
+}
+
+void query_task_result_handler::handle_request(const ReqContext &ctx, Response &res)
+{
+    auto info = TaskManager::instance()->getTaskInfo(std::string(ctx.path_param("taskId")));
+    if (!info)
+    {
+        error_response(res, http::status::not_found, "unknown task");
+        return;
+    }
+    if (info->status != Task::Finished && info->status != Task::Interrupt)
+    {
+        error_response(res, http::status::conflict, "task not finished");
+        return;
+    }
+
+    auto stream = std::make_shared<ResultStream>();
+    stream->object = std::move(info->object);
+    stream->serializer.reset(&stream->object);
+    res.result(http::status::ok);
+    res.set(http::field::content_type, "application/json");
+    res.stream_body([stream](std::string &chunk) {
+        chunk.resize(kChunkSize);
+        chunk.resize(stream->serializer.read(chunk.data(), chunk.size()).size());
+        return !stream->serializer.done();
+    });
 }
\ No newline at end of file
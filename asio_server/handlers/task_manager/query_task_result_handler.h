@@ -3,9 +3,15 @@
 #include <router.h>
 #include <session.h>
 
+// A task's output: GET /queryTaskResult/<id> -> the object the task ended with, streamed in
+// kChunkSize pieces so a large result is never serialized whole; 404 {"error":"unknown task"},
+// or 409 {"error":"task not finished"} while it is still pending or running.
 class query_task_result_handler : public ApiHandler
 {
 public:
-    void handle_request(const ReqContext &ctx, http::response<http::string_body> &res) override;
+    static constexpr std::size_t kChunkSize = 16 * 1024;
+
+    query_task_result_handler();
+    void handle_request(const ReqContext &ctx, Response &res) override;
 };
-REGISTER_DYNAMIC_HANDLER("/queryTaskResult/{taskId}", query_task_result_handler)
\ No newline at end of file
+REGISTER_DYNAMIC_WORKER_HANDLER("/queryTaskResult/{taskId}", query_task_result_handler)
\ No newline at end of file
@@ -0,0 +1,65 @@
+#include "task_events.h"
+#include <event_hub.h>
+
+static const char *status_name(Task::Status status)
+{
+    switch (status)
+    {
+    case Task::Pending:
+        return "pending";
+    case Task::Running:
+        return "running";
+    case Task::Finished:
+        return "finished";
+    case Task::Interrupt:
+        return "interrupted";
+    }
+    return "unknown";
+}
+
+std::optional<Task::Status> task_status(std::string_view name)
+{
+    for (Task::Status status: {Task::Pending, Task::Running, Task::Finished, Task::Interrupt})
+    {
+        if (name == status_name(status))
+            return status;
+    }
+    return std::nullopt;
+}
+
+const char *task_status_name(const TaskManager::TaskInfo &info)
+{
+    return status_name(info.status);
+}
+
+std::string task_topic(std::string_view task_id)
+{
+    return "task/" + std::string(task_id);
+}
+
+std::shared_ptr<const std::string> task_event(const TaskManager::TaskInfo &info)
+{
+    auto event = std::make_shared<std::string>();
+    JsonWriter(*event).value(info);
+    return event;
+}
+
+// TaskManager only sets these once the task's result is in, or it was interrupted.
+bool is_final(const TaskManager::TaskInfo &info)
+{
+    return info.status == Task::Finished || info.status == Task::Interrupt;
+}
+
+// Runs on the task's thread. The event is formatted once, whatever the number of subscribers.
+static void publish_task_info(const TaskManager::TaskInfo &info)
+{
+    if (EventHub::subscriber_count() == 0)
+        return;
+    EventHub::publish(task_topic(info.id), task_event(info), is_final(info));
+}
+
+void publish_task_events()
+{
+    static bool hooked = (TaskManager::instance()->onTaskInfoChanged.add(&publish_task_info), true);
+    (void) hooked;
+}
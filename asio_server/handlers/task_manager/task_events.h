@@ -0,0 +1,36 @@
+#pragma once
+
+#include <json_writer.h>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <taskmanager.h>
+
+// Task changes as EventHub events, shared by /taskEvents and /taskSocket. Each change is
+// published once, as the JSON of its TaskInfo, on the topic of its task.
+std::string task_topic(std::string_view task_id);
+// The status as named in a task's JSON ("pending", "running", ...), and back.
+const char *task_status_name(const TaskManager::TaskInfo &info);
+std::optional<Task::Status> task_status(std::string_view name);
+std::shared_ptr<const std::string> task_event(const TaskManager::TaskInfo &info);
+// Finished or interrupted: no further event follows.
+bool is_final(const TaskManager::TaskInfo &info);
+// Starts publishing TaskManager's changes; called by the handlers before their first
+// subscription, so TaskManager is not created during static initialization.
+void publish_task_events();
+
+// The JSON of a task in every endpoint.
+template<>
+struct JsonFields<TaskManager::TaskInfo>
+{
+    using Info = TaskManager::TaskInfo;
+    static constexpr auto fields = std::make_tuple(json_field("id", &Info::id),
+                                                   json_field("status", &task_status_name),
+                                                   json_field("progressValue", &Info::progressValue),
+                                                   json_field("progressText", &Info::progressText),
+                                                   json_field("createTime", &Info::createTime),
+                                                   json_field("startTime", &Info::startTime),
+                                                   json_field("endTime", &Info::endTime),
+                                                   json_field("result", &Info::result));
+};
@@ -0,0 +1,29 @@
+#include "task_events_handler.h"
+#include "task_events.h"
+#include <body_stream.h>
+
+void task_events_handler::handle_request(const ReqContext &ctx, Response &res)
+{
+    publish_task_events();
+
+    std::string id(ctx.path_param("taskId"));
+    if (!TaskManager::instance()->exists(id))
+    {
+        res.result(http::status::not_found);
+        res.set(http::field::content_type, "application/json");
+        res.body() = R"({"error":"unknown task"})";
+        res.prepare_payload();
+        return;
+    }
+
+    res.result(http::status::ok);
+    auto stream = res.stream_events(ctx.executor());
+    // Subscribe before taking the snapshot, so no change made in between is missed.
+    stream->subscribe(task_topic(id));
+    auto info = TaskManager::instance()->getTaskInfo(id);
+    stream->deliver(task_event(*info));
+    if (is_final(*info))
+    {
+        stream->end();
+    }
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <router.h>
+#include <session.h>
+
+// Pushes a task's progress as server-sent events instead of having clients poll
+// /taskDetail/{taskId}: the current state first, then every change TaskManager reports,
+// until the task finishes or is interrupted.
+class task_events_handler : public ApiHandler
+{
+public:
+    void handle_request(const ReqContext &ctx, Response &res) override;
+};
+REGISTER_DYNAMIC_HANDLER("/taskEvents/{taskId}", task_events_handler)
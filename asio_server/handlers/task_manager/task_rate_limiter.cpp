@@ -0,0 +1,7 @@
+#include "task_rate_limiter.h"
+
+const std::shared_ptr<RateLimiter> &task_rate_limiter()
+{
+    static const std::shared_ptr<RateLimiter> limiter = std::make_shared<RateLimiter>();
+    return limiter;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <memory>
+#include <rate_limiter.h>
+
+// The per-client budget (--rate_limit, --rate_burst) shared by the task endpoints: task
+// queries, interrupts and task submission over /taskSocket. The routes use() it as
+// middleware; /taskSocket, whose upgrade runs no middleware, takes a token per "submit".
+const std::shared_ptr<RateLimiter> &task_rate_limiter();
@@ -0,0 +1,250 @@
+#include "task_socket_handler.h"
+#include "task_events.h"
+#include "task_rate_limiter.h"
+#include <boost/json.hpp>
+#include <chrono>
+#include <cmath>
+#include <json_arena.h>
+#include <metrics.h>
+#include <optional>
+#include <vector>
+#include <websocket_session.h>
+#include <worker_pool.h>
+
+namespace {
+
+class task_socket : public WebSocketHandler
+{
+public:
+    void on_message(WebSocketSession &session, std::string_view message, bool binary) override
+    {
+        JsonArena arena;
+        boost::json::object reply(arena.storage());
+        std::vector<std::shared_ptr<const std::string>> snapshots;
+
+        boost::json::error_code ec;
+        boost::json::value request = boost::json::parse(message, ec, arena.storage());
+        const boost::json::object *obj = ec ? nullptr : request.if_object();
+        const boost::json::value *op = obj ? obj->if_contains("op") : nullptr;
+        if (!op || !op->is_string())
+        {
+            reply["reply"] = "error";
+            reply["error"] = "expected a JSON object with an \"op\"";
+        }
+        else if (op->as_string() == "submit")
+        {
+            reply["reply"] = "submit";
+            if (!submit(session, *obj, reply, binary))
+                return;
+        }
+        else if (op->as_string() == "subscribe")
+        {
+            reply["reply"] = "subscribe";
+            add_subscriptions(session, obj->if_contains("taskIds"), reply, snapshots);
+        }
+        else if (op->as_string() == "unsubscribe")
+        {
+            reply["reply"] = "unsubscribe";
+            if (auto ids = task_ids(obj->if_contains("taskIds")))
+            {
+                for (const auto &id: *ids)
+                {
+                    if (id.is_string())
+                    {
+                        session.unsubscribe(task_topic(id.as_string()));
+                    }
+                }
+            }
+        }
+        else
+        {
+            reply["reply"] = "error";
+            reply["error"] = "unknown op";
+        }
+
+        send_reply(session, reply, snapshots, binary);
+    }
+
+private:
+    struct TaskSpec
+    {
+        std::string name;
+        std::string params;
+        bool valid;
+    };
+
+    static void send_reply(WebSocketSession &session, const boost::json::object &reply,
+                           std::vector<std::shared_ptr<const std::string>> &snapshots, bool binary)
+    {
+        std::string out;
+        serialize_into(out, reply);
+        session.send(std::move(out), binary);
+        for (auto &snapshot: snapshots)
+        {
+            session.send(std::move(snapshot));
+        }
+    }
+
+    static const boost::json::array *task_ids(const boost::json::value *ids)
+    {
+        return ids ? ids->if_array() : nullptr;
+    }
+
+    // Returns true when `reply` is to be sent now: an error, for a client out of tokens in
+    // task_rate_limiter() or a batch past kMaxSubmitBatch. Otherwise the reply is sent
+    // later, once the tasks are created. createTask()
+    // runs a Sync task inline and blocks while the ThreadPool's queue is full, so it runs on
+    // the WorkerPool rather than this io thread, and the reply and snapshots come back
+    // through the connection's executor.
+    static bool submit(WebSocketSession &session, const boost::json::object &request, boost::json::object &reply,
+                       bool binary)
+    {
+        // The upgrade ran no middleware, so each submit takes its token here, keyed like
+        // an HTTP request from this client.
+        ReqContext ctxt(session.request());
+        ctxt.set_remote_address(session.remote_address());
+        RateLimiter &limiter = *task_rate_limiter();
+        std::chrono::nanoseconds retry_after{0};
+        if (!limiter.try_acquire(limiter.key_of(ctxt), std::chrono::steady_clock::now(), retry_after))
+        {
+            Metrics::error(Metrics::Error::rate_limited);
+            reply["error"] = "rate limited";
+            reply["retryAfter"] =
+                static_cast<std::int64_t>(std::ceil(std::chrono::duration<double>(retry_after).count()));
+            return true;
+        }
+
+        const boost::json::value *watch = request.if_contains("subscribe");
+        bool subscribe = watch && watch->is_bool() && watch->as_bool();
+
+        std::vector<TaskSpec> specs;
+        if (auto list = task_ids(request.if_contains("tasks")))
+        {
+            if (list->size() > task_socket_handler::kMaxSubmitBatch)
+            {
+                reply["error"] = "at most " + std::to_string(task_socket_handler::kMaxSubmitBatch) +
+                                 " tasks per submit";
+                return true;
+            }
+            specs.reserve(list->size());
+            for (const auto &task: *list)
+            {
+                const boost::json::object *spec = task.if_object();
+                const boost::json::value *name = spec ? spec->if_contains("name") : nullptr;
+                const boost::json::value *params = spec ? spec->if_contains("params") : nullptr;
+                if (!name || !name->is_string())
+                {
+                    specs.push_back({{}, {}, false});
+                    continue;
+                }
+                specs.push_back({std::string(name->as_string()),
+                                 params && params->is_string() ? std::string(params->as_string()) : std::string(),
+                                 true});
+            }
+        }
+
+        WorkerPool::post([weak = session.weak_from_this(), executor = session.executor(), specs = std::move(specs),
+                          subscribe, binary]() {
+            std::vector<std::optional<std::string>> created;
+            created.reserve(specs.size());
+            for (const auto &spec: specs)
+            {
+                if (!spec.valid)
+                {
+                    created.emplace_back();
+                    continue;
+                }
+                auto [ok, id] = TaskManager::instance()->createTask(spec.name, spec.params);
+                created.push_back(ok ? std::optional<std::string>(std::move(id)) : std::nullopt);
+            }
+
+            net::post(executor, [weak, created = std::move(created), subscribe, binary]() {
+                auto session = weak.lock();
+                if (!session)
+                    return;
+
+                JsonArena arena;
+                boost::json::object reply(arena.storage());
+                std::vector<std::shared_ptr<const std::string>> snapshots;
+                reply["reply"] = "submit";
+                boost::json::array ids(reply.storage());
+                boost::json::array submitted(reply.storage());
+                for (const auto &id: created)
+                {
+                    if (!id)
+                    {
+                        submitted.emplace_back(nullptr);
+                        continue;
+                    }
+                    submitted.emplace_back(*id);
+                    ids.emplace_back(*id);
+                }
+                reply["taskIds"] = std::move(submitted);
+
+                if (subscribe)
+                {
+                    boost::json::value watched(std::move(ids));
+                    add_subscriptions(*session, &watched, reply, snapshots);
+                }
+                send_reply(*session, reply, snapshots, binary);
+            });
+        });
+        return false;
+    }
+
+    // Subscribes before taking each snapshot, so no change made in between is missed.
+    static void add_subscriptions(WebSocketSession &session, const boost::json::value *ids, boost::json::object &reply,
+                                  std::vector<std::shared_ptr<const std::string>> &snapshots)
+    {
+        publish_task_events();
+
+        boost::json::array unknown(reply.storage());
+        boost::json::array rejected(reply.storage());
+        if (auto list = task_ids(ids))
+        {
+            for (const auto &value: *list)
+            {
+                if (!value.is_string())
+                    continue;
+                std::string id(value.as_string());
+                if (!TaskManager::instance()->exists(id))
+                {
+                    unknown.emplace_back(id);
+                    continue;
+                }
+
+                std::string topic = task_topic(id);
+                if (!session.subscribe(topic))
+                {
+                    rejected.emplace_back(id);
+                    continue;
+                }
+                auto info = TaskManager::instance()->getTaskInfo(id);
+                snapshots.push_back(task_event(*info));
+                if (is_final(*info))
+                {
+                    session.unsubscribe(topic);
+                }
+            }
+        }
+        reply["unknown"] = std::move(unknown);
+        // Past WebSocketSession::kMaxSubscriptions.
+        reply["rejected"] = std::move(rejected);
+    }
+};
+
+}// namespace
+
+task_socket_handler::task_socket_handler()
+{
+    accept_websocket(std::make_shared<task_socket>());
+}
+
+void task_socket_handler::handle_request(const ReqContext &ctx, Response &res)
+{
+    res.result(http::status::upgrade_required);
+    res.set(http::field::upgrade, "websocket");
+    res.set(http::field::content_type, "text/plain");
+    res.body() = "WebSocket upgrade required";
+    res.prepare_payload();
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <router.h>
+#include <session.h>
+
+// WebSocket endpoint for clients that submit and watch many tasks over one connection
+// instead of a request per task. Each message is a JSON object with an "op":
+//
+//     {"op":"submit","tasks":[{"name":"...","params":"..."}],"subscribe":true}
+//     {"op":"subscribe","taskIds":["..."]}
+//     {"op":"unsubscribe","taskIds":["..."]}
+//
+// and is answered with {"reply":<op>,...} in a frame of the same type, text or binary.
+// A subscribed task is sent as its current state and then as every change, in the JSON
+// of /taskEvents, until it finishes.
+//
+// A submit of up to kMaxSubmitBatch tasks creates them on the WorkerPool, so its reply may
+// follow those of messages sent after it; a larger one is answered with an "error". Each
+// submit takes a token from task_rate_limiter(), and one refused is answered with
+// {"error":"rate limited","retryAfter":<seconds>}.
+class task_socket_handler : public ApiHandler
+{
+public:
+    static constexpr std::size_t kMaxSubmitBatch = 1000;
+
+    task_socket_handler();
+    void handle_request(const ReqContext &ctx, Response &res) override;
+};
+REGISTER_STATIC_HANDLER("/taskSocket", task_socket_handler)
@@ -0,0 +1,24 @@
+#include "trace_handler.h"
+#include <trace.h>
+
+void trace_handler::handle_request(const ReqContext &ctx, Response &res)
+{
+    if (ctx.method() == http::verb::delete_)
+    {
+        Trace::clear();
+        res.result(http::status::no_content);
+        return;
+    }
+    if (ctx.method() != http::verb::get && ctx.method() != http::verb::head)
+    {
+        res.result(http::status::method_not_allowed);
+        res.set(http::field::allow, "GET, HEAD, DELETE");
+        res.prepare_payload();
+        return;
+    }
+
+    res.result(http::status::ok);
+    res.set(http::field::content_type, "application/json");
+    Trace::render_chrome_json(res.body());
+    res.prepare_payload();
+}
\ No newline at end of file
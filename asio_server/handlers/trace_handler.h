@@ -0,0 +1,14 @@
+#pragma once
+
+#include <router.h>
+#include <session.h>
+
+// The spans recorded for sampled requests (--trace_sample_rate), as Chrome trace-event
+// JSON to load into chrome://tracing or Perfetto. DELETE empties the rings, so the next
+// dump holds only newer requests. The endpoint is unauthenticated, so main() registers it
+// at /debug/trace only when tracing is on at startup.
+class trace_handler : public ApiHandler
+{
+public:
+    void handle_request(const ReqContext &ctx, Response &res) override;
+};
\ No newline at end of file
@@ -1,16 +1,18 @@
 #include "version_handler.h"
 #include <boost/json.hpp>
+#include <json_arena.h>
 
-void version_handler::handle_request(const ReqContext &ctx, http::response<http::string_body> &res)
+void version_handler::handle_request(const ReqContext &ctx, Response &res)
 {
     res.result(http::status::ok);
     res.set(http::field::content_type, "application/json");
 
-    boost::json::object obj;
+    JsonArena arena;
+    boost::json::object obj(arena.storage());
     obj["code"] = 0;
     obj["message"] = "success";
     obj["version"] = "1.0.0";
 
-    res.body() = boost::json::serialize(obj);
+    serialize_into(res.body(), obj);
     res.prepare_payload();
 }
\ No newline at end of file
@@ -6,6 +6,11 @@
 class version_handler : public ApiHandler
 {
 public:
-    void handle_request(const ReqContext &ctx, http::response<http::string_body> &res) override;
+    version_handler()
+    {
+        cache_responses();
+    }
+
+    void handle_request(const ReqContext &ctx, Response &res) override;
 };
 REGISTER_STATIC_HANDLER("/version", version_handler)
\ No newline at end of file
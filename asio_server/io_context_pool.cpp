@@ -0,0 +1,82 @@
+#include "io_context_pool.h"
+#include <iostream>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+static void pin_thread_to_core(std::thread &thread, std::size_t index)
+{
+#ifdef __linux__
+    unsigned cores = std::thread::hardware_concurrency();
+    if (cores == 0)
+        return;
+
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(index % cores, &cpuset);
+    if (pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &cpuset) != 0)
+    {
+        std::cerr << "Failed to pin io thread " << index << " to a core" << std::endl;
+    }
+#else
+    (void) thread;
+    (void) index;
+#endif
+}
+
+IoContextPool::IoContextPool(std::size_t size)
+{
+    if (size == 0)
+        throw std::invalid_argument("IoContextPool size must be greater than zero");
+
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        // Each context is driven by a single thread; tell asio so it can skip cross-thread wakeups.
+        contexts_.push_back(std::make_unique<net::io_context>(1));
+        work_.push_back(net::make_work_guard(*contexts_.back()));
+    }
+}
+
+void IoContextPool::run()
+{
+    std::vector<std::thread> threads;
+    threads.reserve(contexts_.size());
+    for (std::size_t i = 0; i < contexts_.size(); ++i)
+    {
+        threads.emplace_back([ctx = contexts_[i].get()] { ctx->run(); });
+        pin_thread_to_core(threads.back(), i);
+    }
+
+    for (auto &thread: threads)
+    {
+        thread.join();
+    }
+}
+
+void IoContextPool::stop()
+{
+    for (auto &ctx: contexts_)
+    {
+        ctx->stop();
+    }
+}
+
+std::size_t IoContextPool::size() const
+{
+    return contexts_.size();
+}
+
+net::io_context &IoContextPool::get(std::size_t index)
+{
+    return *contexts_.at(index);
+}
+
+std::size_t IoContextPool::next_index()
+{
+    std::size_t index = next_;
+    next_ = (next_ + 1) % contexts_.size();
+    return index;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <boost/asio.hpp>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace net = boost::asio;
+
+// A pool of io_contexts, each run by exactly one thread pinned to its own core.
+// Every Session lives on a single io_context, so handlers never need locking.
+class IoContextPool
+{
+public:
+    explicit IoContextPool(std::size_t size);
+
+    IoContextPool(const IoContextPool &) = delete;
+    IoContextPool &operator=(const IoContextPool &) = delete;
+
+    // Runs every io_context on its own thread and blocks until all of them have stopped.
+    void run();
+    void stop();
+
+    std::size_t size() const;
+    net::io_context &get(std::size_t index);
+
+    // Round-robin selection, used when connections are accepted on a single acceptor.
+    std::size_t next_index();
+
+private:
+    using WorkGuard = net::executor_work_guard<net::io_context::executor_type>;
+
+    std::vector<std::unique_ptr<net::io_context>> contexts_;
+    std::vector<WorkGuard> work_;
+    std::size_t next_ = 0;
+};
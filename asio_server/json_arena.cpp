@@ -0,0 +1,74 @@
+#include "json_arena.h"
+#include <algorithm>
+#include <cstddef>
+
+namespace {
+
+struct ThreadBuffer
+{
+    alignas(std::max_align_t) unsigned char data[JsonArena::kThreadBufferSize];
+    bool in_use = false;
+};
+
+thread_local ThreadBuffer thread_buffer;
+
+template<typename T>
+void serialize_impl(std::string &out, const T &jv)
+{
+    boost::json::serializer sr;
+    sr.reset(&jv);
+
+    out.clear();
+    while (!sr.done())
+    {
+        std::size_t used = out.size();
+        out.resize(std::max<std::size_t>(out.capacity(), std::max<std::size_t>(used * 2, 256)));
+        used += sr.read(&out[used], out.size() - used).size();
+        out.resize(used);
+    }
+}
+
+}// namespace
+
+JsonArena::JsonArena()
+{
+    if (!thread_buffer.in_use)
+    {
+        thread_buffer.in_use = true;
+        owns_thread_buffer_ = true;
+        resource_.emplace(thread_buffer.data, sizeof(thread_buffer.data));
+    }
+    else
+    {
+        resource_.emplace();
+    }
+}
+
+JsonArena::~JsonArena()
+{
+    resource_.reset();
+    if (owns_thread_buffer_)
+    {
+        thread_buffer.in_use = false;
+    }
+}
+
+boost::json::storage_ptr JsonArena::storage()
+{
+    return boost::json::storage_ptr(&*resource_);
+}
+
+void serialize_into(std::string &out, const boost::json::value &jv)
+{
+    serialize_impl(out, jv);
+}
+
+void serialize_into(std::string &out, const boost::json::object &obj)
+{
+    serialize_impl(out, obj);
+}
+
+void serialize_into(std::string &out, const boost::json::array &arr)
+{
+    serialize_impl(out, arr);
+}
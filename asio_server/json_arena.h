@@ -0,0 +1,34 @@
+#pragma once
+
+#include <boost/json.hpp>
+#include <optional>
+#include <string>
+
+// Scoped memory for building a response DOM. It hands out a per-thread buffer that every
+// request on that thread reuses, so typical documents need no heap allocation; larger ones
+// spill over to the heap. A second arena opened on the same thread uses the heap only.
+//
+//     JsonArena arena;
+//     boost::json::object obj(arena.storage());
+class JsonArena
+{
+public:
+    static constexpr std::size_t kThreadBufferSize = 16 * 1024;
+
+    JsonArena();
+    ~JsonArena();
+
+    JsonArena(const JsonArena &) = delete;
+    JsonArena &operator=(const JsonArena &) = delete;
+
+    boost::json::storage_ptr storage();
+
+private:
+    std::optional<boost::json::monotonic_resource> resource_;
+    bool owns_thread_buffer_ = false;
+};
+
+// Serializes into `out`, reusing its capacity instead of returning a fresh string.
+void serialize_into(std::string &out, const boost::json::value &jv);
+void serialize_into(std::string &out, const boost::json::object &obj);
+void serialize_into(std::string &out, const boost::json::array &arr);
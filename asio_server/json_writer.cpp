@@ -0,0 +1,146 @@
+#include "json_writer.h"
+#include <charconv>
+#include <cmath>
+
+namespace {
+
+// Bytes that cannot appear raw in a JSON string: the quote, the backslash and controls.
+constexpr bool needs_escape(unsigned char c)
+{
+    return c < 0x20 || c == '"' || c == '\\';
+}
+
+}// namespace
+
+void JsonWriter::begin_object()
+{
+    separate();
+    out_.push_back('{');
+    need_comma_ = false;
+}
+
+void JsonWriter::end_object()
+{
+    out_.push_back('}');
+    need_comma_ = true;
+}
+
+void JsonWriter::begin_array()
+{
+    separate();
+    out_.push_back('[');
+    need_comma_ = false;
+}
+
+void JsonWriter::end_array()
+{
+    out_.push_back(']');
+    need_comma_ = true;
+}
+
+void JsonWriter::key(std::string_view name)
+{
+    separate();
+    append_escaped(name);
+    out_.push_back(':');
+    need_comma_ = false;
+}
+
+void JsonWriter::value(std::string_view s)
+{
+    separate();
+    append_escaped(s);
+    need_comma_ = true;
+}
+
+void JsonWriter::value(bool b)
+{
+    separate();
+    out_.append(b ? "true" : "false");
+    need_comma_ = true;
+}
+
+void JsonWriter::value(std::int64_t n)
+{
+    separate();
+    char buf[24];
+    out_.append(buf, std::to_chars(buf, buf + sizeof(buf), n).ptr);
+    need_comma_ = true;
+}
+
+void JsonWriter::value(std::uint64_t n)
+{
+    separate();
+    char buf[24];
+    out_.append(buf, std::to_chars(buf, buf + sizeof(buf), n).ptr);
+    need_comma_ = true;
+}
+
+// JSON has no NaN or infinity; they are written as null.
+void JsonWriter::value(double d)
+{
+    if (!std::isfinite(d))
+    {
+        null();
+        return;
+    }
+    separate();
+    char buf[32];
+    out_.append(buf, std::to_chars(buf, buf + sizeof(buf), d).ptr);
+    need_comma_ = true;
+}
+
+void JsonWriter::null()
+{
+    separate();
+    out_.append("null");
+    need_comma_ = true;
+}
+
+// Runs of bytes that need no escaping are appended in one go; most strings are one run.
+void JsonWriter::append_escaped(std::string_view s)
+{
+    static constexpr char hex[] = "0123456789abcdef";
+
+    out_.push_back('"');
+    std::size_t start = 0;
+    for (std::size_t i = 0; i < s.size(); ++i)
+    {
+        auto c = static_cast<unsigned char>(s[i]);
+        if (!needs_escape(c))
+            continue;
+
+        out_.append(s.data() + start, i - start);
+        start = i + 1;
+        switch (c)
+        {
+        case '"':
+            out_.append("\\\"");
+            break;
+        case '\\':
+            out_.append("\\\\");
+            break;
+        case '\n':
+            out_.append("\\n");
+            break;
+        case '\r':
+            out_.append("\\r");
+            break;
+        case '\t':
+            out_.append("\\t");
+            break;
+        case '\b':
+            out_.append("\\b");
+            break;
+        case '\f':
+            out_.append("\\f");
+            break;
+        default:
+            out_.append("\\u00");
+            out_.push_back(hex[c >> 4]);
+            out_.push_back(hex[c & 0xf]);
+        }
+    }
+    out_.append(s.data() + start, s.size() - start);
+    out_.push_back('"');
+}
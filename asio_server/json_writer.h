@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+// Specialize for a struct to describe its JSON object at compile time:
+//
+//     template<>
+//     struct JsonFields<Point>
+//     {
+//         static constexpr auto fields = std::make_tuple(json_field("x", &Point::x),
+//                                                        json_field("label", &label_of));
+//     };
+//
+// A field's getter is a data member pointer or anything invocable with the struct.
+template<typename T>
+struct JsonFields;
+
+template<typename Get>
+struct JsonField
+{
+    std::string_view name;
+    Get get;
+};
+
+template<typename Get>
+constexpr JsonField<Get> json_field(std::string_view name, Get get)
+{
+    return JsonField<Get>{name, get};
+}
+
+template<typename T, typename = void>
+struct has_json_fields : std::false_type
+{
+};
+
+template<typename T>
+struct has_json_fields<T, std::void_t<decltype(JsonFields<T>::fields)>> : std::true_type
+{
+};
+
+// Writes JSON straight into a string, such as a response body, without building a DOM.
+// Commas are placed by the writer; keys and values must alternate inside objects. Writing
+// appends to `out`, so a caller that reuses the string keeps its capacity.
+class JsonWriter
+{
+public:
+    explicit JsonWriter(std::string &out) : out_(out) {}
+
+    void begin_object();
+    void end_object();
+    void begin_array();
+    void end_array();
+    // Keys are escaped like strings.
+    void key(std::string_view name);
+
+    void value(std::string_view s);
+    void value(const char *s)
+    {
+        value(std::string_view(s));
+    }
+    void value(const std::string &s)
+    {
+        value(std::string_view(s));
+    }
+    void value(bool b);
+    void value(std::int64_t n);
+    void value(std::uint64_t n);
+    void value(int n)
+    {
+        value(static_cast<std::int64_t>(n));
+    }
+    void value(double d);
+    void null();
+
+    // An object with the fields of JsonFields<T>, in their declared order.
+    template<typename T, std::enable_if_t<has_json_fields<T>::value, int> = 0>
+    void value(const T &obj)
+    {
+        begin_object();
+        std::apply([&](const auto &...field) { (write_field(field, obj), ...); }, JsonFields<T>::fields);
+        end_object();
+    }
+
+    template<typename T>
+    void value(const std::vector<T> &items)
+    {
+        begin_array();
+        for (const auto &item: items)
+        {
+            value(item);
+        }
+        end_array();
+    }
+
+    template<typename T>
+    void member(std::string_view name, const T &v)
+    {
+        key(name);
+        value(v);
+    }
+
+private:
+    template<typename Get, typename T>
+    void write_field(const JsonField<Get> &field, const T &obj)
+    {
+        key(field.name);
+        value(std::invoke(field.get, obj));
+    }
+
+    void separate()
+    {
+        if (need_comma_)
+        {
+            out_.push_back(',');
+        }
+    }
+    void append_escaped(std::string_view s);
+
+    std::string &out_;
+    bool need_comma_ = false;
+};
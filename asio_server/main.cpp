@@ -1,82 +1,287 @@
 
+#include <algorithm>
+#include <alloc_stats.h>
 #include <boost/asio.hpp>
 #include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/signal_set.hpp>
+#include <compression.h>
+#include <csignal>
+#include <cstdlib>
 #include <gflags/gflags.h>
+#include <handlers/trace_handler.h>
 #include <iostream>
+#include <rate_limiter.h>
+#include <reloadable.h>
+#include <server.h>
 #include <session.h>
+#include <settings.h>
+#include <thread>
+#include <tls.h>
+#include <trace.h>
+#include <worker_pool.h>
 
-namespace net = boost::asio;
-using tcp = boost::asio::ip::tcp;
+static void custom_terminate_handler()
+{
+    try
+    {
+        throw;
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Unhandled exception: " << e.what() << std::endl;
+    }
+    catch (...)
+    {
+        std::cerr << "Unhandled unknown exception!" << std::endl;
+    }
+    std::abort();
+}
 
-class Server
+static void report_accepted(const Server &server)
 {
-public:
-    Server(net::io_context &io_context, unsigned short port) : acceptor_(io_context, {tcp::v4(), port})
+    auto counts = server.accepted_counts();
+    std::cout << "Accepted connections per thread:";
+    for (std::size_t i = 0; i < counts.size(); ++i)
     {
-        do_accept();
+        std::cout << " [" << i << "]=" << counts[i];
     }
+    std::cout << std::endl;
+    std::cout << "Live connections: " << server.live_connections() << std::endl;
 
-private:
-    void do_accept()
+    if (AllocStats::enabled() && AllocStats::requests() > 0)
     {
-        acceptor_.async_accept([this](beast::error_code ec, tcp::socket socket) {
-            if (!ec)
-            {
-                std::make_shared<Session>(std::move(socket))->start();
-            }
+        std::cout << "Heap per request: " << AllocStats::bytes() / AllocStats::requests() << " bytes, "
+                  << AllocStats::allocations() / AllocStats::requests() << " allocations ("
+                  << AllocStats::requests() << " requests)" << std::endl;
+    }
+}
+
+static Reloadable<Settings> settings;
+
+// Everything that can change without a restart; applied at startup and on SIGHUP.
+static void apply_settings(Server *server)
+{
+    const Settings &s = settings.get();
+    Session::Limits limits;
+    limits.body_limit = s.max_body;
+    limits.max_in_flight = s.max_in_flight;
+    limits.idle_timeout = std::chrono::seconds(s.idle_timeout);
+    limits.header_timeout = std::chrono::seconds(s.header_timeout);
+    limits.io_timeout = std::chrono::seconds(s.io_timeout);
+    Session::configure(limits);
 
-            do_accept();
-        });
+    Compression::Options compression;
+    compression.level = s.compression_level;
+    compression.min_size = s.compression_min_size;
+    Compression::configure(compression);
+
+    RateLimiter::Options rate_limit;
+    rate_limit.rate = s.rate_limit;
+    rate_limit.burst = s.rate_burst;
+    rate_limit.key_header = s.rate_limit_header;
+    RateLimiter::configure(rate_limit);
+
+    Trace::Options trace;
+    trace.sample_rate = s.trace_sample_rate;
+    Trace::configure(trace);
+
+    if (server)
+    {
+        server->set_max_connections(s.max_connections);
     }
+}
 
-    tcp::acceptor acceptor_;
-};
+static void schedule_report(net::steady_timer &timer, const Server &server)
+{
+    if (settings.get().report_interval <= 0)
+        return;
+    timer.expires_after(std::chrono::seconds(settings.get().report_interval));
+    timer.async_wait([&timer, &server](boost::system::error_code ec) {
+        if (ec)
+            return;
+        report_accepted(server);
+        schedule_report(timer, server);
+    });
+}
 
-static void custom_terminate_handler()
+// SIGHUP: re-reads --flagfile into a new Settings and, if it is valid, applies what
+// apply_settings() covers, resizes the WorkerPool, restarts the accepted-connection report
+// and reloads the TLS certificate and key, so a renewed certificate needs no restart.
+//
+// The io thread count cannot change: every io thread runs its own io_context, which its
+// acceptor and every connection it accepted are bound to for their lifetime. The port and
+// log directory are fixed by the open sockets and files, and TLS is either on or off for
+// the life of the process; reload_settings() reports changes to those, or to flags only
+// read at startup, as taking effect on restart.
+static void reload(Server &server, net::steady_timer &report_timer)
 {
-    try
+    std::string flagfile;
+    if (!gflags::GetCommandLineOption("flagfile", &flagfile) || flagfile.empty())
     {
-        throw;
+        std::cerr << "SIGHUP: no --flagfile to reload settings from" << std::endl;
+        return;
     }
-    catch (const std::exception &e)
+
+    const Settings &current = settings.get();
+    Settings next;
+    std::vector<std::string> restart_only;
+    std::string error;
+    if (!reload_settings(flagfile, current, next, restart_only, error))
     {
-        std::cerr << "Unhandled exception: " << e.what() << std::endl;
+        std::cerr << "SIGHUP: invalid settings in " << flagfile << ": " << error << ", keeping the previous ones"
+                  << std::endl;
+        return;
     }
-    catch (...)
+
+    std::shared_ptr<net::ssl::context> tls;
+    if (!next.tls_cert.empty())
     {
-        std::cerr << "Unhandled unknown exception!" << std::endl;
+        try
+        {
+            tls = Tls::server_context(next.tls_cert, next.tls_key);
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "SIGHUP: cannot load " << next.tls_cert << ": " << e.what()
+                      << ", keeping the previous settings" << std::endl;
+            return;
+        }
     }
-    std::abort();
+
+    if (!restart_only.empty())
+    {
+        std::cerr << "SIGHUP:";
+        for (std::size_t i = 0; i < restart_only.size(); ++i)
+        {
+            std::cerr << (i == 0 ? " " : ", ") << restart_only[i];
+        }
+        std::cerr << " take effect on restart" << std::endl;
+    }
+
+    settings.set(next);
+    if (tls)
+    {
+        server.set_tls(std::move(tls));
+    }
+    apply_settings(&server);
+    if (next.workers != current.workers)
+    {
+        WorkerPool::resize(next.workers);
+    }
+    if (next.report_interval != current.report_interval)
+    {
+        report_timer.cancel();
+        schedule_report(report_timer, server);
+    }
+    std::cout << "Reloaded settings from " << flagfile << std::endl;
+}
+
+// Stops the pool once every connection has closed or the deadline has passed.
+static void wait_for_drain(net::steady_timer &timer, IoContextPool &pool, std::chrono::steady_clock::time_point deadline)
+{
+    std::size_t live = Session::live_count();
+    if (live == 0 || std::chrono::steady_clock::now() >= deadline)
+    {
+        if (live > 0)
+        {
+            std::cerr << "Drain timeout: closing " << live << " connections" << std::endl;
+        }
+        pool.stop();
+        return;
+    }
+
+    timer.expires_after(std::chrono::milliseconds(50));
+    timer.async_wait([&timer, &pool, deadline](boost::system::error_code ec) {
+        if (!ec)
+        {
+            wait_for_drain(timer, pool, deadline);
+        }
+    });
 }
 
-DEFINE_int32(port, 8080, "Server port number");
-DEFINE_string(log_dir, "./logs", "Log directory path");
+// SIGTERM/SIGINT: stop accepting, let open requests finish within --drain_timeout, exit.
+// A second one exits at once. SIGHUP reloads settings.
+static void wait_for_signal(net::signal_set &signals, Server &server, IoContextPool &pool,
+                            net::steady_timer &drain_timer, net::steady_timer &report_timer)
+{
+    signals.async_wait([&](boost::system::error_code ec, int signal) {
+        if (ec)
+            return;
+
+        if (signal == SIGHUP)
+        {
+            reload(server, report_timer);
+        }
+        else if (Session::is_draining())
+        {
+            pool.stop();
+            return;
+        }
+        else
+        {
+            std::cout << "Draining " << Session::live_count() << " connections" << std::endl;
+            server.stop_accepting();
+            Session::drain();
+            wait_for_drain(drain_timer, pool,
+                           std::chrono::steady_clock::now() + std::chrono::seconds(settings.get().drain_timeout));
+        }
+        wait_for_signal(signals, server, pool, drain_timer, report_timer);
+    });
+}
 
 int main(int argc, char *argv[])
 {
     std::set_terminate(custom_terminate_handler);
     gflags::SetUsageMessage("Usage: " + std::string(argv[0]) +
-                            " --port=<port> --log_dir=<path>\n"
+                            " --port=<port> --threads=<n> --log_dir=<path>\n"
                             "Example:\n"
                             "  " +
-                            std::string(argv[0]) + " --port=8080 --log_dir=./logs");
+                            std::string(argv[0]) + " --port=8080 --threads=4 --log_dir=./logs");
 
     try
     {
         gflags::ParseCommandLineFlags(&argc, &argv, true);
-        if (FLAGS_port <= 0 || FLAGS_log_dir.empty())
+        settings.set(Settings::from_flags());
+        const Settings &s = settings.get();
+        std::string error;
+        if (!s.valid(error))
         {
-            std::cerr << "Error: --port and --log_dir are required.\n\n";
+            std::cerr << "Error: " << error << ".\n\n";
             std::cerr << gflags::ProgramUsage();
             return 1;
         }
 
-        std::cout << "Server will start on port: " << FLAGS_port << std::endl;
-        std::cout << "Log directory: " << FLAGS_log_dir << std::endl;
+        std::size_t threads = s.threads > 0 ? s.threads : std::max(1u, std::thread::hardware_concurrency());
+
+        std::cout << "Server will start on port: " << s.port << std::endl;
+        std::cout << "IO threads: " << threads << std::endl;
+        std::cout << "Worker threads: " << (s.workers > 0 ? std::to_string(s.workers) : "auto") << std::endl;
+        std::cout << "Log directory: " << s.log_dir << std::endl;
+        std::cout << "TLS: " << (s.tls_cert.empty() ? "off" : s.tls_cert) << std::endl;
+
+        WorkerPool::configure(s.workers);
+        apply_settings(nullptr);
+        if (s.trace_sample_rate > 0)
+        {
+            Router::register_static_handler("/debug/trace", std::make_shared<trace_handler>());
+        }
+
+        IoContextPool pool(threads);
+        Server server(pool, s.port, s.reuse_port, s.max_connections);
+        if (!s.tls_cert.empty())
+        {
+            server.set_tls(Tls::server_context(s.tls_cert, s.tls_key));
+        }
+
+        net::signal_set signals(pool.get(0), SIGINT, SIGTERM, SIGHUP);
+        net::steady_timer drain_timer(pool.get(0));
+        net::steady_timer report_timer(pool.get(0));
+        wait_for_signal(signals, server, pool, drain_timer, report_timer);
+        schedule_report(report_timer, server);
 
-        net::io_context io_context;
-        Server server(io_context, FLAGS_port);
-        io_context.run();
+        pool.run();
+        WorkerPool::shutdown();
+        report_accepted(server);
     }
     catch (std::exception const &e)
     {
@@ -0,0 +1,342 @@
+#include "metrics.h"
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+constexpr std::size_t kErrorKinds = static_cast<std::size_t>(Metrics::Error::tls_handshake) + 1;
+const char *const kErrorNames[] = {"not_found", "bad_request", "read",         "write",
+                                   "too_large", "timeout",     "rate_limited", "tls_handshake"};
+static_assert(sizeof(kErrorNames) / sizeof(kErrorNames[0]) == kErrorKinds, "one name per Metrics::Error");
+
+// Upper bounds, in seconds, of the buckets exposed to Prometheus.
+const double kExposedBounds[] = {0.00001, 0.000025, 0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005,
+                                 0.01,    0.025,    0.05,    0.1,    0.25,    0.5,    1,     2.5,    5,     10};
+
+// Only the owning thread writes, so a relaxed load and store is enough and avoids a locked
+// instruction on the hot path.
+void bump(std::atomic<uint64_t> &counter, uint64_t n = 1)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+struct ThreadShard
+{
+    std::atomic<uint64_t> connections_opened{0};
+    std::atomic<uint64_t> connections_closed{0};
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> bytes_in{0};
+    std::atomic<uint64_t> bytes_out{0};
+    std::array<std::atomic<uint64_t>, kErrorKinds> errors{};
+    std::array<std::atomic<LatencyHistogram *>, Metrics::kMaxRoutes> routes{};
+    LatencyHistogram worker_queue;
+
+    LatencyHistogram &route(std::size_t id)
+    {
+        LatencyHistogram *histogram = routes[id].load(std::memory_order_acquire);
+        if (!histogram)
+        {
+            histogram = new LatencyHistogram();
+            routes[id].store(histogram, std::memory_order_release);
+        }
+        return *histogram;
+    }
+};
+
+struct Registry
+{
+    std::mutex mutex;
+    // Shards are never freed, so counts from exited threads stay in the totals.
+    std::vector<ThreadShard *> shards;
+    std::vector<std::string> route_names{"unmatched"};
+};
+
+Registry &registry()
+{
+    static Registry instance;
+    return instance;
+}
+
+ThreadShard &shard()
+{
+    thread_local ThreadShard *local = [] {
+        auto *created = new ThreadShard();
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        registry().shards.push_back(created);
+        return created;
+    }();
+    return *local;
+}
+
+uint64_t sum_over_shards(const std::vector<ThreadShard *> &shards, std::atomic<uint64_t> ThreadShard::*counter)
+{
+    uint64_t total = 0;
+    for (const ThreadShard *s: shards)
+    {
+        total += (s->*counter).load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+std::string escape_label(std::string_view value)
+{
+    std::string escaped;
+    for (char c: value)
+    {
+        if (c == '\n')
+        {
+            escaped += "\\n";
+            continue;
+        }
+        if (c == '\\' || c == '"')
+            escaped += '\\';
+        escaped += c;
+    }
+    return escaped;
+}
+
+void append(std::string &out, const char *format, ...)
+{
+    char line[512];
+    va_list args;
+    va_start(args, format);
+    int n = std::vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (n > 0)
+        out.append(line, std::min<std::size_t>(n, sizeof(line) - 1));
+}
+
+// Writes one Prometheus histogram series from the merged HDR buckets.
+void append_histogram(std::string &out, const char *name, const std::string &labels,
+                      const std::vector<const LatencyHistogram *> &parts)
+{
+    std::array<uint64_t, LatencyHistogram::kBucketCount> merged{};
+    uint64_t count = 0;
+    uint64_t sum_ns = 0;
+    for (const LatencyHistogram *h: parts)
+    {
+        for (std::size_t i = 0; i < merged.size(); ++i)
+        {
+            merged[i] += h->bucket(i);
+        }
+        count += h->count();
+        sum_ns += h->sum();
+    }
+
+    std::string bucket_labels = labels.empty() ? "" : labels + ",";
+    std::string series_labels = labels.empty() ? "" : "{" + labels + "}";
+    std::size_t index = 0;
+    uint64_t cumulative = 0;
+    for (double bound: kExposedBounds)
+    {
+        auto bound_ns = static_cast<uint64_t>(bound * 1e9);
+        while (index < merged.size() && LatencyHistogram::upper_bound(index) <= bound_ns)
+        {
+            cumulative += merged[index++];
+        }
+        append(out, "%s_bucket{%sle=\"%g\"} %llu\n", name, bucket_labels.c_str(), bound,
+               static_cast<unsigned long long>(cumulative));
+    }
+    append(out, "%s_bucket{%sle=\"+Inf\"} %llu\n", name, bucket_labels.c_str(), static_cast<unsigned long long>(count));
+    append(out, "%s_sum%s %.9f\n", name, series_labels.c_str(), sum_ns / 1e9);
+    append(out, "%s_count%s %llu\n", name, series_labels.c_str(), static_cast<unsigned long long>(count));
+}
+
+}// namespace
+
+void LatencyHistogram::record(uint64_t value)
+{
+    bump(buckets_[index_of(value)]);
+    bump(count_);
+    bump(sum_, value);
+}
+
+uint64_t LatencyHistogram::count() const
+{
+    return count_.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::sum() const
+{
+    return sum_.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::bucket(std::size_t index) const
+{
+    return buckets_[index].load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::value_at_quantile(double quantile) const
+{
+    uint64_t total = count();
+    if (total == 0)
+        return 0;
+
+    auto rank = static_cast<uint64_t>(quantile * total);
+    rank = std::min(std::max<uint64_t>(rank, 1), total);
+    uint64_t seen = 0;
+    for (std::size_t i = 0; i < kBucketCount; ++i)
+    {
+        seen += bucket(i);
+        if (seen >= rank)
+            return upper_bound(i);
+    }
+    return upper_bound(kBucketCount - 1);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &other)
+{
+    for (std::size_t i = 0; i < kBucketCount; ++i)
+    {
+        bump(buckets_[i], other.bucket(i));
+    }
+    bump(count_, other.count());
+    bump(sum_, other.sum());
+}
+
+std::size_t LatencyHistogram::index_of(uint64_t value)
+{
+    if (value < kSubBuckets)
+        return value;
+
+    std::size_t msb = 63 - __builtin_clzll(value);
+    std::size_t sub = (value >> (msb - 2)) & (kSubBuckets - 1);
+    return (msb - 1) * kSubBuckets + sub;
+}
+
+uint64_t LatencyHistogram::upper_bound(std::size_t index)
+{
+    if (index < kSubBuckets)
+        return index;
+
+    std::size_t msb = index / kSubBuckets + 1;
+    uint64_t width = uint64_t(1) << (msb - 2);
+    uint64_t lower = (kSubBuckets + index % kSubBuckets) * width;
+    return lower + (width - 1);
+}
+
+std::size_t Metrics::register_route(std::string_view name)
+{
+    auto &reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    if (reg.route_names.size() >= kMaxRoutes)
+        return kUnmatchedRoute;
+
+    reg.route_names.emplace_back(name);
+    return reg.route_names.size() - 1;
+}
+
+std::string Metrics::route_name(std::size_t route)
+{
+    auto &reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    return route < reg.route_names.size() ? reg.route_names[route] : reg.route_names[kUnmatchedRoute];
+}
+
+void Metrics::connection_opened()
+{
+    bump(shard().connections_opened);
+}
+
+void Metrics::connection_closed()
+{
+    bump(shard().connections_closed);
+}
+
+void Metrics::request(std::size_t route, std::chrono::nanoseconds latency)
+{
+    ThreadShard &s = shard();
+    bump(s.requests);
+    s.route(route < kMaxRoutes ? route : kUnmatchedRoute).record(latency.count());
+}
+
+void Metrics::worker_queued(std::chrono::nanoseconds wait)
+{
+    shard().worker_queue.record(wait.count());
+}
+
+void Metrics::error(Error kind)
+{
+    bump(shard().errors[static_cast<std::size_t>(kind)]);
+}
+
+void Metrics::bytes_in(std::size_t bytes)
+{
+    bump(shard().bytes_in, bytes);
+}
+
+void Metrics::bytes_out(std::size_t bytes)
+{
+    bump(shard().bytes_out, bytes);
+}
+
+void Metrics::render_prometheus(std::string &out)
+{
+    auto &reg = registry();
+    std::vector<ThreadShard *> shards;
+    std::vector<std::string> route_names;
+    {
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        shards = reg.shards;
+        route_names = reg.route_names;
+    }
+
+    uint64_t opened = sum_over_shards(shards, &ThreadShard::connections_opened);
+    uint64_t closed = sum_over_shards(shards, &ThreadShard::connections_closed);
+
+    out += "# HELP asio_connections_total Connections accepted.\n# TYPE asio_connections_total counter\n";
+    append(out, "asio_connections_total %llu\n", static_cast<unsigned long long>(opened));
+    out += "# HELP asio_connections_active Connections currently open.\n# TYPE asio_connections_active gauge\n";
+    append(out, "asio_connections_active %lld\n", static_cast<long long>(opened - closed));
+    out += "# HELP asio_requests_total Requests answered.\n# TYPE asio_requests_total counter\n";
+    append(out, "asio_requests_total %llu\n",
+           static_cast<unsigned long long>(sum_over_shards(shards, &ThreadShard::requests)));
+    out += "# HELP asio_bytes_received_total Request bytes parsed.\n# TYPE asio_bytes_received_total counter\n";
+    append(out, "asio_bytes_received_total %llu\n",
+           static_cast<unsigned long long>(sum_over_shards(shards, &ThreadShard::bytes_in)));
+    out += "# HELP asio_bytes_sent_total Response bytes written.\n# TYPE asio_bytes_sent_total counter\n";
+    append(out, "asio_bytes_sent_total %llu\n",
+           static_cast<unsigned long long>(sum_over_shards(shards, &ThreadShard::bytes_out)));
+
+    out += "# HELP asio_errors_total Failed requests and connection errors by kind.\n"
+           "# TYPE asio_errors_total counter\n";
+    for (std::size_t kind = 0; kind < kErrorKinds; ++kind)
+    {
+        uint64_t total = 0;
+        for (const ThreadShard *s: shards)
+        {
+            total += s->errors[kind].load(std::memory_order_relaxed);
+        }
+        append(out, "asio_errors_total{kind=\"%s\"} %llu\n", kErrorNames[kind], static_cast<unsigned long long>(total));
+    }
+
+    out += "# HELP asio_request_duration_seconds Time from a parsed request to its ready response.\n"
+           "# TYPE asio_request_duration_seconds histogram\n";
+    for (std::size_t route = 0; route < route_names.size(); ++route)
+    {
+        std::vector<const LatencyHistogram *> parts;
+        for (const ThreadShard *s: shards)
+        {
+            if (const LatencyHistogram *h = s->routes[route].load(std::memory_order_acquire))
+                parts.push_back(h);
+        }
+        if (!parts.empty())
+        {
+            append_histogram(out, "asio_request_duration_seconds",
+                             "route=\"" + escape_label(route_names[route]) + "\"", parts);
+        }
+    }
+
+    out += "# HELP asio_worker_queue_seconds Time handlers waited for a worker thread.\n"
+           "# TYPE asio_worker_queue_seconds histogram\n";
+    std::vector<const LatencyHistogram *> queue_parts;
+    for (const ThreadShard *s: shards)
+    {
+        queue_parts.push_back(&s->worker_queue);
+    }
+    append_histogram(out, "asio_worker_queue_seconds", "", queue_parts);
+}
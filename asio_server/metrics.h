@@ -0,0 +1,78 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Log-linear latency histogram in the style of HdrHistogram: four sub-buckets per power of
+// two, so a recorded value is off by at most 25%. Only the owning thread records, with
+// plain relaxed stores; any thread may read it concurrently.
+class LatencyHistogram
+{
+public:
+    static constexpr std::size_t kSubBuckets = 4;
+    // Values 0-3 get a bucket each, then every power of two from 2^2 to 2^63 gets four.
+    static constexpr std::size_t kBucketCount = 63 * kSubBuckets;
+
+    void record(uint64_t value);
+
+    uint64_t count() const;
+    uint64_t sum() const;
+    uint64_t bucket(std::size_t index) const;
+    // Upper bound of the bucket holding the given quantile (0..1); 0 if nothing was recorded.
+    uint64_t value_at_quantile(double quantile) const;
+    // Adds another histogram's counts; only the owning thread may call this.
+    void merge(const LatencyHistogram &other);
+
+    static std::size_t index_of(uint64_t value);
+    // Largest value that falls into bucket `index`.
+    static uint64_t upper_bound(std::size_t index);
+
+private:
+    std::array<std::atomic<uint64_t>, kBucketCount> buckets_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_{0};
+};
+
+// Server-wide counters and per-route latency histograms. Every thread records into its own
+// shard without locks or read-modify-write instructions; render_prometheus() sums the
+// shards when /metrics is scraped.
+class Metrics
+{
+public:
+    enum class Error
+    {
+        not_found,
+        bad_request,
+        read,
+        write,
+        too_large,
+        timeout,
+        rate_limited,
+        // Last: metrics.cpp counts the kinds from it.
+        tls_handshake,
+    };
+
+    static constexpr std::size_t kMaxRoutes = 256;
+    // Requests that matched no route are recorded under this id.
+    static constexpr std::size_t kUnmatchedRoute = 0;
+
+    // Returns the id to record requests for `name` (a static path or a route template).
+    static std::size_t register_route(std::string_view name);
+    // The name `route` was registered under.
+    static std::string route_name(std::size_t route);
+
+    static void connection_opened();
+    static void connection_closed();
+    static void request(std::size_t route, std::chrono::nanoseconds latency);
+    static void worker_queued(std::chrono::nanoseconds wait);
+    static void error(Error kind);
+    static void bytes_in(std::size_t bytes);
+    static void bytes_out(std::size_t bytes);
+
+    // Appends every metric in the Prometheus text exposition format.
+    static void render_prometheus(std::string &out);
+};
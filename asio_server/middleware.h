@@ -1,17 +1,43 @@
 #pragma once
 
 #include "req_context.h"
+#include "response.h"
+#include "response_cache.h"
 #include <boost/beast/http.hpp>
 #include <functional>
 #include <memory>
 
 namespace http = boost::beast::http;
 
+// A step in an ApiHandler's chain. Call `next` to continue with the following middleware
+// and finally the handler; it may be called later, e.g. from the completion handler of an
+// async lookup, and the event loop keeps serving other connections meanwhile. Dropping
+// every copy of `next` without calling it ends the chain and sends `res` as it is.
 class Middleware
 {
 public:
     virtual ~Middleware() = default;
-    virtual void operator()(const ReqContext &ctxt, http::response<http::string_body> &res,
-                            std::function<void()> next) = 0;
+    virtual void operator()(const ReqContext &ctxt, Response &res, std::function<void()> next) = 0;
+
+    // Names this step's span in a traced request; must outlive the process, like a literal.
+    virtual const char *span_name() const
+    {
+        return "middleware";
+    }
+
+    // Called once the response is complete, in reverse order of use() and also when the chain
+    // was ended early, just before it is sent. It runs on the connection's io thread, even
+    // when the handler runs on the WorkerPool. `cached` is set when the handler's response
+    // cache will send pre-serialized bytes instead of `res`; a middleware may replace it.
+    virtual void on_response(const ReqContext &, Response &, CachedResponsePtr &) {}
+
+    // When true, on_response is called on the WorkerPool thread instead, right after
+    // handle_request, for handlers that run there; CPU-heavy response work then stays off
+    // the io thread. It only sees `res` (`cached` is null), runs before the on_response of
+    // the other middleware, and is skipped if the chain ends before the handler.
+    virtual bool response_on_worker() const
+    {
+        return false;
+    }
 };
 typedef std::shared_ptr<Middleware> MiddlewarePtr;
\ No newline at end of file
@@ -0,0 +1,163 @@
+#include "rate_limiter.h"
+#include "metrics.h"
+#include "reloadable.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+namespace {
+
+Reloadable<RateLimiter::Options> &global_options()
+{
+    static Reloadable<RateLimiter::Options> options;
+    return options;
+}
+
+// splitmix64's finalizer: spreads client keys that differ in a few bits, such as
+// neighbouring IPv4 addresses, over shards and slots.
+std::uint64_t mix(std::uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+}// namespace
+
+RateLimiter::RateLimiter() : own_options_(false), slots_(new Slot[kShards * kSlotsPerShard]) {}
+
+RateLimiter::RateLimiter(const Options &options)
+    : options_(options), own_options_(true), slots_(new Slot[kShards * kSlotsPerShard])
+{
+}
+
+RateLimiter::RateLimiter(double rate, double burst) : RateLimiter(Options{rate, burst, {}}) {}
+
+RateLimiter::~RateLimiter() = default;
+
+void RateLimiter::configure(const Options &options)
+{
+    global_options().set(options);
+}
+
+const RateLimiter::Options &RateLimiter::defaults()
+{
+    return global_options().get();
+}
+
+const RateLimiter::Options &RateLimiter::options() const
+{
+    return own_options_ ? options_ : global_options().get();
+}
+
+std::uint64_t RateLimiter::key_of(const ReqContext &ctxt) const
+{
+    std::uint64_t key;
+    const std::string &header = options().key_header;
+    std::string_view value = header.empty() ? std::string_view() : ctxt.header(header);
+    if (!value.empty())
+    {
+        key = mix(std::hash<std::string_view>{}(value));
+    }
+    else if (ctxt.remote_address().is_v4())
+    {
+        key = mix(ctxt.remote_address().to_v4().to_uint());
+    }
+    else
+    {
+        auto bytes = ctxt.remote_address().to_v6().to_bytes();
+        key = mix(std::hash<std::string_view>{}(
+                std::string_view(reinterpret_cast<const char *>(bytes.data()), bytes.size())));
+    }
+    return key ? key : 1;
+}
+
+// The home slot's shard is picked by the top bits of the key and the slot by the bottom
+// bits; probing stays inside the shard. A racing claim of the same empty slot by two new
+// clients is settled by the compare-and-swap on `key`. A stale slot taken over keeps its
+// `full_at`, which is already in the past and so reads as a full bucket for the new owner.
+RateLimiter::Slot *RateLimiter::find_slot(std::uint64_t key, std::int64_t now)
+{
+    Slot *shard = &slots_[(key >> 58) % kShards * kSlotsPerShard];
+    std::size_t home = key % kSlotsPerShard;
+    Slot *stale = nullptr;
+    for (std::size_t i = 0; i < kMaxProbe; ++i)
+    {
+        Slot &slot = shard[(home + i) % kSlotsPerShard];
+        std::uint64_t owner = slot.key.load(std::memory_order_acquire);
+        if (owner == key)
+            return &slot;
+        if (owner == 0)
+        {
+            if (slot.key.compare_exchange_strong(owner, key, std::memory_order_acq_rel) || owner == key)
+                return &slot;
+        }
+        if (!stale && slot.full_at.load(std::memory_order_relaxed) <= now)
+        {
+            stale = &slot;
+        }
+    }
+
+    if (stale)
+    {
+        std::uint64_t owner = stale->key.load(std::memory_order_relaxed);
+        if (stale->full_at.load(std::memory_order_relaxed) <= now &&
+            stale->key.compare_exchange_strong(owner, key, std::memory_order_acq_rel))
+            return stale;
+    }
+    return nullptr;
+}
+
+bool RateLimiter::try_acquire(std::uint64_t key, std::chrono::steady_clock::time_point now,
+                              std::chrono::nanoseconds &retry_after)
+{
+    const Options &opts = options();
+    if (opts.rate <= 0)
+        return true;
+
+    // Every request pushes full_at one interval later; a request that would push it more
+    // than a whole bucket beyond now finds the bucket empty.
+    auto interval = static_cast<std::int64_t>(1e9 / opts.rate);
+    auto capacity = static_cast<std::int64_t>(interval * std::max(opts.burst, 1.0));
+    std::int64_t t = std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count();
+
+    Slot *slot = find_slot(key, t);
+    // Every slot near the key's home is in active use: let the client through rather
+    // than penalise it for the table being full.
+    if (!slot)
+        return true;
+
+    std::int64_t full_at = slot->full_at.load(std::memory_order_relaxed);
+    while (true)
+    {
+        std::int64_t next = std::max(full_at, t) + interval;
+        if (next - t > capacity)
+        {
+            retry_after = std::chrono::nanoseconds(next - t - capacity);
+            return false;
+        }
+        if (slot->full_at.compare_exchange_weak(full_at, next, std::memory_order_relaxed))
+            return true;
+    }
+}
+
+void RateLimiter::operator()(const ReqContext &ctxt, Response &res, std::function<void()> next)
+{
+    std::chrono::nanoseconds retry_after{0};
+    if (try_acquire(key_of(ctxt), std::chrono::steady_clock::now(), retry_after))
+    {
+        next();
+        return;
+    }
+
+    Metrics::error(Metrics::Error::rate_limited);
+    res.result(http::status::too_many_requests);
+    res.set(http::field::retry_after,
+            std::to_string(static_cast<long long>(std::ceil(std::chrono::duration<double>(retry_after).count()))));
+    res.set(http::field::content_type, "text/plain");
+    res.body() = "Too Many Requests";
+    res.prepare_payload();
+}
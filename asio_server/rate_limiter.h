@@ -0,0 +1,75 @@
+#pragma once
+
+#include "middleware.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Answers 429 Too Many Requests, without running the handler, once a client has used up its
+// token bucket: `burst` requests at once, refilled at `rate` per second. Clients are keyed
+// by remote address, or by the value of Options::key_header when the request carries it.
+//
+// Buckets live in a fixed table split into kShards open-addressed shards. Each slot is a
+// client key hash and one atomic timestamp (the GCRA form of a token bucket: the time at
+// which the bucket would be full again), so taking a token is a single compare-and-swap
+// and no request ever takes a lock. A slot whose bucket has refilled completely holds no
+// state worth keeping and is handed to the next new client that probes it.
+class RateLimiter : public Middleware
+{
+public:
+    struct Options
+    {
+        // Tokens added per second; 0 turns limiting off.
+        double rate = 100;
+        // Bucket size: requests a client may send at once after being idle.
+        double burst = 100;
+        // Keys clients by this header (e.g. an API key) when present instead of their address.
+        std::string key_header;
+    };
+
+    static constexpr std::size_t kShards = 64;
+    static constexpr std::size_t kSlotsPerShard = 4096;
+    // Slots tried from a key's home slot before the client is let through untracked.
+    static constexpr std::size_t kMaxProbe = 8;
+
+    // Uses the process-wide options from configure(), read on every request.
+    RateLimiter();
+    explicit RateLimiter(const Options &options);
+    RateLimiter(double rate, double burst);
+    ~RateLimiter() override;
+
+    // Sets the options of every RateLimiter built without its own; safe while serving.
+    static void configure(const Options &options);
+    static const Options &defaults();
+
+    // Takes a token for `key` at `now`. On refusal, `retry_after` is how long until the
+    // next token is available.
+    bool try_acquire(std::uint64_t key, std::chrono::steady_clock::time_point now,
+                     std::chrono::nanoseconds &retry_after);
+
+    // The bucket key for a request; never 0.
+    std::uint64_t key_of(const ReqContext &ctxt) const;
+
+    void operator()(const ReqContext &ctxt, Response &res, std::function<void()> next) override;
+    const char *span_name() const override
+    {
+        return "rate_limiter";
+    }
+
+private:
+    struct Slot
+    {
+        std::atomic<std::uint64_t> key{0};
+        // Nanoseconds since the steady_clock epoch at which the bucket is full again.
+        std::atomic<std::int64_t> full_at{0};
+    };
+
+    const Options &options() const;
+    Slot *find_slot(std::uint64_t key, std::int64_t now);
+
+    Options options_;
+    bool own_options_;
+    std::unique_ptr<Slot[]> slots_;
+};
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// A process-wide setting that can be replaced (e.g. on SIGHUP) while io threads read it.
+// get() is a single acquire load of a pointer to an immutable snapshot. Every snapshot is
+// kept until exit, so a reference taken before a replacement never dangles; settings are
+// replaced a handful of times per process, which keeps that cheap.
+template<typename T>
+class Reloadable
+{
+public:
+    Reloadable()
+    {
+        set(T{});
+    }
+    Reloadable(const Reloadable &) = delete;
+    Reloadable &operator=(const Reloadable &) = delete;
+
+    const T &get() const
+    {
+        return *current_.load(std::memory_order_acquire);
+    }
+
+    void set(const T &value)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        snapshots_.push_back(std::make_unique<const T>(value));
+        current_.store(snapshots_.back().get(), std::memory_order_release);
+    }
+
+private:
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<const T>> snapshots_;
+    std::atomic<const T *> current_{nullptr};
+};
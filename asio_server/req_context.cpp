@@ -1,103 +1,121 @@
 #include "req_context.h"
-#include <regex>
+#include <algorithm>
 
-static std::string url_decode(const std::string &str)
+static int hex_value(char c)
 {
-    std::string ret;
-    ret.reserve(str.size());
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
 
-    for (size_t i = 0; i < str.size(); ++i)
+// Percent- and '+'-decodes [data, data + size) in place and returns the decoded length.
+// A '%' that is not followed by two hex digits is kept as is.
+static std::size_t url_decode(char *data, std::size_t size)
+{
+    std::size_t out = 0;
+    for (std::size_t i = 0; i < size; ++i)
     {
-        if (str[i] == '%')
+        char c = data[i];
+        if (c == '%' && i + 2 < size)
         {
-            if (i + 2 < str.size())
+            int hi = hex_value(data[i + 1]);
+            int lo = hex_value(data[i + 2]);
+            if (hi >= 0 && lo >= 0)
             {
-                try
-                {
-                    int value = std::stoi(str.substr(i + 1, 2), nullptr, 16);
-                    ret += static_cast<char>(value);
-                    i += 2;
-                }
-                catch (const std::exception &)
-                {
-                    ret += '%';
-                }
-            }
-            else
-            {
-                ret += '%';
+                c = static_cast<char>(hi * 16 + lo);
+                i += 2;
             }
         }
-        else if (str[i] == '+')
+        else if (c == '+')
         {
-            ret += ' ';
-        }
-        else
-        {
-            ret += str[i];
+            c = ' ';
         }
+        data[out++] = c;
     }
+    return out;
+}
 
-    return ret;
+static bool is_word_char(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
 }
 
-void ReqContext::parse_query_(const std::string &query)
+// "ids[]" and "ids[3]" both name the array "ids"; any other key is used unchanged.
+static std::string_view strip_index(std::string_view key)
 {
-    query_params_.clear();
-    std::istringstream iss(query);
-    std::string pair;
+    std::size_t word = 0;
+    while (word < key.size() && is_word_char(key[word])) ++word;
+    if (word == 0 || word == key.size())
+        return key;
+
+    if (key[word] != '[' || key.back() != ']')
+        return key;
+    for (std::size_t i = word + 1; i + 1 < key.size(); ++i)
+    {
+        if (key[i] < '0' || key[i] > '9')
+            return key;
+    }
+    return key.substr(0, word);
+}
 
-    std::regex re_index(R"((\w+)(\[\d*\]|\[\])?)");
+// Single pass over the query string. Keys and values are views into query_buffer_, which
+// holds the query decoded in place, so the only allocations are that copy and the map.
+void ReqContext::parse_query_(std::string_view query) const
+{
+    query_params_.clear();
+    query_buffer_.assign(query.data(), query.size());
 
-    while (std::getline(iss, pair, '&'))
+    char *data = query_buffer_.data();
+    std::size_t size = query_buffer_.size();
+    std::size_t pos = 0;
+    while (pos < size)
     {
-        if (pair.empty())
-            continue;
+        std::size_t amp = std::string_view(data + pos, size - pos).find('&');
+        std::size_t pair_end = amp == std::string_view::npos ? size : pos + amp;
 
-        auto pos = pair.find('=');
-        std::string key, value;
-        if (pos != std::string::npos)
-        {
-            key = pair.substr(0, pos);
-            value = pair.substr(pos + 1);
-        }
-        else
+        if (pair_end > pos)
         {
-            key = pair;
-            value = "";
-        }
+            std::string_view pair(data + pos, pair_end - pos);
+            std::size_t eq = pair.find('=');
+            std::size_t key_size = eq == std::string_view::npos ? pair.size() : eq;
+            char *value_data = data + pos + key_size + (eq == std::string_view::npos ? 0 : 1);
+            std::size_t value_size = eq == std::string_view::npos ? 0 : pair.size() - eq - 1;
 
-        key = url_decode(key);
-        value = url_decode(value);
+            std::string_view key = strip_index({data + pos, url_decode(data + pos, key_size)});
+            std::string_view value(value_data, url_decode(value_data, value_size));
 
-        std::smatch m;
-        if (std::regex_match(key, m, re_index))
-        {
-            key = m[1];
+            std::vector<std::string_view> *values = nullptr;
+            while (!value.empty())
+            {
+                std::size_t comma = value.find(',');
+                std::string_view item = value.substr(0, comma);
+                if (!item.empty())
+                {
+                    if (!values)
+                        values = &query_params_[key];
+                    values->push_back(item);
+                }
+                value = comma == std::string_view::npos ? std::string_view() : value.substr(comma + 1);
+            }
         }
 
-        std::istringstream vs(value);
-        std::string v;
-        while (std::getline(vs, v, ','))
-        {
-            if (!v.empty())
-                query_params_[key].push_back(v);
-        }
+        pos = pair_end + 1;
     }
 }
 
+ReqContext::ReqContext(const Request &req) : req_(req) {}
 
-ReqContext::ReqContext(const http::request<http::string_body> &req_) : req_(req_)
-{
-    parse_query_(query_path());
-}
-
-void ReqContext::set_path_params(const std::unordered_map<std::string, std::string> &params)
+void ReqContext::set_path_params(const PathParam *params, std::size_t count)
 {
-    path_params_ = params;
+    path_param_count_ = std::min(count, kMaxPathParams);
+    std::copy(params, params + path_param_count_, path_params_.begin());
 }
 
-const http::request<http::string_body> &ReqContext::raw_req() const
+const Request &ReqContext::raw_req() const
 {
     return req_;
 }
@@ -107,60 +125,117 @@ http::verb ReqContext::method() const
     return req_.method();
 }
 
-std::string ReqContext::method_string() const
+std::string_view ReqContext::method_string() const
 {
-    return req_.method_string();
+    return to_string_view(req_.method_string());
 }
 
-
-std::string ReqContext::header(const std::string &key) const
+std::string_view ReqContext::header(std::string_view key) const
 {
-    auto it = req_.find(key);
+    auto it = req_.find(boost::beast::string_view(key.data(), key.size()));
     if (it != req_.end())
-        return it->value();
+        return to_string_view(it->value());
     return {};
 }
 
-std::string ReqContext::header(http::field key) const
+std::string_view ReqContext::header(http::field key) const
 {
     auto it = req_.find(key);
     if (it != req_.end())
-        return it->value();
+        return to_string_view(it->value());
     return {};
 }
 
-std::string ReqContext::body() const
+std::string_view ReqContext::body() const
 {
     return req_.body();
 }
 
-std::string ReqContext::query_path() const
+std::string_view ReqContext::target() const
 {
-    std::string target = req_.target();
+    return to_string_view(req_.target());
+}
+
+std::string_view ReqContext::query_path() const
+{
+    std::string_view target = this->target();
     auto pos = target.find('?');
-    if (pos != std::string::npos)
+    if (pos != std::string_view::npos)
         return target.substr(pos + 1);
     return {};
 }
 
-std::unordered_map<std::string, std::vector<std::string>> ReqContext::query_params() const
+const ReqContext::QueryParams &ReqContext::query_params() const
 {
+    if (!query_parsed_)
+    {
+        parse_query_(query_path());
+        query_parsed_ = true;
+    }
     return query_params_;
 }
 
-std::string ReqContext::path_param(const std::string &key) const
+std::string_view ReqContext::path_param(std::string_view key) const
 {
-    if (has_path_param(key))
-        return path_params().at(key);
+    for (std::size_t i = 0; i < path_param_count_; ++i)
+    {
+        if (path_params_[i].name == key)
+            return path_params_[i].value;
+    }
     return {};
 }
 
-bool ReqContext::has_path_param(const std::string &key) const
+bool ReqContext::has_path_param(std::string_view key) const
+{
+    for (std::size_t i = 0; i < path_param_count_; ++i)
+    {
+        if (path_params_[i].name == key)
+            return true;
+    }
+    return false;
+}
+
+PathParams ReqContext::path_params() const
+{
+    return {path_params_.data(), path_param_count_};
+}
+
+BodySink *ReqContext::body_sink() const
+{
+    return body_sink_.get();
+}
+
+void ReqContext::set_body_sink(std::unique_ptr<BodySink> sink)
+{
+    body_sink_ = std::move(sink);
+}
+
+const boost::asio::ip::address &ReqContext::remote_address() const
+{
+    return remote_address_;
+}
+
+void ReqContext::set_remote_address(const boost::asio::ip::address &address)
+{
+    remote_address_ = address;
+}
+
+const boost::asio::any_io_executor &ReqContext::executor() const
+{
+    return executor_;
+}
+
+void ReqContext::set_executor(const boost::asio::any_io_executor &executor)
+{
+    executor_ = executor;
+}
+
+std::uint64_t ReqContext::trace_id() const
 {
-    return path_params().find(key) != path_params().end();
+    return trace_id_;
 }
 
-std::unordered_map<std::string, std::string> ReqContext::path_params() const
+void ReqContext::set_trace_id(std::uint64_t trace)
 {
-    return path_params_;
+    trace_id_ = trace;
 }
\ No newline at end of file
@@ -1,34 +1,129 @@
 #pragma once
 
+#include "body_stream.h"
+#include "resource_allocator.h"
+#include <array>
+#include <boost/asio/any_io_executor.hpp>
+#include <boost/asio/ip/address.hpp>
 #include <boost/beast/http.hpp>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
 namespace http = boost::beast::http;
 
+// Beast's string_view only converts to std::string_view implicitly from Boost 1.81 on.
+inline std::string_view to_string_view(boost::beast::string_view sv)
+{
+    return {sv.data(), sv.size()};
+}
+
+// Header fields of a request allocate from a memory resource, so that Session can keep them
+// in a pool of its own; a default-constructed Request uses the heap as usual.
+using RequestFields = http::basic_fields<ResourceAllocator<char>>;
+using Request = http::request<http::string_body, RequestFields>;
+
+// A path parameter captured while routing. `name` points into the router and `value`
+// into the request target, so both stay valid for as long as the request does.
+struct PathParam
+{
+    std::string_view name;
+    std::string_view value;
+};
+
+// Read-only view of the path parameters captured for a request.
+class PathParams
+{
+public:
+    PathParams(const PathParam *data, std::size_t size) : data_(data), size_(size) {}
+
+    const PathParam *begin() const
+    {
+        return data_;
+    }
+    const PathParam *end() const
+    {
+        return data_ + size_;
+    }
+    std::size_t size() const
+    {
+        return size_;
+    }
+    bool empty() const
+    {
+        return size_ == 0;
+    }
+
+private:
+    const PathParam *data_;
+    std::size_t size_;
+};
+
+// A view over the request parsed by Session. Nothing is copied: headers, body, target and
+// path parameters are returned as string_views into the borrowed request, which must
+// outlive the context. The query string is only decoded the first time it is asked for,
+// into a buffer owned by the context that the query parameter views point into.
 class ReqContext
 {
-    http::request<http::string_body> req_;
-    std::unordered_map<std::string, std::string> path_params_;
-    std::unordered_map<std::string, std::vector<std::string>> query_params_;
+public:
+    static constexpr std::size_t kMaxPathParams = 8;
+    using QueryParams = std::unordered_map<std::string_view, std::vector<std::string_view>>;
+
+private:
+    const Request &req_;
+    std::array<PathParam, kMaxPathParams> path_params_;
+    std::size_t path_param_count_ = 0;
+    mutable std::string query_buffer_;
+    mutable QueryParams query_params_;
+    mutable bool query_parsed_ = false;
+    std::unique_ptr<BodySink> body_sink_;
+    boost::asio::ip::address remote_address_;
+    boost::asio::any_io_executor executor_;
+    std::uint64_t trace_id_ = 0;
 
 public:
-    ReqContext(const http::request<http::string_body> &req);
-    void set_path_params(const std::unordered_map<std::string, std::string> &params);
+    explicit ReqContext(const Request &req);
+    ReqContext(const ReqContext &) = delete;
+    ReqContext &operator=(const ReqContext &) = delete;
+
+    void set_path_params(const PathParam *params, std::size_t count);
 
-    const http::request<http::string_body> &raw_req() const;
+    const Request &raw_req() const;
+
+    // Address of the connected client, as seen by the socket (not X-Forwarded-For).
+    const boost::asio::ip::address &remote_address() const;
+    void set_remote_address(const boost::asio::ip::address &address);
+
+    // The connection's executor: work posted there runs on its io thread, in order with
+    // the session's own handlers.
+    const boost::asio::any_io_executor &executor() const;
+    void set_executor(const boost::asio::any_io_executor &executor);
+
+    // Non-zero when the request is traced; see Trace.
+    std::uint64_t trace_id() const;
+    void set_trace_id(std::uint64_t trace);
 
     http::verb method() const;
-    std::string method_string() const;
+    std::string_view method_string() const;
+
+    std::string_view header(std::string_view key) const;
+    std::string_view header(http::field key) const;
+    std::string_view body() const;
+    std::string_view target() const;
+    std::string_view query_path() const;
+    const QueryParams &query_params() const;
 
-    std::string header(const std::string &key) const;
-    std::string header(http::field key) const;
-    std::string body() const;
-    std::string query_path() const;
-    std::unordered_map<std::string, std::vector<std::string>> query_params() const;
+    std::string_view path_param(std::string_view key) const;
+    bool has_path_param(std::string_view key) const;
+    PathParams path_params() const;
 
-    std::string path_param(const std::string &key) const;
-    bool has_path_param(const std::string &key) const;
-    std::unordered_map<std::string, std::string> path_params() const;
+    // The sink a streamed request body was written to; null unless the handler streams
+    // request bodies (then body() is empty).
+    BodySink *body_sink() const;
+    void set_body_sink(std::unique_ptr<BodySink> sink);
 
 private:
-    void parse_query_(const std::string &query);
-};
\ No newline at end of file
+    void parse_query_(std::string_view query) const;
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <type_traits>
+
+// Allocates from a std::pmr::memory_resource, like std::pmr::polymorphic_allocator, but can
+// be assigned, which Beast's basic_fields requires. Moving a container moves its resource
+// along; copying or copy-assigning one allocates the copy from the heap (or keeps the
+// target's resource), so a copy never points into memory owned by someone else.
+template<typename T>
+class ResourceAllocator
+{
+public:
+    using value_type = T;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_copy_assignment = std::false_type;
+    using propagate_on_container_swap = std::true_type;
+
+    ResourceAllocator() noexcept = default;
+    ResourceAllocator(std::pmr::memory_resource *resource) noexcept : resource_(resource) {}
+    template<typename U>
+    ResourceAllocator(const ResourceAllocator<U> &other) noexcept : resource_(other.resource())
+    {
+    }
+
+    T *allocate(std::size_t n)
+    {
+        return static_cast<T *>(resource_->allocate(n * sizeof(T), alignof(T)));
+    }
+    void deallocate(T *p, std::size_t n) noexcept
+    {
+        resource_->deallocate(p, n * sizeof(T), alignof(T));
+    }
+
+    ResourceAllocator select_on_container_copy_construction() const noexcept
+    {
+        return {};
+    }
+
+    std::pmr::memory_resource *resource() const noexcept
+    {
+        return resource_;
+    }
+
+private:
+    std::pmr::memory_resource *resource_ = std::pmr::new_delete_resource();
+};
+
+template<typename T, typename U>
+bool operator==(const ResourceAllocator<T> &a, const ResourceAllocator<U> &b) noexcept
+{
+    return a.resource() == b.resource();
+}
+
+template<typename T, typename U>
+bool operator!=(const ResourceAllocator<T> &a, const ResourceAllocator<U> &b) noexcept
+{
+    return !(a == b);
+}
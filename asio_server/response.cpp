@@ -0,0 +1,44 @@
+#include "response.h"
+
+void Response::stream_body(BodyProducer producer)
+{
+    body_producer_ = std::move(producer);
+}
+
+const BodyProducer &Response::body_producer() const
+{
+    return body_producer_;
+}
+
+void Response::send_file(OpenFilePtr file, std::uint64_t offset, std::uint64_t length)
+{
+    file_range_ = {std::move(file), offset, length};
+}
+
+const FileRange &Response::file_range() const
+{
+    return file_range_;
+}
+
+std::shared_ptr<EventStream> Response::stream_events(const boost::asio::any_io_executor &executor)
+{
+    event_stream_ = std::make_shared<EventStream>(executor);
+    return event_stream_;
+}
+
+const std::shared_ptr<EventStream> &Response::event_stream() const
+{
+    return event_stream_;
+}
+
+bool Response::streams_body() const
+{
+    return body_producer_ || file_range_.file || event_stream_;
+}
+
+void Response::clear_body_source()
+{
+    body_producer_ = nullptr;
+    file_range_ = {};
+    event_stream_.reset();
+}
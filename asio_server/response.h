@@ -0,0 +1,58 @@
+#pragma once
+
+#include "body_stream.h"
+#include "file_cache.h"
+#include <boost/asio/any_io_executor.hpp>
+#include <boost/beast/http.hpp>
+#include <cstdint>
+#include <memory>
+
+namespace http = boost::beast::http;
+
+// Part of an open file sent as a response body; see Response::send_file().
+struct FileRange
+{
+    OpenFilePtr file;
+    std::uint64_t offset = 0;
+    std::uint64_t length = 0;
+};
+
+// The response a handler and its middleware fill in. Besides the message itself, it says
+// where the body comes from when it is not body(): a producer, a file or a stream of
+// events. Session reads that once the handler has finished. ReqContext, the request side,
+// stays read-only.
+class Response : public http::response<http::string_body>
+{
+public:
+    using http::response<http::string_body>::message;
+
+    // Sends the body from `producer` instead of body(), with chunked transfer encoding (or
+    // until close for HTTP/1.0), so it never has to be held in memory whole. The producer
+    // is called on the connection's io thread after the handler has finished.
+    void stream_body(BodyProducer producer);
+    const BodyProducer &body_producer() const;
+
+    // Sends `length` bytes of `file` from `offset` as the body instead of body(). Session
+    // sets Content-Length and, on plain TCP on Linux, copies the bytes with sendfile(2) so
+    // they never pass through userspace; over TLS, which has to encrypt them, or without
+    // sendfile(2), they are read with pread(2) in chunks and written like a streamed body.
+    void send_file(OpenFilePtr file, std::uint64_t offset, std::uint64_t length);
+    const FileRange &file_range() const;
+
+    // Makes the response a text/event-stream whose body is the returned stream: events
+    // delivered to it, directly or by subscribing it to an EventHub topic, are written as
+    // they arrive until it is ended. `executor` is the connection's (ReqContext::executor());
+    // the connection serves nothing else meanwhile.
+    std::shared_ptr<EventStream> stream_events(const boost::asio::any_io_executor &executor);
+    const std::shared_ptr<EventStream> &event_stream() const;
+
+    // True when the body is sent by one of the above rather than from body().
+    bool streams_body() const;
+    // Back to a body() response, for Session to reuse the object.
+    void clear_body_source();
+
+private:
+    BodyProducer body_producer_;
+    FileRange file_range_;
+    std::shared_ptr<EventStream> event_stream_;
+};
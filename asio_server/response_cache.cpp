@@ -0,0 +1,131 @@
+#include "response_cache.h"
+#include <atomic>
+#include <boost/beast/core.hpp>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <unordered_map>
+
+namespace {
+
+using TargetMap = std::map<std::string, CachedResponsePtr, std::less<>>;
+
+std::unordered_map<uint64_t, TargetMap> &thread_store()
+{
+    thread_local std::unordered_map<uint64_t, TargetMap> store;
+    return store;
+}
+
+std::string_view trim(std::string_view s)
+{
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+    return s;
+}
+
+}// namespace
+
+std::string ResponseCache::make_etag(std::string_view body)
+{
+    char etag[2 + 16 + 1];
+    std::snprintf(etag, sizeof(etag), "\"%016zx\"", std::hash<std::string_view>{}(body));
+    return etag;
+}
+
+std::string ResponseCache::serialize(const http::response<http::string_body> &res)
+{
+    std::string wire;
+    http::response_serializer<http::string_body> sr(res);
+    boost::beast::error_code ec;
+    do
+    {
+        sr.next(ec, [&](boost::beast::error_code &, const auto &buffers) {
+            for (auto buffer: boost::beast::buffers_range_ref(buffers))
+            {
+                wire.append(static_cast<const char *>(buffer.data()), buffer.size());
+            }
+            sr.consume(boost::beast::buffer_bytes(buffers));
+        });
+    } while (!ec && !sr.is_done());
+    return wire;
+}
+
+void ResponseCache::copy_to(const CachedResponse &cached, http::response<http::string_body> &res)
+{
+    res.result(cached.message.result());
+    for (const auto &field: cached.message)
+    {
+        res.erase(field.name_string());
+    }
+    for (const auto &field: cached.message)
+    {
+        res.insert(field.name_string(), field.value());
+    }
+    res.body() = cached.message.body();
+}
+
+uint64_t ResponseCache::new_owner_id()
+{
+    static std::atomic<uint64_t> next_id{1};
+    return next_id.fetch_add(1, std::memory_order_relaxed);
+}
+
+CachedResponsePtr ResponseCache::find(uint64_t owner, std::string_view target)
+{
+    auto &store = thread_store();
+    auto owner_it = store.find(owner);
+    if (owner_it == store.end())
+        return nullptr;
+
+    auto it = owner_it->second.find(target);
+    if (it == owner_it->second.end())
+        return nullptr;
+
+    if (it->second->expires <= std::chrono::steady_clock::now())
+    {
+        owner_it->second.erase(it);
+        return nullptr;
+    }
+    return it->second;
+}
+
+CachedResponsePtr ResponseCache::store(uint64_t owner, std::string_view target,
+                                       http::response<http::string_body> &res,
+                                       std::chrono::steady_clock::time_point expires)
+{
+    auto entry = std::make_shared<CachedResponse>();
+    entry->etag = make_etag(res.body());
+    res.set(http::field::etag, entry->etag);
+    if (!res.has_content_length())
+    {
+        res.prepare_payload();
+    }
+
+    entry->message = res;
+    entry->message.version(11);
+    entry->message.keep_alive(true);
+    entry->wire = serialize(entry->message);
+    entry->expires = expires;
+
+    auto &targets = thread_store()[owner];
+    if (targets.size() < kMaxEntriesPerHandler || targets.count(target))
+    {
+        targets.insert_or_assign(std::string(target), entry);
+    }
+    return entry;
+}
+
+bool ResponseCache::etag_matches(std::string_view if_none_match, std::string_view etag)
+{
+    while (!if_none_match.empty())
+    {
+        std::size_t comma = if_none_match.find(',');
+        std::string_view tag = trim(if_none_match.substr(0, comma));
+        if (tag.substr(0, 2) == "W/")
+            tag.remove_prefix(2);
+        if (tag == "*" || tag == etag)
+            return true;
+        if_none_match = comma == std::string_view::npos ? std::string_view() : if_none_match.substr(comma + 1);
+    }
+    return false;
+}
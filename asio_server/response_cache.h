@@ -0,0 +1,53 @@
+#pragma once
+
+#include <boost/beast/http.hpp>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace http = boost::beast::http;
+
+// A response kept for reuse. `wire` holds `message` already serialized for an HTTP/1.1
+// keep-alive connection, so Session can send it with no per-request formatting.
+struct CachedResponse
+{
+    http::response<http::string_body> message;
+    std::string etag;
+    std::string wire;
+    std::chrono::steady_clock::time_point expires;
+};
+using CachedResponsePtr = std::shared_ptr<const CachedResponse>;
+
+// Cached responses keyed by an owner id (see new_owner_id) and request target. Every thread has its own store,
+// so lookups take no locks and never contend across io threads.
+class ResponseCache
+{
+public:
+    // Distinct targets remembered per handler; further targets are not cached.
+    static constexpr std::size_t kMaxEntriesPerHandler = 1024;
+
+    // Ids are never reused, so entries of a destroyed owner can never be served for another.
+    static uint64_t new_owner_id();
+
+    static CachedResponsePtr find(uint64_t owner, std::string_view target);
+
+    // Adds an ETag to `res` and remembers it until `expires`.
+    static CachedResponsePtr store(uint64_t owner, std::string_view target, http::response<http::string_body> &res,
+                                   std::chrono::steady_clock::time_point expires);
+
+    // The strong ETag store() gives a response with this body, for handlers that tag
+    // responses they do not cache.
+    static std::string make_etag(std::string_view body);
+
+    // `res` as it goes on the wire, for building a CachedResponse outside store().
+    static std::string serialize(const http::response<http::string_body> &res);
+
+    // Copies `cached` into `res` for sending like an uncached response. Its fields replace any
+    // of the same name in `res`; repeated ones, like Set-Cookie, are all kept.
+    static void copy_to(const CachedResponse &cached, http::response<http::string_body> &res);
+
+    // True if an If-None-Match header value lists `etag` or is "*".
+    static bool etag_matches(std::string_view if_none_match, std::string_view etag);
+};
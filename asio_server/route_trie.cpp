@@ -0,0 +1,93 @@
+#include "route_trie.h"
+#include <stdexcept>
+
+static std::string_view next_segment(std::string_view &rest, bool &last)
+{
+    auto slash = rest.find('/');
+    last = slash == std::string_view::npos;
+    std::string_view segment = rest.substr(0, slash);
+    rest = last ? std::string_view() : rest.substr(slash + 1);
+    return segment;
+}
+
+bool RouteTrie::insert(std::string_view path_template, ApiHandlerPtr handler)
+{
+    if (path_template.empty() || path_template.front() != '/')
+        throw std::invalid_argument("route must start with '/': " + std::string(path_template));
+
+    std::size_t param_count = 0;
+    Node *node = &root_;
+    std::string_view rest = path_template.substr(1);
+    bool last = false;
+    while (!last)
+    {
+        std::string_view segment = next_segment(rest, last);
+        if (segment.size() > 2 && segment.front() == '{' && segment.back() == '}')
+        {
+            std::string_view name = segment.substr(1, segment.size() - 2);
+            if (++param_count > kMaxParams)
+                throw std::invalid_argument("too many path parameters: " + std::string(path_template));
+
+            if (!node->param_child)
+            {
+                node->param_child = std::make_unique<Node>();
+                node->param_child->param_name = std::string(name);
+            }
+            else if (node->param_child->param_name != name)
+            {
+                throw std::invalid_argument("conflicting parameter name in route: " + std::string(path_template));
+            }
+            node = node->param_child.get();
+        }
+        else
+        {
+            if (segment.find_first_of("{}") != std::string_view::npos)
+                throw std::invalid_argument("parameters must span a whole segment: " + std::string(path_template));
+
+            auto it = node->children.find(segment);
+            if (it == node->children.end())
+            {
+                it = node->children.emplace(std::string(segment), std::make_unique<Node>()).first;
+            }
+            node = it->second.get();
+        }
+    }
+
+    // Like the static routes, the first registration of a path wins.
+    if (node->handler)
+        return false;
+    node->handler = std::move(handler);
+    return true;
+}
+
+bool RouteTrie::match_node(const Node &node, std::string_view rest, bool done, Match &match)
+{
+    if (done)
+    {
+        match.handler = node.handler.get();
+        return match.handler != nullptr;
+    }
+
+    bool last = false;
+    std::string_view segment = next_segment(rest, last);
+    if (auto it = node.children.find(segment); it != node.children.end() && match_node(*it->second, rest, last, match))
+        return true;
+    if (!node.param_child || segment.empty())
+        return false;
+
+    // The literal branch, if any, had no route for the rest of the path.
+    match.params[match.param_count++] = {node.param_child->param_name, segment};
+    if (match_node(*node.param_child, rest, last, match))
+        return true;
+    --match.param_count;
+    return false;
+}
+
+bool RouteTrie::match(std::string_view path, Match &match) const
+{
+    match.handler = nullptr;
+    match.param_count = 0;
+    if (path.empty() || path.front() != '/')
+        return false;
+    return match_node(root_, path.substr(1), false, match);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "api_handler.h"
+#include <array>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// Segment-based trie for templates like "/taskDetail/{taskId}". Lookup walks the path
+// once, so its cost depends on the path length and not on the number of routes.
+// Literal segments take precedence over "{param}" segments; when the literal branch has
+// no route for the rest of the path, lookup falls back to the parameter one, so with
+// "/tasks/latest/x" and "/tasks/{id}/y" registered, "/tasks/latest/y" matches the
+// second. Only overlapping routes ever fall back.
+class RouteTrie
+{
+public:
+    static constexpr std::size_t kMaxParams = ReqContext::kMaxPathParams;
+
+    struct Match
+    {
+        ApiHandler *handler = nullptr;
+        std::array<PathParam, kMaxParams> params;
+        std::size_t param_count = 0;
+    };
+
+    // Throws std::invalid_argument for malformed templates. As with the static routes, the
+    // first handler registered for a template wins; later ones are ignored and insert()
+    // returns false.
+    bool insert(std::string_view path_template, ApiHandlerPtr handler);
+    bool match(std::string_view path, Match &match) const;
+
+private:
+    struct Node
+    {
+        std::map<std::string, std::unique_ptr<Node>, std::less<>> children;
+        std::unique_ptr<Node> param_child;
+        std::string param_name;
+        ApiHandlerPtr handler;
+    };
+
+    // Matches `rest`, the path after `node`'s segment; `done` when there is none left.
+    static bool match_node(const Node &node, std::string_view rest, bool done, Match &match);
+
+    Node root_;
+};
@@ -1,50 +1,40 @@
 #include "router.h"
+#include "metrics.h"
 #include "req_context.h"
-#include <boost/algorithm/string.hpp>
+#include "trace.h"
 
 void Router::register_static_handler(const std::string &path, ApiHandlerPtr handler)
 {
-    get_static_routes().emplace(path, std::move(handler));
+    // The first registration of a path wins; a later one gets no metrics series either.
+    ApiHandler *registered = handler.get();
+    if (get_static_routes().emplace(path, std::move(handler)).second)
+    {
+        registered->set_metrics_route(Metrics::register_route(path));
+    }
 }
 
 void Router::register_dynamic_handler(const std::string &path_template, ApiHandlerPtr handler)
 {
-    std::string regex_str = "^" + std::regex_replace(path_template, std::regex("\\{([^}]+)\\}"), "([^/]+)") + "$";
-
-    std::vector<std::string> param_names;
-    std::smatch matches;
-    auto it = path_template.cbegin();
-    while (std::regex_search(it, path_template.cend(), matches, std::regex("\\{([^}]+)\\}")))
+    ApiHandler *registered = handler.get();
+    if (get_dynamic_routes().insert(path_template, std::move(handler)))
     {
-        param_names.push_back(matches[1].str());
-        it = matches[0].second;
+        registered->set_metrics_route(Metrics::register_route(path_template));
     }
-
-    get_dynamic_routes().emplace_back(std::make_tuple(std::regex(regex_str), param_names, handler));
 }
 
-ApiHandler *Router::route(const std::string &path, ReqContext &ctx)
+ApiHandler *Router::route(std::string_view path, ReqContext &ctx)
 {
+    TraceSpan span(ctx.trace_id(), "route");
     if (auto it = get_static_routes().find(path); it != get_static_routes().end())
     {
         return it->second.get();
     }
 
-    for (const auto &dynamic_route: get_dynamic_routes())
+    RouteTrie::Match match;
+    if (get_dynamic_routes().match(path, match))
     {
-
-        const auto &[regex, param_names, handler] = dynamic_route;
-        std::smatch matches;
-        if (std::regex_match(path, matches, regex))
-        {
-            std::unordered_map<std::string, std::string> params;
-            for (size_t i = 0; i < param_names.size(); ++i)
-            {
-                params[param_names[i]] = matches[i + 1].str();
-            }
-            ctx.set_path_params(params);
-            return handler.get();
-        }
+        ctx.set_path_params(match.params.data(), match.param_count);
+        return match.handler;
     }
 
     return nullptr;
@@ -56,8 +46,8 @@ Router::StaticRoutes &Router::get_static_routes()
     return handlers;
 }
 
-std::vector<Router::DynamicRoute> &Router::get_dynamic_routes()
+RouteTrie &Router::get_dynamic_routes()
 {
-    static std::vector<Router::DynamicRoute> routes;
+    static RouteTrie routes;
     return routes;
 }
@@ -1,11 +1,11 @@
 #pragma once
 
 #include "api_handler.h"
+#include "route_trie.h"
 #include <boost/beast/http.hpp>
 #include <map>
 #include <memory>
-#include <regex>
-#include <vector>
+#include <string_view>
 
 namespace http = boost::beast::http;
 
@@ -15,35 +15,31 @@ class Router
 public:
     static void register_static_handler(const std::string &path, ApiHandlerPtr handler);
     static void register_dynamic_handler(const std::string &path, ApiHandlerPtr handler);
-    static ApiHandler *route(const std::string &path, ReqContext &ctx);
+    static ApiHandler *route(std::string_view path, ReqContext &ctx);
 
 private:
-    using StaticRoutes = std::map<std::string, ApiHandlerPtr>;
+    using StaticRoutes = std::map<std::string, ApiHandlerPtr, std::less<>>;
     static StaticRoutes &get_static_routes();
 
-    using DynamicRoute = std::tuple<std::regex, std::vector<std::string>, ApiHandlerPtr>;
-
-    static std::vector<DynamicRoute> &get_dynamic_routes();
+    static RouteTrie &get_dynamic_routes();
 };
 
-#define REGISTER_STATIC_HANDLER(Path, HandlerClass)                                  \
-    namespace {                                                                      \
-    struct HandlerClass##Register                                                    \
-    {                                                                                \
-        HandlerClass##Register()                                                     \
-        {                                                                            \
-            Router::register_static_handler(Path, std::make_shared<HandlerClass>()); \
-        }                                                                            \
-    } HandlerClass##_register;                                                       \
+// The *_WORKER_* variants run the handler on the WorkerPool; use them for handlers that
+// do heavy work (TaskManager queries, large JSON) so they do not stall the io threads.
+#define REGISTER_HANDLER_(Kind, Path, HandlerClass, OnWorker)               \
+    namespace {                                                             \
+    struct HandlerClass##Register                                           \
+    {                                                                       \
+        HandlerClass##Register()                                            \
+        {                                                                   \
+            auto handler = std::make_shared<HandlerClass>();                \
+            handler->set_run_on_worker(OnWorker);                           \
+            Router::register_##Kind##_handler(Path, std::move(handler));    \
+        }                                                                   \
+    } HandlerClass##_register;                                              \
     }
 
-#define REGISTER_DYNAMIC_HANDLER(Path, HandlerClass)                                  \
-    namespace {                                                                       \
-    struct HandlerClass##Register                                                     \
-    {                                                                                 \
-        HandlerClass##Register()                                                      \
-        {                                                                             \
-            Router::register_dynamic_handler(Path, std::make_shared<HandlerClass>()); \
-        }                                                                             \
-    } HandlerClass##_register;                                                        \
-    }
\ No newline at end of file
+#define REGISTER_STATIC_HANDLER(Path, HandlerClass) REGISTER_HANDLER_(static, Path, HandlerClass, false)
+#define REGISTER_DYNAMIC_HANDLER(Path, HandlerClass) REGISTER_HANDLER_(dynamic, Path, HandlerClass, false)
+#define REGISTER_STATIC_WORKER_HANDLER(Path, HandlerClass) REGISTER_HANDLER_(static, Path, HandlerClass, true)
+#define REGISTER_DYNAMIC_WORKER_HANDLER(Path, HandlerClass) REGISTER_HANDLER_(dynamic, Path, HandlerClass, true)
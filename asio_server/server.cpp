@@ -0,0 +1,148 @@
+#include "server.h"
+#include "session.h"
+#include <boost/asio/dispatch.hpp>
+
+#if defined(SO_REUSEPORT)
+using reuse_port_option = net::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+#endif
+
+Server::Server(IoContextPool &pool, unsigned short port, bool reuse_port, std::size_t max_connections)
+    : pool_(pool), max_connections_(max_connections), accepted_(new std::atomic<uint64_t>[pool.size()])
+{
+#if defined(SO_REUSEPORT)
+    per_core_ = reuse_port && pool.size() > 1;
+#else
+    per_core_ = false;
+#endif
+
+    for (std::size_t i = 0; i < pool_.size(); ++i)
+    {
+        accepted_[i] = 0;
+    }
+
+    tcp::endpoint endpoint{tcp::v4(), port};
+    std::size_t listener_count = per_core_ ? pool_.size() : 1;
+    for (std::size_t i = 0; i < listener_count; ++i)
+    {
+        listeners_.push_back(std::make_unique<Listener>(
+                Listener{make_acceptor(pool_.get(i), endpoint, per_core_), i, net::steady_timer(pool_.get(i))}));
+    }
+
+    port_ = listeners_.front()->acceptor.local_endpoint().port();
+    for (auto &listener: listeners_)
+    {
+        do_accept(*listener);
+    }
+}
+
+std::vector<uint64_t> Server::accepted_counts() const
+{
+    std::vector<uint64_t> counts;
+    counts.reserve(pool_.size());
+    for (std::size_t i = 0; i < pool_.size(); ++i)
+    {
+        counts.push_back(accepted_[i].load(std::memory_order_relaxed));
+    }
+    return counts;
+}
+
+std::size_t Server::live_connections() const
+{
+    return Session::live_count();
+}
+
+unsigned short Server::port() const
+{
+    return port_;
+}
+
+void Server::set_max_connections(std::size_t max_connections)
+{
+    max_connections_.store(max_connections, std::memory_order_relaxed);
+}
+
+void Server::set_tls(std::shared_ptr<net::ssl::context> tls)
+{
+    std::atomic_store(&tls_, std::move(tls));
+}
+
+// Each acceptor is closed on its own io thread, which cancels the pending accept.
+void Server::stop_accepting()
+{
+    for (auto &listener: listeners_)
+    {
+        net::post(listener->acceptor.get_executor(), [&listener = *listener] {
+            beast::error_code ec;
+            listener.acceptor.close(ec);
+            listener.retry.cancel();
+        });
+    }
+}
+
+tcp::acceptor Server::make_acceptor(net::io_context &ctx, const tcp::endpoint &endpoint, bool reuse_port)
+{
+    tcp::acceptor acceptor(ctx);
+    acceptor.open(endpoint.protocol());
+    acceptor.set_option(net::socket_base::reuse_address(true));
+#if defined(SO_REUSEPORT)
+    if (reuse_port)
+    {
+        acceptor.set_option(reuse_port_option(true));
+    }
+#else
+    (void) reuse_port;
+#endif
+    acceptor.bind(endpoint);
+    acceptor.listen(net::socket_base::max_listen_connections);
+    return acceptor;
+}
+
+void Server::do_accept(Listener &listener)
+{
+    if (!listener.acceptor.is_open())
+        return;
+
+    // Sessions close on every io thread, so the count is polled rather than waited on.
+    std::size_t max_connections = max_connections_.load(std::memory_order_relaxed);
+    if (max_connections > 0 && Session::live_count() >= max_connections)
+    {
+        listener.retry.expires_after(kAcceptRetry);
+        listener.retry.async_wait([this, &listener](beast::error_code ec) {
+            if (!ec)
+            {
+                do_accept(listener);
+            }
+        });
+        return;
+    }
+
+    // A per-core acceptor keeps its connections on its own io_context; the shared
+    // acceptor spreads them over the pool.
+    std::size_t index = per_core_ ? listener.index : pool_.next_index();
+
+    // Each io_context runs on one thread, so the socket needs no strand.
+    listener.acceptor.async_accept(pool_.get(index),
+                                   [this, &listener, index](beast::error_code ec, tcp::socket socket) {
+                                       if (!ec)
+                                       {
+                                           on_accepted(index, std::move(socket));
+                                       }
+                                       else if (ec == net::error::operation_aborted)
+                                       {
+                                           return;
+                                       }
+
+                                       do_accept(listener);
+                                   });
+}
+
+void Server::on_accepted(std::size_t index, tcp::socket socket)
+{
+    accepted_[index].fetch_add(1, std::memory_order_relaxed);
+    // The shared acceptor completes on whichever io thread it runs on; the session starts
+    // on the thread of the io_context its socket belongs to, and stays there.
+    auto executor = socket.get_executor();
+    net::dispatch(executor, [socket = std::move(socket), tls = std::atomic_load(&tls_)]() mutable {
+        std::make_shared<Session>(std::move(socket), std::move(tls))->start();
+    });
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "io_context_pool.h"
+#include <atomic>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/ssl/context.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+using tcp = boost::asio::ip::tcp;
+
+class Server
+{
+public:
+    // While kAcceptRetry elapses between checks, a paused listener leaves new connections in
+    // the kernel backlog.
+    static constexpr std::chrono::milliseconds kAcceptRetry{10};
+
+    // With reuse_port every io_context gets its own SO_REUSEPORT acceptor and the kernel
+    // balances connections; otherwise one acceptor hands sockets out round-robin.
+    // Accepting pauses while max_connections sessions are open (0 = no limit).
+    Server(IoContextPool &pool, unsigned short port, bool reuse_port = true, std::size_t max_connections = 0);
+
+    // Accepted-connection count per io thread, in pool order.
+    std::vector<uint64_t> accepted_counts() const;
+    // Connections open right now.
+    std::size_t live_connections() const;
+    // The port actually bound, useful when constructed with port 0.
+    unsigned short port() const;
+
+    // Takes effect for the next accept; safe to call while serving.
+    void set_max_connections(std::size_t max_connections);
+    // Connections accepted from now on speak TLS with this context (see Tls::server_context),
+    // or plaintext when it is null. Safe to call while serving, e.g. to load a renewed
+    // certificate; open connections keep the context they started with.
+    void set_tls(std::shared_ptr<net::ssl::context> tls);
+    // Closes the listening sockets; connections already accepted are left alone. New clients
+    // get connection refused, so a load balancer moves them to another instance.
+    void stop_accepting();
+
+private:
+    struct Listener
+    {
+        tcp::acceptor acceptor;
+        std::size_t index;
+        net::steady_timer retry;
+    };
+
+    static tcp::acceptor make_acceptor(net::io_context &ctx, const tcp::endpoint &endpoint, bool reuse_port);
+    void do_accept(Listener &listener);
+    void on_accepted(std::size_t index, tcp::socket socket);
+
+    IoContextPool &pool_;
+    bool per_core_;
+    unsigned short port_ = 0;
+    std::atomic<std::size_t> max_connections_;
+    // Read and replaced with std::atomic_load/atomic_store.
+    std::shared_ptr<net::ssl::context> tls_;
+    std::vector<std::unique_ptr<Listener>> listeners_;
+    std::unique_ptr<std::atomic<uint64_t>[]> accepted_;
+};
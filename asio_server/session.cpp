@@ -1,112 +1,1194 @@
 #include "session.h"
+#include "alloc_stats.h"
+#include "metrics.h"
+#include "reloadable.h"
 #include "req_context.h"
 #include "router.h"
+#include "trace.h"
+#include "websocket_session.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
 #include <iostream>
+#include <limits>
+#include <mutex>
+#include <unordered_set>
+#include <unistd.h>
 
-Session::Session(tcp::socket socket) : socket_(std::move(socket)) {}
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+static Reloadable<Session::Limits> session_limits;
+static std::atomic<std::size_t> live_sessions{0};
+static std::atomic<bool> draining{false};
+
+// Started sessions, for drain() to reach the idle ones. Only touched when a connection
+// opens or closes, never per request.
+static std::mutex registry_mutex;
+static std::unordered_set<Session *> registry;
+
+void Session::configure(const Limits &limits)
+{
+    Limits clamped = limits;
+    clamped.max_in_flight = std::clamp<std::size_t>(limits.max_in_flight, 1, kMaxPipelined);
+    session_limits.set(clamped);
+}
+
+const Session::Limits &Session::limits()
+{
+    return session_limits.get();
+}
+
+void Session::drain()
+{
+    draining.store(true);
+    WebSocketSession::drain();
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for (Session *session: registry)
+    {
+        net::post(session->stream_.get_executor(), [weak = session->weak_from_this()] {
+            if (auto self = weak.lock())
+            {
+                self->close_if_idle();
+            }
+        });
+    }
+}
+
+bool Session::is_draining()
+{
+    return draining.load(std::memory_order_relaxed);
+}
+
+void Session::reset_drain()
+{
+    draining.store(false);
+}
+
+std::size_t Session::live_count()
+{
+    return live_sessions.load(std::memory_order_relaxed) + WebSocketSession::live_count();
+}
+
+Session::Session(tcp::socket socket, std::shared_ptr<net::ssl::context> tls)
+    : stream_(tls ? ConnectionStream(std::move(socket), std::move(tls)) : ConnectionStream(std::move(socket))),
+      send_timer_(stream_.get_executor()),
+      req_(std::piecewise_construct, std::make_tuple(), std::make_tuple(&fields_memory_))
+{
+    // Responses are handed to handlers by reference, so the pool must never reallocate.
+    responses_.reserve(kMaxPipelined);
+    cached_.reserve(kMaxPipelined);
+    traced_.reserve(kMaxPipelined);
+    beast::error_code ec;
+    remote_address_ = stream_.socket().remote_endpoint(ec).address();
+    live_sessions.fetch_add(1, std::memory_order_relaxed);
+    Metrics::connection_opened();
+}
+
+Session::~Session()
+{
+    if (registered_)
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        registry.erase(this);
+    }
+    live_sessions.fetch_sub(1, std::memory_order_relaxed);
+    Metrics::connection_closed();
+}
 
 void Session::start()
 {
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        registry.insert(this);
+        registered_ = true;
+    }
+    if (stream_.is_tls())
+    {
+        handshake();
+        return;
+    }
     read_request();
 }
 
+// A client that connects and stalls in the handshake is dropped like one that stalls in
+// its request header.
+void Session::handshake()
+{
+    stream_.expires_after(session_limits.get().header_timeout);
+    stream_.tls().async_handshake(net::ssl::stream_base::server, [self = shared_from_this()](beast::error_code ec) {
+        if (ec == beast::error::timeout)
+        {
+            Metrics::error(Metrics::Error::timeout);
+            return;
+        }
+        if (ec)
+        {
+            Metrics::error(Metrics::Error::tls_handshake);
+            return;
+        }
+        self->read_request();
+    });
+}
+
+// Runs on the session's executor, so it cannot interleave with the session's own handlers.
+void Session::close_if_idle()
+{
+    if (idle_)
+    {
+        stream_.cancel();
+    }
+    // An event stream never finishes by itself; end it so the connection can close.
+    else if (body_source_ == BodySource::events)
+    {
+        streamed_response().event_stream()->end();
+    }
+}
+
 void Session::read_request()
 {
-    req_ = {};
+    ctxt_.reset();
+    handler_ = nullptr;
+    stream_parser_.reset();
+    // Parse into the previous request object so its body keeps its capacity.
+    if (parser_)
+    {
+        req_ = parser_->release();
+    }
+    // The previous request's fields go back to fields_memory_ for this one's.
+    req_.base() = http::request_header<RequestFields>(req_.get_allocator());
+    req_.body().clear();
+    if (req_.body().capacity() > kMaxPooledBody)
+    {
+        std::string().swap(req_.body());
+    }
+    parser_.emplace(std::move(req_));
+    // The limit depends on the handler, so it is only applied once the header is routed.
+    parser_->body_limit(std::numeric_limits<std::uint64_t>::max());
+
+    // A pipelining client may already have sent the next request; take it from the buffer
+    // without going back to the socket.
+    if (buffer_.size() > 0)
+    {
+        if (!parse_buffered())
+            return;
+        if (parser_->is_header_done())
+        {
+            on_header();
+            return;
+        }
+    }
+
+    // Nothing complete is buffered, so send what has been answered before waiting.
+    if (responses_in_use_ > 0)
+    {
+        write_responses();
+        return;
+    }
+
+    do_read_header();
+}
+
+bool Session::parse_buffered()
+{
+    beast::error_code ec;
+    std::size_t used = parser_->put(buffer_.data(), ec);
+    buffer_.consume(used);
+    Metrics::bytes_in(used);
+    if (ec && ec != http::error::need_more)
+    {
+        handle_read_error(ec);
+        return false;
+    }
+    return true;
+}
+
+// Picks up reading wherever the current request was left when responses were flushed.
+void Session::continue_read()
+{
+    if (stream_parser_ && !stream_parser_->is_done())
+    {
+        read_body_chunk();
+    }
+    else if (parser_ && parser_->is_header_done() && !parser_->is_done())
+    {
+        do_read();
+    }
+    else if (parser_ && parser_->got_some() && !parser_->is_header_done())
+    {
+        do_read_header();
+    }
+    else
+    {
+        read_request();
+    }
+}
+
+void Session::do_read_header()
+{
+    if (buffer_.size() == 0 && !parser_->got_some())
+    {
+        wait_for_request();
+        return;
+    }
+
+    stream_.expires_after(session_limits.get().header_timeout);
+    http::async_read_header(stream_, buffer_, *parser_,
+                            beast::bind_front_handler(&Session::handle_read_header, shared_from_this()));
+}
+
+// Between requests the connection is idle; the header deadline starts with the first byte.
+// While draining, an idle connection is closed instead.
+void Session::wait_for_request()
+{
+    if (is_draining())
+    {
+        end_connection();
+        return;
+    }
+
+    idle_ = true;
+    stream_.expires_after(session_limits.get().idle_timeout);
+    stream_.async_read_some(buffer_.prepare(beast::read_size(buffer_, 65536)),
+                            [self = shared_from_this()](beast::error_code ec, size_t bytes_transferred) {
+                                self->idle_ = false;
+                                // Cancelled by drain(), or the idle timeout: an ordinary end of
+                                // a keep-alive connection.
+                                if (ec == net::error::operation_aborted || ec == beast::error::timeout)
+                                    return;
+                                if (ec == net::error::eof)
+                                {
+                                    self->end_connection();
+                                    return;
+                                }
+                                if (ec)
+                                {
+                                    self->handle_read_error(ec);
+                                    return;
+                                }
+
+                                self->buffer_.commit(bytes_transferred);
+                                if (!self->parse_buffered())
+                                    return;
+                                if (self->parser_->is_header_done())
+                                {
+                                    self->on_header();
+                                    return;
+                                }
+                                self->do_read_header();
+                            });
+}
+
+void Session::handle_read_header(beast::error_code ec, size_t bytes_transferred)
+{
+    if (ec == http::error::end_of_stream)
+    {
+        end_connection();
+        return;
+    }
+    if (ec)
+    {
+        handle_read_error(ec);
+        return;
+    }
+
+    Metrics::bytes_in(bytes_transferred);
+    on_header();
+}
+
+void Session::on_header()
+{
+    request_start_ = std::chrono::steady_clock::now();
+    AllocStats::on_request();
+
+    std::string_view target = to_string_view(parser_->get().target());
+    std::string_view path = target.substr(0, target.find('?'));
+
+    ctxt_.emplace(parser_->get());
+    ctxt_->set_remote_address(remote_address_);
+    ctxt_->set_executor(stream_.get_executor());
+    ctxt_->set_trace_id(Trace::sample());
+    handler_ = Router::route(path, *ctxt_);
+    metrics_route_ = handler_ ? handler_->metrics_route() : Metrics::kUnmatchedRoute;
+
+    bool streams = handler_ && handler_->streams_request_body();
+    std::uint64_t limit = streams ? handler_->request_body_limit() : session_limits.get().body_limit;
+    auto length = parser_->content_length();
+    if (length && *length > limit)
+    {
+        reject_too_large();
+        return;
+    }
+    parser_->body_limit(limit);
+
+    if (streams)
+    {
+        start_body_stream();
+        return;
+    }
+
+    parser_->eager(true);
+    if (!parser_->is_done() && buffer_.size() > 0 && !parse_buffered())
+        return;
+    if (parser_->is_done())
+    {
+        process_request();
+        return;
+    }
+
+    if (responses_in_use_ > 0)
+    {
+        write_responses();
+        return;
+    }
+
+    do_read();
+}
 
-    http::async_read(socket_, buffer_, req_, beast::bind_front_handler(&Session::handle_read, shared_from_this()));
+void Session::do_read()
+{
+    stream_.expires_after(session_limits.get().io_timeout);
+    http::async_read(stream_, buffer_, *parser_, beast::bind_front_handler(&Session::handle_read, shared_from_this()));
 }
 
 void Session::handle_read(beast::error_code ec, size_t bytes_transferred)
 {
     if (ec == http::error::end_of_stream)
     {
-        socket_.shutdown(tcp::socket::shutdown_send, ec);
+        end_connection();
         return;
     }
     if (ec)
     {
-        std::cerr << "Read error: " << ec.message() << std::endl;
+        handle_read_error(ec);
         return;
     }
 
+    Metrics::bytes_in(bytes_transferred);
     process_request();
 }
 
+void Session::start_body_stream()
+{
+    // The header moves into req_ so the context no longer depends on the string_body parser,
+    // which becomes a buffer_body parser that fills stream_chunk_ piece by piece.
+    req_.base() = parser_->get().base();
+    req_.body().clear();
+    std::string_view target = to_string_view(req_.target());
+    std::uint64_t trace = ctxt_->trace_id();
+    ctxt_.emplace(req_);
+    ctxt_->set_remote_address(remote_address_);
+    ctxt_->set_executor(stream_.get_executor());
+    ctxt_->set_trace_id(trace);
+    Router::route(target.substr(0, target.find('?')), *ctxt_);
+
+    stream_parser_.emplace(std::move(*parser_));
+    parser_.reset();
+    ctxt_->set_body_sink(handler_->open_body_sink(*ctxt_));
+    if (!stream_chunk_)
+    {
+        stream_chunk_ = std::make_unique<char[]>(kStreamChunkSize);
+    }
+    // Reads size themselves by the buffer's free space; keep it at least one chunk.
+    buffer_.reserve(kStreamChunkSize);
+
+    if (stream_parser_->is_done())
+    {
+        process_request();
+        return;
+    }
+
+    if (responses_in_use_ > 0)
+    {
+        write_responses();
+        return;
+    }
+
+    read_body_chunk();
+}
+
+void Session::read_body_chunk()
+{
+    auto &body = stream_parser_->get().body();
+    body.data = stream_chunk_.get();
+    body.size = kStreamChunkSize;
+    stream_.expires_after(session_limits.get().io_timeout);
+    http::async_read_some(stream_, buffer_, *stream_parser_,
+                          beast::bind_front_handler(&Session::handle_body_chunk, shared_from_this()));
+}
+
+void Session::handle_body_chunk(beast::error_code ec, size_t bytes_transferred)
+{
+    // The chunk buffer filled up before the message ended; that is the normal case here.
+    if (ec == http::error::need_buffer)
+    {
+        ec = {};
+    }
+    if (ec)
+    {
+        handle_read_error(ec);
+        return;
+    }
+
+    Metrics::bytes_in(bytes_transferred);
+    std::size_t size = kStreamChunkSize - stream_parser_->get().body().size;
+    BodySink *sink = ctxt_->body_sink();
+    if (size > 0 && sink && !sink->write(std::string_view(stream_chunk_.get(), size)))
+    {
+        reject_too_large();
+        return;
+    }
+
+    if (stream_parser_->is_done())
+    {
+        process_request();
+        return;
+    }
+
+    read_body_chunk();
+}
+
+void Session::handle_read_error(beast::error_code ec)
+{
+    if (ec == http::error::body_limit)
+    {
+        reject_too_large();
+        return;
+    }
+    // tcp_stream has already closed the socket.
+    if (ec == beast::error::timeout)
+    {
+        Metrics::error(Metrics::Error::timeout);
+        return;
+    }
+    // A TLS client that closed its socket without a close_notify; most of them do.
+    if (ec == net::ssl::error::stream_truncated)
+        return;
+    // The header section outgrew the parser's limit; the request may be well formed.
+    if (ec == http::error::header_limit)
+    {
+        reject_bad_request(http::status::request_header_fields_too_large);
+        return;
+    }
+    // The parser rejected the request. A client that hung up mid-message gets nothing.
+    if (ec.category() == http::make_error_code(http::error::bad_target).category() &&
+        ec != http::error::partial_message)
+    {
+        reject_bad_request(http::status::bad_request);
+        return;
+    }
+
+    Metrics::error(Metrics::Error::read);
+    std::cerr << "Read error: " << ec.message() << std::endl;
+}
+
+// The rest of the body is never parsed, so the connection is closed after the 413.
+void Session::reject_too_large()
+{
+    Metrics::error(Metrics::Error::too_large);
+    if (!ctxt_)
+    {
+        request_start_ = std::chrono::steady_clock::now();
+        metrics_route_ = Metrics::kUnmatchedRoute;
+    }
+
+    rejected_body_ = true;
+    Response &res = acquire_response();
+    res.version(11);
+    res.keep_alive(false);
+    handle_too_large(res);
+    on_response_ready(nullptr);
+}
+
+// Nothing after a malformed request, or one whose header is too large (`status` 431), can be
+// parsed, so the connection is closed after the 400 or 431. Responses to the pipelined
+// requests before it still go out first, in the same write.
+void Session::reject_bad_request(http::status status)
+{
+    bool header_too_large = status == http::status::request_header_fields_too_large;
+    Metrics::error(header_too_large ? Metrics::Error::too_large : Metrics::Error::bad_request);
+    if (!ctxt_)
+    {
+        request_start_ = std::chrono::steady_clock::now();
+        metrics_route_ = Metrics::kUnmatchedRoute;
+    }
+
+    rejected_body_ = true;
+    Response &res = acquire_response();
+    res.version(11);
+    res.keep_alive(false);
+    if (header_too_large)
+    {
+        handle_header_too_large(res);
+    }
+    else
+    {
+        handle_bad_request(res);
+    }
+    on_response_ready(nullptr);
+}
+
 void Session::process_request()
 {
-    res_.version(req_.version());
-    res_.keep_alive(req_.keep_alive());
+    if (ctxt_->trace_id())
+    {
+        Trace::record(ctxt_->trace_id(), "read", request_start_, Trace::Clock::now());
+    }
 
-    std::string target = req_.target();
-    std::string path = target;
-    if (auto pos = target.find('?'); pos != std::string::npos)
+    const auto &req = ctxt_->raw_req();
+    if (handler_ && handler_->websocket_handler() && websocket::is_upgrade(req))
     {
-        path = target.substr(0, pos);
+        upgrade_to_websocket();
+        return;
     }
 
-    ReqContext ctxt(req_);
-    auto handler = Router::route(path, ctxt);
+    Response &res = acquire_response();
+    res.version(req.version());
+    res.keep_alive(req.keep_alive());
+
+    if (handler_)
+    {
+        // Middleware may finish on another thread; the response always goes back to the
+        // socket's io thread.
+        handler_->execute(*ctxt_, res, [self = shared_from_this()](CachedResponsePtr cached) {
+            net::dispatch(self->stream_.get_executor(),
+                          [self, cached = std::move(cached)]() mutable { self->on_response_ready(std::move(cached)); });
+        });
+        return;
+    }
 
-    if (handler)
+    if (req.method() != http::verb::get && req.method() != http::verb::head)
     {
-        handler->execute(ctxt, res_);
+        Metrics::error(Metrics::Error::bad_request);
+        handle_bad_request(res);
     }
     else
     {
-        if (req_.method() != http::verb::get && req_.method() != http::verb::head)
+        Metrics::error(Metrics::Error::not_found);
+        handle_not_found(res);
+    }
+
+    on_response_ready(nullptr);
+}
+
+// The stream moves to a WebSocketSession and this session ends once the current handler
+// returns. An upgrade behind pipelined requests whose responses are still queued, or with
+// bytes already sent after it, cannot be handed over cleanly and is refused.
+void Session::upgrade_to_websocket()
+{
+    if (responses_in_use_ > 0 || buffer_.size() > 0)
+    {
+        Metrics::error(Metrics::Error::bad_request);
+        Response &res = acquire_response();
+        res.version(11);
+        res.keep_alive(false);
+        handle_bad_request(res);
+        on_response_ready(nullptr);
+        return;
+    }
+
+    Metrics::request(metrics_route_, std::chrono::steady_clock::now() - request_start_);
+    auto ws = std::make_shared<WebSocketSession>(std::move(stream_), handler_->websocket_handler(), metrics_route_);
+    ctxt_.reset();
+    ws->accept(parser_->release());
+}
+
+void Session::handle_not_found(Response &res)
+{
+    res.result(http::status::not_found);
+    res.set(http::field::content_type, "text/html");
+    res.body() = "<html>"
+                 "<head><title>Not Found</title></head>"
+                 "<body><h1>404 Not Found</h1></body>"
+                 "</html>";
+    res.prepare_payload();
+}
+
+void Session::handle_bad_request(Response &res)
+{
+    res.result(http::status::bad_request);
+    res.set(http::field::content_type, "text/html");
+    res.body() = "<html>"
+                 "<head><title>Bad Request</title></head>"
+                 "<body><h1>400 Bad Request</h1></body>"
+                 "</html>";
+    res.prepare_payload();
+}
+
+void Session::handle_header_too_large(Response &res)
+{
+    res.result(http::status::request_header_fields_too_large);
+    res.set(http::field::content_type, "text/html");
+    res.body() = "<html>"
+                 "<head><title>Request Header Fields Too Large</title></head>"
+                 "<body><h1>431 Request Header Fields Too Large</h1></body>"
+                 "</html>";
+    res.prepare_payload();
+}
+
+void Session::handle_too_large(Response &res)
+{
+    res.result(http::status::payload_too_large);
+    res.set(http::field::content_type, "text/html");
+    res.body() = "<html>"
+                 "<head><title>Payload Too Large</title></head>"
+                 "<body><h1>413 Payload Too Large</h1></body>"
+                 "</html>";
+    res.prepare_payload();
+}
+
+Response &Session::acquire_response()
+{
+    if (responses_in_use_ == responses_.size())
+    {
+        responses_.emplace_back();
+        cached_.emplace_back();
+        traced_.emplace_back();
+    }
+
+    Response &res = responses_[responses_in_use_++];
+    res.base() = {};
+    res.body().clear();
+    res.clear_body_source();
+    return res;
+}
+
+void Session::release_responses()
+{
+    for (std::size_t i = 0; i < responses_in_use_; ++i)
+    {
+        if (responses_[i].body().capacity() > kMaxPooledBody)
         {
-            handle_bad_request();
+            std::string().swap(responses_[i].body());
         }
-        else
+        // Closes a sent file and drops a finished producer or event stream now, not when the
+        // object is next reused.
+        responses_[i].clear_body_source();
+    }
+    std::fill(cached_.begin(), cached_.begin() + responses_in_use_, nullptr);
+
+    // Written, or abandoned with the connection; either way the traced requests are over.
+    Trace::Clock::time_point end;
+    for (std::size_t i = 0; i < responses_in_use_; ++i)
+    {
+        TracedResponse &traced = traced_[i];
+        if (!traced.trace)
+            continue;
+        if (end == Trace::Clock::time_point())
         {
-            handle_not_found();
+            end = Trace::Clock::now();
         }
+        Trace::record(traced.trace, "write", write_start_, end);
+        Trace::record(traced.trace, "request", traced.start, end, traced.route);
+        traced.trace = 0;
     }
-
-    write_response();
+    responses_in_use_ = 0;
 }
 
-void Session::handle_not_found()
+Response &Session::streamed_response()
 {
-    res_.result(http::status::not_found);
-    res_.set(http::field::content_type, "text/html");
-    res_.body() = "<html>"
-                  "<head><title>Not Found</title></head>"
-                  "<body><h1>404 Not Found</h1></body>"
-                  "</html>";
-    res_.prepare_payload();
+    return responses_[responses_in_use_ - 1];
 }
 
-void Session::handle_bad_request()
+void Session::on_response_ready(CachedResponsePtr cached)
 {
-    res_.result(http::status::bad_request);
-    res_.set(http::field::content_type, "text/html");
-    res_.body() = "<html>"
-                  "<head><title>Bad Request</title></head>"
-                  "<body><h1>400 Bad Request</h1></body>"
-                  "</html>";
-    res_.prepare_payload();
+    Metrics::request(metrics_route_, std::chrono::steady_clock::now() - request_start_);
+
+    Response &res = responses_[responses_in_use_ - 1];
+    cached_[responses_in_use_ - 1] = std::move(cached);
+    traced_[responses_in_use_ - 1] = {ctxt_ ? ctxt_->trace_id() : 0, request_start_, metrics_route_};
+    // While draining, every response tells the client to reconnect elsewhere. Pre-serialized
+    // bytes cannot say so, but the connection still closes once they are written.
+    if (is_draining() && !cached_[responses_in_use_ - 1])
+    {
+        res.keep_alive(false);
+    }
+    // 304 and 204 carry no body and must not get one.
+    bool bodiless = res.result() == http::status::not_modified || res.result() == http::status::no_content;
+    body_source_ = BodySource::buffered;
+    // HEAD of a streamed body: the headers a GET would get, but no length, as none is known.
+    bool streamed_head = false;
+    if (!cached_[responses_in_use_ - 1] && !bodiless && ctxt_)
+    {
+        bool head = ctxt_->method() == http::verb::head;
+        if (res.file_range().file)
+        {
+            // HEAD reports the length without sending the file.
+            res.content_length(res.file_range().length);
+            if (!head)
+            {
+                body_source_ = BodySource::file;
+                file_sent_ = 0;
+            }
+        }
+        else if (res.body_producer() || res.event_stream())
+        {
+            if (res.event_stream())
+            {
+                res.set(http::field::content_type, "text/event-stream");
+                res.set(http::field::cache_control, "no-cache");
+            }
+            res.erase(http::field::content_length);
+            if (head)
+            {
+                // Chunked framing would make the serializer write the last chunk as a body.
+                streamed_head = true;
+            }
+            else
+            {
+                // HTTP/1.0 has no chunked encoding; the body there is delimited by closing the connection.
+                body_source_ = res.event_stream() ? BodySource::events : BodySource::producer;
+                // Whatever the handler queued is sent, but a draining server waits for no more.
+                if (body_source_ == BodySource::events && is_draining())
+                {
+                    res.event_stream()->end();
+                }
+                if (res.version() == 11)
+                {
+                    res.chunked(true);
+                }
+                else
+                {
+                    res.keep_alive(false);
+                }
+            }
+        }
+    }
+
+    if (body_source_ != BodySource::buffered)
+    {
+        write_responses();
+        return;
+    }
+
+    // Batched responses must be delimited by Content-Length; this also drops chunked framing.
+    if (!cached_[responses_in_use_ - 1] && !bodiless && !streamed_head && !res.has_content_length())
+    {
+        res.prepare_payload();
+    }
+
+    if (!res.keep_alive() || responses_in_use_ >= session_limits.get().max_in_flight)
+    {
+        write_responses();
+        return;
+    }
+
+    read_request();
 }
 
-void Session::write_response()
+void Session::write_responses()
 {
+    // With a Content-Length, a string_body serializer yields header and body in one step,
+    // so every response contributes its buffers to a single gathered write. A streamed
+    // response contributes only its header; write_chunk() or send_file_body() sends the
+    // body afterwards.
+    write_buffers_.clear();
+    if (std::any_of(traced_.begin(), traced_.begin() + responses_in_use_,
+                    [](const TracedResponse &traced) { return traced.trace != 0; }))
+    {
+        write_start_ = Trace::Clock::now();
+    }
+    for (std::size_t i = 0; i < responses_in_use_; ++i)
+    {
+        if (cached_[i])
+        {
+            write_buffers_.push_back(net::buffer(cached_[i]->wire));
+            continue;
+        }
+
+        auto &sr = serializers_.emplace_back(responses_[i]);
+        sr.split(body_source_ != BodySource::buffered && i + 1 == responses_in_use_);
+        beast::error_code ec;
+        sr.next(ec, [this](beast::error_code &, const auto &buffers) {
+            for (auto buffer: beast::buffers_range_ref(buffers))
+            {
+                write_buffers_.push_back(buffer);
+            }
+        });
+        if (ec)
+        {
+            serializers_.clear();
+            handle_write_error(ec);
+            return;
+        }
+    }
+
     auto self = shared_from_this();
+    stream_.expires_after(session_limits.get().io_timeout);
+    net::async_write(stream_, write_buffers_, [self](beast::error_code ec, size_t bytes_transferred) {
+        Metrics::bytes_out(bytes_transferred);
+        self->serializers_.clear();
 
-    http::async_write(socket_, res_, [self](beast::error_code ec, size_t) {
         if (ec)
         {
-            std::cerr << "Write error: " << ec.message() << std::endl;
+            self->handle_write_error(ec);
+            return;
+        }
+
+        switch (self->body_source_)
+        {
+        case BodySource::producer:
+            self->write_chunk();
+            break;
+        case BodySource::file:
+            self->send_file_body();
+            break;
+        case BodySource::events:
+            self->write_events(false);
+            break;
+        case BodySource::buffered:
+            self->finish_write();
+            break;
+        }
+    });
+}
+
+void Session::write_chunk()
+{
+    chunk_out_.clear();
+    const BodyProducer &producer = streamed_response().body_producer();
+    bool more = producer(chunk_out_);
+    while (more && chunk_out_.empty())
+    {
+        more = producer(chunk_out_);
+    }
+
+    write_buffers_.clear();
+    bool chunked = streamed_response().chunked();
+    if (!chunk_out_.empty())
+    {
+        if (chunked)
+        {
+            int size = std::snprintf(chunk_header_, sizeof(chunk_header_), "%zx\r\n", chunk_out_.size());
+            write_buffers_.push_back(net::buffer(chunk_header_, size));
+        }
+        write_buffers_.push_back(net::buffer(chunk_out_));
+        if (chunked)
+        {
+            write_buffers_.push_back(net::buffer("\r\n", 2));
+        }
+    }
+    if (!more && chunked)
+    {
+        write_buffers_.push_back(net::buffer("0\r\n\r\n", 5));
+    }
+
+    auto self = shared_from_this();
+    stream_.expires_after(session_limits.get().io_timeout);
+    net::async_write(stream_, write_buffers_, [self, more](beast::error_code ec, size_t bytes_transferred) {
+        Metrics::bytes_out(bytes_transferred);
+        if (ec)
+        {
+            self->handle_write_error(ec);
+            return;
+        }
+
+        if (more)
+        {
+            self->write_chunk();
+            return;
+        }
+        self->body_source_ = BodySource::buffered;
+        self->finish_write();
+    });
+}
+
+void Session::send_file_body()
+{
+#ifdef __linux__
+    if (!stream_.is_tls())
+    {
+        sendfile_body();
+        return;
+    }
+#endif
+    copy_file_body();
+}
+
+void Session::sendfile_body()
+{
+#ifdef __linux__
+    const FileRange &range = streamed_response().file_range();
+    auto self = shared_from_this();
+    // sendfile(2) copies from the page cache straight into the socket. With the socket in
+    // non-blocking mode a full send buffer shows up as EAGAIN, and the rest is sent once the
+    // socket is writable again. After kFileBytesPerTurn the loop yields to the other
+    // connections on this thread.
+    beast::error_code ec;
+    stream_.socket().native_non_blocking(true, ec);
+    std::size_t budget = kFileBytesPerTurn;
+    while (!ec && file_sent_ < range.length)
+    {
+        if (budget == 0)
+        {
+            net::post(stream_.get_executor(), [self] { self->sendfile_body(); });
             return;
         }
 
-        if (self->res_.keep_alive())
+        off_t offset = range.offset + file_sent_;
+        std::size_t count = std::min<std::uint64_t>(range.length - file_sent_, budget);
+        ssize_t n = ::sendfile(stream_.socket().native_handle(), range.file->fd(), &offset, count);
+        if (n > 0)
         {
-            self->read_request();
+            file_sent_ += n;
+            budget -= n;
+            Metrics::bytes_out(n);
+        }
+        else if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            send_timer_.expires_after(session_limits.get().io_timeout);
+            send_timer_.async_wait([self, wait = ++send_waits_](beast::error_code ec) {
+                if (!ec && wait == self->send_waits_)
+                {
+                    self->stream_.socket().cancel(ec);
+                }
+            });
+            stream_.socket().async_wait(tcp::socket::wait_write, [self](beast::error_code ec) {
+                ++self->send_waits_;
+                self->send_timer_.cancel();
+                if (ec == net::error::operation_aborted)
+                {
+                    ec = beast::error::timeout;
+                }
+                if (ec)
+                {
+                    self->handle_write_error(ec);
+                    return;
+                }
+                self->sendfile_body();
+            });
+            return;
         }
         else
         {
-            self->socket_.shutdown(tcp::socket::shutdown_send, ec);
+            // A file that shrank since it was opened ends the copy early, like any error.
+            ec = n < 0 ? beast::error_code(errno, boost::system::system_category()) : net::error::eof;
+        }
+    }
+    if (ec)
+    {
+        handle_write_error(ec);
+        return;
+    }
+
+    body_source_ = BodySource::buffered;
+    finish_write();
+#endif
+}
+
+// Without sendfile(2), or over TLS, the file is copied through the stream chunk buffer.
+void Session::copy_file_body()
+{
+    const FileRange &range = streamed_response().file_range();
+    if (file_sent_ < range.length)
+    {
+        if (!stream_chunk_)
+        {
+            stream_chunk_ = std::make_unique<char[]>(kStreamChunkSize);
+        }
+        std::size_t count = std::min<std::uint64_t>(range.length - file_sent_, kStreamChunkSize);
+        ssize_t n = ::pread(range.file->fd(), stream_chunk_.get(), count, range.offset + file_sent_);
+        if (n <= 0)
+        {
+            handle_write_error(n < 0 ? beast::error_code(errno, boost::system::system_category()) : net::error::eof);
+            return;
+        }
+        stream_.expires_after(session_limits.get().io_timeout);
+        net::async_write(stream_, net::buffer(stream_chunk_.get(), n),
+                         [self = shared_from_this()](beast::error_code ec, size_t bytes_transferred) {
+                             Metrics::bytes_out(bytes_transferred);
+                             if (ec)
+                             {
+                                 self->handle_write_error(ec);
+                                 return;
+                             }
+                             self->file_sent_ += bytes_transferred;
+                             self->copy_file_body();
+                         });
+        return;
+    }
+
+    body_source_ = BodySource::buffered;
+    finish_write();
+}
+
+// Writes every queued event as one chunk, or a heartbeat comment when there are none, then
+// waits for more; the terminating chunk follows the last event once the stream has ended.
+void Session::write_events(bool heartbeat)
+{
+    EventStream &events = *streamed_response().event_stream();
+    auto &queued = events.queued();
+    if (queued.empty() && !events.ended() && !heartbeat)
+    {
+        wait_for_events();
+        return;
+    }
+
+    static const char kData[] = "data: ";
+    static const char kEnd[] = "\n\n";
+    static const char kHeartbeat[] = ":\n\n";
+    events_out_.assign(std::make_move_iterator(queued.begin()), std::make_move_iterator(queued.end()));
+    queued.clear();
+
+    std::size_t size = 0;
+    for (const auto &event: events_out_)
+    {
+        size += sizeof(kData) - 1 + event->size() + sizeof(kEnd) - 1;
+    }
+    if (events_out_.empty() && heartbeat)
+    {
+        size = sizeof(kHeartbeat) - 1;
+    }
+
+    write_buffers_.clear();
+    bool chunked = streamed_response().chunked();
+    if (size > 0)
+    {
+        if (chunked)
+        {
+            int length = std::snprintf(chunk_header_, sizeof(chunk_header_), "%zx\r\n", size);
+            write_buffers_.push_back(net::buffer(chunk_header_, length));
+        }
+        if (events_out_.empty())
+        {
+            write_buffers_.push_back(net::buffer(kHeartbeat, sizeof(kHeartbeat) - 1));
         }
+        for (const auto &event: events_out_)
+        {
+            write_buffers_.push_back(net::buffer(kData, sizeof(kData) - 1));
+            write_buffers_.push_back(net::buffer(*event));
+            write_buffers_.push_back(net::buffer(kEnd, sizeof(kEnd) - 1));
+        }
+        if (chunked)
+        {
+            write_buffers_.push_back(net::buffer("\r\n", 2));
+        }
+    }
+    bool more = !events.ended();
+    if (!more && chunked)
+    {
+        write_buffers_.push_back(net::buffer("0\r\n\r\n", 5));
+    }
+
+    auto self = shared_from_this();
+    stream_.expires_after(session_limits.get().io_timeout);
+    net::async_write(stream_, write_buffers_, [self, more](beast::error_code ec, size_t bytes_transferred) {
+        Metrics::bytes_out(bytes_transferred);
+        self->events_out_.clear();
+        if (ec)
+        {
+            self->handle_write_error(ec);
+            return;
+        }
+
+        if (more)
+        {
+            self->write_events(false);
+            return;
+        }
+        self->body_source_ = BodySource::buffered;
+        self->finish_write();
     });
 }
+
+// The stream holds only a weak reference back, so a session that goes away while waiting
+// is not kept alive by it; the heartbeat timer holds a strong one until it fires.
+void Session::wait_for_events()
+{
+    auto self = shared_from_this();
+    streamed_response().event_stream()->wait([weak = weak_from_this()] {
+        if (auto self = weak.lock())
+        {
+            self->send_timer_.cancel();
+            self->write_events(false);
+        }
+    });
+
+    send_timer_.expires_after(kEventHeartbeat);
+    send_timer_.async_wait([self](beast::error_code ec) {
+        // Cancelled because events arrived, or fired too late to matter after they did.
+        if (ec || self->body_source_ != BodySource::events || !self->streamed_response().event_stream()->waiting())
+            return;
+        self->streamed_response().event_stream()->cancel_wait();
+        self->write_events(true);
+    });
+}
+
+// A response that was only partly sent cannot be followed by another, so the connection ends.
+void Session::handle_write_error(beast::error_code ec)
+{
+    body_source_ = BodySource::buffered;
+    release_responses();
+    if (ec == beast::error::timeout)
+    {
+        Metrics::error(Metrics::Error::timeout);
+    }
+    else
+    {
+        Metrics::error(Metrics::Error::write);
+        std::cerr << "Write error: " << ec.message() << std::endl;
+    }
+
+    beast::error_code ignored;
+    stream_.socket().close(ignored);
+}
+
+void Session::finish_write()
+{
+    bool keep_alive = responses_[responses_in_use_ - 1].keep_alive();
+    release_responses();
+
+    if (!keep_alive)
+    {
+        end_connection();
+        return;
+    }
+
+    // The flush may have happened while a request was only partly read; keep reading it.
+    continue_read();
+}
+
+// Over TLS a close_notify goes first; the client may not answer it, so the wait is short.
+void Session::end_connection()
+{
+    if (stream_.is_tls())
+    {
+        stream_.expires_after(kTlsShutdownTimeout);
+        stream_.tls().async_shutdown([self = shared_from_this()](beast::error_code) { self->shutdown_tcp(); });
+        return;
+    }
+    shutdown_tcp();
+}
+
+void Session::shutdown_tcp()
+{
+    beast::error_code ec;
+    stream_.socket().shutdown(tcp::socket::shutdown_send, ec);
+    if (rejected_body_)
+    {
+        stream_.expires_after(session_limits.get().header_timeout);
+        linger(0);
+    }
+}
+
+// Reads below TLS: the rest of a rejected body only has to be taken off the socket.
+void Session::linger(std::size_t drained)
+{
+    buffer_.clear();
+    if (drained >= kMaxLingerBytes)
+        return;
+
+    stream_.tcp_layer().async_read_some(buffer_.prepare(kStreamChunkSize),
+                            [self = shared_from_this(), drained](beast::error_code ec, size_t bytes_transferred) {
+                                if (!ec)
+                                {
+                                    self->linger(drained + bytes_transferred);
+                                }
+                            });
+}
\ No newline at end of file
@@ -1,33 +1,201 @@
 #pragma once
 
+#include "connection_stream.h"
+#include "req_context.h"
+#include "response.h"
+#include "response_cache.h"
 #include <boost/asio.hpp>
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/beast.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/bind/bind.hpp>
+#include <chrono>
+#include <cstdint>
+#include <deque>
 #include <memory>
+#include <memory_resource>
+#include <optional>
+#include <vector>
 
 namespace beast = boost::beast;
 namespace http = beast::http;
+namespace net = boost::asio;
 using tcp = boost::asio::ip::tcp;
 
+class ApiHandler;
+
+// One connection. Requests that a client pipelines are parsed straight from buffer_ and
+// handled in order; their responses are queued and sent together in one gathered write
+// once no further complete request is buffered (or Limits::max_in_flight is reached);
+// nothing more is read until they are written, which bounds the work a client can queue.
+//
+// Request and response objects are recycled for the life of the connection, so their body
+// strings keep their capacity from one request to the next (up to kMaxPooledBody), and the
+// request's header fields are allocated from a pool the connection keeps. Response header
+// fields still use the heap.
+//
+// The header is read and routed before the body. Bodies are buffered up to the body limit
+// (413 beyond it) unless the handler streams them, in which case they are read through a
+// kStreamChunkSize buffer into its BodySink. A response with a BodyProducer is written
+// chunk by chunk after its header, and a file response (Response::send_file) with
+// sendfile(2), so memory per connection stays bounded either way. An event stream
+// (Response::stream_events) is written as its events arrive, with a comment line every
+// kEventHeartbeat in between so proxies keep the connection and a vanished client shows up
+// as a failed write.
+//
+// A WebSocket upgrade on a route that accepts it hands the connection over to a
+// WebSocketSession, and the Session ends.
+//
+// Every read and write runs against a beast::tcp_stream deadline (see Limits), so idle,
+// slow or stalled clients are disconnected instead of holding a socket indefinitely.
+//
+// Given a TLS context, the connection starts with a handshake, bounded like a request
+// header, and ends with a close_notify. File responses are then copied through
+// kStreamChunkSize reads instead of sendfile(2), since the kernel cannot encrypt them.
 class Session : public std::enable_shared_from_this<Session>
 {
 public:
-    explicit Session(tcp::socket socket);
+    static constexpr std::size_t kMaxPipelined = 16;
+    static constexpr std::size_t kMaxPooledBody = 64 * 1024;
+    static constexpr std::size_t kStreamChunkSize = 16 * 1024;
+    static constexpr std::uint64_t kDefaultBodyLimit = 1024 * 1024;
+    // How much of a rejected body is read and dropped after the 413, so the client gets to
+    // read the response instead of a reset.
+    static constexpr std::size_t kMaxLingerBytes = 4 * 1024 * 1024;
+    // Most bytes of a file response sent before other connections on the thread get a turn.
+    static constexpr std::size_t kFileBytesPerTurn = 1024 * 1024;
+    static constexpr std::chrono::seconds kEventHeartbeat{15};
+    // How long a closing TLS connection waits for the client's close_notify.
+    static constexpr std::chrono::seconds kTlsShutdownTimeout{2};
+
+    // Limits shared by every Session. configure() may be called again while serving; each
+    // read or write picks up the limits current when it starts.
+    struct Limits
+    {
+        // Largest request body buffered for handlers that do not stream.
+        std::uint64_t body_limit = kDefaultBodyLimit;
+        // Pipelined requests answered before their responses are written; at most kMaxPipelined.
+        std::size_t max_in_flight = kMaxPipelined;
+        // A keep-alive connection is closed when no new request starts within this time.
+        std::chrono::seconds idle_timeout{60};
+        // Once the first byte of a request is in, its header must complete within this time.
+        std::chrono::seconds header_timeout{10};
+        // Every body read and every write must finish within this time.
+        std::chrono::seconds io_timeout{30};
+    };
+
+    // Speaks TLS when given a context; see Tls::server_context().
+    explicit Session(tcp::socket socket, std::shared_ptr<net::ssl::context> tls = nullptr);
+    ~Session();
     void start();
 
+    static void configure(const Limits &limits);
+    static const Limits &limits();
+    // Connections currently open, across all threads, including upgraded WebSocket ones.
+    static std::size_t live_count();
+
+    // For graceful shutdown: idle keep-alive connections close now, and every later response
+    // carries Connection: close, so each connection ends after the request it is handling.
+    // WebSocket connections are closed with "going away".
+    static void drain();
+    static bool is_draining();
+    // Back to normal keep-alive behaviour; for tests that drain more than once.
+    static void reset_drain();
+
 private:
+    void handshake();
     void read_request();
+    void close_if_idle();
+    void wait_for_request();
+    bool parse_buffered();
+    void continue_read();
+    void do_read_header();
+    void handle_read_header(beast::error_code ec, size_t bytes_transferred);
+    void on_header();
+    void do_read();
     void handle_read(beast::error_code ec, size_t bytes_transferred);
+    void start_body_stream();
+    void read_body_chunk();
+    void handle_body_chunk(beast::error_code ec, size_t bytes_transferred);
+    void handle_read_error(beast::error_code ec);
+    void reject_too_large();
+    void reject_bad_request(http::status status);
     void process_request();
-    void handle_not_found();
-    void handle_bad_request();
-    void write_response();
+    void upgrade_to_websocket();
+    void handle_not_found(Response &res);
+    void handle_bad_request(Response &res);
+    void handle_header_too_large(Response &res);
+    void handle_too_large(Response &res);
+    Response &acquire_response();
+    void release_responses();
+    // The last response; while body_source_ is not buffered, the one whose body is streamed.
+    Response &streamed_response();
+    void on_response_ready(CachedResponsePtr cached);
+    void write_responses();
+    void write_chunk();
+    void send_file_body();
+    void sendfile_body();
+    void copy_file_body();
+    void write_events(bool heartbeat);
+    void wait_for_events();
+    void handle_write_error(beast::error_code ec);
+    void finish_write();
+    void end_connection();
+    void shutdown_tcp();
+    void linger(std::size_t drained);
 
 private:
-    tcp::socket socket_;
+    ConnectionStream stream_;
+    // Bounds the wait for writability during sendfile(2), which tcp_stream does not see.
+    net::steady_timer send_timer_;
+    // Counts those waits, so a timeout that fires as its wait completes leaves the next alone.
+    std::uint64_t send_waits_ = 0;
+    net::ip::address remote_address_;
     beast::flat_buffer buffer_;
-    http::request<http::string_body> req_;
-    http::response<http::string_body> res_;
+    // Holds the request header fields. A request's fields go back to it when the next one
+    // is read, so after the first few requests parsing a header allocates nothing.
+    std::pmr::unsynchronized_pool_resource fields_memory_;
+    std::optional<http::request_parser<http::string_body, RequestFields::allocator_type>> parser_;
+    // Replaces parser_ once the header is in when the handler streams the request body.
+    std::optional<http::request_parser<http::buffer_body, RequestFields::allocator_type>> stream_parser_;
+    std::unique_ptr<char[]> stream_chunk_;
+    Request req_;
+    std::optional<ReqContext> ctxt_;
+    ApiHandler *handler_ = nullptr;
+    std::vector<Response> responses_;
+    // Set where a cached response is sent from its pre-serialized bytes instead.
+    std::vector<CachedResponsePtr> cached_;
+    // Per queued response, what its spans need once it is written; trace is 0 if unsampled.
+    struct TracedResponse
+    {
+        std::uint64_t trace = 0;
+        std::chrono::steady_clock::time_point start;
+        std::size_t route = 0;
+    };
+    std::vector<TracedResponse> traced_;
+    std::size_t responses_in_use_ = 0;
+    std::deque<http::response_serializer<http::string_body>> serializers_;
+    std::vector<net::const_buffer> write_buffers_;
+    // Where the body of the last queued response comes from once its header is written.
+    enum class BodySource
+    {
+        buffered,
+        producer,
+        file,
+        events,
+    };
+    BodySource body_source_ = BodySource::buffered;
+    std::uint64_t file_sent_ = 0;
+    bool rejected_body_ = false;
+    std::string chunk_out_;
+    // Events being written; they are shared with the other subscribers.
+    std::vector<std::shared_ptr<const std::string>> events_out_;
+    char chunk_header_[24];
+    std::chrono::steady_clock::time_point request_start_;
+    // When the current write began, if it carries a traced response.
+    std::chrono::steady_clock::time_point write_start_;
+    std::size_t metrics_route_ = 0;
+    // Waiting for the next request with nothing read; see close_if_idle().
+    bool idle_ = false;
+    bool registered_ = false;
 };
\ No newline at end of file
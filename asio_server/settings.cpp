@@ -0,0 +1,292 @@
+#include "settings.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <gflags/gflags.h>
+#include <limits>
+#include <map>
+#include <session.h>
+
+DEFINE_int32(port, 8080, "Server port number");
+DEFINE_int32(threads, 0, "Number of io threads, one io_context per core (0 = hardware concurrency)");
+DEFINE_int32(workers, 0, "Number of worker threads for handlers registered to run off the io threads (0 = hardware concurrency)");
+DEFINE_bool(reuse_port, true, "Give every io thread its own SO_REUSEPORT acceptor");
+DEFINE_uint64(max_body, Session::kDefaultBodyLimit, "Largest request body buffered in memory; larger ones get 413 unless the handler streams them");
+DEFINE_int32(max_connections, 0, "Pause accepting while this many connections are open (0 = unlimited)");
+DEFINE_int32(max_in_flight, Session::kMaxPipelined, "Pipelined requests per connection answered before their responses are written");
+DEFINE_int32(idle_timeout, 60, "Seconds a keep-alive connection may wait for its next request");
+DEFINE_int32(header_timeout, 10, "Seconds a started request has to deliver its complete header");
+DEFINE_int32(io_timeout, 30, "Seconds any single body read or response write may take");
+DEFINE_int32(compression_level, 6, "gzip/deflate level for compressed responses, 1-9 (0 = never compress)");
+DEFINE_int32(compression_min_size, 1024, "Smallest response body worth compressing, in bytes");
+DEFINE_double(rate_limit, 0, "Requests per second each client may make to rate-limited endpoints (0 = unlimited)");
+DEFINE_double(rate_burst, 100, "Requests a client may make at once to rate-limited endpoints");
+DEFINE_string(rate_limit_header, "", "Key rate limits by this request header when present instead of the client address");
+DEFINE_string(tls_cert, "", "PEM certificate chain; with --tls_key, connections speak TLS instead of plaintext");
+DEFINE_string(tls_key, "", "PEM private key for --tls_cert");
+DEFINE_double(trace_sample_rate, 0, "Fraction of requests traced into /debug/trace, 0-1 (0 = tracing off; "
+                                    "/debug/trace is only served when tracing is on at startup)");
+DEFINE_int32(drain_timeout, 30, "Seconds open requests get to finish after SIGTERM/SIGINT before the server exits");
+DEFINE_int32(report_interval, 60, "Seconds between accepted-connection reports (0 = disabled)");
+DEFINE_string(log_dir, "./logs", "Log directory path");
+
+Settings Settings::from_flags()
+{
+    Settings s;
+    s.port = FLAGS_port;
+    s.threads = FLAGS_threads;
+    s.workers = FLAGS_workers;
+    s.reuse_port = FLAGS_reuse_port;
+    s.max_body = FLAGS_max_body;
+    s.max_connections = FLAGS_max_connections;
+    s.max_in_flight = FLAGS_max_in_flight;
+    s.idle_timeout = FLAGS_idle_timeout;
+    s.header_timeout = FLAGS_header_timeout;
+    s.io_timeout = FLAGS_io_timeout;
+    s.compression_level = FLAGS_compression_level;
+    s.compression_min_size = FLAGS_compression_min_size;
+    s.rate_limit = FLAGS_rate_limit;
+    s.rate_burst = FLAGS_rate_burst;
+    s.rate_limit_header = FLAGS_rate_limit_header;
+    s.tls_cert = FLAGS_tls_cert;
+    s.tls_key = FLAGS_tls_key;
+    s.trace_sample_rate = FLAGS_trace_sample_rate;
+    s.drain_timeout = FLAGS_drain_timeout;
+    s.report_interval = FLAGS_report_interval;
+    s.log_dir = FLAGS_log_dir;
+    return s;
+}
+
+bool Settings::valid(std::string &error) const
+{
+    auto invalid = [&error](const char *what) {
+        error = what;
+        return false;
+    };
+    if (port <= 0)
+        return invalid("--port is required and must be positive");
+    if (log_dir.empty())
+        return invalid("--log_dir is required");
+    if (threads < 0)
+        return invalid("--threads must not be negative");
+    if (workers < 0)
+        return invalid("--workers must not be negative");
+    if (max_connections < 0)
+        return invalid("--max_connections must not be negative");
+    if (max_in_flight <= 0)
+        return invalid("--max_in_flight must be positive");
+    if (idle_timeout <= 0)
+        return invalid("--idle_timeout must be positive");
+    if (header_timeout <= 0)
+        return invalid("--header_timeout must be positive");
+    if (io_timeout <= 0)
+        return invalid("--io_timeout must be positive");
+    if (compression_level < 0 || compression_level > 9)
+        return invalid("--compression_level must be between 0 and 9");
+    if (compression_min_size < 0)
+        return invalid("--compression_min_size must not be negative");
+    if (rate_limit < 0)
+        return invalid("--rate_limit must not be negative");
+    if (rate_burst < 1)
+        return invalid("--rate_burst must be at least 1");
+    if (tls_cert.empty() != tls_key.empty())
+        return invalid("--tls_cert and --tls_key must be given together");
+    if (trace_sample_rate < 0 || trace_sample_rate > 1)
+        return invalid("--trace_sample_rate must be between 0 and 1");
+    if (drain_timeout < 0)
+        return invalid("--drain_timeout must not be negative");
+    if (report_interval < 0)
+        return invalid("--report_interval must not be negative");
+    return true;
+}
+
+static bool parse_value(const std::string &text, bool &out)
+{
+    std::string lower(text);
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return std::tolower(c); });
+    if (lower == "true" || lower == "t" || lower == "yes" || lower == "y" || lower == "1")
+    {
+        out = true;
+        return true;
+    }
+    if (lower == "false" || lower == "f" || lower == "no" || lower == "n" || lower == "0")
+    {
+        out = false;
+        return true;
+    }
+    return false;
+}
+
+static bool parse_value(const std::string &text, int &out)
+{
+    char *end = nullptr;
+    errno = 0;
+    long value = std::strtol(text.c_str(), &end, 10);
+    if (text.empty() || *end != '\0' || errno == ERANGE || value < std::numeric_limits<int>::min() ||
+        value > std::numeric_limits<int>::max())
+        return false;
+    out = static_cast<int>(value);
+    return true;
+}
+
+static bool parse_value(const std::string &text, std::uint64_t &out)
+{
+    char *end = nullptr;
+    errno = 0;
+    unsigned long long value = std::strtoull(text.c_str(), &end, 10);
+    if (text.empty() || text[0] == '-' || *end != '\0' || errno == ERANGE)
+        return false;
+    out = value;
+    return true;
+}
+
+static bool parse_value(const std::string &text, double &out)
+{
+    char *end = nullptr;
+    errno = 0;
+    double value = std::strtod(text.c_str(), &end);
+    if (text.empty() || *end != '\0' || errno == ERANGE)
+        return false;
+    out = value;
+    return true;
+}
+
+static bool parse_value(const std::string &text, std::string &out)
+{
+    out = text;
+    return true;
+}
+
+template<auto Member>
+static bool set_field(Settings &s, const std::string &text)
+{
+    return parse_value(text, s.*Member);
+}
+
+// The flags Settings holds, by name.
+static const std::map<std::string, bool (*)(Settings &, const std::string &), std::less<>> settings_fields = {
+        {"port", &set_field<&Settings::port>},
+        {"threads", &set_field<&Settings::threads>},
+        {"workers", &set_field<&Settings::workers>},
+        {"reuse_port", &set_field<&Settings::reuse_port>},
+        {"max_body", &set_field<&Settings::max_body>},
+        {"max_connections", &set_field<&Settings::max_connections>},
+        {"max_in_flight", &set_field<&Settings::max_in_flight>},
+        {"idle_timeout", &set_field<&Settings::idle_timeout>},
+        {"header_timeout", &set_field<&Settings::header_timeout>},
+        {"io_timeout", &set_field<&Settings::io_timeout>},
+        {"compression_level", &set_field<&Settings::compression_level>},
+        {"compression_min_size", &set_field<&Settings::compression_min_size>},
+        {"rate_limit", &set_field<&Settings::rate_limit>},
+        {"rate_burst", &set_field<&Settings::rate_burst>},
+        {"rate_limit_header", &set_field<&Settings::rate_limit_header>},
+        {"tls_cert", &set_field<&Settings::tls_cert>},
+        {"tls_key", &set_field<&Settings::tls_key>},
+        {"trace_sample_rate", &set_field<&Settings::trace_sample_rate>},
+        {"drain_timeout", &set_field<&Settings::drain_timeout>},
+        {"report_interval", &set_field<&Settings::report_interval>},
+        {"log_dir", &set_field<&Settings::log_dir>},
+};
+
+bool read_flagfile(const std::string &path, Settings &s, std::vector<std::string> &restart_only,
+                   std::string &error)
+{
+    std::ifstream in(path);
+    if (!in)
+    {
+        error = "cannot open it";
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(in, line))
+    {
+        auto first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#')
+            continue;
+        line = line.substr(first, line.find_last_not_of(" \t\r") + 1 - first);
+        if (line[0] != '-')
+        {
+            error = "unsupported line \"" + line + "\"";
+            return false;
+        }
+
+        std::string name = line.substr(line.find_first_not_of('-'));
+        std::string value;
+        gflags::CommandLineFlagInfo info;
+        auto eq = name.find('=');
+        if (eq != std::string::npos)
+        {
+            value = name.substr(eq + 1);
+            name.resize(eq);
+        }
+        else if (!gflags::GetCommandLineFlagInfo(name.c_str(), &info) && name.rfind("no", 0) == 0)
+        {
+            name.erase(0, 2);
+            value = "false";
+        }
+        else
+        {
+            value = "true";
+        }
+
+        if (name == "flagfile" || !gflags::GetCommandLineFlagInfo(name.c_str(), &info) ||
+            (eq == std::string::npos && info.type != "bool"))
+        {
+            error = "unsupported flag \"" + line + "\"";
+            return false;
+        }
+        auto field = settings_fields.find(name);
+        if (field != settings_fields.end())
+        {
+            if (!field->second(s, value))
+            {
+                error = "--" + name + " has a bad value \"" + value + "\"";
+                return false;
+            }
+        }
+        else if (value != info.current_value)
+        {
+            restart_only.push_back("--" + name);
+        }
+    }
+    return true;
+}
+
+bool reload_settings(const std::string &path, const Settings &current, Settings &next,
+                     std::vector<std::string> &restart_only, std::string &error)
+{
+    next = current;
+    if (!read_flagfile(path, next, restart_only, error) || !next.valid(error))
+        return false;
+
+    if (next.threads != current.threads)
+    {
+        restart_only.push_back("--threads");
+    }
+    if (next.port != current.port)
+    {
+        restart_only.push_back("--port");
+    }
+    if (next.reuse_port != current.reuse_port)
+    {
+        restart_only.push_back("--reuse_port");
+    }
+    if (next.log_dir != current.log_dir)
+    {
+        restart_only.push_back("--log_dir");
+    }
+    if (next.tls_cert.empty() != current.tls_cert.empty())
+    {
+        restart_only.push_back("turning TLS on or off");
+        next.tls_cert = current.tls_cert;
+        next.tls_key = current.tls_key;
+    }
+    next.threads = current.threads;
+    next.port = current.port;
+    next.reuse_port = current.reuse_port;
+    next.log_dir = current.log_dir;
+    return true;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Every setting main() takes from flags. Startup fills it from the parsed command line;
+// SIGHUP builds a new one from --flagfile and publishes it only once it is valid. Nothing
+// writes the live FLAGS_* after startup, so code that reads them directly, like the
+// artifact handler, never sees a half-applied file.
+struct Settings
+{
+    int port = 0;
+    int threads = 0;
+    int workers = 0;
+    bool reuse_port = true;
+    std::uint64_t max_body = 0;
+    int max_connections = 0;
+    int max_in_flight = 0;
+    int idle_timeout = 0;
+    int header_timeout = 0;
+    int io_timeout = 0;
+    int compression_level = 0;
+    int compression_min_size = 0;
+    double rate_limit = 0;
+    double rate_burst = 0;
+    std::string rate_limit_header;
+    std::string tls_cert;
+    std::string tls_key;
+    double trace_sample_rate = 0;
+    int drain_timeout = 0;
+    int report_interval = 0;
+    std::string log_dir;
+
+    static Settings from_flags();
+
+    // On failure `error` names the offending flag and what it must be.
+    bool valid(std::string &error) const;
+};
+
+// Reads a gflags flagfile into `s` instead of the live FLAGS_*: "--name=value" per line,
+// "--name" or "--noname" for booleans, '#' comments. A known flag that Settings does not
+// hold, such as --artifact_dir, is only read at startup; if the file changes it, its name
+// is added to `restart_only`. Returns false with `error` set for anything else.
+bool read_flagfile(const std::string &path, Settings &s, std::vector<std::string> &restart_only,
+                   std::string &error);
+
+// What SIGHUP would switch to: `current` updated from the flagfile at `path`, checked with
+// valid(). The io thread count, the port, --reuse_port, the log directory and whether TLS
+// is on are kept from `current`; a file that changes them gets them added to
+// `restart_only`, and the rest of it still applies. (--workers does change: the
+// WorkerPool resizes.)
+bool reload_settings(const std::string &path, const Settings &current, Settings &next,
+                     std::vector<std::string> &restart_only, std::string &error);
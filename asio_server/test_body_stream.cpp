@@ -0,0 +1,211 @@
+#include "router.h"
+#include "session.h"
+#include "test_util.h"
+#include <boost/asio.hpp>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+// Counts an upload without keeping it, and remembers the largest piece it was handed.
+class counting_sink : public BodySink
+{
+public:
+    bool write(std::string_view chunk) override
+    {
+        bytes += chunk.size();
+        largest = std::max(largest, chunk.size());
+        return bytes <= 8 * 1024 * 1024;
+    }
+
+    std::size_t bytes = 0;
+    std::size_t largest = 0;
+};
+
+class upload_handler : public ApiHandler
+{
+public:
+    upload_handler()
+    {
+        stream_request_body(16 * 1024 * 1024);
+    }
+
+    std::unique_ptr<BodySink> open_body_sink(const ReqContext &) override
+    {
+        return std::make_unique<counting_sink>();
+    }
+
+    void handle_request(const ReqContext &ctxt, Response &res) override
+    {
+        auto *sink = static_cast<counting_sink *>(ctxt.body_sink());
+        res.result(http::status::ok);
+        res.body() = std::to_string(sink->bytes) + " " + std::to_string(sink->largest) + " " +
+                     std::to_string(ctxt.body().size());
+    }
+};
+
+// Streams `count` pieces of 10000 bytes each, the n-th filled with 'a' + n % 26.
+class download_handler : public ApiHandler
+{
+public:
+    void handle_request(const ReqContext &ctxt, Response &res) override
+    {
+        int count = std::stoi(std::string(ctxt.path_param("count")));
+        res.result(http::status::ok);
+        res.set(http::field::content_type, "text/plain");
+        res.stream_body([count, n = 0](std::string &chunk) mutable {
+            chunk.assign(10000, static_cast<char>('a' + n % 26));
+            return ++n < count;
+        });
+    }
+};
+
+class echo_handler : public ApiHandler
+{
+public:
+    void handle_request(const ReqContext &ctxt, Response &res) override
+    {
+        res.result(http::status::ok);
+        res.body() = std::to_string(ctxt.body().size());
+    }
+};
+
+static http::response<http::string_body> round_trip(tcp::socket &socket, http::request<http::string_body> &req)
+{
+    req.set(http::field::host, "localhost");
+    // A rejected upload is answered before it has been sent in full, so write errors are expected.
+    beast::error_code ec;
+    http::write(socket, req, ec);
+
+    beast::flat_buffer buffer;
+    http::response_parser<http::string_body> parser;
+    parser.body_limit(64 * 1024 * 1024);
+    http::read(socket, buffer, parser, ec);
+    return parser.release();
+}
+
+void test_streamed_upload(const tcp::endpoint &endpoint)
+{
+    net::io_context ctx;
+    tcp::socket socket(ctx);
+    socket.connect(endpoint);
+
+    // Larger than the buffered body limit, sent both with a length and chunked.
+    http::request<http::string_body> req{http::verb::post, "/upload", 11};
+    req.body().assign(3 * 1024 * 1024, 'x');
+    req.prepare_payload();
+    auto res = round_trip(socket, req);
+    check(res.result() == http::status::ok, "streamed upload accepted");
+    std::size_t bytes = 0, largest = 0, buffered = 0;
+    sscanf(res.body().c_str(), "%zu %zu %zu", &bytes, &largest, &buffered);
+    check(bytes == 3 * 1024 * 1024 && buffered == 0, "upload went to the sink");
+    check(largest > 4096 && largest <= Session::kStreamChunkSize, "upload handed over in pieces of at most kStreamChunkSize");
+
+    http::request<http::string_body> chunked{http::verb::post, "/upload", 11};
+    chunked.body().assign(100000, 'y');
+    chunked.chunked(true);
+    res = round_trip(socket, chunked);
+    check(res.result() == http::status::ok && res.body().rfind("100000 ", 0) == 0, "chunked upload on same connection");
+
+    http::request<http::string_body> rejected{http::verb::post, "/upload", 11};
+    rejected.body().assign(9 * 1024 * 1024, 'z');
+    rejected.prepare_payload();
+    res = round_trip(socket, rejected);
+    check(res.result() == http::status::payload_too_large && !res.keep_alive(), "sink rejection answers 413");
+}
+
+void test_buffered_limit(const tcp::endpoint &endpoint)
+{
+    net::io_context ctx;
+    tcp::socket socket(ctx);
+    socket.connect(endpoint);
+
+    http::request<http::string_body> small{http::verb::post, "/echo", 11};
+    small.body().assign(1000, 'x');
+    small.prepare_payload();
+    auto res = round_trip(socket, small);
+    check(res.result() == http::status::ok && res.body() == "1000", "small body is buffered");
+
+    http::request<http::string_body> large{http::verb::post, "/echo", 11};
+    large.body().assign(Session::kDefaultBodyLimit + 1, 'x');
+    large.prepare_payload();
+    res = round_trip(socket, large);
+    check(res.result() == http::status::payload_too_large, "Content-Length over the limit gets 413");
+
+    tcp::socket chunked_socket(ctx);
+    chunked_socket.connect(endpoint);
+    http::request<http::string_body> chunked{http::verb::post, "/echo", 11};
+    chunked.body().assign(Session::kDefaultBodyLimit + 1, 'x');
+    chunked.chunked(true);
+    res = round_trip(chunked_socket, chunked);
+    check(res.result() == http::status::payload_too_large, "chunked body over the limit gets 413");
+}
+
+void test_streamed_download(const tcp::endpoint &endpoint)
+{
+    net::io_context ctx;
+    tcp::socket socket(ctx);
+    socket.connect(endpoint);
+
+    http::request<http::string_body> req{http::verb::get, "/download/300", 11};
+    auto res = round_trip(socket, req);
+    check(res.result() == http::status::ok && res.chunked(), "download is chunked");
+    check(res.body().size() == 3000000 && res.body()[0] == 'a' && res.body()[10000] == 'b' &&
+                  res.body()[2999999] == 'a' + 299 % 26,
+          "download body");
+
+    // The connection stays usable, including for pipelined requests behind a stream.
+    http::request<http::string_body> version{http::verb::get, "/download/2", 11};
+    version.set(http::field::host, "localhost");
+    http::write(socket, version);
+    http::write(socket, version);
+    beast::flat_buffer buffer;
+    for (int i = 0; i < 2; ++i)
+    {
+        http::response<http::string_body> next;
+        http::read(socket, buffer, next);
+        check(next.body().size() == 20000, "pipelined streamed responses");
+    }
+
+    // HEAD gets the headers of the GET, with no body and no made-up Content-Length: 0; the
+    // request pipelined behind it still parses, so nothing was sent in place of a body.
+    http::request<http::string_body> head{http::verb::head, "/download/2", 11};
+    head.set(http::field::host, "localhost");
+    http::write(socket, head);
+    http::write(socket, version);
+    http::response_parser<http::string_body> head_parser;
+    head_parser.skip(true);
+    http::read(socket, buffer, head_parser);
+    auto head_res = head_parser.release();
+    check(head_res.result() == http::status::ok && head_res.body().empty(), "HEAD does not run the producer");
+    check(head_res.count(http::field::content_length) == 0, "HEAD of a stream has no Content-Length");
+    check(head_res[http::field::content_type] == "text/plain", "HEAD keeps the GET's headers");
+    http::response<http::string_body> after;
+    http::read(socket, buffer, after);
+    check(after.body().size() == 20000, "response after HEAD intact");
+}
+
+void test_http10_download(const tcp::endpoint &endpoint)
+{
+    net::io_context ctx;
+    tcp::socket socket(ctx);
+    socket.connect(endpoint);
+
+    http::request<http::string_body> req{http::verb::get, "/download/5", 10};
+    auto res = round_trip(socket, req);
+    check(!res.chunked() && res.body().size() == 50000, "HTTP/1.0 body delimited by close");
+}
+
+int main()
+{
+    Router::register_static_handler("/upload", std::make_shared<upload_handler>());
+    Router::register_static_handler("/echo", std::make_shared<echo_handler>());
+    Router::register_dynamic_handler("/download/{count}", std::make_shared<download_handler>());
+
+    TestServer server;
+    test_streamed_upload(server.endpoint());
+    test_buffered_limit(server.endpoint());
+    test_streamed_download(server.endpoint());
+    test_http10_download(server.endpoint());
+
+    return test_summary("body stream");
+}
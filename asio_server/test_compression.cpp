@@ -0,0 +1,304 @@
+#include "api_handler.h"
+#include "compression.h"
+#include "response_cache.h"
+#include "test_util.h"
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include <zlib.h>
+
+// A task list shaped like /taskDetailList output, `count` entries long.
+static std::string task_list_json(int count)
+{
+    std::string json = "{\"code\":0,\"message\":\"success\",\"tasks\":[";
+    for (int i = 0; i < count; ++i)
+    {
+        if (i)
+            json += ',';
+        json += "{\"taskId\":\"task-" + std::to_string(100000 + i) + "\",\"status\":\"" +
+                (i % 3 ? "running" : "finished") + "\",\"progress\":" + std::to_string(i * 37 % 101) +
+                ",\"createdAt\":" + std::to_string(1700000000 + i * 13) + ",\"owner\":\"user" +
+                std::to_string(i % 17) + "\"}";
+    }
+    return json + "]}";
+}
+
+class json_handler : public ApiHandler
+{
+public:
+    json_handler(std::string body, bool cached) : body_(std::move(body))
+    {
+        if (cached)
+            cache_responses();
+    }
+
+    void handle_request(const ReqContext &, Response &res) override
+    {
+        ++calls;
+        res.result(http::status::ok);
+        res.set(http::field::content_type, "application/json");
+        for (const auto &cookie: cookies)
+        {
+            res.insert(http::field::set_cookie, cookie);
+        }
+        res.body() = body_;
+        if (tagged)
+            res.set(http::field::etag, ResponseCache::make_etag(body_));
+        res.prepare_payload();
+    }
+
+    int calls = 0;
+    std::vector<std::string> cookies;
+    bool tagged = false;
+
+private:
+    std::string body_;
+};
+
+static std::string inflate_body(const std::string &in, bool gzip)
+{
+    z_stream z{};
+    inflateInit2(&z, gzip ? 15 + 16 : 15);
+    std::string out(1 << 20, '\0');
+    z.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(in.data()));
+    z.avail_in = static_cast<uInt>(in.size());
+    z.next_out = reinterpret_cast<Bytef *>(out.data());
+    z.avail_out = static_cast<uInt>(out.size());
+    int rc = inflate(&z, Z_FINISH);
+    out.resize(z.total_out);
+    inflateEnd(&z);
+    return rc == Z_STREAM_END ? out : std::string();
+}
+
+struct Result
+{
+    Response res;
+    CachedResponsePtr cached;
+};
+
+static Result get(ApiHandler &handler, const char *accept_encoding)
+{
+    Request req{http::verb::get, "/tasks", 11};
+    if (accept_encoding)
+        req.set(http::field::accept_encoding, accept_encoding);
+    ReqContext ctxt(req);
+    Result result;
+    handler.execute(ctxt, result.res, [&](CachedResponsePtr cached) { result.cached = std::move(cached); });
+    return result;
+}
+
+void test_negotiate()
+{
+    using E = Compression::Encoding;
+    check(Compression::negotiate("") == E::identity, "no header");
+    check(Compression::negotiate("gzip") == E::gzip, "gzip");
+    check(Compression::negotiate("deflate, gzip") == E::gzip, "gzip preferred on a tie");
+    check(Compression::negotiate("gzip;q=0.5, deflate") == E::deflate, "higher q wins");
+    check(Compression::negotiate("GZIP; q=0.8") == E::gzip, "case and spaces");
+    check(Compression::negotiate("gzip;q=0, deflate;q=0") == E::identity, "q=0 refuses");
+    check(Compression::negotiate("br, identity") == E::identity, "nothing we offer");
+    check(Compression::negotiate("*") == E::gzip, "wildcard");
+    check(Compression::negotiate("*;q=0.5, gzip;q=0") == E::deflate, "wildcard covers unlisted codings only");
+}
+
+void test_round_trip()
+{
+    std::string body = task_list_json(50);
+    std::string out;
+    check(Compression::compress(body, Compression::Encoding::gzip, 6, out) && inflate_body(out, true) == body,
+          "gzip round trip");
+    check(Compression::compress(body, Compression::Encoding::deflate, 1, out) && inflate_body(out, false) == body,
+          "deflate round trip");
+    check(!Compression::compress("ab", Compression::Encoding::gzip, 6, out), "no gain is reported");
+}
+
+void test_uncached()
+{
+    std::string body = task_list_json(50);
+    json_handler handler(body, false);
+    handler.use<Compression>(Compression::Options{6, 1024, true});
+
+    Result r = get(handler, "gzip, deflate");
+    check(r.res[http::field::content_encoding] == "gzip" && inflate_body(r.res.body(), true) == body, "gzip body");
+    check(r.res[http::field::content_length] == std::to_string(r.res.body().size()), "length of compressed body");
+    check(r.res[http::field::vary] == "Accept-Encoding", "Vary on compressed response");
+
+    r = get(handler, nullptr);
+    check(r.res[http::field::content_encoding].empty() && r.res.body() == body, "identity without Accept-Encoding");
+    check(r.res[http::field::vary] == "Accept-Encoding", "Vary on identity response");
+
+    json_handler small("{\"code\":0}", false);
+    small.use<Compression>(Compression::Options{6, 1024, true});
+    r = get(small, "gzip");
+    check(r.res[http::field::content_encoding].empty() && r.res[http::field::vary].empty(), "small body untouched");
+
+    json_handler off(body, false);
+    off.use<Compression>(Compression::Options{0, 1024, true});
+    r = get(off, "gzip");
+    check(r.res[http::field::content_encoding].empty() && r.res.body() == body, "level 0 turns it off");
+}
+
+// Records the thread that compresses.
+class thread_compression : public Compression
+{
+public:
+    thread_compression(const Options &options, std::thread::id &id) : Compression(options), id_(id) {}
+
+    void on_response(const ReqContext &ctxt, Response &res, CachedResponsePtr &cached) override
+    {
+        id_ = std::this_thread::get_id();
+        Compression::on_response(ctxt, res, cached);
+    }
+
+private:
+    std::thread::id &id_;
+};
+
+void test_worker_handler()
+{
+    std::string body = task_list_json(50);
+    json_handler handler(body, false);
+    std::thread::id compress_thread;
+    handler.use<thread_compression>(Compression::Options{6, 1024, true}, compress_thread);
+    handler.set_run_on_worker(true);
+
+    boost::asio::io_context ctx;
+    auto guard = boost::asio::make_work_guard(ctx);
+    Request req{http::verb::get, "/tasks", 11};
+    req.set(http::field::accept_encoding, "gzip");
+    ReqContext ctxt(req);
+    ctxt.set_executor(ctx.get_executor());
+    Response res;
+    handler.execute(ctxt, res, [&](CachedResponsePtr) { guard.reset(); });
+    ctx.run_for(std::chrono::seconds(5));
+
+    check(res[http::field::content_encoding] == "gzip" && inflate_body(res.body(), true) == body,
+          "worker handler body gzipped");
+    check(compress_thread != std::thread::id() && compress_thread != std::this_thread::get_id(),
+          "worker handler body compressed off the io thread");
+}
+
+void test_cached_variants()
+{
+    std::string body = task_list_json(50);
+    json_handler handler(body, true);
+    handler.use<Compression>(Compression::Options{6, 1024, true});
+
+    get(handler, "gzip");// fills the response cache
+    std::size_t before = Compression::cached_variants();
+    Result first = get(handler, "gzip");
+    Result second = get(handler, "gzip");
+    check(first.cached && first.cached == second.cached, "variant reused");
+    check(Compression::cached_variants() == before + 1, "one variant per encoding");
+    check(first.cached->message[http::field::content_encoding] == "gzip" &&
+                  inflate_body(first.cached->message.body(), true) == body,
+          "cached variant is compressed");
+    check(first.cached->wire.find("Content-Encoding: gzip\r\n") != std::string::npos, "wire bytes carry the encoding");
+    check(first.cached->etag.rfind("W/\"", 0) == 0, "compressed variant has a weak ETag");
+
+    Result plain = get(handler, nullptr);
+    check(plain.cached && plain.cached != first.cached && plain.cached->message.body() == body, "identity variant");
+    check(handler.calls == 1, "handler ran once");
+
+    // Revalidating the compressed copy still gets 304.
+    Request req{http::verb::get, "/tasks", 11};
+    req.set(http::field::accept_encoding, "gzip");
+    req.set(http::field::if_none_match, first.cached->etag);
+    ReqContext ctxt(req);
+    Response res;
+    handler.execute(ctxt, res, [](CachedResponsePtr) {});
+    check(res.result() == http::status::not_modified, "weak ETag revalidates");
+}
+
+void test_tagged_variants()
+{
+    // Not the body of the tests above, whose responses were tagged by the response cache.
+    std::string body = task_list_json(60);
+    json_handler handler(body, false);
+    handler.tagged = true;
+    handler.use<Compression>(Compression::Options{6, 1024, true});
+
+    auto reused = Compression::reused_tagged_variants();
+    Result first = get(handler, "gzip");
+    Result second = get(handler, "gzip");
+    check(handler.calls == 2 && !second.cached, "uncached handler runs every time");
+    check(Compression::reused_tagged_variants() == reused + 1, "compressed body reused by ETag");
+    check(second.res.body() == first.res.body() && inflate_body(second.res.body(), true) == body,
+          "reused body is the compressed one");
+    check(second.res[http::field::content_encoding] == "gzip" && second.res[http::field::etag].substr(0, 2) == "W/",
+          "reused body sent as gzip with a weak ETag");
+    check(second.res[http::field::content_length] == std::to_string(second.res.body().size()),
+          "length of the reused body");
+
+    Result deflated = get(handler, "deflate");
+    check(deflated.res[http::field::content_encoding] == "deflate" && inflate_body(deflated.res.body(), false) == body,
+          "each encoding compressed on its own");
+
+    json_handler untagged(body, false);
+    untagged.use<Compression>(Compression::Options{6, 1024, true});
+    reused = Compression::reused_tagged_variants();
+    get(untagged, "gzip");
+    get(untagged, "gzip");
+    check(Compression::reused_tagged_variants() == reused, "no reuse without an ETag");
+}
+
+void test_cached_without_variants()
+{
+    std::string body = task_list_json(50);
+    json_handler handler(body, true);
+    handler.cookies = {"a=1", "b=2"};
+    handler.use<Compression>(Compression::Options{6, 1024, false});
+
+    get(handler, "gzip");// fills the response cache
+    Result r = get(handler, "gzip");
+    check(!r.cached && handler.calls == 1, "cached response sent uncached");
+    check(r.res[http::field::content_encoding] == "gzip" && inflate_body(r.res.body(), true) == body,
+          "compressed for this request");
+    check(r.res.count(http::field::set_cookie) == 2, "both Set-Cookie fields kept");
+    check(r.res[http::field::content_length] == std::to_string(r.res.body().size()), "length of compressed body");
+}
+
+// Wire bytes and CPU per request for a large list response: compression off, each level on
+// every request, and served from a cached compressed variant.
+void bench_compression()
+{
+    std::string body = task_list_json(1000);
+    const int iterations = 2000;
+
+    auto run = [&](const char *label, const char *accept_encoding, int level, bool cached) {
+        json_handler handler(body, cached);
+        handler.use<Compression>(Compression::Options{level, 1024, true});
+        std::size_t bytes = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i)
+        {
+            Result r = get(handler, accept_encoding);
+            bytes = r.cached ? r.cached->message.body().size() : r.res.body().size();
+        }
+        auto us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        printf("  %-18s %8zu bytes %9.1f us/request\n", label, bytes, us / iterations);
+    };
+
+    run("off", "gzip", 0, false);
+    run("gzip level 1", "gzip", 1, false);
+    run("gzip level 6", "gzip", 6, false);
+    run("gzip level 9", "gzip", 9, false);
+    run("gzip cached", "gzip", 6, true);
+}
+
+int main()
+{
+    test_negotiate();
+    test_round_trip();
+    test_uncached();
+    test_worker_handler();
+    test_cached_variants();
+    test_tagged_variants();
+    test_cached_without_variants();
+    bench_compression();
+
+    return test_summary("compression");
+}
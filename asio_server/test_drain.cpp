@@ -0,0 +1,127 @@
+#include "io_context_pool.h"
+#include "router.h"
+#include "server.h"
+#include "session.h"
+#include "test_util.h"
+#include "worker_pool.h"
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+// Takes long enough on the worker pool to still be running when the drain starts.
+class slow_handler : public ApiHandler
+{
+public:
+    void handle_request(const ReqContext &, Response &res) override
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        res.result(http::status::ok);
+        res.body() = "slow";
+    }
+};
+
+class fast_handler : public ApiHandler
+{
+public:
+    void handle_request(const ReqContext &, Response &res) override
+    {
+        res.result(http::status::ok);
+        res.body() = "fast";
+    }
+};
+
+using Clock = std::chrono::steady_clock;
+
+static bool closed_within(tcp::socket &socket, std::chrono::milliseconds limit)
+{
+    auto start = Clock::now();
+    char data[256];
+    beast::error_code ec;
+    while (!ec)
+    {
+        socket.read_some(net::buffer(data), ec);
+    }
+    return ec == net::error::eof && Clock::now() - start < limit;
+}
+
+void test_reconfigure()
+{
+    Session::Limits limits;
+    limits.max_in_flight = 3;
+    Session::configure(limits);
+    const Session::Limits &before = Session::limits();
+    limits.max_in_flight = 5;
+    Session::configure(limits);
+    check(Session::limits().max_in_flight == 5, "new limits apply");
+    check(before.max_in_flight == 3, "earlier snapshot stays valid");
+    Session::configure(Session::Limits{});
+}
+
+void test_drain()
+{
+    IoContextPool pool(1);
+    Server server(pool, 0, false);
+    std::thread runner([&pool] { pool.run(); });
+
+    net::io_context ctx;
+    tcp::endpoint endpoint(net::ip::make_address("127.0.0.1"), server.port());
+
+    // An idle keep-alive connection, and one whose request is still being handled.
+    tcp::socket idle(ctx);
+    idle.connect(endpoint);
+    http::request<http::empty_body> fast{http::verb::get, "/fast", 11};
+    http::write(idle, fast);
+    beast::flat_buffer idle_buffer;
+    http::response<http::string_body> idle_res;
+    http::read(idle, idle_buffer, idle_res);
+    check(idle_res.keep_alive(), "keep-alive before the drain");
+
+    tcp::socket busy(ctx);
+    busy.connect(endpoint);
+    http::request<http::empty_body> slow{http::verb::get, "/slow", 11};
+    http::write(busy, slow);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    server.stop_accepting();
+    Session::drain();
+
+    check(closed_within(idle, std::chrono::milliseconds(200)), "idle connection closed at once");
+
+    beast::flat_buffer buffer;
+    http::response<http::string_body> res;
+    beast::error_code ec;
+    http::read(busy, buffer, res, ec);
+    check(!ec && res.body() == "slow", "in-flight request finishes");
+    check(!res.keep_alive(), "its response says Connection: close");
+    check(closed_within(busy, std::chrono::milliseconds(200)), "then the connection closes");
+
+    tcp::socket late(ctx);
+    late.connect(endpoint, ec);
+    check(ec == net::error::connection_refused, "no new connections");
+
+    for (int i = 0; i < 100 && Session::live_count() > 0; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    check(Session::live_count() == 0, "every session gone");
+
+    pool.stop();
+    runner.join();
+    Session::reset_drain();
+}
+
+int main()
+{
+    auto slow = std::make_shared<slow_handler>();
+    slow->set_run_on_worker(true);
+    Router::register_static_handler("/slow", slow);
+    Router::register_static_handler("/fast", std::make_shared<fast_handler>());
+
+    test_reconfigure();
+    test_drain();
+    WorkerPool::shutdown();
+
+    return test_summary("drain");
+}
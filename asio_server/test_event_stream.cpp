@@ -0,0 +1,252 @@
+#include "event_hub.h"
+#include "router.h"
+#include "session.h"
+#include "test_util.h"
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstdio>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Subscribes the response to the topic named in the path, after a greeting event.
+class events_handler : public ApiHandler
+{
+public:
+    void handle_request(const ReqContext &ctxt, Response &res) override
+    {
+        res.result(http::status::ok);
+        auto stream = res.stream_events(ctxt.executor());
+        stream->deliver(std::make_shared<const std::string>("hello"));
+        stream->subscribe(std::string(ctxt.path_param("topic")));
+    }
+};
+
+// Subscribes, then ends the stream straight away.
+class finished_handler : public ApiHandler
+{
+public:
+    void handle_request(const ReqContext &ctxt, Response &res) override
+    {
+        res.result(http::status::ok);
+        auto stream = res.stream_events(ctxt.executor());
+        stream->subscribe(std::string(ctxt.path_param("topic")));
+        stream->deliver(std::make_shared<const std::string>("over"));
+        stream->end();
+    }
+};
+
+// Counts deliveries without a connection; for the fan-out benchmark.
+class counting_subscriber : public EventSubscriber
+{
+public:
+    explicit counting_subscriber(net::any_io_executor executor) : executor_(std::move(executor)) {}
+
+    net::any_io_executor executor() const override
+    {
+        return executor_;
+    }
+    void deliver(const std::shared_ptr<const std::string> &) override
+    {
+        ++delivered;
+    }
+    void end() override
+    {
+        ended = true;
+    }
+
+    std::size_t delivered = 0;
+    bool ended = false;
+
+private:
+    net::any_io_executor executor_;
+};
+
+static bool wait_for_subscribers(std::size_t count)
+{
+    for (int i = 0; i < 200 && EventHub::subscriber_count() != count; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return EventHub::subscriber_count() == count;
+}
+
+static void publish(const std::string &topic, const char *event, bool last = false)
+{
+    EventHub::publish(topic, std::make_shared<const std::string>(event), last);
+}
+
+void test_fan_out(const tcp::endpoint &endpoint)
+{
+    const int clients = 50;
+    net::io_context ctx;
+    std::vector<tcp::socket> sockets;
+    for (int i = 0; i < clients; ++i)
+    {
+        auto &socket = sockets.emplace_back(ctx);
+        socket.connect(endpoint);
+        http::request<http::empty_body> req{http::verb::get, "/events/fan", 11};
+        http::write(socket, req);
+    }
+    check(wait_for_subscribers(clients), "every client subscribed");
+
+    publish("fan", "1");
+    publish("other", "x");
+    publish("fan", "2", true);
+
+    bool all = true;
+    for (auto &socket: sockets)
+    {
+        beast::flat_buffer buffer;
+        http::response<http::string_body> res;
+        beast::error_code ec;
+        http::read(socket, buffer, res, ec);
+        all = all && !ec && res.chunked() && res[http::field::content_type] == "text/event-stream" &&
+              res.body() == "data: hello\n\ndata: 1\n\ndata: 2\n\n";
+    }
+    check(all, "each client gets every event of its topic, then the end of the stream");
+    check(EventHub::subscriber_count() == 0, "a finished topic is forgotten");
+
+    // The connection is back to serving requests.
+    http::request<http::empty_body> req{http::verb::get, "/events/again", 11};
+    http::write(sockets[0], req);
+    check(wait_for_subscribers(1), "next request on the same connection");
+    publish("again", "3", true);
+    beast::flat_buffer buffer;
+    http::response<http::string_body> res;
+    http::read(sockets[0], buffer, res);
+    check(res.body() == "data: hello\n\ndata: 3\n\n", "second stream");
+}
+
+void test_closed_client(const tcp::endpoint &endpoint)
+{
+    net::io_context ctx;
+    tcp::socket socket(ctx);
+    socket.connect(endpoint);
+    http::request<http::empty_body> req{http::verb::get, "/events/gone", 11};
+    http::write(socket, req);
+    check(wait_for_subscribers(1), "subscribed");
+    socket.close();
+
+    // The session notices at its next write; once it is gone, so is the subscription.
+    for (int i = 0; i < 5; ++i)
+    {
+        publish("gone", "x");
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    check(wait_for_subscribers(0), "closed client is dropped");
+}
+
+// A stream ended by its handler, as for a task that is already final, never hears from its
+// topic again; it must still leave the hub.
+void test_ended_by_handler(const tcp::endpoint &endpoint)
+{
+    net::io_context ctx;
+    tcp::socket socket(ctx);
+    socket.connect(endpoint);
+    http::request<http::empty_body> req{http::verb::get, "/finished/done", 11};
+    http::write(socket, req);
+    beast::flat_buffer buffer;
+    http::response<http::string_body> res;
+    http::read(socket, buffer, res);
+    check(res.body() == "data: over\n\n", "ended stream written");
+    check(wait_for_subscribers(0), "ended stream unsubscribed without a publish");
+}
+
+void test_drain(const tcp::endpoint &endpoint)
+{
+    net::io_context ctx;
+    tcp::socket socket(ctx);
+    socket.connect(endpoint);
+    http::request<http::empty_body> req{http::verb::get, "/events/drain", 11};
+    http::write(socket, req);
+    check(wait_for_subscribers(1), "subscribed before the drain");
+
+    Session::drain();
+    beast::flat_buffer buffer;
+    http::response<http::string_body> res;
+    beast::error_code ec;
+    http::read(socket, buffer, res, ec);
+    check(!ec && res.body() == "data: hello\n\n", "drain ends the stream");
+    char byte;
+    socket.read_some(net::buffer(&byte, 1), ec);
+    check(ec == net::error::eof, "then the connection closes");
+    Session::reset_drain();
+    check(wait_for_subscribers(0), "drained subscriber forgotten");
+}
+
+void test_http10(const tcp::endpoint &endpoint)
+{
+    net::io_context ctx;
+    tcp::socket socket(ctx);
+    socket.connect(endpoint);
+    http::request<http::empty_body> req{http::verb::get, "/events/old", 10};
+    http::write(socket, req);
+    check(wait_for_subscribers(1), "HTTP/1.0 client subscribed");
+    publish("old", "1", true);
+
+    beast::flat_buffer buffer;
+    http::response<http::string_body> res;
+    http::read(socket, buffer, res);
+    check(!res.chunked() && res.body() == "data: hello\n\ndata: 1\n\n", "HTTP/1.0 stream delimited by close");
+}
+
+// One publish reaching 10000 subscribers on one io thread: the cost per delivery, including
+// the post to the thread and the walk over its subscribers.
+void bench_fan_out()
+{
+    const std::size_t subscribers = 10000;
+    const int events = 100;
+    net::io_context ctx{1};
+    auto guard = net::make_work_guard(ctx);
+    std::thread runner([&ctx] { ctx.run(); });
+
+    std::vector<std::shared_ptr<counting_subscriber>> subs;
+    for (std::size_t i = 0; i < subscribers; ++i)
+    {
+        subs.push_back(std::make_shared<counting_subscriber>(ctx.get_executor()));
+        EventHub::subscribe("bench", subs.back());
+    }
+    wait_for_subscribers(subscribers);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < events; ++i)
+    {
+        publish("bench", "{\"progressValue\":50}", i + 1 == events);
+    }
+    std::promise<void> done;
+    net::post(ctx, [&done] { done.set_value(); });
+    done.get_future().wait();
+    auto ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    bool all = true;
+    for (auto &sub: subs)
+    {
+        all = all && sub->delivered == events && sub->ended;
+    }
+    check(all, "every subscriber got every event");
+    check(EventHub::subscriber_count() == 0, "benchmark topic finished");
+    printf("  fan-out to %zu subscribers: %.1f ns/delivery\n", subscribers, ns / (events * subscribers));
+
+    guard.reset();
+    runner.join();
+}
+
+int main()
+{
+    Router::register_dynamic_handler("/events/{topic}", std::make_shared<events_handler>());
+    Router::register_dynamic_handler("/finished/{topic}", std::make_shared<finished_handler>());
+
+    {
+        TestServer server;
+        test_fan_out(server.endpoint());
+        test_closed_client(server.endpoint());
+        test_ended_by_handler(server.endpoint());
+        test_drain(server.endpoint());
+        test_http10(server.endpoint());
+    }
+    bench_fan_out();
+
+    return test_summary("event stream");
+}
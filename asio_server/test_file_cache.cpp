@@ -0,0 +1,158 @@
+#include "file_cache.h"
+#include "router.h"
+#include "session.h"
+#include "test_util.h"
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+// Serves the file named by the path parameter, honouring a Range header.
+class file_handler : public ApiHandler
+{
+public:
+    explicit file_handler(std::string dir) : dir_(std::move(dir)) {}
+
+    void handle_request(const ReqContext &ctxt, Response &res) override
+    {
+        OpenFilePtr file = FileCache::open(dir_ + "/" + std::string(ctxt.path_param("name")));
+        if (!file)
+        {
+            res.result(http::status::not_found);
+            return;
+        }
+
+        ByteRange range = parse_byte_range(ctxt.header(http::field::range), file->size());
+        if (range.kind == ByteRange::Kind::satisfiable)
+        {
+            res.result(http::status::partial_content);
+            res.send_file(file, range.offset, range.length);
+            return;
+        }
+        res.result(http::status::ok);
+        res.send_file(file, 0, file->size());
+    }
+
+private:
+    std::string dir_;
+};
+
+static std::string make_dir()
+{
+    char dir[] = "/tmp/test_file_cacheXXXXXX";
+    return mkdtemp(dir);
+}
+
+static void write_file(const std::string &path, const std::string &content)
+{
+    std::ofstream(path, std::ios::binary | std::ios::trunc) << content;
+}
+
+void test_byte_ranges()
+{
+    auto is = [](const char *header, ByteRange::Kind kind, std::uint64_t offset = 0, std::uint64_t length = 0) {
+        ByteRange r = parse_byte_range(header, 1000);
+        return r.kind == kind && r.offset == offset && r.length == length;
+    };
+    using Kind = ByteRange::Kind;
+    check(is("", Kind::none), "no header");
+    check(is("bytes=0-99", Kind::satisfiable, 0, 100), "closed range");
+    check(is("bytes=900-", Kind::satisfiable, 900, 100), "open range");
+    check(is("bytes=-100", Kind::satisfiable, 900, 100), "suffix range");
+    check(is("bytes=-5000", Kind::satisfiable, 0, 1000), "suffix longer than file");
+    check(is("bytes=990-5000", Kind::satisfiable, 990, 10), "end clamped");
+    check(is("bytes=1000-", Kind::unsatisfiable), "start past end");
+    check(is("bytes=-0", Kind::unsatisfiable), "empty suffix");
+    check(is("bytes=5-1", Kind::none), "reversed range ignored");
+    check(is("bytes=0-1,5-6", Kind::none), "multiple ranges ignored");
+    check(is("items=0-1", Kind::none), "other unit ignored");
+    check(is("bytes=a-1", Kind::none), "garbage ignored");
+}
+
+void test_cache(const std::string &dir)
+{
+    FileCache::clear();
+    std::string path = dir + "/cached";
+    write_file(path, "first");
+
+    OpenFilePtr first = FileCache::open(path);
+    check(first && first->size() == 5, "file opened");
+    check(FileCache::open(path) == first, "second open hits the cache");
+    check(!FileCache::open(dir + "/missing"), "missing file");
+    check(!FileCache::open(dir), "directories are not served");
+
+    // A replaced file is noticed once the entry is due for revalidation.
+    write_file(path + ".new", "second version");
+    rename((path + ".new").c_str(), path.c_str());
+    std::this_thread::sleep_for(FileCache::kRevalidateAfter + std::chrono::milliseconds(50));
+    OpenFilePtr second = FileCache::open(path);
+    check(second && second != first && second->size() == 14, "replaced file reopened");
+    check(first->size() == 5 && first->etag() != second->etag(), "old descriptor stays usable");
+
+    for (std::size_t i = 0; i < FileCache::kMaxEntries + 10; ++i)
+    {
+        write_file(dir + "/f" + std::to_string(i), "x");
+        FileCache::open(dir + "/f" + std::to_string(i));
+    }
+    check(FileCache::size() == FileCache::kMaxEntries, "entries bounded");
+}
+
+void test_send_file(const std::string &dir)
+{
+    std::string content;
+    for (int i = 0; i < 3 * 1024 * 1024; ++i)
+    {
+        content += static_cast<char>('a' + i % 23);
+    }
+    write_file(dir + "/big", content);
+    Router::register_dynamic_handler("/files/{name}", std::make_shared<file_handler>(dir));
+
+    TestServer server;
+    net::io_context ctx;
+    tcp::socket socket(ctx);
+    socket.connect(server.endpoint());
+
+    // Full file, a range and a HEAD, pipelined on one connection.
+    http::request<http::empty_body> full{http::verb::get, "/files/big", 11};
+    http::request<http::empty_body> ranged{http::verb::get, "/files/big", 11};
+    ranged.set(http::field::range, "bytes=1000-1999");
+    http::request<http::empty_body> head{http::verb::head, "/files/big", 11};
+    http::write(socket, full);
+    http::write(socket, ranged);
+    http::write(socket, head);
+
+    beast::flat_buffer buffer;
+    http::response_parser<http::string_body> full_res;
+    full_res.body_limit(64 * 1024 * 1024);
+    http::read(socket, buffer, full_res);
+    check(full_res.get().result() == http::status::ok && full_res.get().body() == content, "whole file");
+
+    http::response<http::string_body> range_res;
+    http::read(socket, buffer, range_res);
+    check(range_res.result() == http::status::partial_content && range_res.body() == content.substr(1000, 1000),
+          "byte range");
+
+    http::response_parser<http::empty_body> head_res;
+    head_res.skip(true);
+    http::read(socket, buffer, head_res);
+    check(head_res.get()[http::field::content_length] == std::to_string(content.size()), "HEAD length");
+
+    http::request<http::empty_body> missing{http::verb::get, "/files/missing", 11};
+    http::write(socket, missing);
+    http::response<http::string_body> missing_res;
+    http::read(socket, buffer, missing_res);
+    check(missing_res.result() == http::status::not_found, "connection usable after file responses");
+}
+
+int main()
+{
+    std::string dir = make_dir();
+    test_byte_ranges();
+    test_cache(dir);
+    test_send_file(dir);
+
+    return test_summary("file cache");
+}
@@ -0,0 +1,139 @@
+#include "handlers/task_manager/task_events.h"
+#include "json_arena.h"
+#include "json_writer.h"
+#include "test_util.h"
+#include <boost/json.hpp>
+#include <chrono>
+#include <cstdio>
+#include <limits>
+#include <string>
+#include <vector>
+
+static std::vector<TaskManager::TaskInfo> make_rows(int count)
+{
+    std::vector<TaskManager::TaskInfo> rows;
+    for (int i = 0; i < count; ++i)
+    {
+        std::int64_t created = 1700000000000 + i;
+        rows.push_back({"task-" + std::to_string(100000 + i), static_cast<Task::Status>(i % 4), created, created + 5,
+                        i % 4 >= 2 ? created + 900 : 0, "step " + std::to_string(i % 10) + " of 10", (i % 10) * 10,
+                        i % 4 == 2, {}});
+    }
+    return rows;
+}
+
+void test_values()
+{
+    std::string out;
+    JsonWriter json(out);
+    json.begin_array();
+    json.value(true);
+    json.value(false);
+    json.null();
+    json.value(0);
+    json.value(std::numeric_limits<std::int64_t>::min());
+    json.value(std::numeric_limits<std::uint64_t>::max());
+    json.value(0.5);
+    json.value(std::numeric_limits<double>::infinity());
+    json.begin_object();
+    json.end_object();
+    json.begin_array();
+    json.end_array();
+    json.end_array();
+    check(out == "[true,false,null,0,-9223372036854775808,18446744073709551615,0.5,null,{},[]]", "scalars and commas");
+}
+
+void test_escaping()
+{
+    std::string out;
+    JsonWriter json(out);
+    json.begin_object();
+    json.member("plain", "abc");
+    json.member("quo\"te", "a\\b\"c");
+    json.member("controls", std::string("\n\r\t\b\f\x01\x1f", 7));
+    json.member("utf8", "caf\xc3\xa9");
+    json.end_object();
+    check(out == R"({"plain":"abc","quo\"te":"a\\b\"c","controls":"\n\r\t\b\f\u0001\u001f","utf8":"café"})",
+          "escaped keys and strings, UTF-8 passed through");
+}
+
+void test_fields()
+{
+    std::string out = "kept:";
+    JsonWriter json(out);
+    json.begin_object();
+    json.member("tasks", make_rows(4));
+    json.key("nextCursor");
+    json.null();
+    json.end_object();
+    check(out == "kept:{\"tasks\":["
+                 R"({"id":"task-100000","status":"pending","progressValue":0,"progressText":"step 0 of 10",)"
+                 R"("createTime":1700000000000,"startTime":1700000000005,"endTime":0,"result":false},)"
+                 R"({"id":"task-100001","status":"running","progressValue":10,"progressText":"step 1 of 10",)"
+                 R"("createTime":1700000000001,"startTime":1700000000006,"endTime":0,"result":false},)"
+                 R"({"id":"task-100002","status":"finished","progressValue":20,"progressText":"step 2 of 10",)"
+                 R"("createTime":1700000000002,"startTime":1700000000007,"endTime":1700000000902,"result":true},)"
+                 R"({"id":"task-100003","status":"interrupted","progressValue":30,"progressText":"step 3 of 10",)"
+                 R"("createTime":1700000000003,"startTime":1700000000008,"endTime":1700000000903,"result":false}],)"
+                 R"("nextCursor":null})",
+          "TaskInfo fields in declared order, appended to the string");
+}
+
+// A 10,000-task list response, written field by field against the DOM that handlers
+// used to build in a JsonArena and serialize. Both reuse the body's capacity.
+void bench_task_list()
+{
+    const int iterations = 50;
+    auto rows = make_rows(10000);
+    std::string body;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int n = 0; n < iterations; ++n)
+    {
+        body.clear();
+        JsonWriter json(body);
+        json.begin_object();
+        json.member("tasks", rows);
+        json.end_object();
+    }
+    auto writer_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    std::size_t writer_size = body.size();
+
+    start = std::chrono::steady_clock::now();
+    for (int n = 0; n < iterations; ++n)
+    {
+        JsonArena arena;
+        boost::json::object obj(arena.storage());
+        boost::json::array tasks(arena.storage());
+        tasks.reserve(rows.size());
+        for (const auto &row: rows)
+        {
+            boost::json::object task(arena.storage());
+            task["id"] = row.id;
+            task["status"] = task_status_name(row);
+            task["progressValue"] = row.progressValue;
+            task["progressText"] = row.progressText;
+            task["createTime"] = row.createTime;
+            task["startTime"] = row.startTime;
+            task["endTime"] = row.endTime;
+            task["result"] = row.result;
+            tasks.emplace_back(std::move(task));
+        }
+        obj["tasks"] = std::move(tasks);
+        serialize_into(body, obj);
+    }
+    auto dom_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    printf("  10000 tasks, %zu bytes: writer %.2f ms, DOM %.2f ms per response\n", writer_size,
+           writer_ns / iterations / 1e6, dom_ns / iterations / 1e6);
+}
+
+int main()
+{
+    test_values();
+    test_escaping();
+    test_fields();
+    bench_task_list();
+
+    return test_summary("JSON writer");
+}
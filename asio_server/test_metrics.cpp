@@ -0,0 +1,98 @@
+#include "metrics.h"
+#include "test_util.h"
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+void test_histogram_buckets()
+{
+    bool ordered = true;
+    for (std::size_t i = 1; i < LatencyHistogram::kBucketCount; ++i)
+    {
+        ordered &= LatencyHistogram::upper_bound(i) > LatencyHistogram::upper_bound(i - 1);
+    }
+    check(ordered, "bucket bounds increase");
+
+    bool contained = true;
+    bool accurate = true;
+    for (uint64_t value = 1; value < (uint64_t(1) << 62); value = value * 3 / 2 + 1)
+    {
+        std::size_t index = LatencyHistogram::index_of(value);
+        uint64_t upper = LatencyHistogram::upper_bound(index);
+        uint64_t lower = index == 0 ? 0 : LatencyHistogram::upper_bound(index - 1) + 1;
+        contained &= lower <= value && value <= upper;
+        accurate &= upper - lower <= value / 4 + 1;
+    }
+    check(contained, "values land in their bucket");
+    check(accurate, "bucket width within 25%");
+    check(LatencyHistogram::index_of(~uint64_t(0)) < LatencyHistogram::kBucketCount, "largest value fits");
+
+    LatencyHistogram h;
+    h.record(100);
+    h.record(100);
+    h.record(5000);
+    check(h.count() == 3 && h.sum() == 5200, "count and sum");
+    check(h.bucket(LatencyHistogram::index_of(100)) == 2, "bucket count");
+}
+
+void test_render()
+{
+    std::size_t route = Metrics::register_route("/taskDetail/{taskId}");
+    Metrics::connection_opened();
+    Metrics::request(route, std::chrono::microseconds(30));
+    Metrics::error(Metrics::Error::not_found);
+    Metrics::bytes_out(128);
+
+    // Another thread records into its own shard; the scrape must see both.
+    std::thread([route] { Metrics::request(route, std::chrono::milliseconds(2)); }).join();
+
+    std::string text;
+    Metrics::render_prometheus(text);
+
+    auto has = [&](const char *line) { return text.find(line) != std::string::npos; };
+    check(has("asio_connections_active 1\n"), "active connections");
+    check(has("asio_requests_total 2\n"), "requests summed over threads");
+    check(has("asio_errors_total{kind=\"not_found\"} 1\n"), "error counter");
+    check(has("asio_bytes_sent_total 128\n"), "bytes out");
+    check(has("asio_request_duration_seconds_bucket{route=\"/taskDetail/{taskId}\",le=\"5e-05\"} 1\n"),
+          "fast request bucket");
+    check(has("asio_request_duration_seconds_bucket{route=\"/taskDetail/{taskId}\",le=\"0.0025\"} 2\n"),
+          "slow request bucket");
+    check(has("asio_request_duration_seconds_count{route=\"/taskDetail/{taskId}\"} 2\n"), "route count");
+}
+
+void test_label_escaping()
+{
+    std::size_t route = Metrics::register_route("/a\"b\\c\nd");
+    Metrics::request(route, std::chrono::microseconds(30));
+
+    std::string text;
+    Metrics::render_prometheus(text);
+    check(text.find("asio_request_duration_seconds_count{route=\"/a\\\"b\\\\c\\nd\"} 1\n") != std::string::npos,
+          "quote, backslash and newline escaped in labels");
+}
+
+void bench_record()
+{
+    std::size_t route = Metrics::register_route("/bench");
+    const size_t iterations = 10000000;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i)
+    {
+        Metrics::request(route, std::chrono::nanoseconds(1000 + (i & 1023)));
+    }
+    auto ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    printf("Metrics::request: %.2f ns/record\n", ns / iterations);
+}
+
+int main()
+{
+    test_histogram_buckets();
+    test_render();
+    test_label_escaping();
+    bench_record();
+
+    return test_summary("metrics");
+}
@@ -0,0 +1,167 @@
+#include "api_handler.h"
+#include "middleware.h"
+#include "test_util.h"
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+namespace net = boost::asio;
+
+class echo_handler : public ApiHandler
+{
+public:
+    void handle_request(const ReqContext &, Response &res) override
+    {
+        res.body() += "handler;";
+    }
+};
+
+// Defers `next` to a later turn of the io_context, like a middleware waiting on a lookup.
+class deferred_middleware : public Middleware
+{
+public:
+    explicit deferred_middleware(net::io_context &ctx) : ctx_(ctx) {}
+
+    void operator()(const ReqContext &, Response &res, std::function<void()> next) override
+    {
+        res.body() += "deferred;";
+        net::post(ctx_, std::move(next));
+    }
+
+private:
+    net::io_context &ctx_;
+};
+
+static Request make_request()
+{
+    return Request{http::verb::get, "/test", 11};
+}
+
+void test_sync_chain()
+{
+    auto req = make_request();
+    ReqContext ctxt(req);
+    Response res;
+
+    echo_handler handler;
+    handler.use([](const ReqContext &, Response &res, std::function<void()> next) {
+        res.body() += "first;";
+        next();
+    });
+    handler.use([](const ReqContext &, Response &res, std::function<void()> next) {
+        res.body() += "second;";
+        next();
+    });
+
+    int completions = 0;
+    handler.execute(ctxt, res, [&](CachedResponsePtr) { ++completions; });
+    check(res.body() == "first;second;handler;", "sync chain order");
+    check(completions == 1, "sync chain completes once");
+}
+
+void test_short_circuit()
+{
+    auto req = make_request();
+    ReqContext ctxt(req);
+    Response res;
+
+    echo_handler handler;
+    handler.use([](const ReqContext &, Response &res, std::function<void()>) {
+        res.result(http::status::too_many_requests);
+    });
+
+    int completions = 0;
+    handler.execute(ctxt, res, [&](CachedResponsePtr) { ++completions; });
+    check(res.result() == http::status::too_many_requests && res.body().empty(), "handler skipped");
+    check(completions == 1, "short circuit completes once");
+}
+
+void test_async_chain()
+{
+    net::io_context ctx;
+    auto req = make_request();
+    ReqContext ctxt(req);
+    Response res;
+
+    echo_handler handler;
+    handler.use<deferred_middleware>(ctx);
+    handler.use<deferred_middleware>(ctx);
+
+    int completions = 0;
+    handler.execute(ctxt, res, [&](CachedResponsePtr) { ++completions; });
+    check(completions == 0 && res.body() == "deferred;", "execute returns before async middleware resumes");
+
+    ctx.run();
+    check(res.body() == "deferred;deferred;handler;", "async chain order");
+    check(completions == 1, "async chain completes once");
+}
+
+// Records the thread on_response runs on.
+class thread_middleware : public Middleware
+{
+public:
+    explicit thread_middleware(std::thread::id &id) : id_(id) {}
+
+    void operator()(const ReqContext &, Response &, std::function<void()> next) override
+    {
+        next();
+    }
+    void on_response(const ReqContext &, Response &, CachedResponsePtr &) override
+    {
+        id_ = std::this_thread::get_id();
+    }
+
+private:
+    std::thread::id &id_;
+};
+
+void test_worker_handler()
+{
+    net::io_context ctx;
+    auto guard = net::make_work_guard(ctx);
+    auto req = make_request();
+    ReqContext ctxt(req);
+    ctxt.set_executor(ctx.get_executor());
+    Response res;
+
+    std::thread::id handler_thread;
+    class thread_handler : public ApiHandler
+    {
+    public:
+        explicit thread_handler(std::thread::id &id) : id_(id) {}
+        void handle_request(const ReqContext &, Response &res) override
+        {
+            id_ = std::this_thread::get_id();
+            res.body() = "worker";
+        }
+
+    private:
+        std::thread::id &id_;
+    } handler(handler_thread);
+    std::thread::id response_thread;
+    handler.use<thread_middleware>(response_thread);
+    handler.set_run_on_worker(true);
+
+    std::thread::id complete_thread;
+    handler.execute(ctxt, res, [&](CachedResponsePtr) {
+        complete_thread = std::this_thread::get_id();
+        guard.reset();
+    });
+    ctx.run_for(std::chrono::seconds(5));
+    check(complete_thread == std::this_thread::get_id(), "worker completes on the io thread");
+    check(res.body() == "worker", "worker handler ran");
+    check(handler_thread != std::this_thread::get_id(), "handler ran off the io thread");
+    check(response_thread == std::this_thread::get_id(), "on_response ran on the io thread");
+}
+
+int main()
+{
+    test_sync_chain();
+    test_short_circuit();
+    test_async_chain();
+    test_worker_handler();
+
+    return test_summary("middleware");
+}
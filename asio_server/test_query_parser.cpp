@@ -0,0 +1,223 @@
+#include "req_context.h"
+#include "test_util.h"
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <iterator>
+#include <map>
+#include <random>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using ParamMap = std::map<std::string, std::vector<std::string>>;
+
+// The std::regex / istringstream parser that ReqContext::parse_query_ replaced, kept here
+// as the reference for differential testing and as the benchmark baseline.
+static std::string legacy_url_decode(const std::string &str)
+{
+    std::string ret;
+    ret.reserve(str.size());
+
+    for (size_t i = 0; i < str.size(); ++i)
+    {
+        if (str[i] == '%')
+        {
+            if (i + 2 < str.size())
+            {
+                try
+                {
+                    int value = std::stoi(str.substr(i + 1, 2), nullptr, 16);
+                    ret += static_cast<char>(value);
+                    i += 2;
+                }
+                catch (const std::exception &)
+                {
+                    ret += '%';
+                }
+            }
+            else
+            {
+                ret += '%';
+            }
+        }
+        else if (str[i] == '+')
+        {
+            ret += ' ';
+        }
+        else
+        {
+            ret += str[i];
+        }
+    }
+
+    return ret;
+}
+
+static ParamMap legacy_parse(const std::string &query)
+{
+    ParamMap params;
+    std::istringstream iss(query);
+    std::string pair;
+
+    std::regex re_index(R"((\w+)(\[\d*\]|\[\])?)");
+
+    while (std::getline(iss, pair, '&'))
+    {
+        if (pair.empty())
+            continue;
+
+        auto pos = pair.find('=');
+        std::string key = pos != std::string::npos ? pair.substr(0, pos) : pair;
+        std::string value = pos != std::string::npos ? pair.substr(pos + 1) : "";
+
+        key = legacy_url_decode(key);
+        value = legacy_url_decode(value);
+
+        std::smatch m;
+        if (std::regex_match(key, m, re_index))
+        {
+            key = m[1];
+        }
+
+        std::istringstream vs(value);
+        std::string v;
+        while (std::getline(vs, v, ','))
+        {
+            if (!v.empty())
+                params[key].push_back(v);
+        }
+    }
+    return params;
+}
+
+static ParamMap parse(const std::string &query)
+{
+    Request req{http::verb::get, "/q?" + query, 11};
+    ReqContext ctxt(req);
+
+    ParamMap params;
+    for (const auto &[key, values]: ctxt.query_params())
+    {
+        auto &out = params[std::string(key)];
+        for (auto value: values)
+        {
+            out.emplace_back(value);
+        }
+    }
+    return params;
+}
+
+void test_semantics()
+{
+    check(parse("") == ParamMap{}, "empty query");
+    check(parse("a=1&b=2") == ParamMap{{"a", {"1"}}, {"b", {"2"}}}, "simple pairs");
+    check(parse("ids=1,2,,3,") == ParamMap{{"ids", {"1", "2", "3"}}}, "comma split");
+    check(parse("ids[]=1&ids[]=2&ids[7]=3") == ParamMap{{"ids", {"1", "2", "3"}}}, "array keys");
+    check(parse("a-b[]=1") == ParamMap{{"a-b[]", {"1"}}}, "non-word key kept");
+    check(parse("name=x%20y+z") == ParamMap{{"name", {"x y z"}}}, "percent and plus");
+    check(parse("v=%2C%41") == ParamMap{{"v", {"A"}}}, "decoded comma splits");
+    check(parse("v=%zz&w=%4") == ParamMap{{"v", {"%zz"}}, {"w", {"%4"}}}, "malformed escapes");
+    check(parse("flag&&=x") == ParamMap{{"", {"x"}}}, "empty values dropped");
+}
+
+static bool has_malformed_escape(const std::string &query)
+{
+    for (size_t i = query.find('%'); i != std::string::npos; i = query.find('%', i + 1))
+    {
+        if (i + 2 >= query.size())
+            continue;
+        if (!std::isxdigit(static_cast<unsigned char>(query[i + 1])) ||
+            !std::isxdigit(static_cast<unsigned char>(query[i + 2])))
+            return true;
+    }
+    return false;
+}
+
+// Random queries built from the characters the parser cares about. Escapes are always
+// well formed here because the legacy decoder mis-parses inputs like "%4g" via std::stoi.
+void test_fuzz()
+{
+    static const char *pieces[] = {"a", "b", "id", "_", "1", "9", "[", "]", "[]", "=", "&", ",", "+", "-",
+                                   ".", "%20", "%2C", "%26", "%3D", "%41", "%25", "%5B", "%5D", "~", "%"};
+    std::mt19937 rng(12345);
+    std::uniform_int_distribution<size_t> pick(0, std::size(pieces) - 1);
+    std::uniform_int_distribution<size_t> length(0, 40);
+
+    size_t mismatches = 0;
+    for (int iteration = 0; iteration < 20000; ++iteration)
+    {
+        std::string query;
+        for (size_t n = length(rng); n > 0; --n)
+        {
+            query += pieces[pick(rng)];
+        }
+        if (has_malformed_escape(query))
+            continue;
+
+        if (parse(query) != legacy_parse(query) && ++mismatches <= 5)
+        {
+            printf("mismatch for query: %s\n", query.c_str());
+        }
+    }
+    check(mismatches == 0, "fuzz matches legacy parser");
+
+    // Arbitrary bytes only need to parse without crashing and stay inside the buffer.
+    std::uniform_int_distribution<int> byte(1, 255);
+    for (int iteration = 0; iteration < 20000; ++iteration)
+    {
+        std::string query;
+        for (size_t n = length(rng); n > 0; --n)
+        {
+            query += static_cast<char>(byte(rng));
+        }
+        parse(query);
+    }
+}
+
+void bench(size_t id_count)
+{
+    std::string query = "ids=";
+    for (size_t i = 0; i < id_count; ++i)
+    {
+        query += (i ? "," : "") + std::to_string(100000 + i * 7919);
+    }
+    query += "&status=running&name=task%20list";
+
+    Request req{http::verb::get, "/taskDetailList?" + query, 11};
+    const size_t rounds = 2000;
+    size_t values = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < rounds / 10; ++i)
+    {
+        values += legacy_parse(query)["ids"].size();
+    }
+    auto legacy_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < rounds; ++i)
+    {
+        ReqContext ctxt(req);
+        values += ctxt.query_params().at("ids").size();
+    }
+    auto parser_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    check(values == (rounds / 10 + rounds) * id_count, "bench parses every id");
+    printf("%5zu ids: legacy %10.1f ns/query, single pass %8.1f ns/query\n", id_count, legacy_ns / (rounds / 10),
+           parser_ns / rounds);
+}
+
+int main()
+{
+    test_semantics();
+    test_fuzz();
+
+    for (size_t ids: {1, 10, 100, 1000})
+    {
+        bench(ids);
+    }
+
+    return test_summary("query parser");
+}
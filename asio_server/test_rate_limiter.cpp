@@ -0,0 +1,166 @@
+#include "api_handler.h"
+#include "rate_limiter.h"
+#include "test_util.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+class counting_handler : public ApiHandler
+{
+public:
+    void handle_request(const ReqContext &, Response &res) override
+    {
+        ++calls;
+        res.result(http::status::ok);
+    }
+
+    int calls = 0;
+};
+
+using Clock = std::chrono::steady_clock;
+
+void test_bucket()
+{
+    RateLimiter limiter(10, 5);
+    auto t = Clock::now();
+    std::chrono::nanoseconds retry_after{0};
+
+    int granted = 0;
+    for (int i = 0; i < 10; ++i)
+    {
+        granted += limiter.try_acquire(42, t, retry_after);
+    }
+    check(granted == 5, "burst granted at once");
+    check(retry_after > std::chrono::milliseconds(90) && retry_after <= std::chrono::milliseconds(100),
+          "retry after one refill interval");
+
+    check(!limiter.try_acquire(42, t + std::chrono::milliseconds(50), retry_after), "no token before refill");
+    check(limiter.try_acquire(42, t + std::chrono::milliseconds(100), retry_after), "one token per interval");
+    check(limiter.try_acquire(43, t, retry_after), "other clients unaffected");
+
+    granted = 0;
+    for (int i = 0; i < 10; ++i)
+    {
+        granted += limiter.try_acquire(42, t + std::chrono::seconds(10), retry_after);
+    }
+    check(granted == 5, "refill stops at the bucket size");
+
+    RateLimiter off(0, 1);
+    granted = 0;
+    for (int i = 0; i < 100; ++i)
+    {
+        granted += off.try_acquire(42, t, retry_after);
+    }
+    check(granted == 100, "rate 0 turns limiting off");
+}
+
+void test_middleware()
+{
+    counting_handler handler;
+    handler.use<RateLimiter>(1, 2);
+
+    Request req{http::verb::get, "/interruptTask/1", 11};
+    auto send = [&](const char *address, const char *api_key) {
+        if (api_key)
+            req.set("X-Api-Key", api_key);
+        else
+            req.erase("X-Api-Key");
+        ReqContext ctxt(req);
+        ctxt.set_remote_address(boost::asio::ip::make_address(address));
+        Response res;
+        handler.execute(ctxt, res, [](CachedResponsePtr) {});
+        return res;
+    };
+
+    send("10.0.0.1", nullptr);
+    send("10.0.0.1", nullptr);
+    auto res = send("10.0.0.1", nullptr);
+    check(res.result() == http::status::too_many_requests && handler.calls == 2, "429 without running the handler");
+    check(res[http::field::retry_after] == "1", "Retry-After in whole seconds");
+    check(send("10.0.0.2", nullptr).result() == http::status::ok, "keyed by address");
+    check(send("::1", nullptr).result() == http::status::ok, "IPv6 clients");
+
+    counting_handler keyed;
+    keyed.use<RateLimiter>(RateLimiter::Options{1, 1, "X-Api-Key"});
+    auto send_keyed = [&](const char *address, const char *api_key) {
+        req.set("X-Api-Key", api_key);
+        ReqContext ctxt(req);
+        ctxt.set_remote_address(boost::asio::ip::make_address(address));
+        Response res;
+        keyed.execute(ctxt, res, [](CachedResponsePtr) {});
+        return res.result();
+    };
+    check(send_keyed("10.0.0.1", "a") == http::status::ok, "first key");
+    check(send_keyed("10.0.0.2", "a") == http::status::too_many_requests, "same key from another address");
+    check(send_keyed("10.0.0.1", "b") == http::status::ok, "other key from the same address");
+}
+
+void test_concurrent()
+{
+    RateLimiter limiter(1, 1000);
+    auto t = Clock::now();
+    std::atomic<int> granted{0};
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i)
+    {
+        threads.emplace_back([&] {
+            std::chrono::nanoseconds retry_after{0};
+            for (int n = 0; n < 1000; ++n)
+            {
+                granted += limiter.try_acquire(7, t, retry_after);
+            }
+        });
+    }
+    for (auto &thread: threads)
+    {
+        thread.join();
+    }
+    check(granted == 1000, "no token handed out twice under contention");
+}
+
+// try_acquire, including the clock read, across 100k distinct clients from one thread and
+// from four; the figure is wall time divided by requests served by all threads.
+void bench_acquire()
+{
+    const std::uint64_t clients = 100000;
+    const std::size_t iterations = 10000000;
+    RateLimiter limiter(1e6, 1e6);
+
+    for (int thread_count: {1, 4})
+    {
+        std::vector<std::thread> threads;
+        auto start = Clock::now();
+        for (int i = 0; i < thread_count; ++i)
+        {
+            threads.emplace_back([&, i] {
+                std::chrono::nanoseconds retry_after{0};
+                std::uint64_t client = i * 7919;
+                for (std::size_t n = 0; n < iterations / thread_count; ++n)
+                {
+                    client = (client + 104729) % clients;
+                    limiter.try_acquire(client * 0x9e3779b97f4a7c15ULL + 1, Clock::now(), retry_after);
+                }
+            });
+        }
+        for (auto &thread: threads)
+        {
+            thread.join();
+        }
+        auto ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        printf("  %d thread(s), %llu clients: %.1f ns/request\n", thread_count,
+               static_cast<unsigned long long>(clients), ns / iterations);
+    }
+}
+
+int main()
+{
+    test_bucket();
+    test_middleware();
+    test_concurrent();
+    bench_acquire();
+
+    return test_summary("rate limiter");
+}
@@ -0,0 +1,163 @@
+#include "req_context.h"
+#include "router.h"
+#include "handlers/version_handler.h"
+#include "test_util.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+// Count every heap allocation made by this process so the hot path can be checked.
+static std::atomic<size_t> allocations{0};
+
+void *operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+class dummy_handler : public ApiHandler
+{
+public:
+    void handle_request(const ReqContext &, Response &) override {}
+};
+
+static Request make_request(const char *target)
+{
+    Request req{http::verb::get, target, 11};
+    req.set(http::field::host, "localhost");
+    req.set(http::field::user_agent, "test_req_context");
+    return req;
+}
+
+static std::string_view path_of(const Request &req)
+{
+    std::string_view target(req.target().data(), req.target().size());
+    return target.substr(0, target.find('?'));
+}
+
+// Serves `req` the way Session does: routes it, runs the handler and puts the bytes it
+// would write into `wire`. `res` is reused across calls, like Session's. Returns whether
+// the pre-serialized cached response was sent.
+static bool serve(const Request &req, Response &res, std::string &wire)
+{
+    res.base() = {};
+    res.body().clear();
+    ReqContext ctxt(req);
+    ApiHandler *handler = Router::route(path_of(req), ctxt);
+    check(handler != nullptr && ctxt.header(http::field::host) == "localhost" &&
+                  ctxt.header("User-Agent") == "test_req_context" && ctxt.body().empty() && ctxt.method_string() == "GET",
+          "request read through ReqContext");
+    if (!handler)
+        return false;
+
+    CachedResponsePtr sent;
+    handler->execute(ctxt, res, [&sent](CachedResponsePtr cached) { sent = std::move(cached); });
+    wire.clear();
+    if (sent)
+    {
+        wire.append(sent->wire);
+        return true;
+    }
+    wire.append(ResponseCache::serialize(res));
+    return false;
+}
+
+// Counts what happens to an already parsed request: routing, the ReqContext, the handler
+// chain and the bytes put on the wire. Session's own work is not in it: reading and
+// parsing the request (header fields come from the connection's pool, see Session) and
+// the Asio operations for the socket read, write and timers.
+void test_version_handling_no_alloc()
+{
+    auto req = make_request("/version");
+    Response res;
+    std::string wire;
+    wire.reserve(1024);
+    // The first request on a thread runs handle_request and fills the response cache and
+    // the JSON arena; the rest are served as measured below.
+    serve(req, res, wire);
+
+    size_t before = allocations.load();
+    bool cached = serve(req, res, wire);
+    size_t used = allocations.load() - before;
+
+    check(cached, "GET /version sent pre-serialized");
+    check(wire.rfind("HTTP/1.1 200 OK\r\n", 0) == 0, "200 OK on the wire");
+    check(wire.find("\"version\":\"1.0.0\"") != std::string::npos, "version in the body on the wire");
+    check(used == 0, "GET /version, from routing to the serialized response, allocates nothing");
+    printf("GET /version after parsing: %zu allocations\n", used);
+}
+
+// The real /version handler, reached the way Session reaches it.
+void test_version_response()
+{
+    auto req = make_request("/version");
+    ReqContext ctxt(req);
+    ApiHandler *handler = Router::route(path_of(req), ctxt);
+    check(dynamic_cast<version_handler *>(handler) != nullptr, "/version routes to version_handler");
+    if (!handler)
+        return;
+
+    Response res{http::status::internal_server_error, 11};
+    bool completed = false;
+    handler->execute(ctxt, res, [&](CachedResponsePtr) { completed = true; });
+    check(completed, "handler completed");
+    check(res.result() == http::status::ok, "200 OK");
+    check(res[http::field::content_type] == "application/json", "JSON content type");
+    check(res.body().find("\"version\":\"1.0.0\"") != std::string::npos, "version in the body");
+    check(res[http::field::content_length] == std::to_string(res.body().size()), "Content-Length set");
+}
+
+void test_path_param_no_alloc()
+{
+    auto req = make_request("/taskDetail/42");
+
+    size_t before = allocations.load();
+    ReqContext ctxt(req);
+    ApiHandler *handler = Router::route(path_of(req), ctxt);
+    std::string_view task_id = ctxt.path_param("taskId");
+    bool has_missing = ctxt.has_path_param("missing");
+    size_t param_count = ctxt.path_params().size();
+    size_t used = allocations.load() - before;
+
+    check(handler != nullptr, "dynamic route found");
+    check(task_id == "42" && !has_missing && param_count == 1, "path params");
+    check(used == 0, "GET /taskDetail/{taskId} allocates nothing");
+}
+
+void test_query_params()
+{
+    auto req = make_request("/taskDetailList?ids[]=a,b&name=x%20y");
+    ReqContext ctxt(req);
+
+    check(ctxt.query_path() == "ids[]=a,b&name=x%20y", "query path");
+    const auto &params = ctxt.query_params();
+    check(params.count("ids") && params.at("ids").size() == 2 && params.at("ids")[1] == "b", "array query param");
+    check(params.count("name") && params.at("name")[0] == "x y", "decoded query param");
+    check(&params == &ctxt.query_params(), "query params parsed once");
+}
+
+int main()
+{
+    Router::register_dynamic_handler("/taskDetail/{taskId}", std::make_shared<dummy_handler>());
+
+    // test_version_response() must see the handler's first, uncached run.
+    test_version_response();
+    test_version_handling_no_alloc();
+    test_path_param_no_alloc();
+    test_query_params();
+
+    return test_summary("request context");
+}
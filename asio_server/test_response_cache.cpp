@@ -0,0 +1,118 @@
+#include "api_handler.h"
+#include "test_util.h"
+#include <cstdio>
+#include <string>
+
+class counting_handler : public ApiHandler
+{
+public:
+    explicit counting_handler(std::chrono::seconds ttl)
+    {
+        cache_responses(ttl);
+    }
+
+    void handle_request(const ReqContext &ctxt, Response &res) override
+    {
+        ++calls;
+        res.result(http::status::ok);
+        res.set(http::field::content_type, "application/json");
+        res.insert(http::field::set_cookie, "a=1");
+        res.insert(http::field::set_cookie, "b=2");
+        res.body() = "{\"target\":\"" + std::string(ctxt.target()) + "\"}";
+        res.prepare_payload();
+    }
+
+    int calls = 0;
+};
+
+struct Result
+{
+    Response res;
+    CachedResponsePtr cached;
+};
+
+static Result get(ApiHandler &handler, const char *target, const std::string &if_none_match = {},
+                  unsigned version = 11)
+{
+    Request req{http::verb::get, target, version};
+    if (!if_none_match.empty())
+    {
+        req.set(http::field::if_none_match, if_none_match);
+    }
+    ReqContext ctxt(req);
+
+    Result result;
+    handler.execute(ctxt, result.res, [&](CachedResponsePtr cached) { result.cached = std::move(cached); });
+    return result;
+}
+
+void test_cache_hit()
+{
+    counting_handler handler(ApiHandler::kCacheForever);
+
+    Result first = get(handler, "/version");
+    check(handler.calls == 1 && !first.cached, "miss runs the handler");
+    check(!first.res[http::field::etag].empty(), "miss response carries an ETag");
+
+    Result second = get(handler, "/version");
+    check(handler.calls == 1 && second.cached, "hit skips the handler");
+    check(second.cached && second.cached->wire.find("\r\n\r\n{\"target\":\"/version\"}") != std::string::npos,
+          "wire bytes hold header and body");
+
+    Result other = get(handler, "/version?x=1");
+    check(handler.calls == 2 && !other.cached, "targets are cached separately");
+}
+
+void test_not_modified()
+{
+    counting_handler handler(ApiHandler::kCacheForever);
+    Result first = get(handler, "/version");
+    std::string etag(first.res[http::field::etag]);
+
+    Result revalidated = get(handler, "/version", "\"other\", " + etag);
+    check(handler.calls == 1 && !revalidated.cached, "304 skips the handler");
+    check(revalidated.res.result() == http::status::not_modified && revalidated.res.body().empty(), "304 response");
+
+    Result changed = get(handler, "/version", "\"other\"");
+    check(changed.cached != nullptr, "non-matching If-None-Match gets the cached response");
+}
+
+void test_http10_copies()
+{
+    counting_handler handler(ApiHandler::kCacheForever);
+    get(handler, "/version");
+
+    Result old = get(handler, "/version", {}, 10);
+    check(handler.calls == 1 && !old.cached, "HTTP/1.0 does not use the keep-alive bytes");
+    check(old.res.body() == "{\"target\":\"/version\"}" && !old.res[http::field::etag].empty(), "copied response");
+    check(old.res.count(http::field::set_cookie) == 2 && old.res.count(http::field::content_type) == 1,
+          "repeated fields copied, single ones not duplicated");
+}
+
+void test_ttl_expiry()
+{
+    counting_handler handler(std::chrono::seconds(0));
+    get(handler, "/version");
+    get(handler, "/version");
+    check(handler.calls == 2, "expired entries are rebuilt");
+}
+
+void test_etag_matching()
+{
+    check(ResponseCache::etag_matches("\"a\"", "\"a\""), "exact tag");
+    check(ResponseCache::etag_matches(" \"b\" ,W/\"a\"", "\"a\""), "weak tag in list");
+    check(ResponseCache::etag_matches("*", "\"a\""), "wildcard");
+    check(!ResponseCache::etag_matches("\"ab\"", "\"a\""), "different tag");
+    check(!ResponseCache::etag_matches("", "\"a\""), "empty header");
+}
+
+int main()
+{
+    test_cache_hit();
+    test_not_modified();
+    test_http10_copies();
+    test_ttl_expiry();
+    test_etag_matching();
+
+    return test_summary("response cache");
+}
@@ -0,0 +1,128 @@
+#include "json_arena.h"
+#include "router.h"
+#include "session.h"
+#include "test_util.h"
+#include <boost/asio.hpp>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// What a handler found on entry, and where its output went.
+struct Seen
+{
+    const Response *res = nullptr;
+    std::size_t capacity = 0;
+    bool empty = false;
+    const char *text = nullptr;
+    const char *body = nullptr;
+    std::pmr::memory_resource *fields = nullptr;
+};
+
+static std::mutex seen_mutex;
+static std::vector<Seen> seen;
+
+// Answers {"text":"xx..."} with `size` x's, built in a JsonArena and serialized into the
+// pooled body.
+class pool_handler : public ApiHandler
+{
+public:
+    void handle_request(const ReqContext &ctxt, Response &res) override
+    {
+        Seen s;
+        s.res = &res;
+        s.capacity = res.body().capacity();
+        s.empty = res.body().empty();
+        s.fields = ctxt.raw_req().get_allocator().resource();
+
+        JsonArena arena;
+        boost::json::string text(std::stoul(std::string(ctxt.path_param("size"))), 'x', arena.storage());
+        s.text = text.data();
+        boost::json::object obj(arena.storage());
+        obj.emplace("text", std::move(text));
+        res.result(http::status::ok);
+        serialize_into(res.body(), obj);
+        s.body = res.body().data();
+
+        std::lock_guard<std::mutex> lock(seen_mutex);
+        seen.push_back(s);
+    }
+};
+
+static std::string expected(std::size_t size)
+{
+    return "{\"text\":\"" + std::string(size, 'x') + "\"}";
+}
+
+static Seen get(tcp::socket &socket, beast::flat_buffer &buffer, std::size_t size)
+{
+    http::request<http::empty_body> req{http::verb::get, "/pool/" + std::to_string(size), 11};
+    http::write(socket, req);
+    http::response<http::string_body> res;
+    http::read(socket, buffer, res);
+    check(res.result() == http::status::ok && res.body() == expected(size), "response body");
+
+    std::lock_guard<std::mutex> lock(seen_mutex);
+    return seen.back();
+}
+
+void test_back_to_back(const tcp::endpoint &endpoint)
+{
+    net::io_context ctx;
+    tcp::socket socket(ctx);
+    socket.connect(endpoint);
+    beast::flat_buffer buffer;
+
+    Seen first = get(socket, buffer, 1000);
+    Seen second = get(socket, buffer, 1000);
+    check(second.res == first.res, "one request at a time reuses the same response");
+    check(second.empty && second.capacity >= 1000, "small body is cleared but keeps its capacity");
+    check(second.body == first.body, "small body serialized into the same buffer");
+    check(second.text == first.text, "JsonArena hands out the same thread buffer again");
+    check(first.fields != std::pmr::new_delete_resource() && second.fields == first.fields,
+          "request fields parsed into the connection's pool");
+
+    Seen big = get(socket, buffer, 200000);
+    check(big.text != first.text, "large document spills out of the thread buffer");
+    Seen after_big = get(socket, buffer, 1000);
+    check(after_big.res == first.res && after_big.empty, "response reused after a large body");
+    check(after_big.capacity <= Session::kMaxPooledBody, "body over kMaxPooledBody released");
+    check(after_big.text == first.text, "thread buffer reused after a spill");
+}
+
+void test_pipelined(const tcp::endpoint &endpoint)
+{
+    net::io_context ctx;
+    tcp::socket socket(ctx);
+    socket.connect(endpoint);
+
+    // Both requests in one write, so the second is read before the first is answered.
+    std::string requests = "GET /pool/200000 HTTP/1.1\r\n\r\nGET /pool/1000 HTTP/1.1\r\n\r\n";
+    net::write(socket, net::buffer(requests));
+    beast::flat_buffer buffer;
+    http::response<http::string_body> big;
+    http::read(socket, buffer, big);
+    http::response<http::string_body> small;
+    http::read(socket, buffer, small);
+    check(big.body() == expected(200000) && small.body() == expected(1000), "pipelined responses in order");
+
+    std::vector<Seen> pair;
+    {
+        std::lock_guard<std::mutex> lock(seen_mutex);
+        pair.assign(seen.end() - 2, seen.end());
+    }
+    Seen next = get(socket, buffer, 1000);
+    check(next.res == pair[0].res && next.capacity <= Session::kMaxPooledBody,
+          "pipelined large body released once written");
+    check(pair[1].fields == pair[0].fields && next.fields == pair[0].fields, "pipelined fields share the pool");
+}
+
+int main()
+{
+    Router::register_dynamic_handler("/pool/{size}", std::make_shared<pool_handler>());
+
+    TestServer server;
+    test_back_to_back(server.endpoint());
+    test_pipelined(server.endpoint());
+
+    return test_summary("response pool");
+}
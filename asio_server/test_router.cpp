@@ -0,0 +1,144 @@
+#include "route_trie.h"
+#include "test_util.h"
+#include <chrono>
+#include <cstdio>
+#include <regex>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+// The std::regex router that RouteTrie replaced, kept here as the baseline.
+class RegexRouter
+{
+public:
+    void insert(const std::string &path_template, ApiHandlerPtr handler)
+    {
+        std::string regex_str = "^" + std::regex_replace(path_template, std::regex("\\{([^}]+)\\}"), "([^/]+)") + "$";
+
+        std::vector<std::string> param_names;
+        std::smatch matches;
+        auto it = path_template.cbegin();
+        while (std::regex_search(it, path_template.cend(), matches, std::regex("\\{([^}]+)\\}")))
+        {
+            param_names.push_back(matches[1].str());
+            it = matches[0].second;
+        }
+
+        routes_.emplace_back(std::regex(regex_str), param_names, handler);
+    }
+
+    ApiHandler *match(const std::string &path, std::unordered_map<std::string, std::string> &params) const
+    {
+        for (const auto &[regex, param_names, handler]: routes_)
+        {
+            std::smatch matches;
+            if (std::regex_match(path, matches, regex))
+            {
+                for (size_t i = 0; i < param_names.size(); ++i)
+                {
+                    params[param_names[i]] = matches[i + 1].str();
+                }
+                return handler.get();
+            }
+        }
+        return nullptr;
+    }
+
+private:
+    std::vector<std::tuple<std::regex, std::vector<std::string>, ApiHandlerPtr>> routes_;
+};
+
+class dummy_handler : public ApiHandler
+{
+public:
+    void handle_request(const ReqContext &, Response &) override {}
+};
+
+void test_match()
+{
+    RouteTrie trie;
+    auto detail = std::make_shared<dummy_handler>();
+    auto result = std::make_shared<dummy_handler>();
+    auto fixed = std::make_shared<dummy_handler>();
+    auto nested = std::make_shared<dummy_handler>();
+    trie.insert("/taskDetail/{taskId}", detail);
+    trie.insert("/queryTaskResult/{taskId}", result);
+    trie.insert("/taskDetail/latest", fixed);
+    trie.insert("/task/{taskId}/step/{stepId}", nested);
+
+    RouteTrie::Match m;
+    check(trie.match("/taskDetail/abc", m) && m.handler == detail.get(), "param route");
+    check(m.param_count == 1 && m.params[0].name == "taskId" && m.params[0].value == "abc", "param capture");
+    check(trie.match("/taskDetail/latest", m) && m.handler == fixed.get() && m.param_count == 0, "literal wins");
+    check(trie.match("/task/1/step/2", m) && m.handler == nested.get(), "nested params");
+    check(m.param_count == 2 && m.params[0].value == "1" && m.params[1].value == "2", "nested capture");
+    check(!trie.match("/taskDetail/", m), "empty param");
+    check(!trie.match("/taskDetail/a/b", m), "too long");
+    check(!trie.match("/taskDetail", m), "too short");
+    check(!trie.match("/task/1/step", m), "intermediate node");
+    check(!trie.match("taskDetail/abc", m), "relative path");
+
+    check(!trie.insert("/taskDetail/{taskId}", result), "duplicate registration refused");
+    check(trie.match("/taskDetail/abc", m) && m.handler == detail.get(), "first registration wins");
+
+    // A literal segment with no route for the rest of the path falls back to the parameter.
+    trie.insert("/task/latest/log", fixed);
+    check(trie.match("/task/latest/log", m) && m.handler == fixed.get() && m.param_count == 0, "literal branch");
+    check(trie.match("/task/latest/step/2", m) && m.handler == nested.get(), "falls back to the parameter");
+    check(m.param_count == 2 && m.params[0].value == "latest" && m.params[1].value == "2", "fallback capture");
+    check(!trie.match("/task/latest/step", m) && m.param_count == 0, "no route in either branch");
+}
+
+void bench(size_t route_count)
+{
+    RouteTrie trie;
+    RegexRouter regex_router;
+    std::vector<std::string> paths;
+    for (size_t i = 0; i < route_count; ++i)
+    {
+        auto handler = std::make_shared<dummy_handler>();
+        std::string name = "/resource" + std::to_string(i);
+        trie.insert(name + "/{id}", handler);
+        regex_router.insert(name + "/{id}", handler);
+        paths.push_back(name + "/" + std::to_string(i * 7919));
+    }
+
+    const size_t lookups = 20000;
+    size_t hits = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < lookups; ++i)
+    {
+        const std::string &path = paths[(i * 31) % paths.size()];
+        std::unordered_map<std::string, std::string> params;
+        ApiHandler *handler = regex_router.match(path, params);
+        hits += handler != nullptr;
+    }
+    auto regex_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < lookups; ++i)
+    {
+        const std::string &path = paths[(i * 31) % paths.size()];
+        RouteTrie::Match m;
+        hits += trie.match(path, m);
+    }
+    auto trie_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    check(hits == 2 * lookups, "bench lookups all hit");
+    printf("%5zu routes: regex %10.1f ns/lookup, trie %6.1f ns/lookup\n", route_count, regex_ns / lookups,
+           trie_ns / lookups);
+}
+
+int main()
+{
+    test_match();
+
+    for (size_t routes: {1, 10, 100, 500})
+    {
+        bench(routes);
+    }
+
+    return test_summary("router");
+}
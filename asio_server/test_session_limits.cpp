@@ -0,0 +1,206 @@
+#include "io_context_pool.h"
+#include "router.h"
+#include "server.h"
+#include "session.h"
+#include "test_util.h"
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+class hello_handler : public ApiHandler
+{
+public:
+    void handle_request(const ReqContext &, Response &res) override
+    {
+        res.result(http::status::ok);
+        res.body() = "hello";
+    }
+};
+
+using Clock = std::chrono::steady_clock;
+
+// Seconds until the server closes the connection, reading (and dropping) whatever it sends.
+static double seconds_until_closed(tcp::socket &socket)
+{
+    auto start = Clock::now();
+    char data[4096];
+    beast::error_code ec;
+    while (!ec)
+    {
+        socket.read_some(net::buffer(data), ec);
+    }
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static void get_hello(tcp::socket &socket, const char *what)
+{
+    http::request<http::empty_body> req{http::verb::get, "/hello", 11};
+    http::write(socket, req);
+    beast::flat_buffer buffer;
+    http::response<http::string_body> res;
+    beast::error_code ec;
+    http::read(socket, buffer, res, ec);
+    check(!ec && res.body() == "hello", what);
+}
+
+void test_timeouts(Server &server)
+{
+    net::io_context ctx;
+    tcp::endpoint endpoint(net::ip::make_address("127.0.0.1"), server.port());
+
+    // Idle keep-alive connections are closed after idle_timeout (1s).
+    tcp::socket idle(ctx);
+    idle.connect(endpoint);
+    get_hello(idle, "request before idling");
+    double idle_for = seconds_until_closed(idle);
+    check(idle_for > 0.8 && idle_for < 1.8, "idle connection closed after idle_timeout");
+
+    // A request that starts but never finishes its header gets header_timeout (1s) from its
+    // first byte, even though bytes keep trickling in.
+    tcp::socket slow(ctx);
+    slow.connect(endpoint);
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    auto start = Clock::now();
+    net::write(slow, net::buffer("GET /hello HTTP/1.1\r\n", 21));
+    for (int i = 0; i < 4; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        beast::error_code ec;
+        net::write(slow, net::buffer("X-Slow: 1\r\n", 11), ec);
+    }
+    double header_for = std::chrono::duration<double>(Clock::now() - start).count() + seconds_until_closed(slow);
+    check(header_for > 0.8 && header_for < 1.8, "slow header closed after header_timeout");
+}
+
+void test_in_flight(Server &server)
+{
+    net::io_context ctx;
+    tcp::socket socket(ctx);
+    socket.connect({net::ip::make_address("127.0.0.1"), server.port()});
+
+    // Ten pipelined requests with max_in_flight = 4 are still all answered, in order.
+    std::string pipeline;
+    for (int i = 0; i < 10; ++i)
+    {
+        pipeline += "GET /hello HTTP/1.1\r\nHost: x\r\n\r\n";
+    }
+    net::write(socket, net::buffer(pipeline));
+
+    beast::flat_buffer buffer;
+    int answered = 0;
+    for (int i = 0; i < 10; ++i)
+    {
+        http::response<http::string_body> res;
+        beast::error_code ec;
+        http::read(socket, buffer, res, ec);
+        answered += !ec && res.body() == "hello";
+    }
+    check(answered == 10, "pipelined requests beyond max_in_flight answered");
+}
+
+void test_malformed_pipelined(Server &server)
+{
+    net::io_context ctx;
+    tcp::socket socket(ctx);
+    socket.connect({net::ip::make_address("127.0.0.1"), server.port()});
+
+    // The two requests before the malformed one are still answered, then a 400 ends it.
+    std::string pipeline = "GET /hello HTTP/1.1\r\nHost: x\r\n\r\n"
+                           "GET /hello HTTP/1.1\r\nHost: x\r\n\r\n"
+                           "GET /hello HTTP/9\r\n\r\n";
+    net::write(socket, net::buffer(pipeline));
+
+    beast::flat_buffer buffer;
+    int answered = 0;
+    for (int i = 0; i < 2; ++i)
+    {
+        http::response<http::string_body> res;
+        beast::error_code ec;
+        http::read(socket, buffer, res, ec);
+        answered += !ec && res.body() == "hello";
+    }
+    check(answered == 2, "responses queued before a malformed request sent");
+
+    http::response<http::string_body> res;
+    beast::error_code ec;
+    http::read(socket, buffer, res, ec);
+    check(!ec && res.result() == http::status::bad_request && !res.keep_alive(), "malformed request gets a 400");
+    check(seconds_until_closed(socket) < 0.5, "then the connection closes");
+}
+
+void test_oversized_header(Server &server)
+{
+    net::io_context ctx;
+    tcp::socket socket(ctx);
+    socket.connect({net::ip::make_address("127.0.0.1"), server.port()});
+
+    // Well formed, but past the parser's 8 KiB header limit: 431, not 400.
+    std::string request = "GET /hello HTTP/1.1\r\nHost: x\r\nX-Padding: " + std::string(16 * 1024, 'p') + "\r\n\r\n";
+    net::write(socket, net::buffer(request));
+
+    beast::flat_buffer buffer;
+    http::response<http::string_body> res;
+    beast::error_code ec;
+    http::read(socket, buffer, res, ec);
+    check(!ec && res.result() == http::status::request_header_fields_too_large && !res.keep_alive(),
+          "oversized header gets a 431");
+    check(seconds_until_closed(socket) < 0.5, "then the connection closes");
+}
+
+void test_connection_limit(Server &server)
+{
+    net::io_context ctx;
+    tcp::endpoint endpoint(net::ip::make_address("127.0.0.1"), server.port());
+
+    // Three connections fill the limit; a fourth is only served once one of them closes.
+    std::vector<tcp::socket> open;
+    for (int i = 0; i < 3; ++i)
+    {
+        open.emplace_back(ctx).connect(endpoint);
+        get_hello(open.back(), "connection within the limit");
+    }
+    check(server.live_connections() == 3, "live connection count");
+
+    tcp::socket waiting(ctx);
+    waiting.connect(endpoint);
+    http::request<http::empty_body> req{http::verb::get, "/hello", 11};
+    http::write(waiting, req);
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    check(waiting.available() == 0, "connection over the limit waits");
+
+    open.front().close();
+    beast::flat_buffer buffer;
+    http::response<http::string_body> res;
+    beast::error_code ec;
+    http::read(waiting, buffer, res, ec);
+    check(!ec && res.body() == "hello", "waiting connection served after one closes");
+}
+
+int main()
+{
+    Router::register_static_handler("/hello", std::make_shared<hello_handler>());
+
+    Session::Limits limits;
+    limits.max_in_flight = 4;
+    limits.idle_timeout = std::chrono::seconds(1);
+    limits.header_timeout = std::chrono::seconds(1);
+    limits.io_timeout = std::chrono::seconds(1);
+    Session::configure(limits);
+
+    IoContextPool pool(1);
+    Server server(pool, 0, false, 3);
+    std::thread runner([&pool] { pool.run(); });
+
+    test_timeouts(server);
+    test_in_flight(server);
+    test_malformed_pipelined(server);
+    test_oversized_header(server);
+    test_connection_limit(server);
+
+    pool.stop();
+    runner.join();
+
+    return test_summary("session limit");
+}
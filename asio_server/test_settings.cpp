@@ -0,0 +1,120 @@
+#include "settings.h"
+#include "test_util.h"
+#include <algorithm>
+#include <fstream>
+#include <gflags/gflags.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// Known to gflags but not held by Settings, like --artifact_dir in asio-demo.
+DEFINE_string(startup_only, "a", "Only read at startup");
+
+struct Reload
+{
+    bool ok = false;
+    Settings next;
+    std::vector<std::string> restart_only;
+    std::string error;
+
+    bool restarts(const char *flag) const
+    {
+        return std::find(restart_only.begin(), restart_only.end(), flag) != restart_only.end();
+    }
+};
+
+// Runs what SIGHUP would with a flagfile holding `content`, against the flags' defaults.
+static Reload reload(const std::string &content)
+{
+    static std::string dir = [] {
+        char dir[] = "/tmp/test_settingsXXXXXX";
+        return std::string(mkdtemp(dir));
+    }();
+    std::string path = dir + "/flags";
+    std::ofstream(path, std::ios::trunc) << content;
+
+    Reload r;
+    r.ok = reload_settings(path, Settings::from_flags(), r.next, r.restart_only, r.error);
+    return r;
+}
+
+void test_defaults()
+{
+    std::string error;
+    check(Settings::from_flags().valid(error), "default flags are valid");
+}
+
+void test_valid_reload()
+{
+    Reload r = reload("# tuned for the load test\n"
+                      "--compression_level=3\n"
+                      "  --rate_limit_header=X-Client  \n"
+                      "\n"
+                      "--noreuse_port\n"
+                      "--port=9090\n"
+                      "--startup_only=b\n");
+    check(r.ok, "valid flagfile reloads");
+    check(r.next.compression_level == 3, "int flag read");
+    check(r.next.rate_limit_header == "X-Client", "string flag read, surrounding blanks dropped");
+    check(r.next.reuse_port && r.restarts("--reuse_port"), "--noreuse_port waits for a restart");
+    check(r.next.port == 8080 && r.restarts("--port"), "--port waits for a restart");
+    check(r.restarts("--startup_only"), "changed startup-only flag reported");
+    check(r.next.idle_timeout == Settings::from_flags().idle_timeout, "unmentioned flags keep their values");
+
+    Reload same = reload("--startup_only=a\n--compression_level=3\n");
+    check(same.ok && same.restart_only.empty(), "unchanged startup-only flag not reported");
+}
+
+void test_unknown_flag()
+{
+    Reload r = reload("--compression_level=3\n--no_such_flag=1\n");
+    check(!r.ok && r.error.find("--no_such_flag=1") != std::string::npos, "unknown flag rejected by name");
+
+    check(!reload("--flagfile=other\n").ok, "nested --flagfile rejected");
+    check(!reload("--port\n").ok, "non-bool flag without a value rejected");
+    check(!reload("compression_level=3\n").ok, "line without dashes rejected");
+}
+
+void test_malformed_value()
+{
+    Reload r = reload("--compression_level=high\n");
+    check(!r.ok && r.error.find("--compression_level") != std::string::npos &&
+                  r.error.find("\"high\"") != std::string::npos,
+          "malformed value names the flag and the value");
+
+    check(!reload("--max_body=-1\n").ok, "negative unsigned value rejected");
+    check(!reload("--reuse_port=maybe\n").ok, "malformed bool rejected");
+
+    Reload range = reload("--compression_level=12\n");
+    check(!range.ok && range.error == "--compression_level must be between 0 and 9", "out-of-range value rejected");
+}
+
+void test_threads_restart_only()
+{
+    Reload r = reload("--compression_level=3\n--threads=" + std::to_string(Settings::from_flags().threads + 2) + "\n");
+    check(r.ok && r.restarts("--threads"), "--threads waits for a restart");
+    check(r.next.threads == Settings::from_flags().threads, "the io thread count is kept");
+    check(r.next.compression_level == 3, "the rest of the file still applies");
+
+    Reload same = reload("--threads=" + std::to_string(Settings::from_flags().threads) + "\n");
+    check(same.ok && same.restart_only.empty(), "unchanged --threads not reported");
+}
+
+void test_missing_file()
+{
+    Reload r;
+    check(!reload_settings("/nonexistent/flags", Settings::from_flags(), r.next, r.restart_only, r.error),
+          "missing flagfile rejected");
+}
+
+int main()
+{
+    test_defaults();
+    test_valid_reload();
+    test_unknown_flag();
+    test_malformed_value();
+    test_threads_restart_only();
+    test_missing_file();
+
+    return test_summary("settings");
+}
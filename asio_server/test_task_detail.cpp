@@ -0,0 +1,38 @@
+#include "handlers/task_manager/query_task_detail_handler.h"
+#include "test_task_util.h"
+#include "worker_pool.h"
+#include <cstdio>
+#include <string>
+
+static Response get(const std::string &target)
+{
+    return request<query_task_detail_handler>(http::verb::get, target);
+}
+
+void test_known_task()
+{
+    std::string id = create("noop");
+
+    auto res = get("/taskDetail/" + id);
+    check(res.result() == http::status::ok, "200 for a known task");
+    check(res[http::field::content_type] == "application/json", "JSON content type");
+    check(res.body().rfind("{\"id\":\"" + id + "\",\"status\":\"finished\",", 0) == 0, "the task's JSON");
+    check(res[http::field::content_length] == std::to_string(res.body().size()), "Content-Length set");
+}
+
+void test_unknown_task()
+{
+    auto res = get("/taskDetail/no-such-task");
+    check(res.result() == http::status::not_found, "404 for an unknown task");
+    check(res.body() == "{\"error\":\"unknown task\"}", "JSON error body");
+}
+
+int main()
+{
+    check(task_classes_registered, "task classes registered");
+    test_known_task();
+    test_unknown_task();
+    WorkerPool::shutdown();
+
+    return test_summary("task detail");
+}
@@ -0,0 +1,174 @@
+#include "handlers/task_manager/query_task_detail_handler.h"
+#include "test_task_util.h"
+#include "worker_pool.h"
+#include <algorithm>
+#include <boost/json.hpp>
+#include <compression.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+static Response post(const std::string &body)
+{
+    return request<query_task_detail_list_handler>(http::verb::post, "/taskDetailList", body);
+}
+
+static boost::json::object get(const std::string &target, http::status expected = http::status::ok)
+{
+    auto res = request<query_task_detail_list_handler>(http::verb::get, target);
+    check(res.result() == expected, target.c_str());
+    boost::json::error_code ec;
+    boost::json::value body = boost::json::parse(res.body(), ec);
+    return !ec && body.is_object() ? body.as_object() : boost::json::object();
+}
+
+// The "id" of every task in `page`.
+static std::vector<std::string> ids_of(const boost::json::object &page)
+{
+    std::vector<std::string> ids;
+    if (auto tasks = page.if_contains("tasks"))
+    {
+        for (const auto &task: tasks->as_array())
+        {
+            ids.emplace_back(task.as_object().at("id").as_string());
+        }
+    }
+    return ids;
+}
+
+static std::string join(const std::vector<std::string> &ids)
+{
+    std::string list;
+    for (const auto &id: ids)
+    {
+        list += (list.empty() ? "" : ",") + id;
+    }
+    return list;
+}
+
+void test_get_task_infos(const std::vector<std::string> &ids)
+{
+    auto infos = TaskManager::instance()->getTaskInfos({ids[2], "no-such-task", ids[0], ids[2]});
+    check(infos.size() == 3 && infos[0].id == ids[2] && infos[1].id == ids[0] && infos[2].id == ids[2],
+          "getTaskInfos keeps the order asked for and repeats duplicates, without unknown ids");
+}
+
+void test_by_ids(const std::vector<std::string> &ids)
+{
+    auto page = get("/taskDetailList?ids=" + ids[1] + ",no-such-task," + ids[0] + "," + ids[1]);
+    check(ids_of(page) == std::vector<std::string>{ids[1], ids[0], ids[1]}, "tasks in the order asked for");
+    check(page["unknown"] == boost::json::value(boost::json::array{"no-such-task"}), "unknown ids listed apart");
+
+    auto res = post("{\"ids\":[\"" + ids[2] + "\",\"gone\"]}");
+    check(res.result() == http::status::ok, "POST {\"ids\":[...]}");
+    check(res.body().find(ids[2]) != std::string::npos, "POST answers like GET");
+    check(res.body().find("\"unknown\":[\"gone\"]") != std::string::npos, "with the unknown ids");
+    check(post("[]").result() == http::status::bad_request, "400 for a body that is not {\"ids\":[...]}");
+
+    auto post_ids = [](const std::vector<std::string> &list) {
+        boost::json::object body{{"ids", boost::json::value_from(list)}};
+        return post(boost::json::serialize(body)).result();
+    };
+    std::vector<std::string> many(query_task_detail_list_handler::kMaxIds, "x");
+    check(post_ids(many) == http::status::ok, "kMaxIds ids answered");
+    many.push_back("x");
+    check(post_ids(many) == http::status::bad_request, "400 past kMaxIds");
+}
+
+void test_pages(std::size_t total)
+{
+    auto all = get("/taskDetailList?limit=1000");
+    check(ids_of(all).size() == total && all["nextCursor"].is_null(), "one page holds every task, then no cursor");
+    check(get("/taskDetailList?limit=" + std::to_string(total))["nextCursor"].is_null(),
+          "no cursor after a page that ends exactly at the last task");
+
+    // Pages of two, joined, are the single page; each cursor names the last task before it.
+    std::vector<std::string> paged;
+    std::string cursor;
+    for (int pages = 0; pages <= static_cast<int>(total); ++pages)
+    {
+        auto page = get("/taskDetailList?limit=2" + (cursor.empty() ? "" : "&cursor=" + cursor));
+        auto ids = ids_of(page);
+        check(ids.size() <= 2, "at most limit tasks");
+        paged.insert(paged.end(), ids.begin(), ids.end());
+        if (page["nextCursor"].is_null())
+            break;
+        const auto &last = page["tasks"].as_array().back().as_object();
+        cursor = std::string(page["nextCursor"].as_string());
+        std::string expected =
+                std::to_string(last.at("createTime").as_int64()) + "-" + std::string(last.at("id").as_string());
+        check(cursor == expected, "cursor is createTime-id of the page's last task");
+    }
+    check(paged == ids_of(all), "paging returns every task once, in creation order");
+
+    get("/taskDetailList?cursor=not-a-cursor", http::status::bad_request);
+    get("/taskDetailList?cursor=12x-abc", http::status::bad_request);
+    get("/taskDetailList?limit=0", http::status::bad_request);
+    get("/taskDetailList?limit=1001", http::status::bad_request);
+    get("/taskDetailList?limit=ten", http::status::bad_request);
+}
+
+void test_status_filter(const std::string &pending, std::size_t finished)
+{
+    check(ids_of(get("/taskDetailList?status=pending")) == std::vector<std::string>{pending}, "status=pending");
+    auto done = ids_of(get("/taskDetailList?status=finished&limit=1000"));
+    check(done.size() == finished, "status=finished lists every finished task");
+    check(std::find(done.begin(), done.end(), pending) == done.end(), "and no pending one");
+    get("/taskDetailList?status=sleeping", http::status::bad_request);
+}
+
+// A list over Compression's min_size carries a strong ETag, so its gzip body is compressed
+// once and reused while the tasks are unchanged, and a client holding it gets 304.
+void test_etag_and_compression()
+{
+    // One worker thread, so the second request finds what the first one cached.
+    WorkerPool::resize(1);
+    for (int i = 0; i < 10; ++i)
+    {
+        create("noop");
+    }
+    Request req{http::verb::get, "/taskDetailList?limit=1000", 11};
+    req.set(http::field::accept_encoding, "gzip");
+    auto reused = Compression::reused_tagged_variants();
+
+    auto first = request<query_task_detail_list_handler>(req);
+    check(first.result() == http::status::ok, "200 for the list");
+    check(first[http::field::content_encoding] == "gzip", "the list is gzipped");
+    check(first[http::field::etag].substr(0, 2) == "W/", "with the weak form of its ETag");
+    check(Compression::reused_tagged_variants() == reused, "compressed on the first request");
+
+    auto second = request<query_task_detail_list_handler>(req);
+    check(second.body() == first.body() && second[http::field::etag] == first[http::field::etag], "same list");
+    check(Compression::reused_tagged_variants() == reused + 1, "compressed body reused on the second");
+
+    req.set(http::field::if_none_match, first[http::field::etag]);
+    auto unchanged = request<query_task_detail_list_handler>(req);
+    check(unchanged.result() == http::status::not_modified && unchanged.body().empty(), "304 for If-None-Match");
+
+    create("noop");
+    auto changed = request<query_task_detail_list_handler>(req);
+    check(changed.result() == http::status::ok && changed[http::field::etag] != first[http::field::etag],
+          "a new task changes the ETag");
+}
+
+int main()
+{
+    check(task_classes_registered, "task classes registered");
+    std::vector<std::string> ids;
+    for (int i = 0; i < 5; ++i)
+    {
+        ids.push_back(create("noop"));
+    }
+    std::string pending = create("gated");
+
+    test_get_task_infos(ids);
+    test_by_ids(ids);
+    test_pages(ids.size() + 1);
+    test_status_filter(pending, ids.size());
+    test_etag_and_compression();
+
+    gate.set_value();
+    WorkerPool::shutdown();
+
+    return test_summary("task list");
+}
\ No newline at end of file
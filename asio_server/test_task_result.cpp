@@ -0,0 +1,91 @@
+#include "handlers/task_manager/query_task_result_handler.h"
+#include "test_task_util.h"
+#include "worker_pool.h"
+#include <boost/json.hpp>
+#include <cstdio>
+#include <string>
+
+// Ends with a result of several kChunkSize pieces, before createTask() returns.
+class rows_task : public Task
+{
+public:
+    static constexpr int kRows = 5000;
+
+    explicit rows_task(const std::string &parameters) : Task(parameters)
+    {
+        m_mode = Sync;
+    }
+
+    static boost::json::object result()
+    {
+        boost::json::array rows;
+        for (int i = 0; i < kRows; ++i)
+        {
+            rows.emplace_back("row-" + std::to_string(i));
+        }
+        return {{"rows", std::move(rows)}};
+    }
+
+    bool execute() override
+    {
+        onBeforeTaskEnd(this, result());
+        return true;
+    }
+};
+
+static bool registered = task_classes_registered &&
+                         TaskFactory::registerClass("rows", [](const std::string &params) {
+                             return std::make_shared<rows_task>(params);
+                         });
+
+static http::response<http::string_body> get(const tcp::endpoint &endpoint, const std::string &id)
+{
+    net::io_context ctx;
+    tcp::socket socket(ctx);
+    socket.connect(endpoint);
+    http::request<http::empty_body> req{http::verb::get, "/queryTaskResult/" + id, 11};
+    http::write(socket, req);
+    beast::flat_buffer buffer;
+    http::response<http::string_body> res;
+    http::read(socket, buffer, res);
+    return res;
+}
+
+void test_streamed_result(const tcp::endpoint &endpoint)
+{
+    auto res = get(endpoint, create("rows"));
+    check(res.result() == http::status::ok, "200 for a finished task");
+    check(res[http::field::content_type] == "application/json", "JSON content type");
+    check(res.chunked(), "result streamed with chunked encoding");
+    check(res.body().size() > 2 * query_task_result_handler::kChunkSize, "result spans several chunks");
+    boost::json::error_code ec;
+    check(boost::json::parse(res.body(), ec) == boost::json::value(rows_task::result()), "the task's result object");
+
+    auto empty = get(endpoint, create("noop"));
+    check(empty.result() == http::status::ok && empty.body() == "{}", "empty result object");
+}
+
+void test_errors(const tcp::endpoint &endpoint)
+{
+    auto unknown = get(endpoint, "no-such-task");
+    check(unknown.result() == http::status::not_found, "404 for an unknown task");
+    check(unknown.body() == "{\"error\":\"unknown task\"}", "JSON error body");
+
+    auto pending = get(endpoint, create("gated"));
+    check(pending.result() == http::status::conflict, "409 while the task has not finished");
+    check(pending.body() == "{\"error\":\"task not finished\"}", "JSON conflict body");
+}
+
+int main()
+{
+    check(registered, "task classes registered");
+    {
+        TestServer server;
+        test_streamed_result(server.endpoint());
+        test_errors(server.endpoint());
+    }
+    gate.set_value();
+    WorkerPool::shutdown();
+
+    return test_summary("task result");
+}
@@ -0,0 +1,148 @@
+#include "handlers/task_manager/task_socket_handler.h"
+#include "rate_limiter.h"
+#include "test_task_util.h"
+#include "websocket_session.h"
+#include "worker_pool.h"
+#include <boost/json.hpp>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+// Holds the thread that creates it for a while, like a slow Sync task would.
+class sleepy_task : public noop_task
+{
+public:
+    using noop_task::noop_task;
+
+    bool execute() override
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        return true;
+    }
+};
+
+static bool registered = task_classes_registered &&
+                         TaskFactory::registerClass("sleepy", [](const std::string &params) {
+                             return std::make_shared<sleepy_task>(params);
+                         });
+
+using Client = websocket::stream<tcp::socket>;
+
+static void connect(Client &ws, const tcp::endpoint &endpoint)
+{
+    ws.next_layer().connect(endpoint);
+    ws.handshake("localhost", "/taskSocket");
+}
+
+static bool is(const boost::json::value &value, const char *text)
+{
+    return value.is_string() && value.as_string() == text;
+}
+
+static boost::json::object read_reply(Client &ws)
+{
+    beast::flat_buffer buffer;
+    ws.read(buffer);
+    boost::json::error_code ec;
+    boost::json::value reply = boost::json::parse(beast::buffers_to_string(buffer.data()), ec);
+    return !ec && reply.is_object() ? reply.as_object() : boost::json::object();
+}
+
+void test_submit(const tcp::endpoint &endpoint)
+{
+    net::io_context ctx;
+    Client ws(ctx);
+    connect(ws, endpoint);
+
+    ws.write(net::buffer(std::string(
+            R"({"op":"submit","tasks":[{"name":"noop"},{"name":"no-such-task"},{"params":"x"}],"subscribe":true})")));
+    auto reply = read_reply(ws);
+    check(is(reply["reply"], "submit"), "submit answered");
+    const boost::json::array *ids = reply.contains("taskIds") ? reply["taskIds"].if_array() : nullptr;
+    check(ids && ids->size() == 3, "an id or null per task");
+    if (!ids || ids->size() != 3)
+        return;
+    check((*ids)[0].is_string() && (*ids)[1].is_null() && (*ids)[2].is_null(), "null for tasks not created");
+
+    auto snapshot = read_reply(ws);
+    check(snapshot["id"] == (*ids)[0] && is(snapshot["status"], "finished"), "the subscribed task's state follows");
+    ws.close(websocket::close_code::normal);
+}
+
+void test_submit_off_io_thread(const tcp::endpoint &endpoint)
+{
+    net::io_context ctx;
+    Client ws(ctx);
+    connect(ws, endpoint);
+
+    // The task holds the thread creating it; messages after the submit are still answered.
+    ws.write(net::buffer(std::string(R"({"op":"submit","tasks":[{"name":"sleepy"}]})")));
+    ws.write(net::buffer(std::string(R"({"op":"unsubscribe","taskIds":[]})")));
+    check(is(read_reply(ws)["reply"], "unsubscribe"), "the io thread keeps serving while tasks are created");
+    auto reply = read_reply(ws);
+    check(is(reply["reply"], "submit") && reply["taskIds"].is_array() && reply["taskIds"].as_array().size() == 1 &&
+                  reply["taskIds"].as_array()[0].is_string(),
+          "then the submit is answered");
+    ws.close(websocket::close_code::normal);
+}
+
+void test_batch_limit(const tcp::endpoint &endpoint)
+{
+    net::io_context ctx;
+    Client ws(ctx);
+    connect(ws, endpoint);
+
+    boost::json::array tasks;
+    for (std::size_t i = 0; i <= task_socket_handler::kMaxSubmitBatch; ++i)
+    {
+        tasks.push_back(boost::json::object{{"name", "noop"}});
+    }
+    ws.write(net::buffer(boost::json::serialize(boost::json::object{{"op", "submit"}, {"tasks", std::move(tasks)}})));
+    auto reply = read_reply(ws);
+    check(is(reply["reply"], "submit") && reply.contains("error") && !reply.contains("taskIds"),
+          "a batch past kMaxSubmitBatch is refused");
+    ws.close(websocket::close_code::normal);
+}
+
+// The upgrade skips middleware, so the task budget is charged per submit instead.
+void test_rate_limited(const tcp::endpoint &endpoint)
+{
+    RateLimiter::Options options;
+    // One token every 100s, in a bucket of 1.5: the earlier tests' tokens, from the same
+    // address, have not yet refilled, so room for exactly one more submit is left.
+    options.rate = 0.01;
+    options.burst = 1.5;
+    RateLimiter::configure(options);
+
+    net::io_context ctx;
+    Client ws(ctx);
+    connect(ws, endpoint);
+    const std::string submit = R"({"op":"submit","tasks":[{"name":"noop"}]})";
+    ws.write(net::buffer(submit));
+    auto first = read_reply(ws);
+    check(is(first["reply"], "submit") && first.contains("taskIds"), "a submit within the budget runs");
+    ws.write(net::buffer(submit));
+    auto second = read_reply(ws);
+    check(is(second["error"], "rate limited") && second["retryAfter"].is_int64() &&
+              second["retryAfter"].as_int64() > 0 && !second.contains("taskIds"),
+          "a submit past the budget is refused with retryAfter");
+    ws.close(websocket::close_code::normal);
+
+    RateLimiter::configure(RateLimiter::Options{});
+}
+
+int main()
+{
+    check(registered, "task classes registered");
+    {
+        TestServer server;
+        test_submit(server.endpoint());
+        test_submit_off_io_thread(server.endpoint());
+        test_batch_limit(server.endpoint());
+        test_rate_limited(server.endpoint());
+    }
+    WorkerPool::shutdown();
+
+    return test_summary("task socket");
+}
\ No newline at end of file
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "router.h"
+#include "test_util.h"
+#include <future>
+#include <memory>
+#include <string>
+#include <task.h>
+#include <taskmanager.h>
+
+// Tasks and a request harness shared by the tests of the task_manager handlers, on top of
+// test_util.h. A test adds its own task classes next to these, and checks
+// task_classes_registered in main().
+
+// Runs where it is created, so its info is final by the time createTask() returns.
+class noop_task : public Task
+{
+public:
+    explicit noop_task(const std::string &parameters) : Task(parameters)
+    {
+        m_mode = Sync;
+    }
+};
+
+// Stays pending on the ThreadPool until `gate` is set; a test that creates one sets it
+// before WorkerPool::shutdown().
+inline std::promise<void> gate;
+inline std::shared_future<void> opened = gate.get_future().share();
+
+class gated_task : public Task
+{
+public:
+    using Task::Task;
+
+    bool execute() override
+    {
+        opened.wait();
+        return true;
+    }
+};
+
+inline const bool task_classes_registered =
+        TaskFactory::registerClass("noop",
+                                   [](const std::string &params) { return std::make_shared<noop_task>(params); }) &&
+        TaskFactory::registerClass("gated",
+                                   [](const std::string &params) { return std::make_shared<gated_task>(params); });
+
+inline std::string create(const char *name)
+{
+    auto [created, id] = TaskManager::instance()->createTask(name);
+    check(created, "task created");
+    return id;
+}
+
+// Routes the request's target and runs the handler found, which must be a `Handler`,
+// through its middleware as Session would. A worker handler runs on the WorkerPool and
+// completes back on the io_context run here.
+template<typename Handler>
+Response request(const Request &req)
+{
+    std::string target(req.target());
+    net::io_context ctx;
+    auto guard = net::make_work_guard(ctx);
+    ReqContext ctxt(req);
+    ctxt.set_executor(ctx.get_executor());
+    Response res{http::status::internal_server_error, 11};
+    ApiHandler *handler = Router::route(target.substr(0, target.find('?')), ctxt);
+    check(dynamic_cast<Handler *>(handler) != nullptr, "routes to the handler under test");
+    if (handler)
+    {
+        handler->execute(ctxt, res, [&](CachedResponsePtr) { guard.reset(); });
+        ctx.run();
+    }
+    return res;
+}
+
+template<typename Handler>
+Response request(http::verb method, const std::string &target, const std::string &body = {})
+{
+    Request req{method, target, 11};
+    req.body() = body;
+    req.prepare_payload();
+    return request<Handler>(req);
+}
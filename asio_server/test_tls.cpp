@@ -0,0 +1,350 @@
+#include "file_cache.h"
+#include "io_context_pool.h"
+#include "router.h"
+#include "server.h"
+#include "session.h"
+#include "test_util.h"
+#include "tls.h"
+#include "websocket_session.h"
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/beast/websocket/ssl.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+class text_handler : public ApiHandler
+{
+public:
+    explicit text_handler(std::string body) : body_(std::move(body)) {}
+
+    void handle_request(const ReqContext &, Response &res) override
+    {
+        res.result(http::status::ok);
+        res.body() = body_;
+    }
+
+private:
+    std::string body_;
+};
+
+class file_handler : public ApiHandler
+{
+public:
+    explicit file_handler(std::string path) : path_(std::move(path)) {}
+
+    void handle_request(const ReqContext &, Response &res) override
+    {
+        OpenFilePtr file = FileCache::open(path_);
+        res.result(http::status::ok);
+        res.send_file(file, 0, file->size());
+    }
+
+private:
+    std::string path_;
+};
+
+class echo_socket : public WebSocketHandler
+{
+public:
+    void on_message(WebSocketSession &session, std::string_view message, bool binary) override
+    {
+        session.send(std::string(message), binary);
+    }
+};
+
+class socket_handler : public ApiHandler
+{
+public:
+    socket_handler()
+    {
+        accept_websocket(std::make_shared<echo_socket>());
+    }
+
+    void handle_request(const ReqContext &, Response &res) override
+    {
+        res.result(http::status::upgrade_required);
+    }
+};
+
+// A self-signed P-256 certificate for localhost, written as PEM into `dir`.
+static void write_certificate(const std::string &dir)
+{
+    EVP_PKEY *key = nullptr;
+    EVP_PKEY_CTX *key_ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+    EVP_PKEY_keygen_init(key_ctx);
+    EVP_PKEY_CTX_set_ec_paramgen_curve_nid(key_ctx, NID_X9_62_prime256v1);
+    EVP_PKEY_keygen(key_ctx, &key);
+    EVP_PKEY_CTX_free(key_ctx);
+
+    X509 *cert = X509_new();
+    X509_set_version(cert, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+    X509_gmtime_adj(X509_getm_notAfter(cert), 24 * 60 * 60);
+    X509_set_pubkey(cert, key);
+    X509_NAME *name = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char *>("localhost"), -1, -1, 0);
+    X509_set_issuer_name(cert, name);
+    X509_sign(cert, key, EVP_sha256());
+
+    BIO *out = BIO_new_file((dir + "/cert.pem").c_str(), "w");
+    PEM_write_bio_X509(out, cert);
+    BIO_free(out);
+    out = BIO_new_file((dir + "/key.pem").c_str(), "w");
+    PEM_write_bio_PrivateKey(out, key, nullptr, nullptr, 0, nullptr, nullptr);
+    BIO_free(out);
+    X509_free(cert);
+    EVP_PKEY_free(key);
+}
+
+using Clock = std::chrono::steady_clock;
+using TlsSocket = net::ssl::stream<tcp::socket>;
+
+// A blocking client connection; resumes `session` when given one.
+struct TlsClient
+{
+    TlsSocket stream;
+
+    TlsClient(net::io_context &ctx, net::ssl::context &client, unsigned short port, SSL_SESSION *session = nullptr)
+        : stream(ctx, client)
+    {
+        stream.next_layer().connect({net::ip::make_address("127.0.0.1"), port});
+        if (session)
+        {
+            SSL_set_session(stream.native_handle(), session);
+        }
+        stream.handshake(net::ssl::stream_base::client);
+    }
+
+    bool resumed()
+    {
+        return SSL_session_reused(stream.native_handle()) == 1;
+    }
+
+    // TLS 1.3 tickets arrive after the handshake, so this is only useful after a response.
+    SSL_SESSION *session()
+    {
+        return SSL_get1_session(stream.native_handle());
+    }
+
+    // A client that drops the connection without a close_notify has its session marked
+    // unusable by OpenSSL, so a resuming client closes like this.
+    beast::error_code close()
+    {
+        beast::error_code ec;
+        stream.shutdown(ec);
+        return ec;
+    }
+
+    http::response<http::string_body> get(const char *target, bool keep_alive = true)
+    {
+        http::request<http::empty_body> req{http::verb::get, target, 11};
+        req.keep_alive(keep_alive);
+        http::write(stream, req);
+        http::response<http::string_body> res;
+        http::read(stream, buffer, res);
+        return res;
+    }
+
+    beast::flat_buffer buffer;
+};
+
+static http::response<http::string_body> plain_get(tcp::socket &socket, const char *target)
+{
+    http::request<http::empty_body> req{http::verb::get, target, 11};
+    http::write(socket, req);
+    beast::flat_buffer buffer;
+    http::response<http::string_body> res;
+    http::read(socket, buffer, res);
+    return res;
+}
+
+void test_requests(net::ssl::context &client, unsigned short port)
+{
+    net::io_context ctx;
+    TlsClient conn(ctx, client, port);
+    check(conn.get("/tls/text").body() == "hello", "request over TLS");
+    check(conn.get("/tls/text").body() == "hello", "keep-alive over TLS");
+
+    auto res = conn.get("/tls/file", false);
+    check(res.body().size() == 256 * 1024 && res.body().find_first_not_of('f') == std::string::npos,
+          "file response copied instead of sendfile");
+
+    // Connection: close ends with a close_notify, which the client reads as a clean end.
+    beast::error_code ec;
+    char byte;
+    conn.stream.read_some(net::buffer(&byte, 1), ec);
+    check(ec == net::error::eof, "close_notify before the connection closes");
+}
+
+void test_resumption(net::ssl::context &client, unsigned short port)
+{
+    net::io_context ctx;
+    SSL_SESSION *session = nullptr;
+    {
+        TlsClient first(ctx, client, port);
+        check(!first.resumed(), "first connection does a full handshake");
+        first.get("/tls/text");
+        session = first.session();
+        check(!first.close(), "close_notify answered by the server");
+    }
+
+    TlsClient second(ctx, client, port, session);
+    check(second.resumed(), "reconnect resumes the session");
+    check(second.get("/tls/text").body() == "hello", "request on the resumed session");
+    second.close();
+    SSL_SESSION_free(session);
+}
+
+void test_websocket(net::ssl::context &client, unsigned short port)
+{
+    net::io_context ctx;
+    websocket::stream<TlsSocket> ws(ctx, client);
+    ws.next_layer().next_layer().connect({net::ip::make_address("127.0.0.1"), port});
+    ws.next_layer().handshake(net::ssl::stream_base::client);
+    ws.handshake("localhost", "/tls/socket");
+    ws.write(net::buffer(std::string("over tls")));
+    beast::flat_buffer buffer;
+    ws.read(buffer);
+    check(beast::buffers_to_string(buffer.data()) == "over tls", "WebSocket over TLS");
+    ws.close(websocket::close_code::normal);
+}
+
+void test_plaintext_client(unsigned short port)
+{
+    net::io_context ctx;
+    tcp::socket socket(ctx);
+    socket.connect({net::ip::make_address("127.0.0.1"), port});
+    http::request<http::empty_body> req{http::verb::get, "/tls/text", 11};
+    http::write(socket, req);
+    beast::flat_buffer buffer;
+    http::response<http::string_body> res;
+    beast::error_code ec;
+    http::read(socket, buffer, res, ec);
+    check(ec && res.body().empty(), "plaintext request on the TLS port gets no response");
+}
+
+// Full and resumed handshakes against plain TCP connects, each followed by one small
+// request; then one keep-alive connection fetching 1 MiB bodies. Client and server share
+// the machine, so the handshake figures include the client's half of the work.
+void bench(net::ssl::context &client, unsigned short tls_port, unsigned short plain_port)
+{
+    const int connections = 300;
+    net::io_context ctx;
+
+    auto rate = [&](const char *what, auto &&connect) {
+        auto start = Clock::now();
+        for (int i = 0; i < connections; ++i)
+        {
+            connect();
+        }
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        printf("  %-22s %7.0f connections/s\n", what, connections / seconds);
+    };
+
+    rate("plaintext:", [&] {
+        tcp::socket socket(ctx);
+        socket.connect({net::ip::make_address("127.0.0.1"), plain_port});
+        plain_get(socket, "/tls/text");
+    });
+    rate("TLS, full handshake:", [&] {
+        TlsClient conn(ctx, client, tls_port);
+        conn.get("/tls/text");
+        conn.close();
+    });
+
+    SSL_SESSION *session = nullptr;
+    {
+        TlsClient conn(ctx, client, tls_port);
+        conn.get("/tls/text");
+        session = conn.session();
+        conn.close();
+    }
+    // A TLS 1.3 session is used once; each connection resumes with the ticket of the last.
+    int resumed = 0;
+    rate("TLS, resumed:", [&] {
+        TlsClient conn(ctx, client, tls_port, session);
+        conn.get("/tls/text");
+        resumed += conn.resumed();
+        SSL_SESSION_free(session);
+        session = conn.session();
+        conn.close();
+    });
+    check(resumed == connections, "every reconnect resumed");
+    SSL_SESSION_free(session);
+
+    const int requests = 64;
+    auto throughput = [&](const char *what, auto &&get) {
+        auto start = Clock::now();
+        std::size_t bytes = 0;
+        for (int i = 0; i < requests; ++i)
+        {
+            bytes += get().body().size();
+        }
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        printf("  %-22s %7.0f MB/s\n", what, bytes / seconds / 1e6);
+    };
+
+    tcp::socket socket(ctx);
+    socket.connect({net::ip::make_address("127.0.0.1"), plain_port});
+    throughput("plaintext 1 MiB bodies:", [&] { return plain_get(socket, "/tls/bulk"); });
+    TlsClient conn(ctx, client, tls_port);
+    throughput("TLS 1 MiB bodies:", [&] { return conn.get("/tls/bulk"); });
+}
+
+int main()
+{
+    char dir_template[] = "/tmp/test_tls_XXXXXX";
+    std::string dir = mkdtemp(dir_template);
+    write_certificate(dir);
+    std::ofstream(dir + "/file.bin") << std::string(256 * 1024, 'f');
+
+    Router::register_static_handler("/tls/text", std::make_shared<text_handler>("hello"));
+    Router::register_static_handler("/tls/bulk", std::make_shared<text_handler>(std::string(1024 * 1024, 'b')));
+    Router::register_static_handler("/tls/file", std::make_shared<file_handler>(dir + "/file.bin"));
+    Router::register_static_handler("/tls/socket", std::make_shared<socket_handler>());
+
+    bool rejected = false;
+    try
+    {
+        Tls::server_context(dir + "/cert.pem", dir + "/missing.pem");
+    }
+    catch (const boost::system::system_error &)
+    {
+        rejected = true;
+    }
+    check(rejected, "missing key file throws");
+
+    IoContextPool pool(1);
+    Server tls_server(pool, 0, false);
+    tls_server.set_tls(Tls::server_context(dir + "/cert.pem", dir + "/key.pem"));
+    Server plain_server(pool, 0, false);
+    std::thread runner([&pool] { pool.run(); });
+
+    net::ssl::context client(net::ssl::context::tls_client);
+    client.set_verify_mode(net::ssl::verify_none);
+    SSL_CTX_set_session_cache_mode(client.native_handle(), SSL_SESS_CACHE_CLIENT);
+
+    test_requests(client, tls_server.port());
+    test_resumption(client, tls_server.port());
+    test_websocket(client, tls_server.port());
+    test_plaintext_client(tls_server.port());
+    bench(client, tls_server.port(), plain_server.port());
+
+    pool.stop();
+    runner.join();
+    for (const char *file: {"/cert.pem", "/key.pem", "/file.bin"})
+    {
+        unlink((dir + file).c_str());
+    }
+    rmdir(dir.c_str());
+
+    return test_summary("TLS");
+}
@@ -0,0 +1,249 @@
+#include "compression.h"
+#include "io_context_pool.h"
+#include "router.h"
+#include "server.h"
+#include "session.h"
+#include "test_util.h"
+#include "trace.h"
+#include "worker_pool.h"
+#include <atomic>
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+class work_handler : public ApiHandler
+{
+public:
+    void handle_request(const ReqContext &, Response &res) override
+    {
+        res.result(http::status::ok);
+        res.body() = std::string(4096, 'w');
+    }
+};
+
+using Clock = Trace::Clock;
+
+static std::size_t count(const std::string &s, const std::string &needle)
+{
+    std::size_t n = 0;
+    for (auto pos = s.find(needle); pos != std::string::npos; pos = s.find(needle, pos + 1))
+    {
+        ++n;
+    }
+    return n;
+}
+
+static std::string dump()
+{
+    std::string out;
+    Trace::render_chrome_json(out);
+    return out;
+}
+
+void test_sampling()
+{
+    Trace::configure({0});
+    bool none = true;
+    for (int i = 0; i < 1000; ++i)
+    {
+        none = none && Trace::sample() == 0;
+    }
+    check(none, "rate 0 samples nothing");
+
+    Trace::configure({1});
+    bool all = true;
+    for (int i = 0; i < 1000; ++i)
+    {
+        all = all && Trace::sample() != 0;
+    }
+    check(all, "rate 1 samples everything");
+
+    Trace::configure({0.25});
+    int sampled = 0;
+    for (int i = 0; i < 20000; ++i)
+    {
+        sampled += Trace::sample() != 0;
+    }
+    check(sampled > 4500 && sampled < 5500, "rate 0.25 samples about a quarter");
+
+    Trace::configure({7});
+    check(Trace::options().sample_rate == 1, "rate clamped to 1");
+    Trace::configure({0});
+}
+
+void test_ring()
+{
+    Trace::clear();
+    check(dump() == R"({"traceEvents":[],"displayTimeUnit":"ns"})", "empty dump");
+
+    auto start = Clock::now();
+    Trace::record(0, "untraced", start, start + std::chrono::microseconds(1));
+    check(count(dump(), "untraced") == 0, "trace id 0 records nothing");
+
+    for (std::size_t i = 0; i < Trace::kRingSize + 10; ++i)
+    {
+        Trace::record(0xabc, "wrap", start, start + std::chrono::microseconds(3));
+    }
+    std::string out = dump();
+    check(count(out, R"("name":"wrap")") == Trace::kRingSize, "ring keeps the last kRingSize spans");
+    check(out.find(R"("cat":"request","ph":"X","ts":0,"dur":3,)") != std::string::npos, "complete event in µs");
+    check(out.find(R"("args":{"trace":"0000000000000abc"})") != std::string::npos, "trace id in hex");
+
+    Trace::clear();
+    Trace::record(0xabc, "after", start, start);
+    out = dump();
+    check(count(out, "wrap") == 0 && count(out, R"("name":"after")") == 1, "clear drops older spans only");
+    Trace::clear();
+}
+
+// Spans named "a" always last 1 µs and "b" 2 µs; a torn copy would mix them up.
+void test_concurrent_dump()
+{
+    std::atomic<bool> stop{false};
+    std::atomic<bool> started{false};
+    std::thread writer([&stop, &started] {
+        auto start = Clock::now();
+        for (std::uint64_t i = 1; !stop.load(std::memory_order_relaxed); ++i)
+        {
+            bool a = i % 2;
+            Trace::record(i, a ? "a" : "b", start, start + std::chrono::microseconds(a ? 1 : 2));
+            if (i == Trace::kRingSize)
+            {
+                started = true;
+            }
+        }
+    });
+    while (!started)
+    {
+        std::this_thread::yield();
+    }
+
+    bool consistent = true;
+    std::size_t seen = 0;
+    for (int n = 0; n < 200; ++n)
+    {
+        std::string out = dump();
+        for (auto pos = out.find(R"("name":")"); pos != std::string::npos; pos = out.find(R"("name":")", pos + 1))
+        {
+            char name = out[pos + 8];
+            auto dur = out.find(R"("dur":)", pos);
+            char value = out[dur + 6];
+            consistent = consistent && ((name == 'a' && value == '1') || (name == 'b' && value == '2'));
+            ++seen;
+        }
+    }
+    stop = true;
+    writer.join();
+    check(seen > 0, "spans seen while written");
+    check(consistent, "no torn spans while written");
+    Trace::clear();
+}
+
+static http::response<http::string_body> get(tcp::socket &socket, const char *target)
+{
+    http::request<http::empty_body> req{http::verb::get, target, 11};
+    req.set(http::field::accept_encoding, "gzip");
+    http::write(socket, req);
+    beast::flat_buffer buffer;
+    http::response<http::string_body> res;
+    http::read(socket, buffer, res);
+    return res;
+}
+
+// The request and write spans end after the response has left, so they may trail it.
+static std::string wait_for(const char *name)
+{
+    std::string out;
+    for (int i = 0; i < 100; ++i)
+    {
+        out = dump();
+        if (out.find(name) != std::string::npos)
+            break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return out;
+}
+
+void test_request(unsigned short port)
+{
+    net::io_context ctx;
+    tcp::socket socket(ctx);
+    socket.connect({net::ip::make_address("127.0.0.1"), port});
+
+    Trace::configure({1});
+    check(get(socket, "/trace/work").result() == http::status::ok, "traced request served");
+    std::string out = wait_for(R"("name":"request")");
+    for (const char *name: {"request", "read", "route", "middleware", "compression", "worker_queue", "handle_request",
+                            "write"})
+    {
+        if (count(out, std::string(R"("name":")") + name + "\"") != 1)
+        {
+            printf("  missing span %s\n", name);
+            check(false, "every span recorded once");
+        }
+    }
+    check(out.find(R"("route":"/trace/work")") != std::string::npos, "request span names its route");
+    auto trace = out.substr(out.find(R"("trace":")"), 26);
+    check(count(out, trace) == 8, "spans share the request's trace id");
+
+    Trace::clear();
+    Trace::configure({0});
+    get(socket, "/trace/work");
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    check(dump().find("traceEvents\":[]") != std::string::npos, "untraced request records nothing");
+}
+
+// What tracing adds per request: one sample() and a handful of spans. Unsampled requests
+// pay only the sample() check and a branch per span.
+void bench()
+{
+    const int iterations = 1000000;
+    auto per_request = [&](const char *what, double rate) {
+        Trace::configure({rate});
+        auto start = Clock::now();
+        for (int i = 0; i < iterations; ++i)
+        {
+            std::uint64_t trace = Trace::sample();
+            for (const char *name: {"route", "middleware", "handle_request", "write", "request"})
+            {
+                TraceSpan span(trace, name);
+            }
+        }
+        double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / iterations;
+        printf("  %-22s %7.1f ns per request\n", what, ns);
+    };
+
+    per_request("off:", 0);
+    per_request("1% sampled:", 0.01);
+    per_request("every request:", 1);
+    Trace::configure({0});
+    Trace::clear();
+}
+
+int main()
+{
+    test_sampling();
+    test_ring();
+    test_concurrent_dump();
+
+    auto handler = std::make_shared<work_handler>();
+    handler->use([](const ReqContext &, Response &, std::function<void()> next) { next(); });
+    handler->use<Compression>();
+    handler->set_run_on_worker(true);
+    Router::register_static_handler("/trace/work", handler);
+
+    IoContextPool pool(1);
+    Server server(pool, 0, false);
+    std::thread runner([&pool] { pool.run(); });
+    test_request(server.port());
+    pool.stop();
+    runner.join();
+    WorkerPool::shutdown();
+
+    bench();
+
+    return test_summary("trace");
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "session.h"
+#include <boost/asio.hpp>
+#include <cctype>
+#include <cstdio>
+#include <memory>
+#include <thread>
+
+// The harness every test_*.cpp shares. check() reports and counts a failed expectation;
+// main() ends with `return test_summary("router");`, which prints the outcome and gives
+// the exit status.
+inline int failures = 0;
+
+inline void check(bool ok, const char *what)
+{
+    if (!ok)
+    {
+        printf("FAILED: %s\n", what);
+        ++failures;
+    }
+}
+
+inline int test_summary(const char *suite)
+{
+    if (failures == 0)
+    {
+        printf("All %s tests passed\n", suite);
+        return 0;
+    }
+    printf("%c%s tests FAILED\n", std::toupper(static_cast<unsigned char>(suite[0])), suite + 1);
+    return 1;
+}
+
+// Serves Sessions on a loopback port from its own io thread for as long as it lives.
+struct TestServer
+{
+    net::io_context ctx{1};
+    tcp::acceptor acceptor{ctx, {net::ip::make_address("127.0.0.1"), 0}};
+    std::thread thread;
+
+    TestServer()
+    {
+        accept();
+        thread = std::thread([this] { ctx.run(); });
+    }
+
+    ~TestServer()
+    {
+        ctx.stop();
+        thread.join();
+    }
+
+    void accept()
+    {
+        acceptor.async_accept([this](beast::error_code ec, tcp::socket socket) {
+            if (ec)
+                return;
+            std::make_shared<Session>(std::move(socket))->start();
+            accept();
+        });
+    }
+
+    tcp::endpoint endpoint() const
+    {
+        return acceptor.local_endpoint();
+    }
+};
\ No newline at end of file
@@ -0,0 +1,248 @@
+#include "event_hub.h"
+#include "router.h"
+#include "session.h"
+#include "test_util.h"
+#include "websocket_session.h"
+#include <atomic>
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+// "sub <topic>" subscribes, "unsub <topic>" unsubscribes, "flood <n>" queues n messages of
+// 64 KiB, anything else echoes.
+class test_socket : public WebSocketHandler
+{
+public:
+    void on_message(WebSocketSession &session, std::string_view message, bool binary) override
+    {
+        ++received;
+        if (message.rfind("sub ", 0) == 0)
+        {
+            session.subscribe(std::string(message.substr(4)));
+            session.send("subscribed");
+        }
+        else if (message.rfind("unsub ", 0) == 0)
+        {
+            session.unsubscribe(std::string(message.substr(6)));
+            session.send("unsubscribed");
+        }
+        else if (message.rfind("flood ", 0) == 0)
+        {
+            auto block = std::make_shared<const std::string>(64 * 1024, 'f');
+            for (int i = std::stoi(std::string(message.substr(6))); i > 0; --i)
+            {
+                session.send(block, true);
+            }
+        }
+        else
+        {
+            session.send(std::string(message), binary);
+        }
+    }
+
+    std::atomic<int> received{0};
+};
+
+class socket_handler : public ApiHandler
+{
+public:
+    socket_handler()
+    {
+        accept_websocket(socket);
+    }
+
+    void handle_request(const ReqContext &, Response &res) override
+    {
+        res.result(http::status::ok);
+        res.body() = "plain";
+    }
+
+    std::shared_ptr<test_socket> socket = std::make_shared<test_socket>();
+};
+
+using Client = websocket::stream<tcp::socket>;
+
+static std::string read_message(Client &ws, bool *binary = nullptr)
+{
+    beast::flat_buffer buffer;
+    ws.read(buffer);
+    if (binary)
+    {
+        *binary = ws.got_binary();
+    }
+    return beast::buffers_to_string(buffer.data());
+}
+
+static bool wait_until(const std::function<bool()> &done)
+{
+    for (int i = 0; i < 200 && !done(); ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return done();
+}
+
+void test_plain_request(const tcp::endpoint &endpoint)
+{
+    net::io_context ctx;
+    tcp::socket socket(ctx);
+    socket.connect(endpoint);
+    http::request<http::empty_body> req{http::verb::get, "/socket", 11};
+    http::write(socket, req);
+    beast::flat_buffer buffer;
+    http::response<http::string_body> res;
+    http::read(socket, buffer, res);
+    check(res.body() == "plain", "a request without upgrade reaches handle_request");
+}
+
+void test_messages(const tcp::endpoint &endpoint)
+{
+    net::io_context ctx;
+    Client ws(ctx);
+    ws.next_layer().connect(endpoint);
+    ws.handshake("localhost", "/socket");
+    check(WebSocketSession::live_count() == 1 && Session::live_count() == 1, "the connection moved to a WebSocketSession");
+
+    ws.text(true);
+    ws.write(net::buffer(std::string("hello")));
+    bool binary = true;
+    check(read_message(ws, &binary) == "hello" && !binary, "text echoed as text");
+    ws.binary(true);
+    ws.write(net::buffer(std::string("\x01\x02", 2)));
+    check(read_message(ws, &binary) == std::string("\x01\x02", 2) && binary, "binary echoed as binary");
+
+    ws.text(true);
+    ws.write(net::buffer(std::string("sub progress")));
+    check(read_message(ws) == "subscribed", "subscribe acknowledged");
+    wait_until([] { return EventHub::subscriber_count() == 1; });
+    EventHub::publish("progress", std::make_shared<const std::string>("{\"p\":1}"));
+    EventHub::publish("unrelated", std::make_shared<const std::string>("x"));
+    EventHub::publish("progress", std::make_shared<const std::string>("{\"p\":2}"), true);
+    check(read_message(ws) == "{\"p\":1}" && read_message(ws) == "{\"p\":2}", "published events arrive in order");
+    check(wait_until([] { return EventHub::subscriber_count() == 0; }), "ended topic unsubscribed");
+
+    // A topic nobody publishes to: only unsubscribing takes the subscription out of the hub.
+    bool acknowledged = true;
+    for (int i = 0; i < 100; ++i)
+    {
+        ws.write(net::buffer(std::string("sub quiet")));
+        ws.write(net::buffer(std::string("unsub quiet")));
+        acknowledged = acknowledged && read_message(ws) == "subscribed" && read_message(ws) == "unsubscribed";
+    }
+    check(acknowledged, "subscribe and unsubscribe acknowledged");
+    check(wait_until([] { return EventHub::subscriber_count() == 0; }), "unsubscribed topics leave the hub");
+
+    ws.close(websocket::close_code::normal);
+    check(wait_until([] { return WebSocketSession::live_count() == 0; }), "closed by the client");
+}
+
+void test_backpressure(const tcp::endpoint &endpoint, test_socket &handler)
+{
+    net::io_context ctx;
+    Client ws(ctx);
+    ws.next_layer().connect(endpoint);
+    ws.handshake("localhost", "/socket");
+
+    // 4 MiB queued for a client that is not reading: more than the socket buffers take, so
+    // the server stops reading and "after" waits until the client catches up.
+    int before = handler.received;
+    ws.write(net::buffer(std::string("flood 64")));
+    ws.write(net::buffer(std::string("after")));
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    check(handler.received == before + 1, "reading paused while the queue is full");
+
+    for (int i = 0; i < 64; ++i)
+    {
+        read_message(ws);
+    }
+    check(read_message(ws) == "after", "reading resumed once the queue drained");
+    check(handler.received == before + 2, "every message handled");
+    ws.close(websocket::close_code::normal);
+}
+
+void test_slow_consumer(const tcp::endpoint &endpoint)
+{
+    net::io_context ctx;
+    Client ws(ctx);
+    ws.next_layer().connect(endpoint);
+    ws.handshake("localhost", "/socket");
+    ws.write(net::buffer(std::string("flood 200")));
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    beast::error_code ec;
+    int read = 0;
+    while (!ec)
+    {
+        beast::flat_buffer buffer;
+        ws.read(buffer, ec);
+        read += !ec;
+    }
+    check(ec == websocket::error::closed && ws.reason().code == websocket::close_code::try_again_later,
+          "client past kMaxQueuedBytes is disconnected");
+    check(read < 200, "and the rest of its queue dropped");
+    check(wait_until([] { return WebSocketSession::live_count() == 0; }), "slow consumer gone");
+}
+
+void test_reset_during_write(const tcp::endpoint &endpoint)
+{
+    {
+        net::io_context ctx;
+        Client ws(ctx);
+        ws.next_layer().connect(endpoint);
+        ws.handshake("localhost", "/socket");
+
+        // The queue is the only owner of the flood's block. With the client not reading, the
+        // server is still writing it when the reset ends the read and the connection.
+        ws.write(net::buffer(std::string("flood 64")));
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        ws.next_layer().set_option(net::socket_base::linger(true, 0));
+        ws.next_layer().close();
+    }
+    check(wait_until([] { return WebSocketSession::live_count() == 0; }), "reset client gone mid-write");
+
+    net::io_context ctx;
+    Client ws(ctx);
+    ws.next_layer().connect(endpoint);
+    ws.handshake("localhost", "/socket");
+    ws.write(net::buffer(std::string("still up")));
+    check(read_message(ws) == "still up", "server unaffected by the reset");
+    ws.close(websocket::close_code::normal);
+    check(wait_until([] { return WebSocketSession::live_count() == 0; }), "closed after the reset");
+}
+
+void test_drain(const tcp::endpoint &endpoint)
+{
+    net::io_context ctx;
+    Client ws(ctx);
+    ws.next_layer().connect(endpoint);
+    ws.handshake("localhost", "/socket");
+
+    Session::drain();
+    beast::flat_buffer buffer;
+    beast::error_code ec;
+    ws.read(buffer, ec);
+    check(ec == websocket::error::closed && ws.reason().code == websocket::close_code::going_away,
+          "drain closes with going away");
+    check(wait_until([] { return Session::live_count() == 0; }), "drained");
+    Session::reset_drain();
+}
+
+int main()
+{
+    auto handler = std::make_shared<socket_handler>();
+    Router::register_static_handler("/socket", handler);
+
+    {
+        TestServer server;
+        test_plain_request(server.endpoint());
+        test_messages(server.endpoint());
+        test_backpressure(server.endpoint(), *handler->socket);
+        test_slow_consumer(server.endpoint());
+        test_reset_during_write(server.endpoint());
+        test_drain(server.endpoint());
+    }
+
+    return test_summary("WebSocket");
+}
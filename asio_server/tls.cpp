@@ -0,0 +1,28 @@
+#include "tls.h"
+#include <openssl/ssl.h>
+
+std::shared_ptr<net::ssl::context> Tls::server_context(const std::string &cert_file, const std::string &key_file)
+{
+    auto context = std::make_shared<net::ssl::context>(net::ssl::context::tls_server);
+    context->set_options(net::ssl::context::default_workarounds | net::ssl::context::no_sslv2 |
+                         net::ssl::context::no_sslv3 | net::ssl::context::no_tlsv1 |
+                         net::ssl::context::no_tlsv1_1 | net::ssl::context::single_dh_use);
+    context->use_certificate_chain_file(cert_file);
+    context->use_private_key_file(key_file, net::ssl::context::pem);
+
+    SSL_CTX *native = context->native_handle();
+    if (SSL_CTX_check_private_key(native) != 1)
+    {
+        throw boost::system::system_error(net::error::invalid_argument, "TLS key does not match the certificate");
+    }
+
+    static const unsigned char kSessionIdContext[] = "asio-demo";
+    SSL_CTX_set_session_id_context(native, kSessionIdContext, sizeof(kSessionIdContext) - 1);
+    SSL_CTX_set_session_cache_mode(native, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(native, kSessionCacheSize);
+    SSL_CTX_set_timeout(native, kSessionLifetime.count());
+    SSL_CTX_clear_options(native, SSL_OP_NO_TICKET);
+    // One TLS 1.3 ticket per handshake instead of OpenSSL's two; a client resumes with one.
+    SSL_CTX_set_num_tickets(native, 1);
+    return context;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <boost/asio/ssl/context.hpp>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace net = boost::asio;
+
+// Server-side TLS settings shared by every connection of a Server.
+//
+// Reconnecting clients resume their session instead of repeating the full handshake:
+// TLS 1.3 and 1.2 clients with a session ticket (stateless, the key is held by the
+// context), and TLS 1.2 clients that offer a session id from the context's cache. Both last
+// kSessionLifetime. A new context (e.g. on SIGHUP) has new ticket keys, so sessions from
+// before it are not resumed.
+class Tls
+{
+public:
+    static constexpr std::chrono::seconds kSessionLifetime{2 * 60 * 60};
+    static constexpr std::size_t kSessionCacheSize = 20000;
+
+    // Loads the PEM certificate chain and private key. Throws boost::system::system_error
+    // if either cannot be read or they do not match.
+    static std::shared_ptr<net::ssl::context> server_context(const std::string &cert_file,
+                                                             const std::string &key_file);
+};
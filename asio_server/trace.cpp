@@ -0,0 +1,219 @@
+#include "trace.h"
+#include "json_writer.h"
+#include "metrics.h"
+#include "reloadable.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <random>
+#include <vector>
+#include <unistd.h>
+
+namespace {
+
+Reloadable<Trace::Options> &global_options()
+{
+    static Reloadable<Trace::Options> options;
+    return options;
+}
+
+// One span. Only the ring's own thread writes it; `seq` is odd while it does, and a reader
+// that sees `seq` change while it copies the fields drops the copy.
+struct Slot
+{
+    std::atomic<std::uint64_t> seq{0};
+    std::atomic<std::uint64_t> trace{0};
+    std::atomic<const char *> name{nullptr};
+    std::atomic<std::int64_t> start{0};
+    std::atomic<std::int64_t> duration{0};
+    std::atomic<std::size_t> route{0};
+};
+
+struct Ring
+{
+    std::array<Slot, Trace::kRingSize> slots;
+    // Spans ever written, and how many of them clear() discarded.
+    std::atomic<std::uint64_t> next{0};
+    std::atomic<std::uint64_t> cleared{0};
+    std::size_t tid = 0;
+};
+
+struct Registry
+{
+    std::mutex mutex;
+    // Rings are never freed, so spans from exited threads can still be dumped.
+    std::vector<Ring *> rings;
+};
+
+Registry &registry()
+{
+    static Registry instance;
+    return instance;
+}
+
+Ring &ring()
+{
+    thread_local Ring *local = [] {
+        auto *created = new Ring();
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        registry().rings.push_back(created);
+        created->tid = registry().rings.size();
+        return created;
+    }();
+    return *local;
+}
+
+// xorshift64*: a few instructions per request, seeded once per thread.
+std::uint64_t next_random()
+{
+    thread_local std::uint64_t state = (static_cast<std::uint64_t>(std::random_device{}()) << 32) | 1;
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545f4914f6cdd1dULL;
+}
+
+struct SpanCopy
+{
+    std::uint64_t trace;
+    const char *name;
+    std::int64_t start;
+    std::int64_t duration;
+    std::size_t route;
+    std::size_t tid;
+};
+
+std::int64_t nanoseconds(Trace::Clock::time_point t)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+}
+
+}// namespace
+
+void Trace::configure(const Options &options)
+{
+    Options clamped = options;
+    clamped.sample_rate = std::clamp(options.sample_rate, 0.0, 1.0);
+    global_options().set(clamped);
+}
+
+const Trace::Options &Trace::options()
+{
+    return global_options().get();
+}
+
+std::uint64_t Trace::sample()
+{
+    double rate = global_options().get().sample_rate;
+    if (rate <= 0)
+        return 0;
+    // The top 53 bits as a uniform double in [0, 1).
+    if (rate < 1 && static_cast<double>(next_random() >> 11) * 0x1.0p-53 >= rate)
+        return 0;
+    return next_random() | 1;
+}
+
+void Trace::record(std::uint64_t trace, const char *name, Clock::time_point start, Clock::time_point end,
+                   std::size_t route)
+{
+    if (!trace)
+        return;
+
+    Ring &r = ring();
+    std::uint64_t n = r.next.load(std::memory_order_relaxed);
+    Slot &slot = r.slots[n % kRingSize];
+    std::uint64_t seq = slot.seq.load(std::memory_order_relaxed);
+    slot.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.trace.store(trace, std::memory_order_relaxed);
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.start.store(nanoseconds(start), std::memory_order_relaxed);
+    slot.duration.store(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count(),
+                        std::memory_order_relaxed);
+    slot.route.store(route, std::memory_order_relaxed);
+    slot.seq.store(seq + 2, std::memory_order_release);
+    r.next.store(n + 1, std::memory_order_release);
+}
+
+void Trace::clear()
+{
+    std::lock_guard<std::mutex> lock(registry().mutex);
+    for (Ring *r: registry().rings)
+    {
+        r->cleared.store(r->next.load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
+}
+
+// Timestamps are in microseconds from the earliest span, which keeps them short and exact.
+void Trace::render_chrome_json(std::string &out)
+{
+    std::vector<Ring *> rings;
+    {
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        rings = registry().rings;
+    }
+
+    std::vector<SpanCopy> spans;
+    for (Ring *r: rings)
+    {
+        std::uint64_t end = r->next.load(std::memory_order_acquire);
+        std::uint64_t begin = std::max(end > kRingSize ? end - kRingSize : 0, r->cleared.load(std::memory_order_relaxed));
+        for (std::uint64_t i = begin; i < end; ++i)
+        {
+            const Slot &slot = r->slots[i % kRingSize];
+            std::uint64_t seq = slot.seq.load(std::memory_order_acquire);
+            if (seq & 1)
+                continue;
+            SpanCopy span;
+            span.trace = slot.trace.load(std::memory_order_relaxed);
+            span.name = slot.name.load(std::memory_order_relaxed);
+            span.start = slot.start.load(std::memory_order_relaxed);
+            span.duration = slot.duration.load(std::memory_order_relaxed);
+            span.route = slot.route.load(std::memory_order_relaxed);
+            span.tid = r->tid;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.seq.load(std::memory_order_relaxed) == seq && span.trace)
+            {
+                spans.push_back(span);
+            }
+        }
+    }
+
+    std::int64_t origin = spans.empty() ? 0 : spans.front().start;
+    for (const SpanCopy &span: spans)
+    {
+        origin = std::min(origin, span.start);
+    }
+
+    JsonWriter json(out);
+    json.begin_object();
+    json.key("traceEvents");
+    json.begin_array();
+    char trace_hex[17];
+    for (const SpanCopy &span: spans)
+    {
+        std::snprintf(trace_hex, sizeof(trace_hex), "%016llx", static_cast<unsigned long long>(span.trace));
+        json.begin_object();
+        json.member("name", span.name);
+        json.member("cat", "request");
+        json.member("ph", "X");
+        json.member("ts", (span.start - origin) / 1e3);
+        json.member("dur", span.duration / 1e3);
+        json.member("pid", static_cast<std::int64_t>(getpid()));
+        json.member("tid", static_cast<std::uint64_t>(span.tid));
+        json.key("args");
+        json.begin_object();
+        json.member("trace", std::string_view(trace_hex, 16));
+        if (span.route)
+        {
+            json.member("route", Metrics::route_name(span.route));
+        }
+        json.end_object();
+        json.end_object();
+    }
+    json.end_array();
+    json.member("displayTimeUnit", "ns");
+    json.end_object();
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Request-scoped tracing, to see where a slow request spent its time. A sampled request
+// gets a trace id (see sample()); the code it passes through records named spans under
+// that id into a ring buffer of the thread it runs on, holding the last kRingSize spans.
+// render_chrome_json() reads every ring, while they are being written, and produces Chrome
+// trace-event JSON for chrome://tracing or Perfetto.
+//
+// A request that is not sampled has trace id 0, and its spans cost a branch: no clock
+// read and no write.
+//
+// Spans recorded by Session and ApiHandler for a traced request:
+//   request          header parsed until the response is written
+//   read             header parsed until the body is in
+//   route            Router::route
+//   <middleware>     each middleware step, named by Middleware::span_name(); a step that calls
+//                    next() synchronously contains the steps after it
+//   worker_queue     waiting for a WorkerPool thread
+//   handle_request   the handler itself
+//   write            the response leaving the socket (streamed bodies included)
+class Trace
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr std::size_t kRingSize = 4096;
+
+    struct Options
+    {
+        // Fraction of requests traced, 0 to 1; 0 turns tracing off.
+        double sample_rate = 0;
+    };
+
+    // Safe while serving; applies to requests that start afterwards.
+    static void configure(const Options &options);
+    static const Options &options();
+
+    // A trace id for a new request if it is sampled, otherwise 0.
+    static std::uint64_t sample();
+
+    // Records a finished span on the calling thread's ring; does nothing for trace id 0.
+    // `name` must outlive the process (a string literal). `route` is a Metrics route id,
+    // shown on the span when non-zero.
+    static void record(std::uint64_t trace, const char *name, Clock::time_point start, Clock::time_point end,
+                       std::size_t route = 0);
+
+    // Appends the spans currently held by every thread as {"traceEvents":[...]}.
+    static void render_chrome_json(std::string &out);
+    // Empties every ring; spans recorded concurrently may survive.
+    static void clear();
+};
+
+// Records the span from construction to destruction for a traced request.
+class TraceSpan
+{
+public:
+    TraceSpan(std::uint64_t trace, const char *name) : trace_(trace), name_(name)
+    {
+        if (trace_)
+        {
+            start_ = Trace::Clock::now();
+        }
+    }
+
+    ~TraceSpan()
+    {
+        if (trace_)
+        {
+            Trace::record(trace_, name_, start_, Trace::Clock::now());
+        }
+    }
+
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+private:
+    std::uint64_t trace_;
+    const char *name_;
+    Trace::Clock::time_point start_;
+};
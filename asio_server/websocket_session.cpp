@@ -0,0 +1,364 @@
+#include "websocket_session.h"
+#include "metrics.h"
+#include "session.h"
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <unordered_set>
+
+static std::atomic<std::size_t> live_sessions{0};
+
+// Open connections, for drain() to reach. Only touched when a connection opens or closes.
+static std::mutex registry_mutex;
+static std::unordered_set<WebSocketSession *> registry;
+
+// One topic of one connection. The hub holds it weakly and the connection strongly, so
+// unsubscribing or closing the connection destroys it, which takes it out of the hub.
+class WebSocketSession::Subscription : public EventSubscriber, public std::enable_shared_from_this<Subscription>
+{
+public:
+    Subscription(std::weak_ptr<WebSocketSession> session, std::string topic, net::any_io_executor executor)
+        : session_(std::move(session)), topic_(std::move(topic)), executor_(std::move(executor))
+    {
+    }
+
+    ~Subscription() override
+    {
+        if (id_ != 0)
+        {
+            EventHub::unsubscribe(executor_, topic_, id_);
+        }
+    }
+
+    void start()
+    {
+        id_ = EventHub::subscribe(topic_, shared_from_this());
+    }
+
+    net::any_io_executor executor() const override
+    {
+        return executor_;
+    }
+
+    void deliver(const std::shared_ptr<const std::string> &event) override
+    {
+        if (auto session = session_.lock())
+        {
+            session->send(event);
+        }
+    }
+
+    void end() override
+    {
+        if (auto session = session_.lock())
+        {
+            session->subscriptions_.erase(topic_);
+        }
+    }
+
+private:
+    std::weak_ptr<WebSocketSession> session_;
+    std::string topic_;
+    net::any_io_executor executor_;
+    std::uint64_t id_ = 0;
+};
+
+std::size_t WebSocketSession::live_count()
+{
+    return live_sessions.load(std::memory_order_relaxed);
+}
+
+void WebSocketSession::drain()
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for (WebSocketSession *session: registry)
+    {
+        net::post(session->ws_.get_executor(), [weak = session->weak_from_this()] {
+            if (auto self = weak.lock())
+            {
+                self->close(websocket::close_code::going_away);
+            }
+        });
+    }
+}
+
+WebSocketSession::WebSocketSession(ConnectionStream &&stream, std::shared_ptr<WebSocketHandler> handler,
+                                   std::size_t metrics_route)
+    : ws_(std::move(stream)), handler_(std::move(handler)), metrics_route_(metrics_route)
+{
+    beast::error_code ec;
+    remote_address_ = ws_.next_layer().socket().remote_endpoint(ec).address();
+    live_sessions.fetch_add(1, std::memory_order_relaxed);
+    Metrics::connection_opened();
+}
+
+WebSocketSession::~WebSocketSession()
+{
+    if (registered_)
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        registry.erase(this);
+    }
+    live_sessions.fetch_sub(1, std::memory_order_relaxed);
+    Metrics::connection_closed();
+}
+
+void WebSocketSession::accept(Request req)
+{
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        registry.insert(this);
+        registered_ = true;
+    }
+    if (Session::is_draining())
+    {
+        closing_ = true;
+        close_code_ = websocket::close_code::going_away;
+    }
+
+    // The websocket stream runs its own timeouts, with pings to tell an idle client from a
+    // vanished one, so the tcp_stream's deadline is switched off.
+    const Session::Limits &limits = Session::limits();
+    ws_.next_layer().expires_never();
+    ws_.set_option(websocket::stream_base::timeout{limits.io_timeout, limits.idle_timeout, true});
+    ws_.read_message_max(limits.body_limit);
+    websocket::permessage_deflate deflate;
+    deflate.server_enable = true;
+    ws_.set_option(deflate);
+
+    // Copied into req_'s own memory: the fields of `req` live in the pool of the Session
+    // that read it, which is about to go away.
+    req_.base() = req.base();
+    req_.body() = std::move(req.body());
+    ws_.async_accept(req_, [self = shared_from_this()](beast::error_code ec) {
+        if (ec)
+        {
+            self->finish(ec);
+            return;
+        }
+
+        self->open_ = true;
+        self->handler_->on_open(*self);
+        if (self->closing_)
+        {
+            if (!self->writing_ && self->queue_.empty())
+            {
+                self->do_close();
+            }
+            else if (!self->writing_)
+            {
+                self->do_write();
+            }
+            return;
+        }
+        if (!self->queue_.empty() && !self->writing_)
+        {
+            self->do_write();
+        }
+        self->do_read();
+    });
+}
+
+const Request &WebSocketSession::request() const
+{
+    return req_;
+}
+
+const net::ip::address &WebSocketSession::remote_address() const
+{
+    return remote_address_;
+}
+
+net::any_io_executor WebSocketSession::executor()
+{
+    return ws_.get_executor();
+}
+
+void WebSocketSession::send(std::shared_ptr<const std::string> message, bool binary)
+{
+    if (closing_ || finished_)
+        return;
+
+    queued_bytes_ += message->size();
+    queue_.push_back({std::move(message), binary});
+    if (queued_bytes_ > kMaxQueuedBytes)
+    {
+        // The client is not keeping up; what it has not been sent yet is dropped.
+        Metrics::error(Metrics::Error::write);
+        while (queue_.size() > (writing_ ? 1 : 0))
+        {
+            queued_bytes_ -= queue_.back().data->size();
+            queue_.pop_back();
+        }
+        close(websocket::close_code::try_again_later);
+        return;
+    }
+
+    if (open_ && !writing_)
+    {
+        do_write();
+    }
+}
+
+void WebSocketSession::send(std::string message, bool binary)
+{
+    send(std::make_shared<const std::string>(std::move(message)), binary);
+}
+
+bool WebSocketSession::subscribe(const std::string &topic)
+{
+    if (subscriptions_.count(topic))
+        return true;
+    if (subscriptions_.size() >= kMaxSubscriptions || finished_)
+        return false;
+
+    auto subscription = std::make_shared<Subscription>(weak_from_this(), topic, ws_.get_executor());
+    subscriptions_.emplace(topic, subscription);
+    subscription->start();
+    return true;
+}
+
+void WebSocketSession::unsubscribe(const std::string &topic)
+{
+    subscriptions_.erase(topic);
+}
+
+std::size_t WebSocketSession::subscription_count() const
+{
+    return subscriptions_.size();
+}
+
+void WebSocketSession::close(websocket::close_code code)
+{
+    if (closing_ || finished_)
+        return;
+
+    closing_ = true;
+    close_code_ = code;
+    subscriptions_.clear();
+    if (open_ && !writing_)
+    {
+        do_close();
+    }
+}
+
+std::size_t WebSocketSession::queued_bytes() const
+{
+    return queued_bytes_;
+}
+
+void WebSocketSession::do_read()
+{
+    reading_ = true;
+    ws_.async_read(buffer_, beast::bind_front_handler(&WebSocketSession::handle_read, shared_from_this()));
+}
+
+void WebSocketSession::handle_read(beast::error_code ec, std::size_t bytes_transferred)
+{
+    reading_ = false;
+    if (ec)
+    {
+        finish(ec);
+        return;
+    }
+
+    Metrics::bytes_in(bytes_transferred);
+    auto start = std::chrono::steady_clock::now();
+    auto data = buffer_.data();
+    handler_->on_message(*this, std::string_view(static_cast<const char *>(data.data()), data.size()),
+                         ws_.got_binary());
+    Metrics::request(metrics_route_, std::chrono::steady_clock::now() - start);
+    buffer_.consume(buffer_.size());
+
+    // Past the threshold, reading resumes from handle_write() once the client catches up.
+    if (closing_ || finished_ || queued_bytes_ >= kPauseReadingBytes)
+        return;
+    do_read();
+}
+
+void WebSocketSession::do_write()
+{
+    writing_ = true;
+    const Frame &frame = queue_.front();
+    ws_.binary(frame.binary);
+    ws_.async_write(net::buffer(*frame.data),
+                    beast::bind_front_handler(&WebSocketSession::handle_write, shared_from_this()));
+}
+
+void WebSocketSession::handle_write(beast::error_code ec, std::size_t bytes_transferred)
+{
+    writing_ = false;
+    Metrics::bytes_out(bytes_transferred);
+    if (ec)
+    {
+        finish(ec);
+        return;
+    }
+    if (finished_)
+    {
+        // finish() kept the frame that was being written; nothing reads it any more.
+        queue_.clear();
+        queued_bytes_ = 0;
+        return;
+    }
+
+    queued_bytes_ -= queue_.front().data->size();
+    queue_.pop_front();
+    if (!queue_.empty())
+    {
+        do_write();
+    }
+    else if (closing_)
+    {
+        do_close();
+        return;
+    }
+
+    if (!reading_ && !closing_ && queued_bytes_ < kPauseReadingBytes)
+    {
+        do_read();
+    }
+}
+
+void WebSocketSession::do_close()
+{
+    ws_.async_close(close_code_, [self = shared_from_this()](beast::error_code ec) {
+        // A pending read ends with websocket::error::closed once the client answers and
+        // finishes the connection; without one, it ends here.
+        if (ec || !self->reading_)
+        {
+            self->finish(ec);
+        }
+    });
+}
+
+void WebSocketSession::finish(beast::error_code ec)
+{
+    if (finished_)
+        return;
+    finished_ = true;
+    subscriptions_.clear();
+    // A write in progress still reads its frame, which the queue may be the only owner of;
+    // handle_write() drops it once the write has ended.
+    while (queue_.size() > (writing_ ? 1 : 0))
+    {
+        queued_bytes_ -= queue_.back().data->size();
+        queue_.pop_back();
+    }
+
+    if (ec == beast::error::timeout)
+    {
+        Metrics::error(Metrics::Error::timeout);
+    }
+    else if (ec && ec != websocket::error::closed && ec != net::error::eof && ec != net::error::operation_aborted)
+    {
+        Metrics::error(Metrics::Error::read);
+        std::cerr << "WebSocket error: " << ec.message() << std::endl;
+    }
+
+    if (open_)
+    {
+        handler_->on_close(*this);
+    }
+}
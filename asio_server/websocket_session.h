@@ -0,0 +1,109 @@
+#pragma once
+
+#include "connection_stream.h"
+#include "event_hub.h"
+#include "req_context.h"
+#include <boost/asio.hpp>
+#include <boost/beast.hpp>
+#include <boost/beast/websocket.hpp>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+namespace net = boost::asio;
+namespace websocket = beast::websocket;
+
+class WebSocketSession;
+
+// Serves the WebSocket connections of a route; see ApiHandler::accept_websocket(). Every
+// call is made on the connection's io thread, so it must not block.
+class WebSocketHandler
+{
+public:
+    virtual ~WebSocketHandler() = default;
+    virtual void on_open(WebSocketSession &) {}
+    virtual void on_message(WebSocketSession &session, std::string_view message, bool binary) = 0;
+    virtual void on_close(WebSocketSession &) {}
+};
+
+// A connection upgraded from a Session. Messages are read one at a time and handed to the
+// WebSocketHandler; what it sends is queued and written in order. The queue is what gives
+// backpressure: past kPauseReadingBytes nothing more is read from the client until the
+// queue drains, and a client that lets it grow past kMaxQueuedBytes (by not reading what
+// it subscribed to) is disconnected.
+//
+// Topic subscriptions go through EventHub, so a published event is written to every
+// subscribed connection without being copied.
+class WebSocketSession : public std::enable_shared_from_this<WebSocketSession>
+{
+public:
+    static constexpr std::size_t kPauseReadingBytes = 256 * 1024;
+    static constexpr std::size_t kMaxQueuedBytes = 8 * 1024 * 1024;
+    static constexpr std::size_t kMaxSubscriptions = 10000;
+
+    WebSocketSession(ConnectionStream &&stream, std::shared_ptr<WebSocketHandler> handler, std::size_t metrics_route);
+    ~WebSocketSession();
+
+    // Completes the handshake for the upgrade request Session has read.
+    void accept(Request req);
+
+    // The upgrade request, e.g. for its query parameters.
+    const Request &request() const;
+    // Address of the connected client, as seen by the socket.
+    const net::ip::address &remote_address() const;
+    net::any_io_executor executor();
+
+    void send(std::shared_ptr<const std::string> message, bool binary = false);
+    void send(std::string message, bool binary = false);
+    // Events published to `topic` are sent as text messages until unsubscribe() or the end
+    // of the topic. Returns false once kMaxSubscriptions is reached.
+    bool subscribe(const std::string &topic);
+    void unsubscribe(const std::string &topic);
+    std::size_t subscription_count() const;
+    // Sends what is queued, then closes.
+    void close(websocket::close_code code = websocket::close_code::normal);
+
+    std::size_t queued_bytes() const;
+
+    // Open WebSocket connections across all threads.
+    static std::size_t live_count();
+    // Closes every connection with "going away"; called by Session::drain().
+    static void drain();
+
+private:
+    class Subscription;
+    struct Frame
+    {
+        std::shared_ptr<const std::string> data;
+        bool binary;
+    };
+
+    void do_read();
+    void handle_read(beast::error_code ec, std::size_t bytes_transferred);
+    void do_write();
+    void handle_write(beast::error_code ec, std::size_t bytes_transferred);
+    void do_close();
+    void finish(beast::error_code ec);
+
+    websocket::stream<ConnectionStream> ws_;
+    std::shared_ptr<WebSocketHandler> handler_;
+    std::size_t metrics_route_;
+    Request req_;
+    net::ip::address remote_address_;
+    beast::flat_buffer buffer_;
+    std::deque<Frame> queue_;
+    std::size_t queued_bytes_ = 0;
+    std::unordered_map<std::string, std::shared_ptr<Subscription>> subscriptions_;
+    bool open_ = false;
+    bool reading_ = false;
+    bool writing_ = false;
+    bool closing_ = false;
+    bool finished_ = false;
+    websocket::close_code close_code_ = websocket::close_code::normal;
+    bool registered_ = false;
+};
@@ -0,0 +1,86 @@
+#include "worker_pool.h"
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Guarded by WorkerPool::mutex().
+std::size_t configured_threads = 0;
+std::size_t running_threads = 0;
+// Joining the pools resize() replaced.
+std::vector<std::thread> retiring;
+
+std::size_t thread_count(std::size_t threads)
+{
+    return threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+}
+
+}// namespace
+
+void WorkerPool::configure(std::size_t threads)
+{
+    std::unique_lock<std::shared_mutex> lock(mutex());
+    configured_threads = threads;
+}
+
+void WorkerPool::resize(std::size_t threads)
+{
+    std::unique_lock<std::shared_mutex> lock(mutex());
+    configured_threads = threads;
+    if (!pool() || thread_count(threads) == running_threads)
+        return;
+
+    std::shared_ptr<net::thread_pool> previous = std::move(pool());
+    running_threads = thread_count(threads);
+    pool() = std::make_unique<net::thread_pool>(running_threads);
+    // No post() can reach the previous pool any more, so join() returns once its queue is empty.
+    retiring.emplace_back([previous] { previous->join(); });
+}
+
+std::size_t WorkerPool::size()
+{
+    std::shared_lock<std::shared_mutex> lock(mutex());
+    return pool() ? running_threads : thread_count(configured_threads);
+}
+
+void WorkerPool::shutdown()
+{
+    net::thread_pool *current;
+    std::vector<std::thread> joining;
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex());
+        current = pool().get();
+        joining.swap(retiring);
+    }
+    // Joined without the lock, so a post() made meanwhile does not wait on it.
+    if (current)
+    {
+        current->join();
+    }
+    for (std::thread &thread: joining)
+    {
+        thread.join();
+    }
+}
+
+std::shared_mutex &WorkerPool::mutex()
+{
+    static std::shared_mutex mutex;
+    return mutex;
+}
+
+std::unique_ptr<net::thread_pool> &WorkerPool::pool()
+{
+    static std::unique_ptr<net::thread_pool> pool;
+    return pool;
+}
+
+void WorkerPool::start()
+{
+    std::unique_lock<std::shared_mutex> lock(mutex());
+    if (pool())
+        return;
+    running_threads = thread_count(configured_threads);
+    pool() = std::make_unique<net::thread_pool>(running_threads);
+}
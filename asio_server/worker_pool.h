@@ -0,0 +1,46 @@
+#pragma once
+
+#include <boost/asio/post.hpp>
+#include <boost/asio/thread_pool.hpp>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <utility>
+
+namespace net = boost::asio;
+
+// CPU pool for handlers registered with REGISTER_*_WORKER_HANDLER, so slow handlers do
+// not hold up the io threads. Created on first use with the configured thread count, and
+// replaced by resize() while the server runs.
+class WorkerPool
+{
+public:
+    // Sets the thread count the pool starts with; 0 means hardware concurrency.
+    static void configure(std::size_t threads);
+    // Sends new work to a pool of `threads` threads (0 = hardware concurrency). The previous
+    // pool runs what it was already given and is joined on a thread of its own, so neither
+    // the caller nor a queued handler waits.
+    static void resize(std::size_t threads);
+    static std::size_t size();
+    template<typename Handler>
+    static void post(Handler &&handler)
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex());
+        if (!pool())
+        {
+            lock.unlock();
+            start();
+            lock.lock();
+        }
+        net::post(*pool(), std::forward<Handler>(handler));
+    }
+    // Waits for queued handlers to finish and joins the worker threads.
+    static void shutdown();
+
+private:
+    static std::shared_mutex &mutex();
+    // Guarded by mutex(); replaced only under the exclusive lock.
+    static std::unique_ptr<net::thread_pool> &pool();
+    static void start();
+};
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+// Bounded multi-producer multi-consumer queue of T* (Dmitry Vyukov's array queue). Each cell
+// carries a sequence number telling producers and consumers whose turn it is, so a push or
+// pop is one CAS on its position counter plus a release store on the cell; no locks.
+template<typename T>
+class InjectionQueue
+{
+    struct Cell
+    {
+        std::atomic<std::size_t> sequence;
+        T *item;
+    };
+
+    std::unique_ptr<Cell[]> _cells;
+    std::size_t _mask;
+    alignas(64) std::atomic<std::size_t> _enqueue_pos{0};
+    alignas(64) std::atomic<std::size_t> _dequeue_pos{0};
+
+public:
+    // Holds at least `capacity` items; rounded up to a power of two.
+    explicit InjectionQueue(std::size_t capacity)
+    {
+        std::size_t size = 2;
+        while (size < capacity) size *= 2;
+        _cells.reset(new Cell[size]);
+        _mask = size - 1;
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            _cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    InjectionQueue(const InjectionQueue &) = delete;
+    InjectionQueue &operator=(const InjectionQueue &) = delete;
+
+    // False when full.
+    bool try_push(T *item)
+    {
+        std::size_t pos = _enqueue_pos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell &cell = _cells[pos & _mask];
+            std::size_t seq = cell.sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0)
+            {
+                if (_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    cell.item = item;
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = _enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Null when empty.
+    T *try_pop()
+    {
+        std::size_t pos = _dequeue_pos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell &cell = _cells[pos & _mask];
+            std::size_t seq = cell.sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+            if (diff == 0)
+            {
+                if (_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    T *item = cell.item;
+                    cell.sequence.store(pos + _mask + 1, std::memory_order_release);
+                    return item;
+                }
+            }
+            else if (diff < 0)
+            {
+                return nullptr;
+            }
+            else
+            {
+                pos = _dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // A snapshot.
+    bool empty() const
+    {
+        return _dequeue_pos.load(std::memory_order_seq_cst) >= _enqueue_pos.load(std::memory_order_seq_cst);
+    }
+};
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Move-only void() callable that keeps callables of up to kInlineSize bytes in place, so
+// the task lambdas ThreadPool builds need no heap block of their own. Larger callables, or
+// ones that may throw while moving, are boxed on the heap instead.
+class InlineTask
+{
+public:
+    static constexpr std::size_t kInlineSize = 56;
+
+    InlineTask() = default;
+
+    template<typename F, typename = std::enable_if_t<!std::is_same<std::decay_t<F>, InlineTask>::value>>
+    InlineTask(F &&func)
+    {
+        emplace(std::forward<F>(func));
+    }
+
+    InlineTask(InlineTask &&other) noexcept
+    {
+        take(other);
+    }
+
+    InlineTask &operator=(InlineTask &&other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            take(other);
+        }
+        return *this;
+    }
+
+    InlineTask(const InlineTask &) = delete;
+    InlineTask &operator=(const InlineTask &) = delete;
+
+    ~InlineTask()
+    {
+        reset();
+    }
+
+    template<typename F>
+    void emplace(F &&func)
+    {
+        using Fn = std::decay_t<F>;
+        reset();
+        if constexpr (fits_inline<Fn>())
+        {
+            ::new (static_cast<void *>(_storage)) Fn(std::forward<F>(func));
+            _ops = &inline_ops<Fn>;
+        }
+        else
+        {
+            ::new (static_cast<void *>(_storage)) Fn *(new Fn(std::forward<F>(func)));
+            _ops = &heap_ops<Fn>;
+        }
+    }
+
+    void reset()
+    {
+        if (_ops)
+        {
+            _ops->destroy(_storage);
+            _ops = nullptr;
+        }
+    }
+
+    explicit operator bool() const
+    {
+        return _ops != nullptr;
+    }
+
+    void operator()()
+    {
+        _ops->invoke(_storage);
+    }
+
+private:
+    struct Ops
+    {
+        void (*invoke)(void *storage);
+        // Move-constructs into `to` and destroys the source.
+        void (*relocate)(void *from, void *to);
+        void (*destroy)(void *storage);
+    };
+
+    template<typename Fn>
+    static constexpr bool fits_inline()
+    {
+        return sizeof(Fn) <= kInlineSize && alignof(Fn) <= alignof(std::max_align_t) &&
+               std::is_nothrow_move_constructible<Fn>::value;
+    }
+
+    template<typename Fn>
+    static constexpr Ops inline_ops = {
+            [](void *storage) { (*static_cast<Fn *>(storage))(); },
+            [](void *from, void *to) {
+                ::new (to) Fn(std::move(*static_cast<Fn *>(from)));
+                static_cast<Fn *>(from)->~Fn();
+            },
+            [](void *storage) { static_cast<Fn *>(storage)->~Fn(); },
+    };
+
+    template<typename Fn>
+    static constexpr Ops heap_ops = {
+            [](void *storage) { (**static_cast<Fn **>(storage))(); },
+            [](void *from, void *to) { ::new (to) Fn *(*static_cast<Fn **>(from)); },
+            [](void *storage) { delete *static_cast<Fn **>(storage); },
+    };
+
+    void take(InlineTask &other) noexcept
+    {
+        if (other._ops)
+        {
+            other._ops->relocate(other._storage, _storage);
+            _ops = other._ops;
+            other._ops = nullptr;
+        }
+    }
+
+    alignas(std::max_align_t) unsigned char _storage[kInlineSize];
+    const Ops *_ops = nullptr;
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "injection_queue.h"
+#include <cstddef>
+
+// Recycles default-constructed T objects so a hot path can take and return them without
+// touching the heap. Each thread keeps up to kLocalCache objects; beyond that they go to a
+// shared lock-free queue, which is how objects freed on one thread (a task run by a
+// worker) get back to another (the thread that enqueues). Objects come back in whatever
+// state they were released in; callers reset them first.
+template<typename T>
+class ObjectPool
+{
+    static constexpr std::size_t kLocalCache = 64;
+    static constexpr std::size_t kSharedCapacity = 4096;
+
+    struct Local
+    {
+        T *items[kLocalCache];
+        std::size_t count = 0;
+
+        ~Local()
+        {
+            while (count > 0) release_shared(items[--count]);
+        }
+    };
+
+    static Local &local()
+    {
+        thread_local Local cache;
+        return cache;
+    }
+
+    // Never freed: threads may still return objects during static destruction.
+    static InjectionQueue<T> &shared()
+    {
+        static auto *queue = new InjectionQueue<T>(kSharedCapacity);
+        return *queue;
+    }
+
+    static void release_shared(T *item)
+    {
+        if (!shared().try_push(item))
+        {
+            delete item;
+        }
+    }
+
+public:
+    static T *acquire()
+    {
+        Local &cache = local();
+        if (cache.count > 0)
+            return cache.items[--cache.count];
+        if (T *item = shared().try_pop())
+            return item;
+        return new T();
+    }
+
+    static void release(T *item)
+    {
+        Local &cache = local();
+        if (cache.count < kLocalCache)
+        {
+            cache.items[cache.count++] = item;
+            return;
+        }
+        release_shared(item);
+    }
+};
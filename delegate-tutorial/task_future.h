@@ -0,0 +1,276 @@
+#pragma once
+
+#include "object_pool.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+// The state a TaskPromise and its TaskFuture share, taken from an ObjectPool instead of
+// allocated per task the way std::promise does. `status` lets the producer skip the mutex
+// unless a consumer is already blocked in wait(). Like std::future<T&>, a TaskFuture<T&>
+// holds the address of the referred-to object, which must outlive get().
+template<typename T>
+struct TaskFutureState
+{
+    static_assert(!std::is_rvalue_reference<T>::value,
+                  "TaskFuture<T&&> is not supported: return a value or an lvalue reference");
+
+    using Value = std::conditional_t<std::is_void<T>::value, char,
+                                     std::conditional_t<std::is_reference<T>::value,
+                                                        std::add_pointer_t<std::remove_reference_t<T>>, T>>;
+
+    enum Status
+    {
+        kPending,
+        kWaiting,
+        kReady,
+    };
+
+    std::atomic<int> refs{0};
+    std::atomic<int> status{kPending};
+    std::optional<Value> value;
+    std::exception_ptr error;
+    std::mutex mutex;
+    std::condition_variable cv;
+
+    static TaskFutureState *make()
+    {
+        TaskFutureState *state = ObjectPool<TaskFutureState>::acquire();
+        state->refs.store(2, std::memory_order_relaxed);
+        state->status.store(kPending, std::memory_order_relaxed);
+        return state;
+    }
+
+    void release()
+    {
+        if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            value.reset();
+            error = nullptr;
+            ObjectPool<TaskFutureState>::release(this);
+        }
+    }
+
+    void publish()
+    {
+        if (status.exchange(kReady, std::memory_order_acq_rel) == kWaiting)
+        {
+            // Taking the lock orders this after a waiter's check of `status`.
+            {
+                std::lock_guard<std::mutex> l(mutex);
+            }
+            cv.notify_all();
+        }
+    }
+
+    bool ready() const
+    {
+        return status.load(std::memory_order_acquire) == kReady;
+    }
+
+    void wait()
+    {
+        if (ready())
+            return;
+        std::unique_lock<std::mutex> l(mutex);
+        announce_waiter();
+        cv.wait(l, [this] { return ready(); });
+    }
+
+    template<typename Rep, typename Period>
+    bool wait_for(const std::chrono::duration<Rep, Period> &timeout)
+    {
+        if (ready())
+            return true;
+        std::unique_lock<std::mutex> l(mutex);
+        announce_waiter();
+        return cv.wait_for(l, timeout, [this] { return ready(); });
+    }
+
+private:
+    void announce_waiter()
+    {
+        int expected = kPending;
+        status.compare_exchange_strong(expected, kWaiting, std::memory_order_acq_rel);
+    }
+};
+
+template<typename T>
+class TaskFuture;
+
+// Producer side of a TaskFuture. Dropping an unsatisfied promise, as ThreadPool does with
+// tasks enqueued after Stop(), makes get() throw future_error(broken_promise).
+template<typename T>
+class TaskPromise
+{
+    using State = TaskFutureState<T>;
+
+public:
+    TaskPromise() : _state(State::make()) {}
+
+    TaskPromise(TaskPromise &&other) noexcept : _state(std::exchange(other._state, nullptr)) {}
+
+    TaskPromise &operator=(TaskPromise &&other) noexcept
+    {
+        if (this != &other)
+        {
+            abandon();
+            _state = std::exchange(other._state, nullptr);
+        }
+        return *this;
+    }
+
+    TaskPromise(const TaskPromise &) = delete;
+    TaskPromise &operator=(const TaskPromise &) = delete;
+
+    ~TaskPromise()
+    {
+        abandon();
+    }
+
+    // Call once, before the promise is used.
+    TaskFuture<T> get_future()
+    {
+        return TaskFuture<T>(_state);
+    }
+
+    // Stores what `func` returns, or what it throws.
+    template<typename F>
+    void run(F &&func)
+    {
+        try
+        {
+            if constexpr (std::is_void<T>::value)
+            {
+                func();
+                _state->value.emplace();
+            }
+            else if constexpr (std::is_reference<T>::value)
+            {
+                _state->value.emplace(std::addressof(func()));
+            }
+            else
+            {
+                _state->value.emplace(func());
+            }
+        }
+        catch (...)
+        {
+            _state->error = std::current_exception();
+        }
+        finish();
+    }
+
+private:
+    void finish()
+    {
+        _state->publish();
+        _state->release();
+        _state = nullptr;
+    }
+
+    void abandon()
+    {
+        if (_state)
+        {
+            _state->error = std::make_exception_ptr(std::future_error(std::future_errc::broken_promise));
+            finish();
+        }
+    }
+
+    State *_state;
+};
+
+// Consumer side: get(), wait() and wait_for() behave like std::future's.
+template<typename T>
+class TaskFuture
+{
+    using State = TaskFutureState<T>;
+
+public:
+    TaskFuture() = default;
+
+    TaskFuture(TaskFuture &&other) noexcept : _state(std::exchange(other._state, nullptr)) {}
+
+    TaskFuture &operator=(TaskFuture &&other) noexcept
+    {
+        if (this != &other)
+        {
+            if (_state)
+            {
+                _state->release();
+            }
+            _state = std::exchange(other._state, nullptr);
+        }
+        return *this;
+    }
+
+    TaskFuture(const TaskFuture &) = delete;
+    TaskFuture &operator=(const TaskFuture &) = delete;
+
+    ~TaskFuture()
+    {
+        if (_state)
+        {
+            _state->release();
+        }
+    }
+
+    bool valid() const
+    {
+        return _state != nullptr;
+    }
+
+    void wait() const
+    {
+        _state->wait();
+    }
+
+    template<typename Rep, typename Period>
+    std::future_status wait_for(const std::chrono::duration<Rep, Period> &timeout) const
+    {
+        return _state->wait_for(timeout) ? std::future_status::ready : std::future_status::timeout;
+    }
+
+    // Like std::future::get(), leaves the future invalid.
+    T get()
+    {
+        wait();
+        State *state = std::exchange(_state, nullptr);
+        struct Release
+        {
+            State *state;
+            ~Release()
+            {
+                state->release();
+            }
+        } release{state};
+
+        if (state->error)
+        {
+            std::rethrow_exception(state->error);
+        }
+        if constexpr (std::is_reference<T>::value)
+        {
+            return **state->value;
+        }
+        else if constexpr (!std::is_void<T>::value)
+        {
+            return std::move(*state->value);
+        }
+    }
+
+private:
+    friend class TaskPromise<T>;
+
+    explicit TaskFuture(State *state) : _state(state) {}
+
+    State *_state = nullptr;
+};
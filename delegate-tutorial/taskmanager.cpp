@@ -1,6 +1,9 @@
 #include "taskmanager.h"
 #include "task.h"
+#include <algorithm>
 #include <chrono>
+#include <cstdlib>
+#include <exception>
 
 std::unique_ptr<TaskManager> g_task_manager;
 
@@ -15,26 +18,30 @@ std::unique_ptr<TaskManager> &TaskManager::instance()
 
 bool TaskManager::interruptTask(const std::string &uuid)
 {
-    std::lock_guard<std::mutex> lock(_mtx);
-    auto it = _mapTask.find(uuid);
-    if (it != _mapTask.end())
+    std::optional<TaskInfo> changed;
     {
-        std::shared_ptr<Task> task = it->second;
-        if (task)
+        std::lock_guard<std::mutex> lock(_mtx);
+        auto it = _mapTask.find(uuid);
+        if (it == _mapTask.end() || !it->second)
         {
-            task->cancel();
-            auto infoIt = _mapProgressInfos.find(uuid);
-            if (infoIt != _mapProgressInfos.end())
-            {
-                infoIt->second.status = Task::Interrupt;
-                infoIt->second.endTime = std::chrono::steady_clock::now().time_since_epoch().count();
-                infoIt->second.progressText = "Interrupted";
-            }
-            _mapTask.erase(it);
-            return true;
+            return false;
+        }
+        it->second->cancel();
+        auto infoIt = _mapProgressInfos.find(uuid);
+        if (infoIt != _mapProgressInfos.end())
+        {
+            setStatus(infoIt->second, Task::Interrupt);
+            infoIt->second.endTime = std::chrono::steady_clock::now().time_since_epoch().count();
+            infoIt->second.progressText = "Interrupted";
+            changed = infoIt->second;
         }
+        _mapTask.erase(it);
+    }
+    if (changed)
+    {
+        onTaskInfoChanged(*changed);
     }
-    return false;
+    return true;
 }
 
 bool TaskManager::interruptTaskList(const std::vector<std::string> &uuids)
@@ -49,12 +56,12 @@ bool TaskManager::interruptTaskList(const std::vector<std::string> &uuids)
 
 bool TaskManager::exists(const std::string &uuid) const
 {
+    std::lock_guard<std::mutex> lock(_mtx);
     return _mapProgressInfos.find(uuid) != _mapProgressInfos.end();
 }
 
 std::tuple<bool, std::string> TaskManager::createTask(const std::string &id, const std::string &body_params)
 {
-    std::lock_guard<std::mutex> lock(_mtx);
     std::shared_ptr<Task> task = TaskFactory::createTask(id, body_params);
     if (!task)
     {
@@ -63,8 +70,11 @@ std::tuple<bool, std::string> TaskManager::createTask(const std::string &id, con
     task->onBeforeTaskStart.add(this, &TaskManager::onBeforeTaskStart);
     task->onBeforeTaskEnd.add(this, &TaskManager::onBeforeTaskEnd);
     task->onProgressUpdate.add(this, &TaskManager::onProgressUpdate);
-    if (task)
+
+    // The lock only covers registering the task: post() blocks while the pool's queue is
+    // full, and completions take the lock.
     {
+        std::lock_guard<std::mutex> lock(_mtx);
         _mapTask.insert({task->id(), task});
         TaskInfo info;
         info.id = task->id();
@@ -76,49 +86,43 @@ std::tuple<bool, std::string> TaskManager::createTask(const std::string &id, con
         info.progressValue = 0;
         info.result = false;
         _mapProgressInfos.insert({task->id(), info});
+        _createdOrder.emplace(info.createTime, info.id);
+        _createdOrderByStatus[info.status].emplace(info.createTime, info.id);
+    }
 
-        if (task->getMode() == Task::Async)
-        {
-            _threadPool.enqueue([this, task]() {
-                bool ret = task->execute();
-                auto it = _mapTask.find(task->id());
-                if (it != _mapTask.end())
-                {
-                    TaskInfo &info = _mapProgressInfos[task->id()];
-                    info.result = ret;
-                    info.endTime = std::chrono::steady_clock::now().time_since_epoch().count();
-                    info.progressText = ret ? "Completed" : "Failed";
-                    if (ret)
-                    {
-                        info.progressValue = 100;
-                    }
-                    _mapTask.erase(it);
-                }
-            });
-        }
-        else
-        {
-            bool ret = task->execute();
-            auto it = _mapTask.find(task->id());
-            if (it != _mapTask.end())
+    if (task->getMode() == Task::Async)
+    {
+        // Nothing waits on a posted task, so a throwing task is reported as failed, with
+        // what() in its progressText, rather than allowed to terminate the process.
+        _threadPool.post([this, task]() {
+            bool ret = false;
+            std::string error;
+            try
             {
-                TaskInfo &info = _mapProgressInfos[task->id()];
-                info.result = ret;
-                info.endTime = std::chrono::steady_clock::now().time_since_epoch().count();
-                info.progressText = ret ? "Completed" : "Failed";
-                if (ret)
-                {
-                    info.progressValue = 100;
-                }
-                _mapTask.erase(it);
+                ret = task->execute();
             }
-        }
+            catch (const std::exception &e)
+            {
+                error = e.what();
+            }
+            catch (...)
+            {
+                error = "unknown exception";
+            }
+            onTaskCompleted(task->id(), ret, error);
+        });
+    }
+    else
+    {
+        bool ret = task->execute();
+        onTaskCompleted(task->id(), ret);
     }
     return {true, task->id()};
 }
 
 std::optional<TaskManager::TaskInfo> TaskManager::getTaskInfo(const std::string &uuid) const
 {
+    std::lock_guard<std::mutex> lock(_mtx);
     auto it = _mapProgressInfos.find(uuid);
     if (it != _mapProgressInfos.end())
     {
@@ -130,56 +134,159 @@ std::optional<TaskManager::TaskInfo> TaskManager::getTaskInfo(const std::string
 std::vector<TaskManager::TaskInfo> TaskManager::getTaskInfos(const std::vector<std::string> &uuids) const
 {
     std::vector<TaskInfo> infos;
-    for (auto &&[id, info]: _mapProgressInfos)
+    infos.reserve(uuids.size());
+    std::lock_guard<std::mutex> lock(_mtx);
+    for (const auto &uuid: uuids)
     {
-        if (std::find(uuids.begin(), uuids.end(), id) != uuids.end())
+        auto it = _mapProgressInfos.find(uuid);
+        if (it != _mapProgressInfos.end())
         {
-            infos.push_back(info);
+            infos.push_back(it->second);
         }
     }
     return infos;
 }
 
-void TaskManager::onBeforeTaskStart(Task *task)
+// A cursor is "<createTime>-<id>" of the last task on the previous page.
+std::optional<TaskManager::TaskPage> TaskManager::listTasks(const std::string &cursor, std::size_t limit,
+                                                            std::optional<Task::Status> status) const
 {
+    CreationKey after;
+    if (!cursor.empty())
+    {
+        auto dash = cursor.find('-');
+        char *end = nullptr;
+        after.first = std::strtoll(cursor.c_str(), &end, 10);
+        if (dash == std::string::npos || end != cursor.c_str() + dash)
+        {
+            return std::nullopt;
+        }
+        after.second = cursor.substr(dash + 1);
+    }
+
+    TaskPage page;
     std::lock_guard<std::mutex> lock(_mtx);
-    auto it = _mapTask.find(task->id());
-    if (it != _mapTask.end())
+    const std::set<CreationKey> &order = status ? _createdOrderByStatus[*status] : _createdOrder;
+    auto it = cursor.empty() ? order.begin() : order.upper_bound(after);
+    page.infos.reserve(std::min(limit, order.size()));
+    for (; it != order.end() && page.infos.size() < limit; ++it)
     {
-        TaskInfo &info = _mapProgressInfos[task->id()];
-        info.status = Task::Running;
-        info.startTime = std::chrono::steady_clock::now().time_since_epoch().count();
+        page.infos.push_back(_mapProgressInfos.at(it->second));
     }
+    if (it != order.end() && !page.infos.empty())
+    {
+        const TaskInfo &last = page.infos.back();
+        page.nextCursor = std::to_string(last.createTime) + "-" + last.id;
+    }
+    return page;
 }
 
+// Call with _mtx held.
+void TaskManager::setStatus(TaskInfo &info, Task::Status status)
+{
+    if (info.status == status)
+    {
+        return;
+    }
+    _createdOrderByStatus[info.status].erase({info.createTime, info.id});
+    _createdOrderByStatus[status].emplace(info.createTime, info.id);
+    info.status = status;
+}
+
+void TaskManager::onBeforeTaskStart(Task *task)
+{
+    std::optional<TaskInfo> changed;
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        auto it = _mapTask.find(task->id());
+        if (it != _mapTask.end())
+        {
+            TaskInfo &info = _mapProgressInfos[task->id()];
+            setStatus(info, Task::Running);
+            info.startTime = std::chrono::steady_clock::now().time_since_epoch().count();
+            changed = info;
+        }
+    }
+    if (changed)
+    {
+        onTaskInfoChanged(*changed);
+    }
+}
+
+// Only records the task's output. The task is not final until onTaskCompleted() has its
+// result, so subscribers watching for the end still get that last update.
 void TaskManager::onBeforeTaskEnd(Task *task, const boost::json::object &object)
 {
-    std::lock_guard<std::mutex> lock(_mtx);
-    auto it = _mapTask.find(task->id());
-    if (it != _mapTask.end())
+    std::optional<TaskInfo> changed;
     {
-        TaskInfo &info = _mapProgressInfos[task->id()];
-        info.status = Task::Finished;
-        info.endTime = std::chrono::steady_clock::now().time_since_epoch().count();
-        info.object = object;
+        std::lock_guard<std::mutex> lock(_mtx);
+        auto it = _mapTask.find(task->id());
+        if (it != _mapTask.end())
+        {
+            TaskInfo &info = _mapProgressInfos[task->id()];
+            info.object = object;
+            changed = info;
+        }
+    }
+    if (changed)
+    {
+        onTaskInfoChanged(*changed);
     }
 }
 
 void TaskManager::onProgressUpdate(Task *task, int progressValue, int progressMax, const std::string &progressText)
 {
     (void) progressMax;
-    std::lock_guard<std::mutex> lock(_mtx);
-    auto it = _mapTask.find(task->id());
-    if (it != _mapTask.end())
+    std::optional<TaskInfo> changed;
     {
-        TaskInfo &info = _mapProgressInfos[task->id()];
-        if (info.status == Task::Interrupt)
+        std::lock_guard<std::mutex> lock(_mtx);
+        auto it = _mapTask.find(task->id());
+        if (it != _mapTask.end())
         {
-            // If the task has been interrupted, do not update progress
-            return;
+            TaskInfo &info = _mapProgressInfos[task->id()];
+            if (info.status == Task::Interrupt)
+            {
+                // If the task has been interrupted, do not update progress
+                return;
+            }
+            setStatus(info, Task::Running);
+            info.progressValue = progressValue;
+            info.progressText = progressText;
+            changed = info;
+        }
+    }
+    if (changed)
+    {
+        onTaskInfoChanged(*changed);
+    }
+}
+
+void TaskManager::onTaskCompleted(const std::string &uuid, bool ret, const std::string &error)
+{
+    std::optional<TaskInfo> changed;
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        auto it = _mapTask.find(uuid);
+        if (it != _mapTask.end())
+        {
+            TaskInfo &info = _mapProgressInfos[uuid];
+            if (info.status != Task::Interrupt)
+            {
+                setStatus(info, Task::Finished);
+            }
+            info.result = ret;
+            info.endTime = std::chrono::steady_clock::now().time_since_epoch().count();
+            info.progressText = ret ? "Completed" : error.empty() ? "Failed" : "Failed: " + error;
+            if (ret)
+            {
+                info.progressValue = 100;
+            }
+            _mapTask.erase(it);
+            changed = info;
         }
-        info.status = Task::Running;
-        info.progressValue = progressValue;
-        info.progressText = progressText;
+    }
+    if (changed)
+    {
+        onTaskInfoChanged(*changed);
     }
 }
\ No newline at end of file
@@ -3,10 +3,13 @@
 
 #include "task.h"
 #include "threadpool.h"
+#include <array>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <optional>
+#include <set>
+#include <unordered_map>
 
 class TaskManager
 {
@@ -24,6 +27,13 @@ public:
         boost::json::object object;
     };
 
+    struct TaskPage
+    {
+        std::vector<TaskInfo> infos;
+        // Cursor for the page after this one; empty on the last page.
+        std::string nextCursor;
+    };
+
     static std::unique_ptr<TaskManager> &instance();
 
     bool interruptTask(const std::string &uuid);
@@ -36,8 +46,19 @@ public:
 
     std::optional<TaskInfo> getTaskInfo(const std::string &uuid) const;
 
+    // The infos of the given tasks in the order asked for; unknown ids are left out.
     std::vector<TaskInfo> getTaskInfos(const std::vector<std::string> &uuids) const;
 
+    // Tasks in creation order, at most `limit` of them, starting after `cursor` (empty for
+    // the first page) and, with `status`, only those currently in that state. Returns
+    // nullopt for a malformed cursor.
+    std::optional<TaskPage> listTasks(const std::string &cursor, std::size_t limit,
+                                      std::optional<Task::Status> status = std::nullopt) const;
+
+    // Fired with a copy of a task's info each time it changes (started, progress, finished,
+    // interrupted), on the thread that changed it and after the manager's lock is released.
+    Delegate<void(const TaskInfo &)> onTaskInfoChanged;
+
 private:
     void onBeforeTaskStart(Task *task);
 
@@ -45,10 +66,21 @@ private:
 
     void onProgressUpdate(Task *task, int progressValue, int progressMax, const std::string &progressText);
 
+    // `error` is what the task threw, if it did.
+    void onTaskCompleted(const std::string &uuid, bool ret, const std::string &error = std::string());
+
+    void setStatus(TaskInfo &info, Task::Status status);
+
 private:
+    // Orders tasks by creation time, ties broken by id; listTasks() cursors encode one.
+    using CreationKey = std::pair<int64_t, std::string>;
+
     std::map<std::string, std::shared_ptr<Task>> _mapTask;
-    std::map<std::string, TaskInfo> _mapProgressInfos;
-    std::mutex _mtx;
+    std::unordered_map<std::string, TaskInfo> _mapProgressInfos;
+    std::set<CreationKey> _createdOrder;
+    // _createdOrder split by current status, indexed by Task::Status.
+    std::array<std::set<CreationKey>, Task::Interrupt + 1> _createdOrderByStatus;
+    mutable std::mutex _mtx;
     ThreadPool _threadPool;
 };
 
@@ -0,0 +1,82 @@
+#include "taskmanager.h"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+// Finishes inside createTask(), so the manager holds only finished tasks.
+class noop_task : public Task
+{
+public:
+    explicit noop_task(const std::string &parameters) : Task(parameters)
+    {
+        m_mode = Sync;
+    }
+};
+
+using Clock = std::chrono::steady_clock;
+
+static double milliseconds_since(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// The lookups behind /taskDetailList: batches of ids through getTaskInfos() and pages of
+// all tasks through listTasks(), as the number of tasks grows to a million.
+int main()
+{
+    TaskFactory::registerClass("noop", [](const std::string &params) { return std::make_shared<noop_task>(params); });
+    const std::size_t batch = 1000;
+    const std::size_t page_size = 1000;
+    const int batches = 100;
+
+    std::mt19937 rng(1);
+    std::vector<std::string> ids;
+    printf("%8s %22s %22s\n", "tasks", "1000-id batch (ms)", "page through all (ms)");
+    for (std::size_t tasks: {1000, 10000, 100000, 200000, 1000000})
+    {
+        while (ids.size() < tasks)
+        {
+            ids.push_back(std::get<1>(TaskManager::instance()->createTask("noop")));
+        }
+
+        std::vector<std::vector<std::string>> requests(batches);
+        for (auto &request: requests)
+        {
+            for (std::size_t i = 0; i < batch; ++i)
+            {
+                request.push_back(ids[std::uniform_int_distribution<std::size_t>(0, ids.size() - 1)(rng)]);
+            }
+        }
+        auto start = Clock::now();
+        std::size_t found = 0;
+        for (const auto &request: requests)
+        {
+            found += TaskManager::instance()->getTaskInfos(request).size();
+        }
+        double per_batch = milliseconds_since(start) / batches;
+
+        start = Clock::now();
+        std::size_t listed = 0;
+        std::string cursor;
+        do
+        {
+            auto page = TaskManager::instance()->listTasks(cursor, page_size);
+            listed += page->infos.size();
+            cursor = page->nextCursor;
+        } while (!cursor.empty());
+        double paging = milliseconds_since(start);
+
+        if (found != batches * batch || listed != tasks)
+        {
+            fprintf(stderr, "found %zu of %zu ids and listed %zu of %zu tasks\n", found, batches * batch, listed,
+                    tasks);
+            return 1;
+        }
+        printf("%8zu %22.3f %22.1f\n", tasks, per_batch, paging);
+        fflush(stdout);
+    }
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,315 @@
+#include "threadpool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Stress test of ThreadPool: every task runs exactly once, and no wake-up is lost, through
+// the injection queue, the work-stealing deques, parking, Stop() and a full queue. A lost
+// wake-up shows as a task that does not run within kTimeout rather than as a hang.
+
+static int failures = 0;
+
+static void check(bool ok, const char *what)
+{
+    if (!ok)
+    {
+        printf("FAILED: %s\n", what);
+        ++failures;
+    }
+}
+
+static int test_summary(const char *suite)
+{
+    if (failures == 0)
+    {
+        printf("All %s tests passed\n", suite);
+        return 0;
+    }
+    printf("%c%s tests FAILED\n", std::toupper(static_cast<unsigned char>(suite[0])), suite + 1);
+    return 1;
+}
+
+static constexpr auto kTimeout = std::chrono::seconds(10);
+
+// How many times each of `size` tasks ran.
+class RunCounts
+{
+public:
+    explicit RunCounts(std::size_t size) : _counts(new std::atomic<int>[size]), _size(size)
+    {
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            _counts[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void ran(std::size_t i)
+    {
+        _counts[i].fetch_add(1, std::memory_order_relaxed);
+        _total.fetch_add(1, std::memory_order_release);
+    }
+
+    // Waits until `expected` runs have been counted; false on timeout.
+    bool wait_for(std::size_t expected) const
+    {
+        auto deadline = std::chrono::steady_clock::now() + kTimeout;
+        while (_total.load(std::memory_order_acquire) < expected)
+        {
+            if (std::chrono::steady_clock::now() > deadline)
+                return false;
+            std::this_thread::yield();
+        }
+        return true;
+    }
+
+    bool each_once() const
+    {
+        for (std::size_t i = 0; i < _size; ++i)
+        {
+            if (_counts[i].load(std::memory_order_relaxed) != 1)
+                return false;
+        }
+        return true;
+    }
+
+private:
+    std::unique_ptr<std::atomic<int>[]> _counts;
+    std::size_t _size;
+    std::atomic<std::size_t> _total{0};
+};
+
+// Several threads post through the injection queue at once.
+void test_outside_submissions(std::size_t threads)
+{
+    const std::size_t producers = 4;
+    const std::size_t per_producer = 20000;
+    RunCounts counts(producers * per_producer);
+    ThreadPool pool(threads);
+
+    std::vector<std::thread> feeders;
+    for (std::size_t p = 0; p < producers; ++p)
+    {
+        feeders.emplace_back([&, p] {
+            for (std::size_t i = 0; i < per_producer; ++i)
+            {
+                pool.post([&counts, index = p * per_producer + i] { counts.ran(index); });
+            }
+        });
+    }
+    for (auto &feeder: feeders) feeder.join();
+
+    check(counts.wait_for(producers * per_producer), "every posted task runs");
+    check(counts.each_once(), "each posted task runs exactly once");
+}
+
+// A tree of tasks enqueued from inside tasks: all of it starts on one worker's deque, so
+// the other workers only get work by stealing.
+static void fan_out(ThreadPool &pool, RunCounts &counts, std::size_t node, std::size_t size)
+{
+    counts.ran(node);
+    for (std::size_t child = 2 * node + 1; child <= 2 * node + 2 && child < size; ++child)
+    {
+        pool.post([&pool, &counts, child, size] { fan_out(pool, counts, child, size); });
+    }
+}
+
+void test_steal_heavy_fan_out(std::size_t threads)
+{
+    const std::size_t size = (1 << 17) - 1;
+    RunCounts counts(size);
+    ThreadPool pool(threads);
+    pool.post([&] { fan_out(pool, counts, 0, size); });
+
+    check(counts.wait_for(size), "every task of a fan-out runs");
+    check(counts.each_once(), "each task of a fan-out runs exactly once");
+}
+
+// One task at a time with a pause in between, so the workers have parked each time the
+// next one arrives: a wake-up Notify() misses leaves the task waiting forever.
+void test_wake_after_park(std::size_t threads)
+{
+    ThreadPool pool(threads);
+    bool all_woken = true;
+    for (int round = 0; round < 200 && all_woken; ++round)
+    {
+        if (round % 4 == 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+        auto done = pool.enqueue([round] { return round; });
+        all_woken = done.wait_for(kTimeout) == std::future_status::ready && done.get() == round;
+    }
+    check(all_woken, "a task posted to parked workers runs");
+
+    // Producers racing with workers that are about to park.
+    std::vector<std::thread> producers;
+    std::atomic<bool> lost{false};
+    for (int p = 0; p < 4; ++p)
+    {
+        producers.emplace_back([&pool, &lost] {
+            for (int i = 0; i < 500 && !lost.load(); ++i)
+            {
+                auto done = pool.enqueue([] {});
+                if (done.wait_for(kTimeout) != std::future_status::ready)
+                {
+                    lost = true;
+                }
+                if (i % 50 == 0)
+                {
+                    std::this_thread::sleep_for(std::chrono::microseconds(200));
+                }
+            }
+        });
+    }
+    for (auto &producer: producers) producer.join();
+    check(!lost.load(), "no wake-up lost while workers park");
+}
+
+// Stop() runs what is already queued, on the injection queue and on the deques, then
+// refuses more.
+void test_stop_with_queued_work(std::size_t threads)
+{
+    const std::size_t outside = 5000;
+    const std::size_t inside = 5000;
+    RunCounts counts(outside + inside);
+    std::promise<void> gate;
+    std::shared_future<void> opened = gate.get_future().share();
+    std::promise<void> queued;
+    {
+        ThreadPool pool(threads, outside + 1);
+        // Queues work onto a worker's own deque, then holds that worker while the
+        // injection queue fills.
+        pool.post([&, opened] {
+            for (std::size_t i = 0; i < inside; ++i)
+            {
+                pool.post([&counts, index = outside + i] { counts.ran(index); });
+            }
+            queued.set_value();
+            opened.wait();
+        });
+        for (std::size_t i = 0; i < outside; ++i)
+        {
+            pool.post([&counts, i] { counts.ran(i); });
+        }
+        queued.get_future().wait();
+
+        std::thread stopper([&pool] { pool.Stop(); });
+        gate.set_value();
+        stopper.join();
+
+        check(counts.each_once(), "Stop() runs every queued task exactly once");
+        auto late = pool.enqueue([] {});
+        bool broken = false;
+        try
+        {
+            late.get();
+        }
+        catch (const std::future_error &e)
+        {
+            broken = e.code() == std::future_errc::broken_promise;
+        }
+        check(broken, "a task enqueued after Stop() reports a broken promise");
+    }
+}
+
+// A small injection queue that fills up: enqueue() waits in WaitToInject() until a worker
+// makes room, and gives up, breaking the promise, if the pool stops first.
+void test_full_injection_queue(std::size_t threads)
+{
+    const std::size_t capacity = 4;
+    const std::size_t producers = 4;
+    const std::size_t per_producer = 2000;
+    {
+        RunCounts counts(producers * per_producer);
+        std::promise<void> gate;
+        std::shared_future<void> opened = gate.get_future().share();
+        ThreadPool pool(threads, capacity);
+        // Every worker blocked, so the queue is certain to fill.
+        for (std::size_t i = 0; i < threads; ++i)
+        {
+            pool.post([opened] { opened.wait(); });
+        }
+
+        std::vector<std::thread> feeders;
+        for (std::size_t p = 0; p < producers; ++p)
+        {
+            feeders.emplace_back([&, p] {
+                for (std::size_t i = 0; i < per_producer; ++i)
+                {
+                    pool.post([&counts, index = p * per_producer + i] { counts.ran(index); });
+                }
+            });
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        gate.set_value();
+        for (auto &feeder: feeders) feeder.join();
+
+        check(counts.wait_for(producers * per_producer), "tasks that waited for room run");
+        check(counts.each_once(), "tasks that waited for room run exactly once");
+    }
+    {
+        std::promise<void> gate;
+        std::shared_future<void> opened = gate.get_future().share();
+        ThreadPool pool(threads, capacity);
+        for (std::size_t i = 0; i < threads; ++i)
+        {
+            pool.post([opened] { opened.wait(); });
+        }
+        std::vector<TaskFuture<void>> queued;
+        for (std::size_t i = 0; i < capacity; ++i)
+        {
+            queued.push_back(pool.enqueue([] {}));
+        }
+
+        // Blocks in WaitToInject() until Stop() gives up on it.
+        std::promise<TaskFuture<void>> blocked;
+        std::thread waiter([&] { blocked.set_value(pool.enqueue([] {})); });
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        std::thread stopper([&pool] { pool.Stop(); });
+        auto refused = blocked.get_future().get();
+        gate.set_value();
+        stopper.join();
+        waiter.join();
+
+        bool broken = false;
+        try
+        {
+            refused.get();
+        }
+        catch (const std::future_error &e)
+        {
+            broken = e.code() == std::future_errc::broken_promise;
+        }
+        check(broken, "an enqueue() waiting for room when the pool stops reports a broken promise");
+        bool ran = true;
+        for (auto &future: queued)
+        {
+            ran = ran && future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+        }
+        check(ran, "the tasks already queued still run");
+    }
+}
+
+int main()
+{
+    // At least four, so stealing and parking are exercised on a small machine too.
+    std::size_t many = std::max(4u, std::thread::hardware_concurrency());
+    for (std::size_t threads: {std::size_t(1), std::size_t(2), many})
+    {
+        printf("%zu thread(s)\n", threads);
+        test_outside_submissions(threads);
+        test_steal_heavy_fan_out(threads);
+        test_wake_after_park(threads);
+        test_stop_with_queued_work(threads);
+        test_full_injection_queue(threads);
+        fflush(stdout);
+    }
+    return test_summary("thread pool");
+}
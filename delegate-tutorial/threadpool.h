@@ -1,30 +1,86 @@
 #pragma once
 
+#include "injection_queue.h"
+#include "inline_task.h"
+#include "object_pool.h"
+#include "task_future.h"
+#include "work_stealing_deque.h"
+#include <atomic>
 #include <condition_variable>
-#include <functional>
-#include <future>
+#include <memory>
 #include <mutex>
-#include <queue>
 #include <thread>
+#include <tuple>
 #include <type_traits>
+#include <vector>
 
+// Work-stealing pool. Each worker has a Chase-Lev deque: tasks enqueued from inside a task
+// go onto the running worker's own deque and are popped newest first, without locks. Tasks
+// enqueued from outside go through a lock-free injection queue of MaxTaskSize() slots;
+// enqueue() blocks while it is full. A worker with nothing of its own takes from the
+// injection queue, then steals the oldest task of another worker.
+//
+// A worker that runs out of work spins for a while looking for more (at most half of them at
+// a time), then parks. enqueue()
+// wakes a parked worker only when none is spinning, and a spinning worker that finds work
+// wakes another in case there is more, so a burst fans out without every enqueue taking
+// the park lock.
+//
+// Submitting a task allocates nothing once the pool has warmed up: the task is an
+// InlineTask node recycled through an ObjectPool, and enqueue()'s TaskFuture shares a
+// pooled state with its promise. post() skips the future altogether.
 class ThreadPool
 {
+    using Job = InlineTask;
+
+    // Rounds of looking for work before a worker parks.
+    static constexpr int kSpinRounds = 64;
+    // Every this many tasks a worker checks the injection queue before its own deque, so a
+    // task that keeps enqueueing more cannot starve outside submissions.
+    static constexpr unsigned kInjectInterval = 61;
+
+    struct alignas(64) Worker
+    {
+        ThreadPool *pool;
+        WorkStealingDeque<Job> deque;
+        unsigned ticks = 0;
+        std::uint64_t random;
+    };
+
     std::size_t _thread_sz;
     std::size_t _max_task_sz;
+    std::vector<std::unique_ptr<Worker>> _states;
     std::vector<std::thread> _workers;
-    std::queue<std::function<void()>> _queue;
-    std::mutex _que_mtx;
-    std::condition_variable _condition;
-    bool _stop;
+    std::unique_ptr<InjectionQueue<Job>> _injector;
+    std::atomic<bool> _stop{false};
+
+    // Workers looking for work, and workers parked or about to park.
+    alignas(64) std::atomic<std::size_t> _spinning{0};
+    std::atomic<std::size_t> _idle{0};
+    std::mutex _park_mtx;
+    std::condition_variable _park_cv;
+    // Wake-ups handed out and not yet taken; guarded by _park_mtx.
+    std::size_t _wake_tokens = 0;
+
+    // enqueue() callers waiting for room in the injection queue.
+    std::atomic<std::size_t> _full_waiters{0};
+    std::mutex _full_mtx;
+    std::condition_variable _full_cv;
+
+    static Worker *&current()
+    {
+        thread_local Worker *worker = nullptr;
+        return worker;
+    }
 
 public:
     ThreadPool(size_t threadCount = std::thread::hardware_concurrency(), size_t maxTaskSize = 128)
-        : _stop(false), _thread_sz(threadCount), _max_task_sz(maxTaskSize)
+        : _thread_sz(threadCount), _max_task_sz(maxTaskSize)
     {
         Start();
     }
-    size_t &MaxTaskSize()
+    // Slots in the injection queue, fixed when the pool starts.
+    size_t MaxTaskSize() const
     {
         return _max_task_sz;
     }
@@ -33,39 +89,68 @@ public:
         return _thread_sz;
     }
 
+    // The arguments are copied or moved into the task and passed to `func` as lvalues, as
+    // std::bind would. A `func` returning T& gives a TaskFuture<T&>, as with std::future;
+    // one returning T&& is rejected at compile time.
     template<typename F, typename... Arg>
-    auto enqueue(F &&func, Arg &&...arg) -> std::future<typename std::result_of<F(Arg...)>::type>
+    auto enqueue(F &&func, Arg &&...arg) -> TaskFuture<std::invoke_result_t<std::decay_t<F> &, std::decay_t<Arg> &...>>
     {
-        typedef typename std::result_of<F(Arg...)>::type return_type;
+        typedef std::invoke_result_t<std::decay_t<F> &, std::decay_t<Arg> &...> return_type;
 
-        auto task = std::make_shared<std::packaged_task<return_type()>>(
-                std::bind(std::forward<F>(func), std::forward<Arg>(arg)...));
-        std::future<return_type> res = task->get_future();
+        TaskPromise<return_type> promise;
+        TaskFuture<return_type> res = promise.get_future();
 
-        {
-            std::unique_lock<std::mutex> l(this->_que_mtx);
+        // After Stop() the task is dropped, and the future reports a broken promise.
+        if (_stop.load(std::memory_order_acquire))
+            return res;
+        Submit([promise = std::move(promise), func = std::forward<F>(func),
+                args = std::make_tuple(std::forward<Arg>(arg)...)]() mutable {
+            promise.run([&]() -> return_type { return std::apply(func, args); });
+        });
+        return res;
+    }
 
-            this->_condition.wait(l, [this] { return this->_stop || this->_queue.size() < _max_task_sz; });
-            if (_stop)
-                return res;
-            _queue.push([task]() { (*task)(); });
+    // Fire-and-forget enqueue(): nothing reports the result, and an exception escaping the
+    // task terminates the process. Dropped after Stop().
+    template<typename F, typename... Arg>
+    void post(F &&func, Arg &&...arg)
+    {
+        if (_stop.load(std::memory_order_acquire))
+            return;
+        if constexpr (sizeof...(Arg) == 0)
+        {
+            Submit(std::forward<F>(func));
+        }
+        else
+        {
+            Submit([func = std::forward<F>(func), args = std::make_tuple(std::forward<Arg>(arg)...)]() mutable {
+                std::apply(func, args);
+            });
         }
-        _condition.notify_one();
-
-        return res;
     }
 
     ~ThreadPool()
     {
         Stop();
+        for (auto &state: _states)
+        {
+            while (Job *job = state->deque.pop()) Discard(job);
+        }
+        while (Job *job = _injector->try_pop()) Discard(job);
     }
 
-
+    // Runs every task already enqueued, then joins the workers.
     void Stop()
     {
-        std::unique_lock<std::mutex> l(_que_mtx);
-        _stop = true;
-        _condition.notify_all();
+        {
+            std::lock_guard<std::mutex> l(_park_mtx);
+            _stop.store(true, std::memory_order_release);
+        }
+        _park_cv.notify_all();
+        {
+            std::lock_guard<std::mutex> l(_full_mtx);
+        }
+        _full_cv.notify_all();
         for (std::thread &worker: _workers)
         {
             if (worker.joinable())
@@ -76,22 +161,215 @@ public:
 private:
     void Start()
     {
-        auto threadFunc = [this]() {
-            while (true)
+        _injector = std::make_unique<InjectionQueue<Job>>(_max_task_sz);
+        for (size_t i = 0; i < _thread_sz; i++)
+        {
+            auto state = std::make_unique<Worker>();
+            state->pool = this;
+            state->random = 0x9e3779b97f4a7c15ULL * (i + 1);
+            _states.push_back(std::move(state));
+        }
+        for (size_t i = 0; i < _thread_sz; i++) _workers.emplace_back([this, i]() { Run(*_states[i]); });
+    }
+
+    template<typename F>
+    void Submit(F &&func)
+    {
+        Job *job = ObjectPool<Job>::acquire();
+        try
+        {
+            job->emplace(std::forward<F>(func));
+        }
+        catch (...)
+        {
+            // Copying the callable or boxing it on the heap threw; emplace() left the node
+            // empty, so it goes straight back to the pool.
+            ObjectPool<Job>::release(job);
+            throw;
+        }
+        Worker *self = current();
+        if (self && self->pool == this)
+        {
+            self->deque.push(job);
+        }
+        else if (!_injector->try_push(job) && !WaitToInject(job))
+        {
+            Discard(job);
+            return;
+        }
+        Notify();
+    }
+
+    // Destroys the task, which breaks its promise if it never ran, and recycles the node.
+    static void Discard(Job *job)
+    {
+        job->reset();
+        ObjectPool<Job>::release(job);
+    }
+
+    // False if the pool stopped first.
+    bool WaitToInject(Job *job)
+    {
+        std::unique_lock<std::mutex> l(_full_mtx);
+        _full_waiters.fetch_add(1, std::memory_order_seq_cst);
+        bool pushed = false;
+        _full_cv.wait(l, [&] { return (pushed = _injector->try_push(job)) || _stop.load(std::memory_order_acquire); });
+        _full_waiters.fetch_sub(1, std::memory_order_relaxed);
+        return pushed;
+    }
+
+    // Called after making a task visible. The fence pairs with the one in Park(): either this
+    // sees the parking worker, or the worker sees the task.
+    void Notify()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_spinning.load(std::memory_order_seq_cst) > 0 || _idle.load(std::memory_order_seq_cst) == 0)
+            return;
+        {
+            std::lock_guard<std::mutex> l(_park_mtx);
+            if (_wake_tokens >= _idle.load(std::memory_order_relaxed))
+                return;
+            ++_wake_tokens;
+        }
+        _park_cv.notify_one();
+    }
+
+    void Run(Worker &self)
+    {
+        current() = &self;
+        for (;;)
+        {
+            Job *job = NextJob(self);
+            if (!job)
+            {
+                job = Search(self);
+            }
+            if (!job)
+            {
+                if (Park())
+                    continue;
+                break;
+            }
+            (*job)();
+            Discard(job);
+        }
+        current() = nullptr;
+    }
+
+    Job *NextJob(Worker &self)
+    {
+        if (++self.ticks % kInjectInterval == 0)
+        {
+            if (Job *job = TakeInjected())
+                return job;
+        }
+        if (Job *job = self.deque.pop())
+            return job;
+        if (Job *job = TakeInjected())
+            return job;
+        return Steal(self);
+    }
+
+    Job *TakeInjected()
+    {
+        Job *job = _injector->try_pop();
+        if (job)
+        {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (_full_waiters.load(std::memory_order_seq_cst) > 0)
             {
-                std::function<void()> task;
                 {
-                    std::unique_lock<std::mutex> l(this->_que_mtx);
-                    this->_condition.wait(l, [this] { return this->_stop || !this->_queue.empty(); });
-                    if (this->_queue.empty())
-                        return;
-                    task = std::move(this->_queue.front());
-                    this->_queue.pop();
+                    std::lock_guard<std::mutex> l(_full_mtx);
                 }
-                this->_condition.notify_one();
-                task();
+                _full_cv.notify_one();
+            }
+        }
+        return job;
+    }
+
+    // One pass over the other workers, starting at a random one.
+    Job *Steal(Worker &self)
+    {
+        std::size_t n = _states.size();
+        self.random ^= self.random << 13;
+        self.random ^= self.random >> 7;
+        self.random ^= self.random << 17;
+        std::size_t start = self.random % n;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            Worker &victim = *_states[(start + i) % n];
+            if (&victim == &self)
+                continue;
+            if (Job *job = victim.deque.steal())
+                return job;
+        }
+        return nullptr;
+    }
+
+    // At most half the workers spin at once; the rest park straight away.
+    Job *Search(Worker &self)
+    {
+        if (_spinning.fetch_add(1, std::memory_order_seq_cst) * 2 >= _thread_sz)
+        {
+            _spinning.fetch_sub(1, std::memory_order_seq_cst);
+            return nullptr;
+        }
+        Job *job = nullptr;
+        for (int i = 0; i < kSpinRounds && !job; ++i)
+        {
+            job = TakeInjected();
+            if (!job)
+            {
+                job = Steal(self);
             }
-        };
-        for (size_t i = 0; i < _thread_sz; i++) _workers.emplace_back(threadFunc);
+            if (!job)
+            {
+                std::this_thread::yield();
+            }
+        }
+        // The last spinner to find work hands the search on; Notify() skipped waking anyone
+        // while it was spinning.
+        if (_spinning.fetch_sub(1, std::memory_order_seq_cst) == 1 && job)
+        {
+            Notify();
+        }
+        return job;
+    }
+
+    bool HasWork() const
+    {
+        if (!_injector->empty())
+            return true;
+        for (const auto &state: _states)
+        {
+            if (!state->deque.empty())
+                return true;
+        }
+        return false;
+    }
+
+    // Returns false once the pool is stopping and no work is left anywhere.
+    bool Park()
+    {
+        _idle.fetch_add(1, std::memory_order_seq_cst);
+        std::unique_lock<std::mutex> l(_park_mtx);
+        for (;;)
+        {
+            if (HasWork())
+                break;
+            if (_stop.load(std::memory_order_acquire))
+            {
+                _idle.fetch_sub(1, std::memory_order_relaxed);
+                return false;
+            }
+            if (_wake_tokens > 0)
+            {
+                --_wake_tokens;
+                break;
+            }
+            _park_cv.wait(l);
+        }
+        _idle.fetch_sub(1, std::memory_order_relaxed);
+        return true;
     }
-};
\ No newline at end of file
+};
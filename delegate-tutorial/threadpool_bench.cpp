@@ -0,0 +1,215 @@
+#include "threadpool.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// The pool ThreadPool replaced: one queue behind one mutex and one condition variable.
+// Kept here as the baseline; Stop() releases the lock before joining, which the original
+// did not.
+class MutexThreadPool
+{
+    std::size_t _max_task_sz;
+    std::vector<std::thread> _workers;
+    std::queue<std::function<void()>> _queue;
+    std::mutex _que_mtx;
+    std::condition_variable _condition;
+    bool _stop = false;
+
+public:
+    MutexThreadPool(size_t threadCount, size_t maxTaskSize) : _max_task_sz(maxTaskSize)
+    {
+        for (size_t i = 0; i < threadCount; i++)
+        {
+            _workers.emplace_back([this]() {
+                while (true)
+                {
+                    std::function<void()> task;
+                    {
+                        std::unique_lock<std::mutex> l(_que_mtx);
+                        _condition.wait(l, [this] { return _stop || !_queue.empty(); });
+                        if (_queue.empty())
+                            return;
+                        task = std::move(_queue.front());
+                        _queue.pop();
+                    }
+                    _condition.notify_one();
+                    task();
+                }
+            });
+        }
+    }
+
+    template<typename F, typename... Arg>
+    auto enqueue(F &&func, Arg &&...arg) -> std::future<typename std::result_of<F(Arg...)>::type>
+    {
+        typedef typename std::result_of<F(Arg...)>::type return_type;
+
+        auto task = std::make_shared<std::packaged_task<return_type()>>(
+                std::bind(std::forward<F>(func), std::forward<Arg>(arg)...));
+        std::future<return_type> res = task->get_future();
+        {
+            std::unique_lock<std::mutex> l(_que_mtx);
+            _condition.wait(l, [this] { return _stop || _queue.size() < _max_task_sz; });
+            if (_stop)
+                return res;
+            _queue.push([task]() { (*task)(); });
+        }
+        _condition.notify_one();
+        return res;
+    }
+
+    ~MutexThreadPool()
+    {
+        {
+            std::unique_lock<std::mutex> l(_que_mtx);
+            _stop = true;
+        }
+        _condition.notify_all();
+        for (std::thread &worker: _workers) worker.join();
+    }
+};
+
+using Clock = std::chrono::steady_clock;
+
+static std::atomic<long> counter{0};
+static std::atomic<long> allocations{0};
+
+void *operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+struct Result
+{
+    double tasks_per_second;
+    double allocations_per_task;
+};
+
+static void count_task()
+{
+    counter.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Tasks submitted one by one from outside the pool. Through enqueue() each is waited on
+// through its future, keeping at most `window` futures pending; through post() the
+// counter says when all have run.
+template<typename Pool, bool Post>
+static Result submit(std::size_t threads, int tasks)
+{
+    const int window = 1024;
+    Pool pool(threads, 128);
+    counter = 0;
+    std::vector<decltype(pool.enqueue(count_task))> futures(window);
+    long allocated = allocations.load();
+    auto start = Clock::now();
+    for (int i = 0; i < tasks; ++i)
+    {
+        if constexpr (Post)
+        {
+            pool.post(count_task);
+        }
+        else
+        {
+            auto &slot = futures[i % window];
+            if (slot.valid())
+            {
+                slot.get();
+            }
+            slot = pool.enqueue(count_task);
+        }
+    }
+    if constexpr (Post)
+    {
+        while (counter.load(std::memory_order_relaxed) < tasks) std::this_thread::yield();
+    }
+    for (auto &f: futures)
+    {
+        if (f.valid())
+        {
+            f.get();
+        }
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return {tasks / seconds, double(allocations.load() - allocated) / tasks};
+}
+
+// Each task submits two children until `depth`, as a recursive divide-and-conquer would.
+template<typename Pool, bool Post>
+static void spawn(Pool &pool, int depth)
+{
+    counter.fetch_add(1, std::memory_order_relaxed);
+    if (depth == 0)
+        return;
+    for (int child = 0; child < 2; ++child)
+    {
+        if constexpr (Post)
+        {
+            pool.post([&pool, depth]() { spawn<Pool, Post>(pool, depth - 1); });
+        }
+        else
+        {
+            pool.enqueue([&pool, depth]() { spawn<Pool, Post>(pool, depth - 1); });
+        }
+    }
+}
+
+template<typename Pool, bool Post>
+static Result fan_out(std::size_t threads, int depth)
+{
+    // Room for the whole tree: a worker of the mutex pool blocking on a full queue would
+    // wait on itself.
+    Pool pool(threads, std::size_t(1) << (depth + 1));
+    counter = 0;
+    long total = (1L << (depth + 1)) - 1;
+    long allocated = allocations.load();
+    auto start = Clock::now();
+    pool.enqueue([&pool, depth]() { spawn<Pool, Post>(pool, depth); });
+    while (counter.load(std::memory_order_relaxed) < total) std::this_thread::yield();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return {total / seconds, double(allocations.load() - allocated) / total};
+}
+
+int main()
+{
+    const int tasks = 200000;
+    const int depth = 16;
+    printf("%u hardware threads; tasks per second (heap allocations per task)\n", std::thread::hardware_concurrency());
+    printf("%7s %18s %18s %18s %18s %18s %18s\n", "threads", "enqueue mutex", "enqueue steal", "post steal",
+           "fan-out mutex", "fan-out steal", "fan-out post");
+    for (std::size_t threads: {1, 2, 4, 8, 16, 32, 64})
+    {
+        Result results[] = {submit<MutexThreadPool, false>(threads, tasks), submit<ThreadPool, false>(threads, tasks),
+                            submit<ThreadPool, true>(threads, tasks),      fan_out<MutexThreadPool, false>(threads, depth),
+                            fan_out<ThreadPool, false>(threads, depth),    fan_out<ThreadPool, true>(threads, depth)};
+        printf("%7zu", threads);
+        for (const Result &r: results)
+        {
+            printf(" %11.0f (%4.2f)", r.tasks_per_second, r.allocations_per_task);
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+    return 0;
+}
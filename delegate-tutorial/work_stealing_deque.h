@@ -0,0 +1,128 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Chase-Lev work-stealing deque of T*, with the memory orderings of Le et al., "Correct and
+// Efficient Work-Stealing for Weak Memory Models" (PPoPP 2013). The owning thread pushes
+// and pops at the bottom without locking; any other thread steals from the top, contending
+// only on a CAS of `_top` and only for the last element. The array grows when full; a
+// replaced array is kept until the deque is destroyed, since a thief may still be reading it.
+template<typename T>
+class WorkStealingDeque
+{
+    struct Array
+    {
+        explicit Array(std::int64_t capacity) : capacity(capacity), slots(new std::atomic<T *>[capacity]) {}
+
+        T *get(std::int64_t i) const
+        {
+            return slots[i & (capacity - 1)].load(std::memory_order_relaxed);
+        }
+
+        void put(std::int64_t i, T *item)
+        {
+            slots[i & (capacity - 1)].store(item, std::memory_order_relaxed);
+        }
+
+        std::int64_t capacity;
+        std::unique_ptr<std::atomic<T *>[]> slots;
+    };
+
+    alignas(64) std::atomic<std::int64_t> _top{0};
+    alignas(64) std::atomic<std::int64_t> _bottom{0};
+    std::atomic<Array *> _array;
+    // Every array this deque has used; only the owner touches the vector.
+    std::vector<std::unique_ptr<Array>> _arrays;
+
+public:
+    // `capacity` must be a power of two.
+    explicit WorkStealingDeque(std::int64_t capacity = 256)
+    {
+        _arrays.emplace_back(new Array(capacity));
+        _array.store(_arrays.back().get(), std::memory_order_relaxed);
+    }
+
+    WorkStealingDeque(const WorkStealingDeque &) = delete;
+    WorkStealingDeque &operator=(const WorkStealingDeque &) = delete;
+
+    // Owner only.
+    void push(T *item)
+    {
+        std::int64_t b = _bottom.load(std::memory_order_relaxed);
+        std::int64_t t = _top.load(std::memory_order_acquire);
+        Array *a = _array.load(std::memory_order_relaxed);
+        if (b - t > a->capacity - 1)
+        {
+            a = grow(a, t, b);
+        }
+        a->put(b, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        _bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    // Owner only; the most recently pushed item, or null.
+    T *pop()
+    {
+        std::int64_t b = _bottom.load(std::memory_order_relaxed) - 1;
+        Array *a = _array.load(std::memory_order_relaxed);
+        _bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        std::int64_t t = _top.load(std::memory_order_relaxed);
+        if (t > b)
+        {
+            _bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        T *item = a->get(b);
+        if (t == b)
+        {
+            // The last item; a thief may be taking it at the same time.
+            if (!_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            {
+                item = nullptr;
+            }
+            _bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    // Any thread; the oldest item, or null if empty or another thread won the race for it.
+    T *steal()
+    {
+        std::int64_t t = _top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        std::int64_t b = _bottom.load(std::memory_order_acquire);
+        if (t >= b)
+            return nullptr;
+
+        T *item = _array.load(std::memory_order_acquire)->get(t);
+        if (!_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            return nullptr;
+        return item;
+    }
+
+    // Any thread; a snapshot.
+    bool empty() const
+    {
+        std::int64_t b = _bottom.load(std::memory_order_seq_cst);
+        std::int64_t t = _top.load(std::memory_order_seq_cst);
+        return b <= t;
+    }
+
+private:
+    Array *grow(Array *old, std::int64_t t, std::int64_t b)
+    {
+        _arrays.emplace_back(new Array(old->capacity * 2));
+        Array *a = _arrays.back().get();
+        for (std::int64_t i = t; i < b; ++i)
+        {
+            a->put(i, old->get(i));
+        }
+        _array.store(a, std::memory_order_release);
+        return a;
+    }
+};